@@ -0,0 +1,196 @@
+/*
+ * Cryptographic API.
+ *
+ * CRC32 (IEEE 802.3) chksum, tuned for SH.
+ *
+ * lib/crc32 defaults to slicing by 8, which needs 8KB of tables: half of
+ * the operand cache on some SH-4 parts.  This slices by 4 from a 4KB
+ * cache aligned table, a word at a time once the buffer is aligned.  The
+ * semantics are those of crc32_le(): the optional 4 byte little-endian
+ * key seeds the CRC, which otherwise starts at 0, and the digest is the
+ * little-endian CRC, not inverted.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ */
+#include <crypto/internal/hash.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/string.h>
+#include <linux/kernel.h>
+#include <linux/cache.h>
+#include <asm/byteorder.h>
+#include <asm/unaligned.h>
+
+#define CHKSUM_BLOCK_SIZE	1
+#define CHKSUM_DIGEST_SIZE	4
+
+#define CRC32_POLY_LE		0xedb88320
+
+struct chksum_ctx {
+	u32 key;
+};
+
+struct chksum_desc_ctx {
+	u32 crc;
+};
+
+/* crc32_sh_table[n][i]: CRC of byte i followed by n zero bytes */
+static u32 crc32_sh_table[4][256] __read_mostly ____cacheline_aligned;
+
+static u32 crc32_sh_le(u32 crc, const u8 *p, unsigned int len)
+{
+	const u32 *t0 = crc32_sh_table[0], *t1 = crc32_sh_table[1];
+	const u32 *t2 = crc32_sh_table[2], *t3 = crc32_sh_table[3];
+
+	for (; len && ((unsigned long)p & 3); len--)
+		crc = (crc >> 8) ^ t0[(crc ^ *p++) & 0xff];
+
+	for (; len >= 4; len -= 4, p += 4) {
+		crc ^= le32_to_cpup((const __le32 *)p);
+		crc = t3[crc & 0xff] ^ t2[(crc >> 8) & 0xff] ^
+		      t1[(crc >> 16) & 0xff] ^ t0[crc >> 24];
+	}
+
+	for (; len; len--)
+		crc = (crc >> 8) ^ t0[(crc ^ *p++) & 0xff];
+
+	return crc;
+}
+
+static int chksum_init(struct shash_desc *desc)
+{
+	struct chksum_ctx *mctx = crypto_shash_ctx(desc->tfm);
+	struct chksum_desc_ctx *ctx = shash_desc_ctx(desc);
+
+	ctx->crc = mctx->key;
+
+	return 0;
+}
+
+/*
+ * Setting the seed allows arbitrary accumulators and flexible XOR policy.
+ * The CRC is not inverted on the way in or out, so for the usual
+ * ~0 preset set a key of ~0 and invert the digest.
+ */
+static int chksum_setkey(struct crypto_shash *tfm, const u8 *key,
+			 unsigned int keylen)
+{
+	struct chksum_ctx *mctx = crypto_shash_ctx(tfm);
+
+	if (keylen != sizeof(mctx->key)) {
+		crypto_shash_set_flags(tfm, CRYPTO_TFM_RES_BAD_KEY_LEN);
+		return -EINVAL;
+	}
+	mctx->key = get_unaligned_le32(key);
+	return 0;
+}
+
+static int chksum_update(struct shash_desc *desc, const u8 *data,
+			 unsigned int length)
+{
+	struct chksum_desc_ctx *ctx = shash_desc_ctx(desc);
+
+	ctx->crc = crc32_sh_le(ctx->crc, data, length);
+	return 0;
+}
+
+static int chksum_final(struct shash_desc *desc, u8 *out)
+{
+	struct chksum_desc_ctx *ctx = shash_desc_ctx(desc);
+
+	put_unaligned_le32(ctx->crc, out);
+	return 0;
+}
+
+static int __chksum_finup(u32 *crcp, const u8 *data, unsigned int len, u8 *out)
+{
+	put_unaligned_le32(crc32_sh_le(*crcp, data, len), out);
+	return 0;
+}
+
+static int chksum_finup(struct shash_desc *desc, const u8 *data,
+			unsigned int len, u8 *out)
+{
+	struct chksum_desc_ctx *ctx = shash_desc_ctx(desc);
+
+	return __chksum_finup(&ctx->crc, data, len, out);
+}
+
+static int chksum_digest(struct shash_desc *desc, const u8 *data,
+			 unsigned int length, u8 *out)
+{
+	struct chksum_ctx *mctx = crypto_shash_ctx(desc->tfm);
+
+	return __chksum_finup(&mctx->key, data, length, out);
+}
+
+static int crc32_cra_init(struct crypto_tfm *tfm)
+{
+	struct chksum_ctx *mctx = crypto_tfm_ctx(tfm);
+
+	mctx->key = 0;
+	return 0;
+}
+
+static struct shash_alg alg = {
+	.digestsize		=	CHKSUM_DIGEST_SIZE,
+	.setkey			=	chksum_setkey,
+	.init		=	chksum_init,
+	.update		=	chksum_update,
+	.final		=	chksum_final,
+	.finup		=	chksum_finup,
+	.digest		=	chksum_digest,
+	.descsize		=	sizeof(struct chksum_desc_ctx),
+	.base			=	{
+		.cra_name		=	"crc32",
+		.cra_driver_name	=	"crc32-sh",
+		.cra_priority		=	100,
+		.cra_blocksize		=	CHKSUM_BLOCK_SIZE,
+		.cra_ctxsize		=	sizeof(struct chksum_ctx),
+		.cra_module		=	THIS_MODULE,
+		.cra_init		=	crc32_cra_init,
+	}
+};
+
+static void __init crc32_sh_init_table(void)
+{
+	unsigned int i, j;
+	u32 crc;
+
+	for (i = 0; i < 256; i++) {
+		crc = i;
+		for (j = 0; j < 8; j++)
+			crc = (crc >> 1) ^ (crc & 1 ? CRC32_POLY_LE : 0);
+		crc32_sh_table[0][i] = crc;
+	}
+
+	for (i = 0; i < 256; i++) {
+		crc = crc32_sh_table[0][i];
+		for (j = 1; j < 4; j++) {
+			crc = (crc >> 8) ^ crc32_sh_table[0][crc & 0xff];
+			crc32_sh_table[j][i] = crc;
+		}
+	}
+}
+
+static int __init crc32_sh_mod_init(void)
+{
+	crc32_sh_init_table();
+
+	return crypto_register_shash(&alg);
+}
+
+static void __exit crc32_sh_mod_fini(void)
+{
+	crypto_unregister_shash(&alg);
+}
+
+module_init(crc32_sh_mod_init);
+module_exit(crc32_sh_mod_fini);
+
+MODULE_DESCRIPTION("CRC32 calculations, SH optimized");
+MODULE_LICENSE("GPL");
+MODULE_ALIAS("crc32");
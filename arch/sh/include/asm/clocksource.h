@@ -0,0 +1,20 @@
+#ifndef __ASM_SH_CLOCKSOURCE_H
+#define __ASM_SH_CLOCKSOURCE_H
+
+/*
+ * A clocksource whose counter register can be read from user mode sets
+ * vdso_counter to the bus address of that register; the vDSO then maps
+ * it read-only and uncached. The value read is XORed with vdso_xor,
+ * which lets down counters such as the TMU be used as is.
+ */
+struct arch_clocksource_data {
+	unsigned long vdso_counter;
+	u32 vdso_xor;
+};
+
+#define arch_clocksource_user_counter(cs, addr, xor)	do {	\
+	(cs)->archdata.vdso_counter = (addr);			\
+	(cs)->archdata.vdso_xor = (xor);			\
+} while (0)
+
+#endif /* __ASM_SH_CLOCKSOURCE_H */
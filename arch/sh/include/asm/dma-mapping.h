@@ -38,6 +38,8 @@ static inline int dma_set_mask(struct device *dev, u64 mask)
 
 void dma_cache_sync(struct device *dev, void *vaddr, size_t size,
 		    enum dma_data_direction dir);
+void dma_cache_sync_sg(struct device *dev, struct scatterlist *sg, int nents,
+		       enum dma_data_direction dir);
 
 #define dma_alloc_noncoherent(d, s, h, f) dma_alloc_coherent(d, s, h, f)
 #define dma_free_noncoherent(d, s, v, h) dma_free_coherent(d, s, v, h)
@@ -0,0 +1,24 @@
+#ifndef __ASM_SH_DMA_MEMCPY_H
+#define __ASM_SH_DMA_MEMCPY_H
+
+#include <linux/types.h>
+#include <linux/string.h>
+#include <linux/errno.h>
+#include <asm/page.h>
+
+#ifdef CONFIG_SH_DMA_MEMCPY
+extern int __sh_dma_memcpy(void *dst, const void *src, size_t len);
+extern void sh_dma_copy_page(void *to, void *from);
+#else
+static inline int __sh_dma_memcpy(void *dst, const void *src, size_t len)
+{
+	return -ENODEV;
+}
+
+static inline void sh_dma_copy_page(void *to, void *from)
+{
+	copy_page(to, from);
+}
+#endif
+
+#endif /* __ASM_SH_DMA_MEMCPY_H */
@@ -16,4 +16,29 @@ static inline int fb_is_primary_device(struct fb_info *info)
 	return 0;
 }
 
+#ifdef CONFIG_SH_STORE_QUEUE_BURST
+#include <cpu/sq.h>
+
+/*
+ * Hooks for the generic fillrect/copyarea code (drivers/video/fb_draw.h):
+ * write a run of whole words in store queue bursts. Return the number of
+ * words written, 0 if the caller should write them itself.
+ */
+static inline unsigned int fb_fill_words(void __iomem *dst,
+					 unsigned long pat, unsigned int n)
+{
+	return sq_memset_io(dst, pat, n * sizeof(long)) ? 0 : n;
+}
+#define fb_fill_words fb_fill_words
+
+static inline unsigned int fb_copy_words(void __iomem *dst,
+					 const void __iomem *src,
+					 unsigned int n)
+{
+	return sq_memcpy_io(dst, (const void __force *)src,
+			    n * sizeof(long)) ? 0 : n;
+}
+#define fb_copy_words fb_copy_words
+#endif
+
 #endif /* _ASM_FB_H_ */
@@ -0,0 +1,131 @@
+#ifndef __ASM_SH_FUTEX_GRB_H
+#define __ASM_SH_FUTEX_GRB_H
+
+/*
+ * Futex operations on user memory by roll-back (gRB), rather than by
+ * disabling interrupts around the accesses.
+ *
+ * A fault on either access happens with r15 still negative, so the
+ * exception entry code rolls the sequence back before do_page_fault()
+ * looks for a fixup: the saved PC is then that of the LOGIN instruction,
+ * which is why that is the address recorded in the exception table.
+ * r15 has been restored from r1 by then, so the fixup can return
+ * straight past the LOGOUT.
+ */
+#define __futex_atomic_op(insn, ret, oldval, tmp, uaddr, oparg)	\
+	__asm__ __volatile__ (					\
+		"   .align 2              \n\t"			\
+		"   mova    1f,   r0      \n\t" /* r0 = end point */	\
+		"   nop                   \n\t"			\
+		"   mov    r15,   r1      \n\t" /* r1 = saved sp */	\
+		"0: mov    #-8,   r15     \n\t" /* LOGIN */		\
+		"   mov.l  @%3,   %1      \n\t" /* load  old value */	\
+		"   mov     %1,   %0      \n\t"			\
+		"   " insn "              \n\t" /* compute new value */	\
+		"   mov.l   %0,   @%3     \n\t" /* store new value */	\
+		"1: mov     r1,   r15     \n\t" /* LOGOUT */		\
+		"2:                       \n\t"			\
+		".section .fixup,\"ax\"   \n"			\
+		"3: mov.l   4f,   %0      \n\t"			\
+		"   jmp    @%0            \n\t"			\
+		"    mov    %5,   %2      \n\t"			\
+		"   .balign 4             \n"			\
+		"4: .long   2b            \n\t"			\
+		".previous                \n"			\
+		".section __ex_table,\"a\"\n\t"			\
+		"   .long   0b, 3b        \n\t"			\
+		".previous"						\
+		: "=&r" (tmp), "=&r" (oldval), "+r" (ret),		\
+		  "+r" (uaddr), "+r" (oparg)	/* inhibit r15 overloading */ \
+		: "i" (-EFAULT)						\
+		: "memory", "r0", "r1")
+
+static inline int atomic_futex_op_xchg_set(int oparg, u32 __user *uaddr,
+					   int *oldval)
+{
+	int ret = 0, tmp;
+
+	__futex_atomic_op("mov %4, %0", ret, *oldval, tmp, uaddr, oparg);
+
+	return ret;
+}
+
+static inline int atomic_futex_op_xchg_add(int oparg, u32 __user *uaddr,
+					   int *oldval)
+{
+	int ret = 0, tmp;
+
+	__futex_atomic_op("add %4, %0", ret, *oldval, tmp, uaddr, oparg);
+
+	return ret;
+}
+
+static inline int atomic_futex_op_xchg_or(int oparg, u32 __user *uaddr,
+					  int *oldval)
+{
+	int ret = 0, tmp;
+
+	__futex_atomic_op("or  %4, %0", ret, *oldval, tmp, uaddr, oparg);
+
+	return ret;
+}
+
+static inline int atomic_futex_op_xchg_and(int oparg, u32 __user *uaddr,
+					   int *oldval)
+{
+	int ret = 0, tmp;
+
+	__futex_atomic_op("and %4, %0", ret, *oldval, tmp, uaddr, oparg);
+
+	return ret;
+}
+
+static inline int atomic_futex_op_xchg_xor(int oparg, u32 __user *uaddr,
+					   int *oldval)
+{
+	int ret = 0, tmp;
+
+	__futex_atomic_op("xor %4, %0", ret, *oldval, tmp, uaddr, oparg);
+
+	return ret;
+}
+
+static inline int atomic_futex_op_cmpxchg_inatomic(u32 *uval,
+						   u32 __user *uaddr,
+						   u32 oldval, u32 newval)
+{
+	int ret = 0;
+	u32 prev = 0;
+
+	__asm__ __volatile__ (
+		"   .align 2              \n\t"
+		"   mova    1f,   r0      \n\t" /* r0 = end point */
+		"   nop                   \n\t"
+		"   mov    r15,   r1      \n\t" /* r1 = saved sp */
+		"0: mov    #-8,   r15     \n\t" /* LOGIN */
+		"   mov.l  @%2,   %1      \n\t" /* load  old value */
+		"   cmp/eq  %1,   %3      \n\t"
+		"   bf            1f      \n\t" /* if not equal */
+		"   mov.l   %4,   @%2     \n\t" /* store new value */
+		"1: mov     r1,   r15     \n\t" /* LOGOUT */
+		"2:                       \n\t"
+		".section .fixup,\"ax\"   \n"
+		"3: mov.l   4f,   %1      \n\t"
+		"   jmp    @%1            \n\t"
+		"    mov    %5,   %0      \n\t"
+		"   .balign 4             \n"
+		"4: .long   2b            \n\t"
+		".previous                \n"
+		".section __ex_table,\"a\"\n\t"
+		"   .long   0b, 3b        \n\t"
+		".previous"
+		: "+r" (ret), "=&r" (prev),
+		  "+r" (uaddr), "+r" (oldval), "+r" (newval) /* inhibit r15 */
+		: "i" (-EFAULT)
+		: "memory", "r0", "r1", "t");
+
+	*uval = prev;
+	return ret;
+}
+
+#endif /* __ASM_SH_FUTEX_GRB_H */
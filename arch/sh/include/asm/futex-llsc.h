@@ -0,0 +1,131 @@
+#ifndef __ASM_SH_FUTEX_LLSC_H
+#define __ASM_SH_FUTEX_LLSC_H
+
+/*
+ * Futex operations on user memory for SH-4A, using movli.l/movco.l.
+ *
+ * Both the load-linked and the store-conditional may fault, so each has
+ * an exception table entry; the fixup simply bails out with -EFAULT and
+ * the generic futex code faults the page in and retries.
+ */
+#define __futex_atomic_op(insn, ret, oldval, tmp, uaddr, oparg)	\
+	__asm__ __volatile__ (					\
+"1:	movli.l	@%3, %0		! __futex_atomic_op	\n"	\
+"	mov	%0, %1				\n"	\
+"	" insn "				\n"	\
+"2:	movco.l	%0, @%3				\n"	\
+"	bf	1b				\n"	\
+"	synco					\n"	\
+"3:						\n"	\
+"	.section .fixup,\"ax\"			\n"	\
+"4:	mov.l	5f, %0				\n"	\
+"	jmp	@%0				\n"	\
+"	 mov	%5, %2				\n"	\
+"	.balign	4				\n"	\
+"5:	.long	3b				\n"	\
+"	.previous				\n"	\
+"	.section __ex_table,\"a\"		\n"	\
+"	.long	1b, 4b				\n"	\
+"	.long	2b, 4b				\n"	\
+"	.previous"						\
+	: "=&z" (tmp), "=&r" (oldval), "+r" (ret)		\
+	: "r" (uaddr), "r" (oparg), "i" (-EFAULT)		\
+	: "t", "memory")
+
+static inline int atomic_futex_op_xchg_set(int oparg, u32 __user *uaddr,
+					   int *oldval)
+{
+	int ret = 0;
+	unsigned long tmp;
+
+	__futex_atomic_op("mov	%4, %0", ret, *oldval, tmp, uaddr, oparg);
+
+	return ret;
+}
+
+static inline int atomic_futex_op_xchg_add(int oparg, u32 __user *uaddr,
+					   int *oldval)
+{
+	int ret = 0;
+	unsigned long tmp;
+
+	__futex_atomic_op("add	%4, %0", ret, *oldval, tmp, uaddr, oparg);
+
+	return ret;
+}
+
+static inline int atomic_futex_op_xchg_or(int oparg, u32 __user *uaddr,
+					  int *oldval)
+{
+	int ret = 0;
+	unsigned long tmp;
+
+	__futex_atomic_op("or	%4, %0", ret, *oldval, tmp, uaddr, oparg);
+
+	return ret;
+}
+
+static inline int atomic_futex_op_xchg_and(int oparg, u32 __user *uaddr,
+					   int *oldval)
+{
+	int ret = 0;
+	unsigned long tmp;
+
+	__futex_atomic_op("and	%4, %0", ret, *oldval, tmp, uaddr, oparg);
+
+	return ret;
+}
+
+static inline int atomic_futex_op_xchg_xor(int oparg, u32 __user *uaddr,
+					   int *oldval)
+{
+	int ret = 0;
+	unsigned long tmp;
+
+	__futex_atomic_op("xor	%4, %0", ret, *oldval, tmp, uaddr, oparg);
+
+	return ret;
+}
+
+/*
+ * As in __cmpxchg_u32(), the old value is written back when the compare
+ * fails so that the movli.l reservation is always consumed.
+ */
+static inline int atomic_futex_op_cmpxchg_inatomic(u32 *uval,
+						   u32 __user *uaddr,
+						   u32 oldval, u32 newval)
+{
+	int ret = 0;
+	unsigned long tmp;
+	u32 prev = 0;
+
+	__asm__ __volatile__ (
+"1:	movli.l	@%3, %0		! atomic_futex_op_cmpxchg_inatomic \n"
+"	mov	%0, %1				\n"
+"	cmp/eq	%1, %4				\n"
+"	bf	2f				\n"
+"	mov	%5, %0				\n"
+"2:	movco.l	%0, @%3				\n"
+"	bf	1b				\n"
+"	synco					\n"
+"3:						\n"
+"	.section .fixup,\"ax\"			\n"
+"4:	mov.l	5f, %0				\n"
+"	jmp	@%0				\n"
+"	 mov	%6, %2				\n"
+"	.balign	4				\n"
+"5:	.long	3b				\n"
+"	.previous				\n"
+"	.section __ex_table,\"a\"		\n"
+"	.long	1b, 4b				\n"
+"	.long	2b, 4b				\n"
+"	.previous"
+	: "=&z" (tmp), "=&r" (prev), "+r" (ret)
+	: "r" (uaddr), "r" (oldval), "r" (newval), "i" (-EFAULT)
+	: "t", "memory");
+
+	*uval = prev;
+	return ret;
+}
+
+#endif /* __ASM_SH_FUTEX_LLSC_H */
@@ -1,6 +1,10 @@
 #ifndef __ASM_SH_L2_CACHEFLUSH_H
 #define __ASM_SH_L2_CACHEFLUSH_H
 
+#include <linux/dma-direction.h>
+
+struct scatterlist;
+
 #if defined(CONFIG_STM_L2_CACHE)
 
 #include <asm/stm-l2-cache.h>
@@ -29,6 +33,22 @@ static inline void __l2_flush_invalidate_region(void *start, int size)
 #define __l2_flush_invalidate_phys(start, size) \
 		stm_l2_flush_invalidate(start, size, 1)
 
+static inline void __l2_flush_sg(struct scatterlist *sg, int nents,
+				 enum dma_data_direction direction)
+{
+	switch (direction) {
+	case DMA_FROM_DEVICE:
+		stm_l2_flush_sg(sg, nents, STM_L2_FLUSH_INVALIDATE);
+		break;
+	case DMA_TO_DEVICE:
+		stm_l2_flush_sg(sg, nents, STM_L2_FLUSH_WBACK);
+		break;
+	default:
+		stm_l2_flush_sg(sg, nents, STM_L2_FLUSH_PURGE);
+		break;
+	}
+}
+
 #else
 
 static inline void __l2_flush_wback_region(void *start, int size)
@@ -55,6 +75,11 @@ static inline void __l2_flush_invalidate_phys(unsigned long start, int size)
 {
 }
 
+static inline void __l2_flush_sg(struct scatterlist *sg, int nents,
+				 enum dma_data_direction direction)
+{
+}
+
 #endif
 
 #endif
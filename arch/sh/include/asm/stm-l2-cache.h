@@ -16,6 +16,18 @@
 void stm_l2_flush_wback(unsigned long start, int size, int is_phys);
 void stm_l2_flush_purge(unsigned long start, int size, int is_phys);
 void stm_l2_flush_invalidate(unsigned long start, int size, int is_phys);
+
+/* ...or the segments of a scatterlist, with a single L2 sync */
+struct scatterlist;
+
+enum stm_l2_flush_op {
+	STM_L2_FLUSH_WBACK,
+	STM_L2_FLUSH_PURGE,
+	STM_L2_FLUSH_INVALIDATE,
+};
+
+void stm_l2_flush_sg(struct scatterlist *sg, int nents,
+		enum stm_l2_flush_op op);
 #ifdef CONFIG_STM_L2_CACHE
 void stm_l2_disable(void);
 #else
@@ -0,0 +1,36 @@
+#ifndef __ASM_SH_VDSO_H
+#define __ASM_SH_VDSO_H
+
+#define VDSO_CLOCK_NONE		0	/* no user readable counter */
+#define VDSO_CLOCK_COUNTER	1	/* read the mapped counter register */
+
+#ifndef __ASSEMBLY__
+
+#include <linux/types.h>
+#include <linux/time.h>
+
+/*
+ * Time keeping data shared between the kernel and the vDSO.
+ *
+ * The kernel updates it on every tick from update_vsyscall() and the
+ * vDSO reads it under the seq counter. The page is mapped in the process
+ * with the same cache colour as its kernel address, so no cache
+ * maintenance is needed on either side.
+ */
+struct vdso_data {
+	u32 seq;
+	u32 clock_mode;
+	u32 cycle_last;
+	u32 mask;
+	u32 mult;
+	u32 shift;
+	u32 counter_offset;	/* offset of the counter in its page */
+	u32 counter_xor;
+	struct timespec wall_time;
+	struct timespec wall_to_monotonic;
+	struct timezone tz;
+};
+
+#endif /* __ASSEMBLY__ */
+
+#endif /* __ASM_SH_VDSO_H */
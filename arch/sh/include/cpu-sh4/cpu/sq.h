@@ -33,4 +33,14 @@ unsigned long sq_remap(unsigned long phys, unsigned int size,
 void sq_unmap(unsigned long vaddr);
 void sq_flush_range(unsigned long start, unsigned int len);
 
+#ifdef CONFIG_SH_STORE_QUEUE_BURST
+int __sq_memcpy_io(volatile void __iomem *to, const void *from,
+		   unsigned long count);
+int __sq_memset_io(volatile void __iomem *to, u32 pattern,
+		   unsigned long count);
+int sq_memcpy_io(volatile void __iomem *to, const void *from,
+		 unsigned long count);
+int sq_memset_io(volatile void __iomem *to, u32 pattern, unsigned long count);
+#endif
+
 #endif /* __ASM_CPU_SH4_SQ_H */
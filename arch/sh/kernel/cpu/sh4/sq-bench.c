@@ -0,0 +1,174 @@
+/*
+ * arch/sh/kernel/cpu/sh4/sq-bench.c
+ *
+ * Compare the throughput of store queue burst writes to uncached memory
+ * with word writes across buffer sizes, to help choose the sq_burst=
+ * threshold.
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License.  See the file "COPYING" in the main directory of this archive
+ * for more details.
+ */
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/gfp.h>
+#include <linux/mm.h>
+#include <linux/dma-mapping.h>
+#include <linux/ktime.h>
+#include <linux/sched.h>
+#include <cpu/sq.h>
+
+#define PRINT_PREF KERN_INFO "sq_bench: "
+
+static unsigned int min_size = 32;
+module_param(min_size, uint, S_IRUGO);
+MODULE_PARM_DESC(min_size, "Smallest write size in bytes (default: 32)");
+
+static unsigned int max_size = 256 * 1024;
+module_param(max_size, uint, S_IRUGO);
+MODULE_PARM_DESC(max_size, "Largest write size in bytes (default: 256KiB)");
+
+static unsigned int iterations = 64;
+module_param(iterations, uint, S_IRUGO);
+MODULE_PARM_DESC(iterations, "Writes per size and method (default: 64)");
+
+static long calc_speed(size_t bytes, ktime_t start, ktime_t finish)
+{
+	s64 us = ktime_to_us(ktime_sub(finish, start));
+	u64 k = bytes;
+
+	if (us <= 0)
+		return 0;
+
+	/* KiB/s */
+	k *= USEC_PER_SEC;
+	do_div(k, 1024);
+	do_div(k, us);
+
+	return (long)k;
+}
+
+/* What memcpy_toio() and memset_io() do without the store queues */
+static void word_copy(volatile u32 *dst, const u32 *src, size_t size)
+{
+	for (; size; size -= 4)
+		*dst++ = *src++;
+}
+
+static void word_fill(volatile u32 *dst, u32 pattern, size_t size)
+{
+	for (; size; size -= 4)
+		*dst++ = pattern;
+}
+
+static int bench_size(void *dst, void *src, size_t size)
+{
+	long word_speed, sq_speed, word_fill_speed, sq_fill_speed;
+	ktime_t start, finish;
+	unsigned int i;
+	int err;
+
+	/* Check the burst path writes correctly before timing it */
+	word_fill(dst, 0, size);
+	err = __sq_memcpy_io(dst, src, size);
+	if (err) {
+		printk(PRINT_PREF "size %zu: burst copy failed (%d)\n",
+		       size, err);
+		return err;
+	}
+	if (memcmp(dst, src, size)) {
+		printk(PRINT_PREF "size %zu: burst copy mismatch\n", size);
+		return -EIO;
+	}
+
+	start = ktime_get();
+	for (i = 0; i < iterations; i++)
+		word_copy(dst, src, size);
+	finish = ktime_get();
+	word_speed = calc_speed((size_t)iterations * size, start, finish);
+
+	start = ktime_get();
+	for (i = 0; i < iterations; i++)
+		__sq_memcpy_io(dst, src, size);
+	finish = ktime_get();
+	sq_speed = calc_speed((size_t)iterations * size, start, finish);
+
+	start = ktime_get();
+	for (i = 0; i < iterations; i++)
+		word_fill(dst, i, size);
+	finish = ktime_get();
+	word_fill_speed = calc_speed((size_t)iterations * size, start, finish);
+
+	start = ktime_get();
+	for (i = 0; i < iterations; i++)
+		__sq_memset_io(dst, i, size);
+	finish = ktime_get();
+	sq_fill_speed = calc_speed((size_t)iterations * size, start, finish);
+
+	printk(PRINT_PREF "size %7zu: copy word %7ld KiB/s, sq %7ld KiB/s; "
+	       "fill word %7ld KiB/s, sq %7ld KiB/s\n",
+	       size, word_speed, sq_speed, word_fill_speed, sq_fill_speed);
+
+	return 0;
+}
+
+static int __init sq_bench_init(void)
+{
+	dma_addr_t dma_handle;
+	void *src, *dst;
+	unsigned int order;
+	size_t size;
+	int err = 0;
+
+	if (min_size < 4 || min_size > max_size || !iterations)
+		return -EINVAL;
+
+	order = get_order(max_size);
+
+	src = (void *)__get_free_pages(GFP_KERNEL, order);
+	dst = dma_alloc_coherent(NULL, max_size, &dma_handle, GFP_KERNEL);
+	if (!src || !dst) {
+		printk(PRINT_PREF "cannot allocate %u byte buffers\n",
+		       max_size);
+		err = -ENOMEM;
+		goto out;
+	}
+
+	for (size = 0; size < max_size; size++)
+		((u8 *)src)[size] = size ^ (size >> 8);
+
+	printk(PRINT_PREF "%u writes per size, %u to %u bytes\n",
+	       iterations, min_size, max_size);
+
+	for (size = min_size & ~3; size <= max_size; size <<= 1) {
+		err = bench_size(dst, src, size);
+		if (err)
+			break;
+		cond_resched();
+	}
+
+	if (!err)
+		printk(PRINT_PREF "finished\n");
+
+out:
+	if (dst)
+		dma_free_coherent(NULL, max_size, dst, dma_handle);
+	if (src)
+		free_pages((unsigned long)src, order);
+
+	return err;
+}
+module_init(sq_bench_init);
+
+static void __exit sq_bench_exit(void)
+{
+}
+module_exit(sq_bench_exit);
+
+MODULE_DESCRIPTION("Store queue burst write benchmark");
+MODULE_AUTHOR("STMicroelectronics Limited");
+MODULE_LICENSE("GPL");
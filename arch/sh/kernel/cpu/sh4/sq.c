@@ -21,8 +21,13 @@
 #include <linux/mm.h>
 #include <linux/io.h>
 #include <linux/prefetch.h>
+#include <linux/percpu.h>
 #include <asm/page.h>
 #include <asm/cacheflush.h>
+#include <asm/mmu.h>
+#include <asm/mmu_context.h>
+#include <asm/tlbflush.h>
+#include <asm/uncached.h>
 #include <cpu/sq.h>
 
 struct sq_mapping;
@@ -70,6 +75,312 @@ void sq_flush_range(unsigned long start, unsigned int len)
 }
 EXPORT_SYMBOL(sq_flush_range);
 
+#ifdef CONFIG_SH_STORE_QUEUE_BURST
+/*
+ * Burst writes to uncached and device memory. Each CPU owns a one page
+ * window in the store queue area, which is pointed at the destination
+ * page with interrupts disabled while the queues are being filled, so
+ * nothing else on that CPU can use them in the middle of a burst.
+ *
+ * sq_remap() users fill the same two queues through their own mappings
+ * without disabling interrupts, and a task preempted half way through
+ * filling a queue would have it clobbered by a burst. Bursts are
+ * therefore only done while there are no sq_remap() mappings at all.
+ */
+struct sq_window {
+	unsigned long addr;
+	pte_t *pte;
+};
+
+static DEFINE_PER_CPU(struct sq_window, sq_window);
+static int sq_burst_ready;
+
+/* Writes shorter than this are not worth setting up the window for */
+static unsigned long sq_burst_min = 256;
+
+/*
+ * sq_burst=<size>
+ *
+ * Minimum write size sent through the store queues, 0 disables.
+ */
+static int __init sq_burst_setup(char *str)
+{
+	sq_burst_min = memparse(str, &str);
+
+	return 1;
+}
+__setup("sq_burst=", sq_burst_setup);
+
+/*
+ * Find the physical address behind a kernel virtual address, provided
+ * the CPU does not cache it: the store queues write to memory directly,
+ * so any cached copy would go stale.
+ */
+static int sq_burst_phys(unsigned long addr, unsigned long *phys)
+{
+	unsigned long flags;
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+	pte_t *pte;
+
+	if (virt_addr_uncached(addr)) {
+		*phys = __pa(CAC_ADDR(addr));
+		return 0;
+	}
+
+	if (__in_29bit_mode() && PXSEG(addr) == P2SEG) {
+		*phys = addr & 0x1fffffff;
+		return 0;
+	}
+
+	if (pmb_virt_to_phys((void *)addr, phys, &flags) == 0)
+		return (flags & PMB_C) ? -EINVAL : 0;
+
+	if (addr < VMALLOC_START || addr >= VMALLOC_END)
+		return -EINVAL;
+
+	pgd = pgd_offset_k(addr);
+	if (pgd_none(*pgd))
+		return -EINVAL;
+	pud = pud_offset(pgd, addr);
+	if (pud_none(*pud))
+		return -EINVAL;
+	pmd = pmd_offset(pud, addr);
+	if (pmd_none(*pmd))
+		return -EINVAL;
+	pte = pte_offset_kernel(pmd, addr);
+	if (!pte_present(*pte) || (pte_val(*pte) & _PAGE_CACHABLE))
+		return -EINVAL;
+
+	*phys = (pte_pfn(*pte) << PAGE_SHIFT) | (addr & ~PAGE_MASK);
+
+	return 0;
+}
+
+static void sq_write_words(volatile u32 *to, const u32 *src, u32 pattern,
+			   unsigned long count)
+{
+	if (src)
+		for (; count; count -= 4)
+			*to++ = *src++;
+	else
+		for (; count; count -= 4)
+			*to++ = pattern;
+}
+
+/*
+ * Write 'count' bytes (a multiple of 32) to 'phys', 32 byte aligned and
+ * within one page, through this CPU's window. Fails without writing if
+ * the queues may be in use through an sq_remap() mapping.
+ */
+static int sq_burst_page(unsigned long phys, const u32 *src, u32 pattern,
+			 unsigned long count)
+{
+	struct sq_window *win;
+	volatile u32 *sq;
+	unsigned long flags;
+	int i;
+
+	local_irq_save(flags);
+
+	if (unlikely(ACCESS_ONCE(sq_mapping_list))) {
+		local_irq_restore(flags);
+		return -EBUSY;
+	}
+
+	win = &__get_cpu_var(sq_window);
+	set_pte(win->pte, pfn_pte(phys >> PAGE_SHIFT, PAGE_KERNEL_NOCACHE));
+	sq = (volatile u32 *)(win->addr + (phys & ~PAGE_MASK));
+
+	for (; count; count -= SQ_SIZE, sq += 8) {
+		if (src)
+			for (i = 0; i < 8; i++)
+				sq[i] = *src++;
+		else
+			for (i = 0; i < 8; i++)
+				sq[i] = pattern;
+
+		/* Write out the queue just filled */
+		prefetchw((void *)sq);
+	}
+
+	store_queue_barrier();
+
+	pte_clear(&init_mm, win->addr, win->pte);
+	local_flush_tlb_one(get_asid(), win->addr);
+
+	local_irq_restore(flags);
+
+	return 0;
+}
+
+static int sq_burst(volatile void __iomem *to, const void *from, u32 pattern,
+		    unsigned long count)
+{
+	unsigned long addr = (unsigned long __force)to;
+	const u32 *src = from;
+	unsigned long phys, len, head;
+	int mapped;
+
+	if (!sq_burst_ready)
+		return -ENODEV;
+	if (ACCESS_ONCE(sq_mapping_list))
+		return -EBUSY;
+	if ((addr | (unsigned long)from | count) & 3)
+		return -EINVAL;
+	if (sq_burst_phys(addr, &phys))
+		return -EINVAL;
+
+	mapped = 1;
+	while (count) {
+		len = min(count, PAGE_SIZE - (addr & ~PAGE_MASK));
+
+		/* Pages behind a vmalloc/ioremap address may differ */
+		if (!mapped)
+			mapped = !sq_burst_phys(addr, &phys);
+
+		head = mapped ? (-addr & (SQ_SIZE - 1)) : len;
+		head = min(head, len);
+		sq_write_words((volatile u32 *)addr, src, pattern, head);
+		if (src)
+			src += head / 4;
+
+		if (len - head >= SQ_SIZE) {
+			unsigned long burst = (len - head) & SQ_ALIGN_MASK;
+
+			/* An sq_remap() user turned up since the check */
+			if (sq_burst_page(phys + head, src, pattern, burst))
+				sq_write_words((volatile u32 *)(addr + head),
+					       src, pattern, burst);
+			if (src)
+				src += burst / 4;
+			head += burst;
+		}
+
+		sq_write_words((volatile u32 *)(addr + head), src, pattern,
+			       len - head);
+		if (src)
+			src += (len - head) / 4;
+
+		addr += len;
+		count -= len;
+		mapped = 0;
+	}
+
+	return 0;
+}
+
+/**
+ * __sq_memcpy_io - Copy to uncached or device memory in store queue bursts
+ * @to: destination, 4 byte aligned
+ * @from: source, 4 byte aligned
+ * @count: number of bytes, a multiple of 4
+ *
+ * Returns 0 once the data has been written, or a negative error code if
+ * the destination can not be reached through the store queues, or they
+ * are in use through sq_remap(), in which case nothing has been written.
+ */
+int __sq_memcpy_io(volatile void __iomem *to, const void *from,
+		   unsigned long count)
+{
+	return sq_burst(to, from, 0, count);
+}
+EXPORT_SYMBOL(__sq_memcpy_io);
+
+/**
+ * __sq_memset_io - Fill uncached or device memory in store queue bursts
+ * @to: destination, 4 byte aligned
+ * @pattern: 32 bit value to write
+ * @count: number of bytes, a multiple of 4
+ *
+ * Returns as __sq_memcpy_io().
+ */
+int __sq_memset_io(volatile void __iomem *to, u32 pattern,
+		   unsigned long count)
+{
+	return sq_burst(to, NULL, pattern, count);
+}
+EXPORT_SYMBOL(__sq_memset_io);
+
+/**
+ * sq_memcpy_io - Copy to uncached or device memory, in bursts if large
+ * @to: destination
+ * @from: source
+ * @count: number of bytes
+ *
+ * As __sq_memcpy_io(), but also fails for writes below the sq_burst=
+ * threshold, which are faster done a word at a time.
+ */
+int sq_memcpy_io(volatile void __iomem *to, const void *from,
+		 unsigned long count)
+{
+	if (!sq_burst_min || count < sq_burst_min)
+		return -EINVAL;
+
+	return sq_burst(to, from, 0, count);
+}
+EXPORT_SYMBOL(sq_memcpy_io);
+
+/**
+ * sq_memset_io - Fill uncached or device memory, in bursts if large
+ * @to: destination
+ * @pattern: 32 bit value to write
+ * @count: number of bytes
+ *
+ * Returns as sq_memcpy_io().
+ */
+int sq_memset_io(volatile void __iomem *to, u32 pattern, unsigned long count)
+{
+	if (!sq_burst_min || count < sq_burst_min)
+		return -EINVAL;
+
+	return sq_burst(to, NULL, pattern, count);
+}
+EXPORT_SYMBOL(sq_memset_io);
+
+static int __init sq_burst_init(void)
+{
+	struct sq_window *win;
+	struct vm_struct *vma;
+	unsigned long addr;
+	pud_t *pud;
+	pmd_t *pmd;
+	int cpu, page;
+
+	for_each_possible_cpu(cpu) {
+		/* The window page, and a guard page for the vm area */
+		page = bitmap_find_free_region(sq_bitmap,
+					       0x04000000 >> PAGE_SHIFT, 1);
+		if (page < 0)
+			return -ENOSPC;
+
+		addr = P4SEG_STORE_QUE + (page << PAGE_SHIFT);
+		vma = __get_vm_area(PAGE_SIZE, VM_ALLOC, addr,
+				    addr + 2 * PAGE_SIZE);
+		if (!vma)
+			return -ENOMEM;
+
+		pud = pud_alloc(&init_mm, pgd_offset_k(addr), addr);
+		pmd = pud ? pmd_alloc(&init_mm, pud, addr) : NULL;
+		win = &per_cpu(sq_window, cpu);
+		win->pte = pmd ? pte_alloc_kernel(pmd, addr) : NULL;
+		if (!win->pte)
+			return -ENOMEM;
+		win->addr = addr;
+	}
+
+	sq_burst_ready = 1;
+
+	return 0;
+}
+#else
+static inline int sq_burst_init(void)
+{
+	return 0;
+}
+#endif /* CONFIG_SH_STORE_QUEUE_BURST */
+
 static inline void sq_mapping_list_add(struct sq_mapping *map)
 {
 	struct sq_mapping **p, *tmp;
@@ -392,6 +703,10 @@ static int __init sq_api_init(void)
 	if (unlikely(ret != 0))
 		goto out;
 
+	if (sq_burst_init())
+		pr_warning("sq: no store queue window, burst writes "
+			   "disabled\n");
+
 	return 0;
 
 out:
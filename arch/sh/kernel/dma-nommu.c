@@ -35,12 +35,12 @@ static int nommu_map_sg(struct device *dev, struct scatterlist *sg,
 	for_each_sg(sg, s, nents, i) {
 		BUG_ON(!sg_page(s));
 
-		dma_cache_sync(dev, sg_virt(s), s->length, dir);
-
 		s->dma_address = sg_phys(s);
 		s->dma_length = s->length;
 	}
 
+	dma_cache_sync_sg(dev, sg, nents, dir);
+
 	return nents;
 }
 
@@ -54,11 +54,7 @@ static void nommu_sync_single(struct device *dev, dma_addr_t addr,
 static void nommu_sync_sg(struct device *dev, struct scatterlist *sg,
 			  int nelems, enum dma_data_direction dir)
 {
-	struct scatterlist *s;
-	int i;
-
-	for_each_sg(sg, s, nelems, i)
-		dma_cache_sync(dev, sg_virt(s), s->length, dir);
+	dma_cache_sync_sg(dev, sg, nelems, dir);
 }
 #endif
 
@@ -24,6 +24,11 @@
 #include <linux/ftrace.h>
 #include <linux/module.h>
 #include <linux/slab.h>
+#include <linux/mutex.h>
+#include <linux/vmalloc.h>
+#include <linux/rcupdate.h>
+#include <linux/percpu.h>
+#include <linux/hash.h>
 #include <asm/dwarf.h>
 #include <asm/unwinder.h>
 #include <asm/sections.h>
@@ -45,7 +50,37 @@ static struct rb_root cie_root;
 static DEFINE_SPINLOCK(dwarf_cie_lock);
 
 static struct rb_root fde_root;
-static DEFINE_SPINLOCK(dwarf_fde_lock);
+static unsigned int fde_count;
+static DEFINE_MUTEX(dwarf_fde_mutex);
+
+/*
+ * The rbtree above is only used to build the FDE table; lookups
+ * binary search an RCU-protected, sorted snapshot of it, which is
+ * republished whenever FDEs are added or removed.
+ */
+struct dwarf_fde_entry {
+	unsigned long start;
+	unsigned long end;
+	struct dwarf_fde *fde;
+};
+
+struct dwarf_fde_table {
+	unsigned int nr_entries;
+	struct dwarf_fde_entry entries[0];
+};
+
+static struct dwarf_fde_table __rcu *fde_table;
+
+/* Per-CPU cache of recent PC -> FDE table entry lookups */
+#define DWARF_FDE_CACHE_BITS	4
+#define DWARF_FDE_CACHE_SIZE	(1 << DWARF_FDE_CACHE_BITS)
+
+struct dwarf_fde_cache {
+	unsigned long pc[DWARF_FDE_CACHE_SIZE];
+	struct dwarf_fde_entry *entry[DWARF_FDE_CACHE_SIZE];
+};
+
+static DEFINE_PER_CPU(struct dwarf_fde_cache, fde_cache);
 
 static struct dwarf_cie *cached_cie;
 
@@ -346,40 +381,113 @@ out:
 /**
  *	dwarf_lookup_fde - locate the FDE that covers pc
  *	@pc: the program counter
+ *
+ *	The caller must be in an RCU read-side critical section for as
+ *	long as it uses the returned FDE (and its CIE).
  */
 struct dwarf_fde *dwarf_lookup_fde(unsigned long pc)
 {
-	struct rb_node **rb_node = &fde_root.rb_node;
-	struct dwarf_fde *fde = NULL;
+	struct dwarf_fde_table *table;
+	struct dwarf_fde_entry *entry;
+	struct dwarf_fde_cache *cache;
+	unsigned int slot, low, high, mid;
 	unsigned long flags;
 
-	spin_lock_irqsave(&dwarf_fde_lock, flags);
+	table = rcu_dereference(fde_table);
+	if (!table)
+		return NULL;
 
-	while (*rb_node) {
-		struct dwarf_fde *fde_tmp;
-		unsigned long tmp_start, tmp_end;
+	slot = hash_long(pc, DWARF_FDE_CACHE_BITS);
 
-		fde_tmp = rb_entry(*rb_node, struct dwarf_fde, node);
-		BUG_ON(!fde_tmp);
+	/*
+	 * The cached entry may come from an older table, so only trust
+	 * it if it lies within the current one and still covers pc.
+	 */
+	local_irq_save(flags);
+	cache = &__get_cpu_var(fde_cache);
+	entry = cache->entry[slot];
+	if (cache->pc[slot] == pc &&
+	    entry >= table->entries &&
+	    entry < table->entries + table->nr_entries &&
+	    pc >= entry->start && pc < entry->end) {
+		local_irq_restore(flags);
+		return entry->fde;
+	}
+	local_irq_restore(flags);
 
-		tmp_start = fde_tmp->initial_location;
-		tmp_end = fde_tmp->initial_location + fde_tmp->address_range;
+	/* Find the last entry starting at or below pc */
+	low = 0;
+	high = table->nr_entries;
+	while (low < high) {
+		mid = low + (high - low) / 2;
 
-		if (pc < tmp_start) {
-			rb_node = &(*rb_node)->rb_left;
-		} else {
-			if (pc < tmp_end) {
-				fde = fde_tmp;
-				goto out;
-			} else
-				rb_node = &(*rb_node)->rb_right;
+		if (pc < table->entries[mid].start)
+			high = mid;
+		else
+			low = mid + 1;
+	}
+
+	if (!low)
+		return NULL;
+
+	entry = &table->entries[low - 1];
+	if (pc >= entry->end)
+		return NULL;
+
+	local_irq_save(flags);
+	cache = &__get_cpu_var(fde_cache);
+	cache->pc[slot] = pc;
+	cache->entry[slot] = entry;
+	local_irq_restore(flags);
+
+	return entry->fde;
+}
+
+/**
+ *	dwarf_fde_table_update - publish a new FDE table
+ *
+ *	Rebuild the sorted FDE table from the rbtree and publish it,
+ *	waiting for lookups on the old table to finish before freeing
+ *	it. If the new table can't be allocated then no table is
+ *	published, so that FDEs which have been removed from the rbtree
+ *	may still be freed safely once this returns.
+ *
+ *	Must be called with dwarf_fde_mutex held.
+ */
+static int dwarf_fde_table_update(void)
+{
+	struct dwarf_fde_table *table, *old;
+	struct rb_node *rb_node;
+	unsigned int i = 0;
+
+	table = vmalloc(sizeof(*table) + fde_count * sizeof(table->entries[0]));
+	if (table) {
+		for (rb_node = rb_first(&fde_root); rb_node;
+		     rb_node = rb_next(rb_node)) {
+			struct dwarf_fde *fde;
+
+			fde = rb_entry(rb_node, struct dwarf_fde, node);
+
+			table->entries[i].start = fde->initial_location;
+			table->entries[i].end = fde->initial_location +
+						fde->address_range;
+			table->entries[i].fde = fde;
+			i++;
 		}
+
+		table->nr_entries = i;
 	}
 
-out:
-	spin_unlock_irqrestore(&dwarf_fde_lock, flags);
+	old = rcu_dereference_protected(fde_table,
+					lockdep_is_held(&dwarf_fde_mutex));
+	rcu_assign_pointer(fde_table, table);
+
+	if (old) {
+		synchronize_rcu();
+		vfree(old);
+	}
 
-	return fde;
+	return table ? 0 : -ENOMEM;
 }
 
 /**
@@ -633,6 +741,8 @@ struct dwarf_frame *dwarf_unwind_stack(unsigned long pc,
 	frame->prev = prev;
 	frame->return_addr = 0;
 
+	rcu_read_lock();
+
 	fde = dwarf_lookup_fde(pc);
 	if (!fde) {
 		/*
@@ -653,7 +763,7 @@ struct dwarf_frame *dwarf_unwind_stack(unsigned long pc,
 		goto bail;
 	}
 
-	cie = dwarf_lookup_cie(fde->cie_pointer);
+	cie = fde->cie;
 
 	frame->pc = fde->initial_location;
 
@@ -666,6 +776,8 @@ struct dwarf_frame *dwarf_unwind_stack(unsigned long pc,
 	dwarf_cfa_execute_insns(fde->instructions, fde->end, cie,
 				fde, frame, pc);
 
+	rcu_read_unlock();
+
 	/* Calculate the CFA */
 	switch (frame->flags) {
 	case DWARF_FRAME_CFA_REG_OFFSET:
@@ -702,7 +814,7 @@ struct dwarf_frame *dwarf_unwind_stack(unsigned long pc,
 	 * the end of the callstack.
 	 */
 	if (!reg || reg->flags == DWARF_UNDEFINED)
-		goto bail;
+		goto free;
 
 	UNWINDER_BUG_ON(reg->flags != DWARF_REG_OFFSET);
 
@@ -730,6 +842,8 @@ struct dwarf_frame *dwarf_unwind_stack(unsigned long pc,
 	return frame;
 
 bail:
+	rcu_read_unlock();
+free:
 	dwarf_free_frame(frame);
 	return NULL;
 }
@@ -872,7 +986,6 @@ static int dwarf_parse_fde(void *entry, u32 entry_type,
 	struct rb_node *parent = *rb_node;
 	struct dwarf_fde *fde;
 	struct dwarf_cie *cie;
-	unsigned long flags;
 	int count;
 	void *p = start;
 
@@ -918,7 +1031,7 @@ static int dwarf_parse_fde(void *entry, u32 entry_type,
 	fde->end = end;
 
 	/* Add to list. */
-	spin_lock_irqsave(&dwarf_fde_lock, flags);
+	mutex_lock(&dwarf_fde_mutex);
 
 	while (*rb_node) {
 		struct dwarf_fde *fde_tmp;
@@ -945,13 +1058,14 @@ static int dwarf_parse_fde(void *entry, u32 entry_type,
 
 	rb_link_node(&fde->node, parent, rb_node);
 	rb_insert_color(&fde->node, &fde_root);
+	fde_count++;
 
 #ifdef CONFIG_MODULES
 	if (mod != NULL)
 		list_add_tail(&fde->link, &mod->arch.fde_list);
 #endif
 
-	spin_unlock_irqrestore(&dwarf_fde_lock, flags);
+	mutex_unlock(&dwarf_fde_mutex);
 
 	return 0;
 }
@@ -1003,6 +1117,8 @@ static void dwarf_unwinder_cleanup(void)
 	 * Traverse all the FDE/CIE lists and remove and free all the
 	 * memory associated with those data structures.
 	 */
+	mutex_lock(&dwarf_fde_mutex);
+
 	while (*fde_rb_node) {
 		struct dwarf_fde *fde;
 
@@ -1011,6 +1127,11 @@ static void dwarf_unwinder_cleanup(void)
 		kfree(fde);
 	}
 
+	fde_count = 0;
+	dwarf_fde_table_update();
+
+	mutex_unlock(&dwarf_fde_mutex);
+
 	while (*cie_rb_node) {
 		struct dwarf_cie *cie;
 
@@ -1086,6 +1207,13 @@ static int dwarf_parse_section(char *eh_frame_start, char *eh_frame_end,
 		entry = (char *)entry + len + 4;
 	}
 
+	mutex_lock(&dwarf_fde_mutex);
+	err = dwarf_fde_table_update();
+	mutex_unlock(&dwarf_fde_mutex);
+
+	if (err)
+		goto out;
+
 	printk(KERN_INFO "DWARF unwinder initialised: read %u CIEs, %u FDEs\n",
 	       c_entries, f_entries);
 
@@ -1142,26 +1270,39 @@ void module_dwarf_cleanup(struct module *mod)
 	struct dwarf_fde *fde, *ftmp;
 	struct dwarf_cie *cie, *ctmp;
 	unsigned long flags;
+	LIST_HEAD(fde_list);
+
+	/*
+	 * Unlink the FDEs and publish a table without them before
+	 * freeing anything; once the update returns no unwinder can
+	 * still be looking at them or at the CIEs they point to.
+	 */
+	mutex_lock(&dwarf_fde_mutex);
+
+	list_for_each_entry_safe(fde, ftmp, &mod->arch.fde_list, link) {
+		list_move_tail(&fde->link, &fde_list);
+		rb_erase(&fde->node, &fde_root);
+		fde_count--;
+	}
+
+	dwarf_fde_table_update();
+
+	mutex_unlock(&dwarf_fde_mutex);
+
+	list_for_each_entry_safe(fde, ftmp, &fde_list, link)
+		kfree(fde);
 
 	spin_lock_irqsave(&dwarf_cie_lock, flags);
 
 	list_for_each_entry_safe(cie, ctmp, &mod->arch.cie_list, link) {
 		list_del(&cie->link);
 		rb_erase(&cie->node, &cie_root);
+		if (cached_cie == cie)
+			cached_cie = NULL;
 		kfree(cie);
 	}
 
 	spin_unlock_irqrestore(&dwarf_cie_lock, flags);
-
-	spin_lock_irqsave(&dwarf_fde_lock, flags);
-
-	list_for_each_entry_safe(fde, ftmp, &mod->arch.fde_list, link) {
-		list_del(&fde->link);
-		rb_erase(&fde->node, &fde_root);
-		kfree(fde);
-	}
-
-	spin_unlock_irqrestore(&dwarf_fde_lock, flags);
 }
 #endif /* CONFIG_MODULES */
 
@@ -12,6 +12,9 @@
 #include <linux/pci.h>
 #include <asm/machvec.h>
 #include <asm/io.h>
+#ifdef CONFIG_SH_STORE_QUEUE_BURST
+#include <cpu/sq.h>
+#endif
 
 /*
  * Copy data from IO memory space to "real" memory space.
@@ -81,6 +84,14 @@ EXPORT_SYMBOL(memcpy_fromio);
  */
 void memcpy_toio(volatile void __iomem *to, const void *from, unsigned long count)
 {
+#ifdef CONFIG_SH_STORE_QUEUE_BURST
+	if (sq_memcpy_io(to, from, count & ~3UL) == 0) {
+		to += count & ~3UL;
+		from += count & ~3UL;
+		count &= 3;
+	}
+#endif
+
 	if ((((u32)to | (u32)from) & 0x3) == 0) {
 		for ( ; count > 3; count -= 4) {
 			*(volatile u32 *)to = *(u32 *)from;
@@ -101,14 +112,31 @@ EXPORT_SYMBOL(memcpy_toio);
 
 /*
  * "memset" on IO memory space.
- * This needs to be optimized.
  */
 void memset_io(volatile void __iomem *dst, int c, unsigned long count)
 {
-        while (count) {
-                count--;
-                writeb(c, dst);
-                dst++;
-        }
+	u32 pattern = (c & 0xff) * 0x01010101;
+
+	for (; count && ((u32)dst & 0x3); count--) {
+		writeb(c, dst);
+		dst++;
+	}
+
+#ifdef CONFIG_SH_STORE_QUEUE_BURST
+	if (sq_memset_io(dst, pattern, count & ~3UL) == 0) {
+		dst += count & ~3UL;
+		count &= 3;
+	}
+#endif
+
+	for (; count > 3; count -= 4) {
+		writel(pattern, dst);
+		dst += 4;
+	}
+
+	for (; count > 0; count--) {
+		writeb(c, dst);
+		dst++;
+	}
 }
 EXPORT_SYMBOL(memset_io);
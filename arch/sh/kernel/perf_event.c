@@ -25,6 +25,7 @@
 #include <linux/io.h>
 #include <linux/irq.h>
 #include <linux/perf_event.h>
+#include <linux/hrtimer.h>
 #include <linux/export.h>
 #include <asm/processor.h>
 
@@ -32,6 +33,12 @@ struct cpu_hw_events {
 	struct perf_event	*events[MAX_HWEVENTS];
 	unsigned long		used_mask[BITS_TO_LONGS(MAX_HWEVENTS)];
 	unsigned long		active_mask[BITS_TO_LONGS(MAX_HWEVENTS)];
+
+	/*
+	 * Overflow emulation for sampling events, see sh_pmu_sample_tick().
+	 */
+	struct hrtimer		sample_timer;
+	unsigned int		n_sampling;
 };
 
 DEFINE_PER_CPU(struct cpu_hw_events, cpu_hw_events);
@@ -43,6 +50,24 @@ static atomic_t num_events;
 /* Used to avoid races in calling reserve/release_pmc_hardware */
 static DEFINE_MUTEX(pmc_reserve_mutex);
 
+/*
+ * Sampling tick, in microseconds. This bounds the effective sampling
+ * rate, so it defaults to the 4kHz that perf record asks for.
+ */
+static unsigned long sh_pmu_sample_us = 250;
+
+static int __init sh_pmu_sample_setup(char *str)
+{
+	unsigned long us;
+
+	if (kstrtoul(str, 0, &us) || !us)
+		return 0;
+
+	sh_pmu_sample_us = us;
+	return 1;
+}
+__setup("perf_sample_us=", sh_pmu_sample_setup);
+
 /*
  * Stub these out for now, do something more profound later.
  */
@@ -128,14 +153,6 @@ static int __hw_perf_event_init(struct perf_event *event)
 	if (!sh_pmu_initialized())
 		return -ENODEV;
 
-	/*
-	 * All of the on-chip counters are "limited", in that they have
-	 * no interrupts, and are therefore unable to do sampling without
-	 * further work and timer assistance.
-	 */
-	if (hwc->sample_period)
-		return -EINVAL;
-
 	/*
 	 * See if we need to reserve the counter.
 	 *
@@ -181,6 +198,16 @@ static int __hw_perf_event_init(struct perf_event *event)
 
 	hwc->config |= config;
 
+	/*
+	 * The on-chip counters have no overflow interrupt, so sampling
+	 * events are driven from a per-CPU hrtimer instead. Counting
+	 * events never need the timer.
+	 */
+	if (is_sampling_event(event)) {
+		hwc->last_period = hwc->sample_period;
+		local64_set(&hwc->period_left, hwc->sample_period);
+	}
+
 	return 0;
 }
 
@@ -223,6 +250,99 @@ again:
 	delta >>= shift;
 
 	local64_add(delta, &event->count);
+	local64_sub(delta, &hwc->period_left);
+}
+
+static void sh_pmu_stop(struct perf_event *event, int flags);
+
+static inline ktime_t sh_pmu_sample_interval(void)
+{
+	return ns_to_ktime((u64)sh_pmu_sample_us * NSEC_PER_USEC);
+}
+
+/*
+ * Returns non-zero if the sample should be dropped because the counter
+ * ran in a mode the event asked to exclude. The counters themselves
+ * have no privilege filtering, so this is the best we can do.
+ */
+static int sh_pmu_exclude_sample(struct perf_event *event,
+				 struct pt_regs *regs)
+{
+	if (user_mode(regs))
+		return event->attr.exclude_user;
+
+	return event->attr.exclude_kernel;
+}
+
+/*
+ * Re-arm the software period once it has elapsed. If we have fallen
+ * more than a whole period behind (the tick is coarse compared to a
+ * small period), restart from a full period rather than emitting a
+ * burst of back-to-back samples.
+ */
+static int sh_pmu_set_period(struct hw_perf_event *hwc)
+{
+	s64 left = local64_read(&hwc->period_left);
+	s64 period = hwc->sample_period;
+
+	if (left > 0)
+		return 0;
+
+	left += period;
+	if (left <= 0)
+		left = period;
+
+	local64_set(&hwc->period_left, left);
+	hwc->last_period = period;
+
+	return 1;
+}
+
+/*
+ * Sampling tick. Runs in hard interrupt context on the CPU that owns
+ * the counters, so the irq regs are the interrupted context that the
+ * sample and its callchain are attributed to.
+ */
+static enum hrtimer_restart sh_pmu_sample_tick(struct hrtimer *timer)
+{
+	struct cpu_hw_events *cpuc = &__get_cpu_var(cpu_hw_events);
+	struct pt_regs *regs = get_irq_regs();
+	struct perf_sample_data data;
+	int idx;
+
+	if (!cpuc->n_sampling)
+		return HRTIMER_NORESTART;
+
+	for (idx = 0; idx < sh_pmu->num_events; idx++) {
+		struct perf_event *event = cpuc->events[idx];
+		struct hw_perf_event *hwc;
+		u64 last_period;
+
+		if (!event || !is_sampling_event(event))
+			continue;
+
+		hwc = &event->hw;
+		sh_perf_event_update(event, hwc, idx);
+
+		last_period = hwc->last_period;
+		if (!sh_pmu_set_period(hwc))
+			continue;
+
+		if (!regs || sh_pmu_exclude_sample(event, regs))
+			continue;
+
+		perf_sample_data_init(&data, 0);
+		data.period = last_period;
+
+		if (perf_event_overflow(event, &data, regs))
+			sh_pmu_stop(event, 0);
+	}
+
+	if (!cpuc->n_sampling)
+		return HRTIMER_NORESTART;
+
+	hrtimer_forward_now(timer, sh_pmu_sample_interval());
+	return HRTIMER_RESTART;
 }
 
 static void sh_pmu_stop(struct perf_event *event, int flags)
@@ -235,6 +355,14 @@ static void sh_pmu_stop(struct perf_event *event, int flags)
 		sh_pmu->disable(hwc, idx);
 		cpuc->events[idx] = NULL;
 		event->hw.state |= PERF_HES_STOPPED;
+
+		/*
+		 * We may be called from the tick itself when the event is
+		 * throttled, so only try to cancel; the tick notices that
+		 * nothing is left to sample and does not re-arm.
+		 */
+		if (is_sampling_event(event) && !--cpuc->n_sampling)
+			hrtimer_try_to_cancel(&cpuc->sample_timer);
 	}
 
 	if ((flags & PERF_EF_UPDATE) && !(event->hw.state & PERF_HES_UPTODATE)) {
@@ -255,9 +383,22 @@ static void sh_pmu_start(struct perf_event *event, int flags)
 	if (flags & PERF_EF_RELOAD)
 		WARN_ON_ONCE(!(event->hw.state & PERF_HES_UPTODATE));
 
+	if ((flags & PERF_EF_RELOAD) && is_sampling_event(event))
+		sh_pmu_set_period(hwc);
+
+	/*
+	 * Enabling clears the counter, so restart the raw count from
+	 * zero as well.
+	 */
+	local64_set(&hwc->prev_count, 0);
+
 	cpuc->events[idx] = event;
 	event->hw.state = 0;
 	sh_pmu->enable(hwc, idx);
+
+	if (is_sampling_event(event) && !cpuc->n_sampling++)
+		hrtimer_start(&cpuc->sample_timer, sh_pmu_sample_interval(),
+			      HRTIMER_MODE_REL_PINNED);
 }
 
 static void sh_pmu_del(struct perf_event *event, int flags)
@@ -365,6 +506,9 @@ static void sh_pmu_setup(int cpu)
 	struct cpu_hw_events *cpuhw = &per_cpu(cpu_hw_events, cpu);
 
 	memset(cpuhw, 0, sizeof(struct cpu_hw_events));
+
+	hrtimer_init(&cpuhw->sample_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	cpuhw->sample_timer.function = sh_pmu_sample_tick;
 }
 
 static int __cpuinit
@@ -0,0 +1,226 @@
+/*
+ * arch/sh/kernel/vsyscall/vsyscall-gettimeofday.c
+ *
+ * User mode gettimeofday(), clock_gettime() and time() for the vDSO.
+ *
+ * The time keeping data is read from the vdso_data page under its seq
+ * counter. The high resolution clocks also need the clock source counter,
+ * which is read from its register page when the kernel could map it;
+ * otherwise they fall back to the system call.
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License.  See the file "COPYING" in the main directory of this archive
+ * for more details.
+ */
+#include <linux/kernel.h>
+#include <linux/time.h>
+#include <linux/compiler.h>
+#include <asm/barrier.h>
+#include <asm/unistd.h>
+#include <asm/vdso.h>
+
+/* Both pages are mapped just below the DSO, see vsyscall.lds.S */
+extern struct vdso_data __vdso_data __attribute__((visibility("hidden")));
+extern u8 __vdso_counter[] __attribute__((visibility("hidden")));
+
+/* The SH-3/SH-4 trapa needs the same padding as the libc uses */
+#define VDSO_SYSCALL_PAD	"or r0, r0; or r0, r0; or r0, r0; " \
+				"or r0, r0; or r0, r0"
+
+static long vdso_syscall2(long nr, long arg1, long arg2)
+{
+	register long r3 asm("r3") = nr;
+	register long r4 asm("r4") = arg1;
+	register long r5 asm("r5") = arg2;
+	register long r0 asm("r0");
+
+	asm volatile("trapa	#0x12\n\t" VDSO_SYSCALL_PAD
+		     : "=r" (r0)
+		     : "r" (r3), "r" (r4), "r" (r5)
+		     : "memory");
+
+	return r0;
+}
+
+static inline u32 vdso_read_begin(const struct vdso_data *vd)
+{
+	u32 seq;
+
+	while ((seq = ACCESS_ONCE(vd->seq)) & 1)
+		barrier();
+	smp_rmb();
+
+	return seq;
+}
+
+static inline int vdso_read_retry(const struct vdso_data *vd, u32 seq)
+{
+	smp_rmb();
+
+	return ACCESS_ONCE(vd->seq) != seq;
+}
+
+/* 64-bit right shift by less than 32 without calling into libgcc */
+static inline u64 vdso_shr64(u64 v, u32 shift)
+{
+	u32 hi = v >> 32, lo = v;
+
+	if (!shift)
+		return v;
+	lo = (lo >> shift) | (hi << (32 - shift));
+	hi >>= shift;
+
+	return ((u64)hi << 32) | lo;
+}
+
+static inline u64 vdso_get_ns(const struct vdso_data *vd)
+{
+	u32 cycles, delta;
+
+	cycles = *(volatile u32 *)(__vdso_counter + vd->counter_offset);
+	cycles ^= vd->counter_xor;
+	delta = (cycles - vd->cycle_last) & vd->mask;
+
+	return vdso_shr64((u64)delta * vd->mult, vd->shift);
+}
+
+static inline void vdso_ts_set(struct timespec *ts, time_t sec, u64 ns)
+{
+	while (ns >= NSEC_PER_SEC) {
+		ns -= NSEC_PER_SEC;
+		sec++;
+	}
+	ts->tv_sec = sec;
+	ts->tv_nsec = ns;
+}
+
+static int vdso_realtime(struct timespec *ts)
+{
+	const struct vdso_data *vd = &__vdso_data;
+	time_t sec;
+	u64 ns;
+	u32 seq;
+
+	do {
+		seq = vdso_read_begin(vd);
+		if (vd->clock_mode == VDSO_CLOCK_NONE)
+			return -1;
+		sec = vd->wall_time.tv_sec;
+		ns = vd->wall_time.tv_nsec + vdso_get_ns(vd);
+	} while (vdso_read_retry(vd, seq));
+
+	vdso_ts_set(ts, sec, ns);
+
+	return 0;
+}
+
+static int vdso_monotonic(struct timespec *ts)
+{
+	const struct vdso_data *vd = &__vdso_data;
+	time_t sec;
+	u64 ns;
+	u32 seq;
+
+	do {
+		seq = vdso_read_begin(vd);
+		if (vd->clock_mode == VDSO_CLOCK_NONE)
+			return -1;
+		sec = vd->wall_time.tv_sec + vd->wall_to_monotonic.tv_sec;
+		ns = vd->wall_time.tv_nsec + vd->wall_to_monotonic.tv_nsec;
+		ns += vdso_get_ns(vd);
+	} while (vdso_read_retry(vd, seq));
+
+	vdso_ts_set(ts, sec, ns);
+
+	return 0;
+}
+
+static void vdso_realtime_coarse(struct timespec *ts)
+{
+	const struct vdso_data *vd = &__vdso_data;
+	u32 seq;
+
+	do {
+		seq = vdso_read_begin(vd);
+		ts->tv_sec = vd->wall_time.tv_sec;
+		ts->tv_nsec = vd->wall_time.tv_nsec;
+	} while (vdso_read_retry(vd, seq));
+}
+
+static void vdso_monotonic_coarse(struct timespec *ts)
+{
+	const struct vdso_data *vd = &__vdso_data;
+	time_t sec;
+	u32 ns, seq;
+
+	do {
+		seq = vdso_read_begin(vd);
+		sec = vd->wall_time.tv_sec + vd->wall_to_monotonic.tv_sec;
+		ns = vd->wall_time.tv_nsec + vd->wall_to_monotonic.tv_nsec;
+	} while (vdso_read_retry(vd, seq));
+
+	vdso_ts_set(ts, sec, ns);
+}
+
+int __kernel_clock_gettime(clockid_t clock, struct timespec *ts)
+{
+	switch (clock) {
+	case CLOCK_REALTIME:
+		if (!vdso_realtime(ts))
+			return 0;
+		break;
+	case CLOCK_MONOTONIC:
+		if (!vdso_monotonic(ts))
+			return 0;
+		break;
+	case CLOCK_REALTIME_COARSE:
+		vdso_realtime_coarse(ts);
+		return 0;
+	case CLOCK_MONOTONIC_COARSE:
+		vdso_monotonic_coarse(ts);
+		return 0;
+	}
+
+	return vdso_syscall2(__NR_clock_gettime, clock, (long)ts);
+}
+
+static void vdso_timezone(struct timezone *tz)
+{
+	const struct vdso_data *vd = &__vdso_data;
+	u32 seq;
+
+	do {
+		seq = vdso_read_begin(vd);
+		tz->tz_minuteswest = vd->tz.tz_minuteswest;
+		tz->tz_dsttime = vd->tz.tz_dsttime;
+	} while (vdso_read_retry(vd, seq));
+}
+
+int __kernel_gettimeofday(struct timeval *tv, struct timezone *tz)
+{
+	struct timespec ts;
+
+	if (likely(tv)) {
+		if (vdso_realtime(&ts))
+			return vdso_syscall2(__NR_gettimeofday, (long)tv,
+					     (long)tz);
+		tv->tv_sec = ts.tv_sec;
+		tv->tv_usec = ts.tv_nsec / NSEC_PER_USEC;
+	}
+	if (unlikely(tz))
+		vdso_timezone(tz);
+
+	return 0;
+}
+
+time_t __kernel_time(time_t *t)
+{
+	time_t sec = ACCESS_ONCE(__vdso_data.wall_time.tv_sec);
+
+	if (t)
+		*t = sec;
+
+	return sec;
+}
@@ -18,6 +18,13 @@
 #include <linux/elf.h>
 #include <linux/sched.h>
 #include <linux/err.h>
+#include <linux/mman.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/security.h>
+#include <linux/perf_event.h>
+#include <linux/clocksource.h>
+#include <asm/vdso.h>
 
 /*
  * Should the kernel map a VDSO page into processes and pass its
@@ -40,6 +47,20 @@ __setup("vdso=", vdso_setup);
 extern const char vsyscall_trapa_start, vsyscall_trapa_end;
 static struct page *syscall_pages[1];
 
+/*
+ * The time keeping data page and, when the clock source counter can be
+ * read from user mode, the page holding the counter register are mapped
+ * just below the DSO (see vsyscall.lds.S):
+ *
+ *	[ counter ][ vdso_data ][ DSO ]
+ */
+#define VDSO_DATA_PAGES		2
+
+static struct vdso_data *vdso_data;
+static struct page *vdso_data_pages[2];
+static unsigned long vdso_counter_phys;
+static int vdso_counter_fixed;
+
 int __init vsyscall_init(void)
 {
 	void *syscall_page = (void *)get_zeroed_page(GFP_ATOMIC);
@@ -54,31 +75,187 @@ int __init vsyscall_init(void)
 	       &vsyscall_trapa_start,
 	       &vsyscall_trapa_end - &vsyscall_trapa_start);
 
+	vdso_data = (struct vdso_data *)get_zeroed_page(GFP_ATOMIC);
+	vdso_data_pages[0] = virt_to_page(vdso_data);
+
 	return 0;
 }
 
+/*
+ * Physical address through which user mode can read the counter
+ * register of a clock source, or 0. The P4 control registers are
+ * visible in area 7 through the TLB.
+ */
+static unsigned long vdso_counter_address(struct clocksource *clock)
+{
+#ifdef CONFIG_29BIT
+	unsigned long addr = clock->archdata.vdso_counter;
+
+	if (addr && (addr >= P4SEG))
+		return addr & 0x1fffffff;
+#endif
+	return 0;
+}
+
+/*
+ * update_vsyscall() runs from the tick and update_vsyscall_tz() from
+ * settimeofday(), so the writers need a lock of their own: a lost seq
+ * increment would leave the vDSO readers spinning forever.
+ */
+static DEFINE_SPINLOCK(vdso_data_lock);
+
+static unsigned long vdso_write_begin(void)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&vdso_data_lock, flags);
+	vdso_data->seq++;
+	smp_wmb();
+
+	return flags;
+}
+
+static void vdso_write_end(unsigned long flags)
+{
+	smp_wmb();
+	vdso_data->seq++;
+	spin_unlock_irqrestore(&vdso_data_lock, flags);
+}
+
+void update_vsyscall_tz(void)
+{
+	unsigned long flags;
+
+	if (unlikely(!vdso_data))
+		return;
+
+	flags = vdso_write_begin();
+	vdso_data->tz = sys_tz;
+	vdso_write_end(flags);
+}
+
+void update_vsyscall(struct timespec *wall_time, struct timespec *wtm,
+		     struct clocksource *clock, u32 mult)
+{
+	unsigned long counter = vdso_counter_address(clock);
+	unsigned long flags;
+
+	if (unlikely(!vdso_data))
+		return;
+
+	/*
+	 * Only one counter page is mapped in the processes: the first user
+	 * readable one seen before the first exec. Any other clock source
+	 * makes the vDSO fall back to the system calls.
+	 */
+	if (counter && !vdso_counter_phys && !vdso_counter_fixed)
+		vdso_counter_phys = counter & PAGE_MASK;
+
+	flags = vdso_write_begin();
+
+	if (counter && ((counter & PAGE_MASK) == vdso_counter_phys) &&
+	    (clock->mask <= 0xffffffff)) {
+		vdso_data->clock_mode = VDSO_CLOCK_COUNTER;
+		vdso_data->counter_offset = counter & ~PAGE_MASK;
+		vdso_data->counter_xor = clock->archdata.vdso_xor;
+	} else
+		vdso_data->clock_mode = VDSO_CLOCK_NONE;
+
+	vdso_data->cycle_last = clock->cycle_last;
+	vdso_data->mask = clock->mask;
+	vdso_data->mult = mult;
+	vdso_data->shift = clock->shift;
+	vdso_data->wall_time = *wall_time;
+	vdso_data->wall_to_monotonic = *wtm;
+
+	vdso_write_end(flags);
+}
+
+/*
+ * Map the clock source counter register page read-only and uncached.
+ * It is I/O memory with no struct page behind it, so it gets a
+ * VM_IO | VM_PFNMAP mapping of its own.
+ */
+static int vdso_map_counter(struct mm_struct *mm, unsigned long addr)
+{
+	struct vm_area_struct *vma;
+	int ret;
+
+	vma = kmem_cache_zalloc(vm_area_cachep, GFP_KERNEL);
+	if (unlikely(!vma))
+		return -ENOMEM;
+
+	INIT_LIST_HEAD(&vma->anon_vma_chain);
+	vma->vm_mm = mm;
+	vma->vm_start = addr;
+	vma->vm_end = addr + PAGE_SIZE;
+	vma->vm_flags = VM_READ | VM_MAYREAD | VM_IO | VM_PFNMAP |
+			VM_RESERVED | VM_DONTEXPAND | mm->def_flags;
+	vma->vm_page_prot = pgprot_noncached(vm_get_page_prot(vma->vm_flags));
+
+	ret = security_file_mmap(NULL, 0, 0, 0, vma->vm_start, 1);
+	if (unlikely(ret))
+		goto out;
+
+	ret = insert_vm_struct(mm, vma);
+	if (unlikely(ret))
+		goto out;
+
+	mm->total_vm++;
+	perf_event_mmap(vma);
+
+	/* On failure the VMA goes away with the mm of the failed exec */
+	return io_remap_pfn_range(vma, addr, vdso_counter_phys >> PAGE_SHIFT,
+				  PAGE_SIZE, vma->vm_page_prot);
+
+out:
+	kmem_cache_free(vm_area_cachep, vma);
+	return ret;
+}
+
 /* Setup a VMA at program startup for the vsyscall page */
 int arch_setup_additional_pages(struct linux_binprm *bprm, int uses_interp)
 {
 	struct mm_struct *mm = current->mm;
-	unsigned long addr;
+	unsigned long addr, pgoff;
 	int ret;
 
 	down_write(&mm->mmap_sem);
-	addr = get_unmapped_area(NULL, 0, PAGE_SIZE, 0, 0);
+	vdso_counter_fixed = 1;
+	smp_mb();
+
+	/*
+	 * Give the data page the cache colour of its kernel address so
+	 * that the vDSO sees the kernel updates without any flushing.
+	 */
+	pgoff = page_to_pfn(vdso_data_pages[0]) - 1;
+	addr = get_unmapped_area(NULL, 0, (VDSO_DATA_PAGES + 1) * PAGE_SIZE,
+				 pgoff, MAP_SHARED);
 	if (IS_ERR_VALUE(addr)) {
 		ret = addr;
 		goto up_fail;
 	}
 
-	ret = install_special_mapping(mm, addr, PAGE_SIZE,
+	ret = install_special_mapping(mm, addr + VDSO_DATA_PAGES * PAGE_SIZE,
+				      PAGE_SIZE,
 				      VM_READ | VM_EXEC |
 				      VM_MAYREAD | VM_MAYWRITE | VM_MAYEXEC,
 				      syscall_pages);
 	if (unlikely(ret))
 		goto up_fail;
 
-	current->mm->context.vdso = (void *)addr;
+	ret = install_special_mapping(mm, addr + PAGE_SIZE, PAGE_SIZE,
+				      VM_READ | VM_MAYREAD, vdso_data_pages);
+	if (unlikely(ret))
+		goto up_fail;
+
+	if (vdso_counter_phys) {
+		ret = vdso_map_counter(mm, addr);
+		if (unlikely(ret))
+			goto up_fail;
+	}
+
+	current->mm->context.vdso = (void *)(addr + VDSO_DATA_PAGES * PAGE_SIZE);
 
 up_fail:
 	up_write(&mm->mmap_sem);
@@ -87,8 +264,17 @@ up_fail:
 
 const char *arch_vma_name(struct vm_area_struct *vma)
 {
-	if (vma->vm_mm && vma->vm_start == (long)vma->vm_mm->context.vdso)
+	unsigned long vdso;
+
+	if (!vma->vm_mm)
+		return NULL;
+
+	vdso = (unsigned long)vma->vm_mm->context.vdso;
+	if (vma->vm_start == vdso)
 		return "[vdso]";
+	if (vdso && (vma->vm_start >= vdso - VDSO_DATA_PAGES * PAGE_SIZE) &&
+	    (vma->vm_start < vdso))
+		return "[vvar]";
 
 	return NULL;
 }
@@ -15,6 +15,7 @@
 #include <linux/module.h>
 #include <asm/mmu_context.h>
 #include <asm/cacheflush.h>
+#include <asm/dma-memcpy.h>
 
 void (*local_flush_cache_all)(void *args) = cache_noop;
 void (*local_flush_cache_mm)(void *args) = cache_noop;
@@ -95,17 +96,16 @@ void copy_user_highpage(struct page *to, struct page *from,
 {
 	void *vfrom, *vto;
 
-	vto = kmap_atomic(to);
-
 	if (boot_cpu_data.dcache.n_aliases && page_mapped(from) &&
 	    test_bit(PG_dcache_clean, &from->flags)) {
+		vto = kmap_atomic(to);
 		vfrom = kmap_coherent(from, vaddr);
 		copy_page(vto, vfrom);
 		kunmap_coherent(vfrom);
 	} else {
-		vfrom = kmap_atomic(from);
-		copy_page(vto, vfrom);
-		kunmap_atomic(vfrom);
+		/* There is no highmem, and the DMA copy may sleep */
+		sh_dma_copy_page(page_address(to), page_address(from));
+		vto = kmap_atomic(to);
 	}
 
 	if (pages_do_alias((unsigned long)vto, vaddr & PAGE_MASK) ||
@@ -327,6 +327,36 @@ void dma_cache_sync(struct device *dev, void *vaddr, size_t size,
 }
 EXPORT_SYMBOL(dma_cache_sync);
 
+/*
+ * As dma_cache_sync() for each segment, but with the L2 maintenance done
+ * for the list as a whole.
+ */
+void dma_cache_sync_sg(struct device *dev, struct scatterlist *sg, int nents,
+		       enum dma_data_direction direction)
+{
+	struct scatterlist *s;
+	int i;
+
+	for_each_sg(sg, s, nents, i) {
+		switch (direction) {
+		case DMA_FROM_DEVICE:		/* invalidate only */
+			__flush_invalidate_region(sg_virt(s), s->length);
+			break;
+		case DMA_TO_DEVICE:		/* writeback only */
+			__flush_wback_region(sg_virt(s), s->length);
+			break;
+		case DMA_BIDIRECTIONAL:		/* writeback and invalidate */
+			__flush_purge_region(sg_virt(s), s->length);
+			break;
+		default:
+			BUG();
+		}
+	}
+
+	__l2_flush_sg(sg, nents, direction);
+}
+EXPORT_SYMBOL(dma_cache_sync_sg);
+
 static int __init memchunk_setup(char *str)
 {
 	return 1; /* accept anything that begins with "memchunk." */
@@ -0,0 +1,149 @@
+/*
+ * arch/sh/mm/dma-memcpy-bench.c
+ *
+ * Compare the throughput of the DMA memcpy offload with the CPU
+ * memcpy() across copy sizes, to help choose the dma_memcpy= threshold.
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License.  See the file "COPYING" in the main directory of this archive
+ * for more details.
+ */
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/gfp.h>
+#include <linux/mm.h>
+#include <linux/ktime.h>
+#include <linux/sched.h>
+#include <asm/dma-memcpy.h>
+
+#define PRINT_PREF KERN_INFO "dma_memcpy_bench: "
+
+static unsigned int min_size = 256;
+module_param(min_size, uint, S_IRUGO);
+MODULE_PARM_DESC(min_size, "Smallest copy size in bytes (default: 256)");
+
+static unsigned int max_size = 256 * 1024;
+module_param(max_size, uint, S_IRUGO);
+MODULE_PARM_DESC(max_size, "Largest copy size in bytes (default: 256KiB)");
+
+static unsigned int iterations = 64;
+module_param(iterations, uint, S_IRUGO);
+MODULE_PARM_DESC(iterations, "Copies per size and method (default: 64)");
+
+static long calc_speed(size_t bytes, ktime_t start, ktime_t finish)
+{
+	s64 us = ktime_to_us(ktime_sub(finish, start));
+	u64 k = bytes;
+
+	if (us <= 0)
+		return 0;
+
+	/* KiB/s */
+	k *= USEC_PER_SEC;
+	do_div(k, 1024);
+	do_div(k, us);
+
+	return (long)k;
+}
+
+static int bench_size(void *dst, void *src, size_t size)
+{
+	long cpu_speed, dma_speed;
+	ktime_t start, finish;
+	unsigned int i;
+	int err;
+
+	/* Check the offload path copies correctly before timing it */
+	memset(dst, 0, size);
+	err = __sh_dma_memcpy(dst, src, size);
+	if (err) {
+		printk(PRINT_PREF "size %zu: DMA copy failed (%d)\n",
+		       size, err);
+		return err;
+	}
+	if (memcmp(dst, src, size)) {
+		printk(PRINT_PREF "size %zu: DMA copy mismatch\n", size);
+		return -EIO;
+	}
+
+	start = ktime_get();
+	for (i = 0; i < iterations; i++)
+		memcpy(dst, src, size);
+	finish = ktime_get();
+	cpu_speed = calc_speed((size_t)iterations * size, start, finish);
+
+	start = ktime_get();
+	for (i = 0; i < iterations; i++) {
+		err = __sh_dma_memcpy(dst, src, size);
+		if (err)
+			return err;
+	}
+	finish = ktime_get();
+	dma_speed = calc_speed((size_t)iterations * size, start, finish);
+
+	printk(PRINT_PREF "size %7zu: memcpy %7ld KiB/s, dma %7ld KiB/s%s\n",
+	       size, cpu_speed, dma_speed,
+	       dma_speed > cpu_speed ? " (dma faster)" : "");
+
+	return 0;
+}
+
+static int __init dma_memcpy_bench_init(void)
+{
+	unsigned int order;
+	void *src, *dst;
+	size_t size;
+	int err = 0;
+
+	if (!min_size || min_size > max_size || !iterations)
+		return -EINVAL;
+
+	order = get_order(max_size);
+
+	src = (void *)__get_free_pages(GFP_KERNEL, order);
+	dst = (void *)__get_free_pages(GFP_KERNEL, order);
+	if (!src || !dst) {
+		printk(PRINT_PREF "cannot allocate %u byte buffers\n",
+		       max_size);
+		err = -ENOMEM;
+		goto out;
+	}
+
+	for (size = 0; size < max_size; size++)
+		((u8 *)src)[size] = size ^ (size >> 8);
+
+	printk(PRINT_PREF "%u copies per size, %u to %u bytes\n",
+	       iterations, min_size, max_size);
+
+	for (size = min_size; size <= max_size; size <<= 1) {
+		err = bench_size(dst, src, size);
+		if (err)
+			break;
+		cond_resched();
+	}
+
+	if (!err)
+		printk(PRINT_PREF "finished\n");
+
+out:
+	if (dst)
+		free_pages((unsigned long)dst, order);
+	if (src)
+		free_pages((unsigned long)src, order);
+
+	return err;
+}
+module_init(dma_memcpy_bench_init);
+
+static void __exit dma_memcpy_bench_exit(void)
+{
+}
+module_exit(dma_memcpy_bench_exit);
+
+MODULE_DESCRIPTION("DMA memcpy offload benchmark");
+MODULE_AUTHOR("STMicroelectronics Limited");
+MODULE_LICENSE("GPL");
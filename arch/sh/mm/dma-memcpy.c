@@ -0,0 +1,217 @@
+/*
+ * arch/sh/mm/dma-memcpy.c
+ *
+ * Offload of page copies to a DMA_MEMCPY capable dmaengine channel
+ * (FDMA on STMicroelectronics SoCs).
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License.  See the file "COPYING" in the main directory of this archive
+ * for more details.
+ */
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/mm.h>
+#include <linux/dmaengine.h>
+#include <linux/dma-mapping.h>
+#include <linux/completion.h>
+#include <linux/mutex.h>
+#include <linux/jiffies.h>
+#include <linux/debugfs.h>
+#include <asm/sizes.h>
+#include <asm/dma-memcpy.h>
+
+/*
+ * The channel is private to this file, and only one copy is in flight
+ * on it at a time, so that a copy which times out can be aborted
+ * without affecting anyone else.
+ */
+static struct dma_chan *dma_memcpy_chan;
+static DEFINE_MUTEX(dma_memcpy_mutex);
+static DECLARE_COMPLETION(dma_memcpy_done);
+
+/* A copy not done by then is aborted, and left to the CPU */
+#define DMA_MEMCPY_TIMEOUT	msecs_to_jiffies(100)
+
+/*
+ * Pages of at least this size are copied by the DMA engine. The cost
+ * of setting up the transfer and of the cache maintenance only pays off
+ * for large copies, so with 4K pages nothing is offloaded by default.
+ */
+static unsigned long dma_memcpy_threshold = SZ_16K;
+
+static u32 dma_memcpy_offloaded;
+static u32 dma_memcpy_fallbacks;
+
+/*
+ * dma_memcpy=<size>
+ *
+ * Minimum page size copied by the DMA engine, 0 disables.
+ */
+static int __init dma_memcpy_setup(char *str)
+{
+	dma_memcpy_threshold = memparse(str, &str);
+
+	return 1;
+}
+__setup("dma_memcpy=", dma_memcpy_setup);
+
+static void dma_memcpy_callback(void *param)
+{
+	complete(&dma_memcpy_done);
+}
+
+static int dma_memcpy_wait(struct dma_chan *chan, dma_cookie_t cookie)
+{
+	unsigned long timeout = DMA_MEMCPY_TIMEOUT;
+
+	/*
+	 * The callback of a copy which was aborted may still run once the
+	 * next copy is submitted, so check this copy is really done.
+	 */
+	do {
+		timeout = wait_for_completion_timeout(&dma_memcpy_done,
+						      timeout);
+		if (dma_async_is_tx_complete(chan, cookie, NULL, NULL) ==
+				DMA_SUCCESS)
+			return 0;
+	} while (timeout);
+
+	/* Nothing else can be queued on the channel, see dma_memcpy_mutex */
+	dmaengine_terminate_all(chan);
+
+	return -ETIMEDOUT;
+}
+
+/**
+ * __sh_dma_memcpy - copy lowmem using the DMA engine
+ * @dst: destination
+ * @src: source
+ * @len: number of bytes to copy
+ *
+ * Sleeps until the DMA engine signals the end of the copy, so this may
+ * only be called from process context. Copies are serialized. Returns 0
+ * once the data has been copied, or a negative error code if the copy
+ * could not be offloaded or did not complete in time, and must be done
+ * by the CPU.
+ */
+int __sh_dma_memcpy(void *dst, const void *src, size_t len)
+{
+	struct dma_chan *chan = dma_memcpy_chan;
+	struct dma_async_tx_descriptor *tx;
+	struct device *dev;
+	dma_addr_t dma_src, dma_dst;
+	dma_cookie_t cookie;
+	int err;
+
+	might_sleep();
+
+	if (!chan || !len)
+		return -ENODEV;
+
+	if (!virt_addr_valid(src) || !virt_addr_valid(src + len - 1) ||
+	    !virt_addr_valid(dst) || !virt_addr_valid(dst + len - 1))
+		return -EINVAL;
+
+	dev = chan->device->dev;
+
+	mutex_lock(&dma_memcpy_mutex);
+
+	/* The DMA API does the L1/L2 maintenance */
+	dma_src = dma_map_single(dev, (void *)src, len, DMA_TO_DEVICE);
+
+	/*
+	 * The destination is purged rather than just invalidated, so that
+	 * any dirty data sharing its first and last cache lines survives.
+	 */
+	dma_dst = dma_map_single(dev, dst, len, DMA_BIDIRECTIONAL);
+
+	tx = chan->device->device_prep_dma_memcpy(chan, dma_dst, dma_src, len,
+			DMA_CTRL_ACK | DMA_COMPL_SKIP_SRC_UNMAP |
+			DMA_COMPL_SKIP_DEST_UNMAP);
+	if (!tx) {
+		err = -ENOMEM;
+		goto unmap;
+	}
+
+	INIT_COMPLETION(dma_memcpy_done);
+	tx->callback = dma_memcpy_callback;
+	cookie = tx->tx_submit(tx);
+	if (dma_submit_error(cookie)) {
+		err = -EIO;
+		goto unmap;
+	}
+
+	err = dma_memcpy_wait(chan, cookie);
+
+unmap:
+	dma_unmap_single(dev, dma_dst, len, DMA_BIDIRECTIONAL);
+	dma_unmap_single(dev, dma_src, len, DMA_TO_DEVICE);
+
+	mutex_unlock(&dma_memcpy_mutex);
+
+	return err;
+}
+EXPORT_SYMBOL(__sh_dma_memcpy);
+
+/**
+ * sh_dma_copy_page - copy a page, offloading it if pages are large enough
+ * @to: destination page, lowmem address
+ * @from: source page, lowmem address
+ *
+ * The page is copied by the CPU if the offload fails. May sleep.
+ */
+void sh_dma_copy_page(void *to, void *from)
+{
+	if (dma_memcpy_threshold && PAGE_SIZE >= dma_memcpy_threshold) {
+		if (__sh_dma_memcpy(to, from, PAGE_SIZE) == 0) {
+			dma_memcpy_offloaded++;
+			return;
+		}
+
+		dma_memcpy_fallbacks++;
+	}
+
+	copy_page(to, from);
+}
+
+static int __init dma_memcpy_init(void)
+{
+	dma_cap_mask_t mask;
+
+	/* Also taken below the threshold, for the benchmark module */
+	if (!dma_memcpy_threshold)
+		return 0;
+
+	dma_cap_zero(mask);
+	dma_cap_set(DMA_MEMCPY, mask);
+
+	dma_memcpy_chan = dma_request_channel(mask, NULL, NULL);
+	if (!dma_memcpy_chan) {
+		pr_info("dma_memcpy: no DMA_MEMCPY channel, copies stay on "
+			"the CPU\n");
+		return 0;
+	}
+
+	pr_info("dma_memcpy: offloading copies to %s\n",
+		dma_chan_name(dma_memcpy_chan));
+
+#ifdef CONFIG_DEBUG_FS
+	{
+		struct dentry *dir = debugfs_create_dir("dma_memcpy", NULL);
+
+		if (dir) {
+			debugfs_create_u32("offloaded", S_IRUGO, dir,
+					   &dma_memcpy_offloaded);
+			debugfs_create_u32("fallbacks", S_IRUGO, dir,
+					   &dma_memcpy_fallbacks);
+		}
+	}
+#endif
+
+	return 0;
+}
+/* Must run after the dmaengine drivers have registered their channels */
+late_initcall(dma_memcpy_init);
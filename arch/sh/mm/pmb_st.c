@@ -48,6 +48,13 @@
 #define NR_PMB_ENTRIES	16
 #define MIN_PMB_MAPPING_SIZE	(8*1024*1024)
 
+/*
+ * Smaller uncached mappings (register blocks) are given a PMB entry of
+ * their own, to be shared with later mappings nearby, only while this
+ * many entries remain free for large mappings.
+ */
+#define PMB_RESERVED_ENTRIES	4
+
 #ifdef CONFIG_PMB_64M_TILES
 #define PMB_FIXED_SHIFT 26
 #define PMB_VIRT2POS(virt) (((virt) >> PMB_FIXED_SHIFT) & (NR_PMB_ENTRIES - 1))
@@ -71,8 +78,17 @@ struct pmb_mapping {
 	struct pmb_entry *entries;
 	struct pmb_mapping *next;
 	int usage;
+	int shared;	/* May be grown to cover nearby requests */
 };
 
+static struct {
+	u32 requests;
+	u32 hits;	/* Served by an existing mapping */
+	u32 merges;	/* Served by growing an existing mapping */
+	u32 maps;	/* Served by a new mapping */
+	u32 fallbacks;	/* Left to the TLB */
+} pmb_stats;
+
 static DEFINE_RWLOCK(pmb_lock);
 static unsigned long pmb_map;
 static struct pmb_entry   pmbe[NR_PMB_ENTRIES];
@@ -506,7 +522,8 @@ static struct pmb_mapping* pmb_calc(unsigned long phys, unsigned long size,
 	BUG_ON(entry->next);
 
 	/* Do we have a conflict with the requested maping? */
-	BUG_ON(req_virt && ((req_virt & (alignment-1)) != virt_offset));
+	if (req_virt && ((req_virt & (alignment-1)) != virt_offset))
+		goto failed;
 
 	/* Next try and find a virtual address to map this */
 	prev_end = P1SEG;
@@ -568,6 +585,106 @@ failed_give_up:
 }
 #endif
 
+static struct pmb_mapping *pmb_mapping_find(unsigned long addr,
+					    struct pmb_mapping ***prev);
+
+#ifndef CONFIG_PMB_64M_TILES
+static struct pmb_entry pmbe_saved[NR_PMB_ENTRIES];
+
+static void pmb_mapping_discard(struct pmb_mapping *mapping)
+{
+	struct pmb_mapping **prev_mapping;
+	struct pmb_entry *entry;
+
+	pmb_mapping_find(mapping->virt, &prev_mapping);
+	*prev_mapping = mapping->next;
+
+	for (entry = mapping->entries; entry; entry = entry->next)
+		pmb_free(entry->pos);
+	pmb_mapping_free(mapping);
+}
+
+/*
+ * Replace a mapping with one which also covers phys to phys + size,
+ * keeping the virtual addresses already handed out for it. The new
+ * mapping is retiled from scratch, so adjacent regions coalesce into
+ * larger PMB pages where the alignment allows. Returns NULL, leaving
+ * the mapping untouched, if the new one can not be placed.
+ */
+static struct pmb_mapping *pmb_merge(struct pmb_mapping *mapping,
+				     unsigned long phys, unsigned long size)
+{
+	unsigned long start, end, virt, old_pos, flags;
+	struct pmb_mapping *new_mapping;
+	struct pmb_mapping **prev_mapping;
+	struct pmb_entry *entry;
+	int pos;
+
+	start = min(phys, mapping->phys) & ~(pmb_sizes[0].size - 1);
+	end = max(phys + size, mapping->phys + mapping->size);
+	virt = mapping->virt - (mapping->phys - start);
+	if (virt < P1SEG || virt > mapping->virt)
+		return NULL;
+
+	DPRINTK("grow phys %08lx-%08lx to %08lx-%08lx at virt %08lx\n",
+		mapping->phys, mapping->phys + mapping->size, start, end, virt);
+
+	/*
+	 * Take the old mapping out of the way, so its virtual range and
+	 * its entries can be reused. pmb_calc() scribbles on the entries
+	 * it tries, so keep a copy to put back if it fails.
+	 */
+	memcpy(pmbe_saved, pmbe, sizeof(pmbe));
+	pmb_mapping_find(mapping->virt, &prev_mapping);
+	*prev_mapping = mapping->next;
+	old_pos = 0;
+	for (entry = mapping->entries; entry; entry = entry->next) {
+		old_pos |= 1 << entry->pos;
+		pmb_free(entry->pos);
+	}
+
+	new_mapping = pmb_calc(start, end - start, virt, PMB_NO_ENTRY,
+			       mapping->flags);
+
+	/* The first entry may have been rounded down to a larger page */
+	if (new_mapping && (new_mapping->phys != start)) {
+		pmb_mapping_discard(new_mapping);
+		new_mapping = NULL;
+	}
+
+	if (!new_mapping) {
+		memcpy(pmbe, pmbe_saved, sizeof(pmbe));
+		pmb_map |= old_pos;
+		*prev_mapping = mapping;
+		return NULL;
+	}
+
+	new_mapping->usage = mapping->usage;
+	new_mapping->shared = 1;
+
+	/* Entries may be reused, so clear all the old ones first */
+	local_irq_save(flags);
+	jump_to_uncached();
+	for (pos = 0; pos < NR_PMB_ENTRIES; pos++)
+		if (old_pos & (1 << pos))
+			__clear_pmb_entry(pos);
+	__pmb_mapping_set(new_mapping);
+	back_to_cached();
+	local_irq_restore(flags);
+
+	pmb_mapping_free(mapping);
+
+	return new_mapping;
+}
+#else
+/* Entries are tied to their virtual address, so mappings can't grow */
+static struct pmb_mapping *pmb_merge(struct pmb_mapping *mapping,
+				     unsigned long phys, unsigned long size)
+{
+	return NULL;
+}
+#endif
+
 /* Try to create a PMB at the requested phys/virt. req_virt of 0
  * means map to any virtual address
  */
@@ -593,6 +710,8 @@ static struct pmb_mapping *get_pmb_map(unsigned long req_virt,
 
 	write_lock(&pmb_lock);
 
+	pmb_stats.requests++;
+
 	for (mapping = pmb_mappings; mapping; mapping=mapping->next) {
 		DPRINTK("check against phys %08lx size %08lx flags %08lx\n",
 			mapping->phys, mapping->size, mapping->flags);
@@ -609,20 +728,50 @@ static struct pmb_mapping *get_pmb_map(unsigned long req_virt,
 	if (mapping) {
 		/* If we hit an existing mapping, use it */
 		mapping->usage++;
+		pmb_stats.hits++;
 		DPRINTK("found, usage now %d\n", mapping->usage);
-	} else if (size < MIN_PMB_MAPPING_SIZE) {
-		/* We spit upon small mappings */
+		goto out;
+	}
+
+	/* Otherwise try to grow one which overlaps or adjoins the request */
+	if (!req_virt) {
+		for (mapping = pmb_mappings; mapping; mapping = mapping->next) {
+			if (!mapping->shared || (mapping->flags != pmb_flags) ||
+			    (phys > mapping->phys + mapping->size) ||
+			    (phys + size < mapping->phys))
+				continue;
+			mapping = pmb_merge(mapping, phys, size);
+			if (mapping) {
+				mapping->usage++;
+				pmb_stats.merges++;
+				DPRINTK("grown, usage now %d\n", mapping->usage);
+				goto out;
+			}
+			break;
+		}
+	}
+
+	if ((size < MIN_PMB_MAPPING_SIZE) &&
+	    (req_virt || !(pmb_flags & PMB_UB) ||
+	     (NR_PMB_ENTRIES - hweight_long(pmb_map) <=
+	      PMB_RESERVED_ENTRIES))) {
+		/* We spit upon small mappings, unless there is room */
+		pmb_stats.fallbacks++;
 		write_unlock(&pmb_lock);
 		return ERR_PTR(-EINVAL);
-	} else {
-		mapping = pmb_calc(phys, size, req_virt, PMB_NO_ENTRY, pmb_flags);
-		if (!mapping) {
-			write_unlock(&pmb_lock);
-			return ERR_PTR(-ENOSPC);
-		}
-		pmb_mapping_set(mapping);
 	}
 
+	mapping = pmb_calc(phys, size, req_virt, PMB_NO_ENTRY, pmb_flags);
+	if (!mapping) {
+		pmb_stats.fallbacks++;
+		write_unlock(&pmb_lock);
+		return ERR_PTR(-ENOSPC);
+	}
+	mapping->shared = !req_virt;
+	pmb_mapping_set(mapping);
+	pmb_stats.maps++;
+
+out:
 	write_unlock(&pmb_lock);
 
 	return mapping;
@@ -925,6 +1074,49 @@ static int pmb_debugfs_open(struct inode *inode, struct file *file)
 	return single_open(file, pmb_seq_show, NULL);
 }
 
+static int pmb_stats_seq_show(struct seq_file *file, void *iter)
+{
+	struct pmb_mapping *mapping;
+	u32 served, hit_rate = 0;
+	int nr_mappings = 0;
+
+	read_lock(&pmb_lock);
+
+	for (mapping = pmb_mappings; mapping; mapping = mapping->next)
+		nr_mappings++;
+
+	served = pmb_stats.hits + pmb_stats.merges;
+	if (pmb_stats.requests)
+		hit_rate = served * 100 / pmb_stats.requests;
+
+	seq_printf(file, "requests:     %u\n", pmb_stats.requests);
+	seq_printf(file, "hits:         %u\n", pmb_stats.hits);
+	seq_printf(file, "merges:       %u\n", pmb_stats.merges);
+	seq_printf(file, "hit rate:     %u%%\n", hit_rate);
+	seq_printf(file, "new mappings: %u\n", pmb_stats.maps);
+	seq_printf(file, "tlb fallback: %u\n", pmb_stats.fallbacks);
+	seq_printf(file, "mappings:     %d\n", nr_mappings);
+	seq_printf(file, "free entries: %d\n",
+		   NR_PMB_ENTRIES - (int)hweight_long(pmb_map));
+
+	read_unlock(&pmb_lock);
+
+	return 0;
+}
+
+static int pmb_stats_debugfs_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, pmb_stats_seq_show, NULL);
+}
+
+static const struct file_operations pmb_stats_debugfs_fops = {
+	.owner		= THIS_MODULE,
+	.open		= pmb_stats_debugfs_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static const struct file_operations pmb_debugfs_fops = {
 	.owner		= THIS_MODULE,
 	.open		= pmb_debugfs_open,
@@ -944,6 +1136,14 @@ static int __init pmb_debugfs_init(void)
 	if (IS_ERR(dentry))
 		return PTR_ERR(dentry);
 
+	dentry = debugfs_create_file("pmb_stats", S_IFREG | S_IRUGO,
+				     arch_debugfs_dir, NULL,
+				     &pmb_stats_debugfs_fops);
+	if (!dentry)
+		return -ENOMEM;
+	if (IS_ERR(dentry))
+		return PTR_ERR(dentry);
+
 	return 0;
 }
 subsys_initcall(pmb_debugfs_init);
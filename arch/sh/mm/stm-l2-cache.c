@@ -27,6 +27,9 @@
 #include <linux/io.h>
 #include <linux/pm.h>
 #include <linux/uaccess.h>
+#include <linux/perf_event.h>
+#include <linux/timer.h>
+#include <linux/scatterlist.h>
 #include <asm/addrspace.h>
 #include <asm/page.h>
 #include <asm/pgtable.h>
@@ -72,11 +75,15 @@ static int stm_l2_n_ways;
 static enum stm_l2_mode stm_l2_current_mode = MODE_BYPASS;
 static DEFINE_SPINLOCK(stm_l2_current_mode_lock);
 
+/* Ranges at least this big are handled by flushing the whole cache,
+ * 0 means the cache size */
+static unsigned long stm_l2_flush_threshold;
+
 
 
 /* Performance informations */
 
-#if defined(CONFIG_DEBUG_FS)
+#if defined(CONFIG_DEBUG_FS) || defined(CONFIG_PERF_EVENTS)
 
 static struct stm_l2_perf_counter {
 	enum { EVENT, CYCLE } type;
@@ -107,24 +114,27 @@ static struct stm_l2_perf_counter {
 	{ CYCLE,  5, "HPML", "Hit on Pending Miss Latency" },
 };
 
-static int stm_l2_perf_seq_printf_counter(struct seq_file *s,
-		struct stm_l2_perf_counter *counter)
+static u64 stm_l2_perf_read(struct stm_l2_perf_counter *counter)
 {
 	void *address;
-	long long unsigned int val64;
+	u32 high, low;
 
 	switch (counter->type) {
 	case EVENT:
 		address = stm_l2_base + L2ECA(counter->index);
-		return seq_printf(s, "%u", readl(address));
+		return readl(address);
 	case CYCLE:
+		/* 48 bits split over two registers; retry if the low
+		 * word wrapped between the reads. */
 		address = stm_l2_base + L2CCA(counter->index);
-		val64 = readl(address + 4) & 0xffff;
-		val64 = (val64 << 32) | readl(address);
-		return seq_printf(s, "%llu", val64);
+		do {
+			high = readl(address + 4);
+			low = readl(address);
+		} while (high != readl(address + 4));
+		return ((u64)(high & 0xffff) << 32) | low;
 	}
 	BUG();
-	return -EFAULT;
+	return 0;
 }
 
 static int stm_l2_perf_get_overflow(struct stm_l2_perf_counter *counter)
@@ -146,6 +156,294 @@ static int stm_l2_perf_get_overflow(struct stm_l2_perf_counter *counter)
 	return !!(readl(address) & (1 << counter->index));
 }
 
+#endif /* defined(CONFIG_DEBUG_FS) || defined(CONFIG_PERF_EVENTS) */
+
+
+
+#if defined(CONFIG_PERF_EVENTS)
+
+/*
+ * The L2 counters are a single free-running bank shared by the whole
+ * system, enabled and cleared all at once. Events therefore never own
+ * a counter; they just accumulate deltas of the counter selected by
+ * attr.config (an index into stm_l2_perf_counters) while scheduled in.
+ * For task events this gives the L2 traffic seen while the task ran.
+ *
+ * There is no overflow interrupt, so a timer folds the deltas of all
+ * running events often enough for the 32-bit event counters to wrap at
+ * most once, and clears the bank whenever one of the used counters
+ * reports an overflow.
+ */
+
+#define STM_L2_PMU_MAX_EVENTS	32
+#define STM_L2_PMU_POLL_PERIOD	(2 * HZ)
+
+static struct pmu stm_l2_pmu;
+static struct perf_event *stm_l2_pmu_events[STM_L2_PMU_MAX_EVENTS];
+static int stm_l2_pmu_users;
+static int stm_l2_pmu_was_enabled;
+static DEFINE_SPINLOCK(stm_l2_pmu_lock);
+static struct timer_list stm_l2_pmu_timer;
+
+static inline int stm_l2_pmu_busy(void)
+{
+	return stm_l2_pmu_users != 0;
+}
+
+/* Counter widths, for wrap-safe deltas */
+static u64 stm_l2_perf_mask(struct stm_l2_perf_counter *counter)
+{
+	return counter->type == EVENT ? 0xffffffffULL : 0xffffffffffffULL;
+}
+
+static void stm_l2_pmu_update(struct perf_event *event)
+{
+	struct hw_perf_event *hwc = &event->hw;
+	struct stm_l2_perf_counter *counter = &stm_l2_perf_counters[hwc->idx];
+	u64 prev_count, new_count;
+
+again:
+	prev_count = local64_read(&hwc->prev_count);
+	new_count = stm_l2_perf_read(counter);
+
+	if (local64_cmpxchg(&hwc->prev_count, prev_count,
+			new_count) != prev_count)
+		goto again;
+
+	local64_add((new_count - prev_count) & stm_l2_perf_mask(counter),
+			&event->count);
+}
+
+static void stm_l2_pmu_poll(unsigned long data)
+{
+	unsigned long flags;
+	int overflow = 0;
+	int i;
+
+	spin_lock_irqsave(&stm_l2_pmu_lock, flags);
+
+	if (!stm_l2_pmu_users)
+		goto out;
+
+	for (i = 0; i < STM_L2_PMU_MAX_EVENTS; i++) {
+		struct perf_event *event = stm_l2_pmu_events[i];
+
+		if (!event || (event->hw.state & PERF_HES_STOPPED))
+			continue;
+
+		stm_l2_pmu_update(event);
+		overflow |= stm_l2_perf_get_overflow(
+				&stm_l2_perf_counters[event->hw.idx]);
+	}
+
+	if (overflow) {
+		/* Everything is folded in, so restart the bank from zero */
+		writel(1 | (1 << 1), stm_l2_base + L2PMC);
+
+		for (i = 0; i < STM_L2_PMU_MAX_EVENTS; i++)
+			if (stm_l2_pmu_events[i])
+				local64_set(&stm_l2_pmu_events[i]->hw.prev_count,
+						0);
+	}
+
+	mod_timer(&stm_l2_pmu_timer, jiffies + STM_L2_PMU_POLL_PERIOD);
+out:
+	spin_unlock_irqrestore(&stm_l2_pmu_lock, flags);
+}
+
+static int stm_l2_pmu_event_init(struct perf_event *event)
+{
+	if (event->attr.type != stm_l2_pmu.type)
+		return -ENOENT;
+
+	/* No overflow interrupt and no per-mode filtering: counting only */
+	if (is_sampling_event(event) || has_branch_stack(event))
+		return -EOPNOTSUPP;
+
+	if (event->attr.exclude_user || event->attr.exclude_kernel ||
+			event->attr.exclude_hv || event->attr.exclude_idle)
+		return -EINVAL;
+
+	if (event->attr.config >= ARRAY_SIZE(stm_l2_perf_counters))
+		return -EINVAL;
+
+	event->hw.idx = event->attr.config;
+
+	return 0;
+}
+
+static void stm_l2_pmu_start(struct perf_event *event, int flags)
+{
+	struct hw_perf_event *hwc = &event->hw;
+
+	local64_set(&hwc->prev_count,
+			stm_l2_perf_read(&stm_l2_perf_counters[hwc->idx]));
+	hwc->state = 0;
+}
+
+static void stm_l2_pmu_stop(struct perf_event *event, int flags)
+{
+	struct hw_perf_event *hwc = &event->hw;
+
+	if (hwc->state & PERF_HES_STOPPED)
+		return;
+
+	stm_l2_pmu_update(event);
+	hwc->state |= PERF_HES_STOPPED | PERF_HES_UPTODATE;
+}
+
+static int stm_l2_pmu_add(struct perf_event *event, int flags)
+{
+	unsigned long irqflags;
+	int i;
+
+	spin_lock_irqsave(&stm_l2_pmu_lock, irqflags);
+
+	for (i = 0; i < STM_L2_PMU_MAX_EVENTS; i++)
+		if (!stm_l2_pmu_events[i])
+			break;
+
+	if (i == STM_L2_PMU_MAX_EVENTS) {
+		spin_unlock_irqrestore(&stm_l2_pmu_lock, irqflags);
+		return -EAGAIN;
+	}
+
+	if (!stm_l2_pmu_users++) {
+		stm_l2_pmu_was_enabled = readl(stm_l2_base + L2PMC) & 1;
+		writel(1, stm_l2_base + L2PMC);
+		mod_timer(&stm_l2_pmu_timer, jiffies + STM_L2_PMU_POLL_PERIOD);
+	}
+
+	event->hw.state = PERF_HES_STOPPED | PERF_HES_UPTODATE;
+	if (flags & PERF_EF_START)
+		stm_l2_pmu_start(event, PERF_EF_RELOAD);
+
+	stm_l2_pmu_events[i] = event;
+
+	spin_unlock_irqrestore(&stm_l2_pmu_lock, irqflags);
+
+	return 0;
+}
+
+static void stm_l2_pmu_del(struct perf_event *event, int flags)
+{
+	unsigned long irqflags;
+	int i;
+
+	spin_lock_irqsave(&stm_l2_pmu_lock, irqflags);
+
+	stm_l2_pmu_stop(event, PERF_EF_UPDATE);
+
+	for (i = 0; i < STM_L2_PMU_MAX_EVENTS; i++)
+		if (stm_l2_pmu_events[i] == event)
+			stm_l2_pmu_events[i] = NULL;
+
+	if (!--stm_l2_pmu_users) {
+		if (!stm_l2_pmu_was_enabled)
+			writel(0, stm_l2_base + L2PMC);
+		del_timer(&stm_l2_pmu_timer);
+	}
+
+	spin_unlock_irqrestore(&stm_l2_pmu_lock, irqflags);
+}
+
+static void stm_l2_pmu_read(struct perf_event *event)
+{
+	stm_l2_pmu_update(event);
+}
+
+PMU_FORMAT_ATTR(event, "config:0-4");
+
+static struct attribute *stm_l2_pmu_format_attrs[] = {
+	&format_attr_event.attr,
+	NULL,
+};
+
+static struct attribute_group stm_l2_pmu_format_group = {
+	.name = "format",
+	.attrs = stm_l2_pmu_format_attrs,
+};
+
+/* Named aliases, so that "stm_l2/L32M/" works with perf tools which
+ * know about the events directory; "stm_l2/event=1/" works anywhere. */
+static ssize_t stm_l2_pmu_event_show(struct device *dev,
+		struct device_attribute *attr, char *page)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(stm_l2_perf_counters); i++)
+		if (!strcmp(stm_l2_perf_counters[i].name, attr->attr.name))
+			return sprintf(page, "event=0x%02x\n", i);
+
+	return -ENOENT;
+}
+
+static struct attribute_group stm_l2_pmu_events_group = {
+	.name = "events",
+};
+
+static const struct attribute_group *stm_l2_pmu_attr_groups[] = {
+	&stm_l2_pmu_format_group,
+	&stm_l2_pmu_events_group,
+	NULL,
+};
+
+static struct pmu stm_l2_pmu = {
+	.attr_groups	= stm_l2_pmu_attr_groups,
+	.event_init	= stm_l2_pmu_event_init,
+	.add		= stm_l2_pmu_add,
+	.del		= stm_l2_pmu_del,
+	.start		= stm_l2_pmu_start,
+	.stop		= stm_l2_pmu_stop,
+	.read		= stm_l2_pmu_read,
+};
+
+static int __init stm_l2_pmu_init(void)
+{
+	static struct device_attribute
+			event_attrs[ARRAY_SIZE(stm_l2_perf_counters)];
+	static struct attribute
+			*attrs[ARRAY_SIZE(stm_l2_perf_counters) + 1];
+	int i;
+
+	if (!stm_l2_base)
+		return 0;
+
+	for (i = 0; i < ARRAY_SIZE(stm_l2_perf_counters); i++) {
+		sysfs_attr_init(&event_attrs[i].attr);
+		event_attrs[i].attr.name = stm_l2_perf_counters[i].name;
+		event_attrs[i].attr.mode = S_IRUGO;
+		event_attrs[i].show = stm_l2_pmu_event_show;
+		attrs[i] = &event_attrs[i].attr;
+	}
+	stm_l2_pmu_events_group.attrs = attrs;
+
+	setup_timer(&stm_l2_pmu_timer, stm_l2_pmu_poll, 0);
+
+	return perf_pmu_register(&stm_l2_pmu, "stm_l2", -1);
+}
+device_initcall(stm_l2_pmu_init);
+
+#else
+
+static inline int stm_l2_pmu_busy(void)
+{
+	return 0;
+}
+
+#endif /* defined(CONFIG_PERF_EVENTS) */
+
+
+
+#if defined(CONFIG_DEBUG_FS)
+
+static int stm_l2_perf_seq_printf_counter(struct seq_file *s,
+		struct stm_l2_perf_counter *counter)
+{
+	return seq_printf(s, "%llu",
+			(unsigned long long)stm_l2_perf_read(counter));
+}
+
 
 
 static ssize_t stm_l2_perf_enabled_read(struct file *file,
@@ -170,6 +468,10 @@ static ssize_t stm_l2_perf_enabled_write(struct file *file,
 	if (copy_from_user(value, buf, min(sizeof(value), count)) != 0)
 		return -EFAULT;
 
+	/* The perf PMU relies on the counters running */
+	if (stm_l2_pmu_busy())
+		return -EBUSY;
+
 	if (count == 1 || (count == 2 && value[1] == '\n')) {
 		switch (buf[0]) {
 		case 'y':
@@ -198,6 +500,10 @@ static const struct file_operations stm_l2_perf_enabled_fops = {
 static ssize_t stm_l2_perf_clear_write(struct file *file,
 		const char __user *buf, size_t count, loff_t *ppos)
 {
+	/* Clearing behind perf's back would corrupt its deltas */
+	if (stm_l2_pmu_busy())
+		return -EBUSY;
+
 	if (count) {
 		unsigned int l2pmc;
 
@@ -422,6 +728,69 @@ static void stm_l2_flush_common(unsigned long start, int size, int is_phys,
 	}
 }
 
+static void stm_l2_invalidate(void);
+
+static unsigned long stm_l2_size(void)
+{
+	return stm_l2_block_size * stm_l2_n_sets * stm_l2_n_ways;
+}
+
+static int stm_l2_flush_whole(unsigned long size)
+{
+	unsigned long threshold = stm_l2_flush_threshold;
+
+	return size >= (threshold ? threshold : stm_l2_size());
+}
+
+/* stm-l2-helper.S */
+void stm_l2_purge_all_helper(unsigned long top, unsigned long set_top,
+	void *l2base);
+
+/*
+ * Write back and/or invalidate the whole cache, by entry and by set.
+ * This costs a fixed number of register writes (a few thousand for a
+ * 256KB cache), much less than walking a range of many MB line by line.
+ */
+static void stm_l2_flush_all(unsigned int l2reg)
+{
+	unsigned long top = stm_l2_size();
+	unsigned long i;
+
+	asm volatile("synco"
+			: /* no output */
+			: /* no input */
+			: "memory");
+
+	if (stm_l2_current_mode != MODE_COPY_BACK) {
+		/* Nothing dirty, so there is nothing to lose either */
+		if (l2reg != L2FA)
+			stm_l2_invalidate();
+		return;
+	}
+
+	if (l2reg == L2FA) {
+		for (i = 0; i < top; i += stm_l2_block_size)
+			writel(i, stm_l2_base + L2FE);
+		return;
+	}
+
+	/* Once everything has been written back it can all be invalidated,
+	 * provided nothing gets dirty in between. This is only guaranteed
+	 * with exceptions blocked and no memory accesses at all, as in the
+	 * copy-back to write-through switch. */
+	stm_l2_purge_all_helper(top, stm_l2_block_size * stm_l2_n_sets,
+			stm_l2_base);
+}
+
+static void stm_l2_flush_range(unsigned long start, int size, int is_phys,
+		unsigned int l2reg)
+{
+	if (stm_l2_flush_whole(size))
+		stm_l2_flush_all(l2reg);
+	else
+		stm_l2_flush_common(start, size, is_phys, l2reg);
+}
+
 void stm_l2_flush_wback(unsigned long start, int size, int is_phys)
 {
 	if (!stm_l2_base)
@@ -429,7 +798,7 @@ void stm_l2_flush_wback(unsigned long start, int size, int is_phys)
 
 	switch (stm_l2_current_mode) {
 	case MODE_COPY_BACK:
-		stm_l2_flush_common(start, size, is_phys, L2FA);
+		stm_l2_flush_range(start, size, is_phys, L2FA);
 		/* Fall through */
 	case MODE_WRITE_THROUGH:
 		/* Since this is for the purposes of DMA, we have to
@@ -454,7 +823,7 @@ void stm_l2_flush_purge(unsigned long start, int size, int is_phys)
 
 	switch (stm_l2_current_mode) {
 	case MODE_COPY_BACK:
-		stm_l2_flush_common(start, size, is_phys, L2PA);
+		stm_l2_flush_range(start, size, is_phys, L2PA);
 		/* Fall through */
 	case MODE_WRITE_THROUGH:
 		/* Since this is for the purposes of DMA, we have to
@@ -491,7 +860,7 @@ void stm_l2_flush_invalidate(unsigned long start, int size, int is_phys)
 	switch (stm_l2_current_mode) {
 	case MODE_COPY_BACK:
 	case MODE_WRITE_THROUGH:
-		stm_l2_flush_common(start, size, is_phys, L2IA);
+		stm_l2_flush_range(start, size, is_phys, L2IA);
 		stm_l2_sync();
 		break;
 	case MODE_BYPASS:
@@ -503,6 +872,56 @@ void stm_l2_flush_invalidate(unsigned long start, int size, int is_phys)
 }
 EXPORT_SYMBOL(stm_l2_flush_invalidate);
 
+/*
+ * Maintenance for all the segments of a scatterlist, with a single sync
+ * at the end, and a single whole cache operation if together they are
+ * bigger than the threshold.
+ */
+void stm_l2_flush_sg(struct scatterlist *sg, int nents,
+		enum stm_l2_flush_op op)
+{
+	static const unsigned int l2regs[] = {
+		[STM_L2_FLUSH_WBACK] = L2FA,
+		[STM_L2_FLUSH_PURGE] = L2PA,
+		[STM_L2_FLUSH_INVALIDATE] = L2IA,
+	};
+	unsigned int l2reg = l2regs[op];
+	struct scatterlist *s;
+	unsigned long total = 0;
+	int i;
+
+	if (!stm_l2_base)
+		return;
+
+	switch (stm_l2_current_mode) {
+	case MODE_WRITE_THROUGH:
+		/* As for a single range, only invalidation has work to do */
+		if (op != STM_L2_FLUSH_INVALIDATE)
+			break;
+		/* Fall through */
+	case MODE_COPY_BACK:
+		for_each_sg(sg, s, nents, i)
+			total += s->length;
+
+		if (stm_l2_flush_whole(total)) {
+			stm_l2_flush_all(l2reg);
+			break;
+		}
+
+		for_each_sg(sg, s, nents, i)
+			stm_l2_flush_common(sg_phys(s), s->length, 1, l2reg);
+		break;
+	case MODE_BYPASS:
+		return;
+	default:
+		BUG();
+		break;
+	}
+
+	stm_l2_sync();
+}
+EXPORT_SYMBOL(stm_l2_flush_sg);
+
 
 
 /* Mode control */
@@ -669,10 +1088,37 @@ static ssize_t stm_l2_mode_store(struct device *dev,
 static struct device_attribute stm_l2_mode_attr =
 	__ATTR(mode, S_IRUGO | S_IWUSR, stm_l2_mode_show, stm_l2_mode_store);
 
+static ssize_t stm_l2_flush_threshold_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	unsigned long threshold = stm_l2_flush_threshold;
+
+	return sprintf(buf, "%lu\n", threshold ? threshold : stm_l2_size());
+}
+
+static ssize_t stm_l2_flush_threshold_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	unsigned long threshold;
+
+	if (kstrtoul(buf, 0, &threshold))
+		return -EINVAL;
+
+	stm_l2_flush_threshold = threshold;
+
+	return count;
+}
+
+static struct device_attribute stm_l2_flush_threshold_attr =
+	__ATTR(flush_threshold, S_IRUGO | S_IWUSR,
+			stm_l2_flush_threshold_show,
+			stm_l2_flush_threshold_store);
+
 static struct attribute_group stm_l2_attr_group = {
 	.name = "l2",
 	.attrs = (struct attribute * []) {
 		&stm_l2_mode_attr.attr,
+		&stm_l2_flush_threshold_attr.attr,
 		NULL
 	},
 };
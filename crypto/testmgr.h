@@ -14683,6 +14683,90 @@ static struct hash_testvec michael_mic_tv_template[] = {
 	}
 };
 
+/*
+ * CRC32 test vectors
+ */
+#define CRC32_TEST_VECTORS 8
+
+static struct hash_testvec crc32_tv_template[] = {
+	{
+		.psize = 0,
+		.digest = "\x00\x00\x00\x00",
+	},
+	{
+		.key = "\x87\xa9\xcb\xed",
+		.ksize = 4,
+		.psize = 0,
+		.digest = "\x87\xa9\xcb\xed",
+	},
+	{
+		.plaintext = "123456789",
+		.psize = 9,
+		.digest = "\x88\x2d\xfd\x2d",
+	},
+	{
+		.key = "\xff\xff\xff\xff",
+		.ksize = 4,
+		.plaintext = "\x01\x02\x03\x04\x05\x06\x07\x08"
+			     "\x09\x0a\x0b\x0c\x0d\x0e\x0f\x10"
+			     "\x11\x12\x13\x14\x15\x16\x17\x18"
+			     "\x19\x1a\x1b\x1c\x1d\x1e\x1f\x20"
+			     "\x21\x22\x23\x24\x25\x26\x27\x28",
+		.psize = 40,
+		.digest = "\x3a\xdf\x4b\xb0",
+	},
+	{
+		.key = "\xff\xff\xff\xff",
+		.ksize = 4,
+		.plaintext = "\x29\x2a\x2b\x2c\x2d\x2e\x2f\x30"
+			     "\x31\x32\x33\x34\x35\x36\x37\x38"
+			     "\x39\x3a\x3b\x3c\x3d\x3e\x3f\x40"
+			     "\x41\x42\x43\x44\x45\x46\x47\x48"
+			     "\x49\x4a\x4b\x4c\x4d\x4e\x4f\x50",
+		.psize = 40,
+		.digest = "\xa9\x7a\x7f\x7b",
+	},
+	{
+		.key = "\xff\xff\xff\xff",
+		.ksize = 4,
+		.plaintext = "\x51\x52\x53\x54\x55\x56\x57\x58"
+			     "\x59\x5a\x5b\x5c\x5d\x5e\x5f\x60"
+			     "\x61\x62\x63\x64\x65\x66\x67\x68"
+			     "\x69\x6a\x6b\x6c\x6d\x6e\x6f\x70"
+			     "\x71\x72\x73\x74\x75\x76\x77\x78",
+		.psize = 40,
+		.digest = "\xba\xd3\xf8\x1c",
+	},
+	{
+		.key = "\x78\x56\x34\x12",
+		.ksize = 4,
+		.plaintext = "\x79\x7a\x7b\x7c\x7d\x7e\x7f\x80"
+			     "\x81\x82\x83\x84\x85\x86\x87\x88"
+			     "\x89\x8a\x8b\x8c\x8d\x8e\x8f\x90"
+			     "\x91\x92\x93\x94\x95\x96\x97\x98"
+			     "\x99\x9a\x9b\x9c\x9d\x9e\x9f\xa0",
+		.psize = 40,
+		.digest = "\xa6\x5d\x14\xaa",
+	},
+	{
+		.plaintext = "\x03\x0a\x11\x18\x1f\x26\x2d\x34"
+			     "\x3b\x42\x49\x50\x57\x5e\x65\x6c"
+			     "\x73\x7a\x81\x88\x8f\x96\x9d\xa4"
+			     "\xab\xb2\xb9\xc0\xc7\xce\xd5\xdc"
+			     "\xe3\xea\xf1\xf8\xff\x06\x0d\x14"
+			     "\x1b\x22\x29\x30\x37\x3e\x45\x4c"
+			     "\x53\x5a\x61\x68\x6f\x76\x7d\x84"
+			     "\x8b\x92\x99\xa0\xa7\xae\xb5\xbc"
+			     "\xc3\xca\xd1\xd8\xdf\xe6\xed\xf4"
+			     "\xfb\x02\x09\x10\x17\x1e\x25\x2c"
+			     "\x33\x3a\x41\x48\x4f\x56\x5d\x64"
+			     "\x6b\x72\x79\x80\x87\x8e\x95\x9c"
+			     "\xa3\xaa\xb1\xb8\xbf",
+		.psize = 101,
+		.digest = "\xba\x84\x80\x59",
+	}
+};
+
 /*
  * CRC32C test vectors
  */
@@ -225,6 +225,7 @@ static int sh_tmu_register_clocksource(struct sh_tmu_priv *p,
 				       char *name, unsigned long rating)
 {
 	struct clocksource *cs = &p->cs;
+	struct resource *res;
 
 	cs->name = name;
 	cs->rating = rating;
@@ -236,6 +237,12 @@ static int sh_tmu_register_clocksource(struct sh_tmu_priv *p,
 	cs->mask = CLOCKSOURCE_MASK(32);
 	cs->flags = CLOCK_SOURCE_IS_CONTINUOUS;
 
+	/* TCNT counts down, hence the XOR as in ->read() */
+	res = platform_get_resource(p->pdev, IORESOURCE_MEM, 0);
+	if (res)
+		arch_clocksource_user_counter(cs, res->start + (TCNT << 2),
+					      0xffffffff);
+
 	dev_info(&p->pdev->dev, "used as clock source\n");
 
 	/* Register with dummy 1 Hz value, gets updated in ->enable() */
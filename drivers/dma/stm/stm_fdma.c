@@ -81,6 +81,13 @@ static void stm_fdma_irq_complete(struct stm_fdma_chan *fchan)
 		goto err_inv;
 	}
 
+	/* Complete the descriptor now if the client asked for it */
+	if (test_bit(STM_FDMA_IRQ_CALLBACK, &fchan->flags)) {
+		spin_unlock_irqrestore(&fchan->lock, irqflags);
+		stm_fdma_desc_complete((unsigned long) fchan);
+		return;
+	}
+
 	/* Complete the descriptor */
 	tasklet_hi_schedule(&fchan->tasklet_complete);
 	spin_unlock_irqrestore(&fchan->lock, irqflags);
@@ -121,6 +128,7 @@ static irqreturn_t stm_fdma_irq_handler(int irq, void *dev_id)
 				state = STM_FDMA_STATE_ERROR;
 
 		if (status & 1 || state == STM_FDMA_STATE_ERROR) {
+			stm_fdma_latency_start(fchan);
 			fchan->state = state;
 			stm_fdma_irq_complete(fchan);
 			result = IRQ_HANDLED;
@@ -221,9 +229,7 @@ static int stm_fdma_alloc_chan_resources(struct dma_chan *chan)
 	struct stm_fdma_device *fdev = fchan->fdev;
 	struct stm_dma_paced_config *paced;
 	unsigned long irqflags = 0;
-	LIST_HEAD(list);
 	int result;
-	int i;
 
 	dev_dbg(fdev->dev, "%s(chan=%p)\n", __func__, chan);
 
@@ -293,22 +299,13 @@ static int stm_fdma_alloc_chan_resources(struct dma_chan *chan)
 		return -EINVAL;
 	}
 
-	/* Allocate descriptors to a temporary list */
-	for (i = 0; i < STM_FDMA_DESCRIPTORS; ++i) {
-		struct stm_fdma_desc *fdesc;
-
-		fdesc = stm_fdma_desc_alloc(fchan);
-		if (!fdesc) {
-			dev_err(fdev->dev, "Failed to allocate desc\n");
-			break;
-		}
-
-		list_add_tail(&fdesc->node, &list);
-	}
+	/* Preallocate the descriptor ring, any shortfall is met on demand */
+	result = stm_fdma_desc_ring_alloc(fchan);
+	if (result < 0)
+		result = 0;
 
 	spin_lock_irqsave(&fchan->lock, irqflags);
-	fchan->desc_count = i;
-	list_splice(&list, &fchan->desc_free);
+	fchan->desc_count = result;
 	fchan->last_completed = chan->cookie = 1;
 	spin_unlock_irqrestore(&fchan->lock, irqflags);
 
@@ -347,6 +344,12 @@ static void stm_fdma_free_chan_resources(struct dma_chan *chan)
 		stm_fdma_desc_free(fdesc);
 	}
 
+	/* Free the descriptor ring (after any lists that reference it) */
+	stm_fdma_desc_ring_free(fchan);
+
+	/* Completion callbacks return to the tasklet for the next client */
+	clear_bit(STM_FDMA_IRQ_CALLBACK, &fchan->flags);
+
 	/* Perform any channel configuration clean up */
 	switch (fchan->type) {
 	case STM_DMA_TYPE_FREE_RUNNING:
@@ -1041,6 +1044,34 @@ static void stm_fdma_issue_pending(struct dma_chan *chan)
 	spin_unlock_irqrestore(&fchan->lock, irqflags);
 }
 
+
+/*
+ * Channel extensions API
+ */
+
+/*
+ * Completion callbacks normally run from a high priority tasklet. A client
+ * whose callbacks are short and interrupt safe (e.g. one which just
+ * prepares and submits the next transfer) can have them called directly
+ * from the interrupt handler instead, removing the tasklet scheduling
+ * latency. This should be set before any transfers are submitted.
+ */
+int stm_dma_irq_callbacks(struct dma_chan *chan, int enable)
+{
+	struct stm_fdma_chan *fchan = to_stm_fdma_chan(chan);
+
+	dev_dbg(fchan->fdev->dev, "%s(fchan=%p, enable=%d)\n", __func__,
+			fchan, enable);
+
+	if (enable)
+		set_bit(STM_FDMA_IRQ_CALLBACK, &fchan->flags);
+	else
+		clear_bit(STM_FDMA_IRQ_CALLBACK, &fchan->flags);
+
+	return 0;
+}
+EXPORT_SYMBOL(stm_dma_irq_callbacks);
+
 void stm_fdma_parse_dt(struct platform_device *pdev,
 		struct stm_fdma_device *fdev)
 {
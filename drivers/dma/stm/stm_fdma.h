@@ -16,6 +16,7 @@
 
 #include <linux/clk.h>
 #include <linux/interrupt.h>
+#include <linux/ktime.h>
 #include <linux/dmaengine.h>
 #include <linux/libelf.h>
 #include <linux/stm/dma.h>
@@ -66,6 +67,7 @@ struct stm_fdma_dreq_router {
 
 #define STM_FDMA_IS_CYCLIC	1
 #define STM_FDMA_IS_PARKED	2
+#define STM_FDMA_IRQ_CALLBACK	3
 
 enum stm_fdma_state {
 	STM_FDMA_STATE_IDLE,
@@ -75,6 +77,16 @@ enum stm_fdma_state {
 	STM_FDMA_STATE_ERROR
 };
 
+/* Completion latency histogram, power of two buckets in microseconds */
+#define STM_FDMA_LATENCY_BUCKETS	16
+
+struct stm_fdma_latency {
+	ktime_t irq_time;
+	u32 count;
+	u32 max_us;
+	u32 hist[STM_FDMA_LATENCY_BUCKETS];
+};
+
 struct stm_fdma_desc;
 struct stm_fdma_device;
 
@@ -91,6 +103,10 @@ struct stm_fdma_chan {
 	dma_addr_t dma_addr;
 
 	u32 desc_count;
+	struct stm_fdma_desc *ring;
+	u32 ring_size;
+	u32 ring_next;
+	unsigned long *ring_map;
 	struct list_head desc_free;
 	struct list_head desc_queue;
 	struct list_head desc_active;
@@ -100,6 +116,10 @@ struct stm_fdma_chan {
 
 	dma_cookie_t last_completed;
 
+#ifdef CONFIG_STM_FDMA_LATENCY
+	struct stm_fdma_latency latency;
+#endif
+
 	void *extension;
 };
 
@@ -145,6 +165,7 @@ struct stm_fdma_device {
 	struct dentry *debug_dir;
 	struct dentry *debug_regs;
 	struct dentry *debug_dmem;
+	struct dentry *debug_latency;
 	struct dentry *debug_chans[STM_FDMA_NUM_CHANNELS];
 #endif
 };
@@ -154,7 +175,8 @@ struct stm_fdma_device {
  * FDMA descriptor specific
  */
 
-#define STM_FDMA_DESCRIPTORS	32
+#define STM_FDMA_DESCRIPTORS	64
+#define STM_FDMA_RING_MAX	512
 
 struct stm_fdma_desc {
 	struct list_head node;
@@ -214,11 +236,22 @@ void stm_fdma_debugfs_unregister(struct stm_fdma_device *fdev);
 
 #endif
 
+#ifdef CONFIG_STM_FDMA_LATENCY
+static inline void stm_fdma_latency_start(struct stm_fdma_chan *fchan)
+{
+	fchan->latency.irq_time = ktime_get();
+}
+#else
+#define stm_fdma_latency_start(f)	do { } while (0)
+#endif
+
 
 dma_cookie_t stm_fdma_tx_submit(struct dma_async_tx_descriptor *desc);
 
 struct stm_fdma_desc *stm_fdma_desc_alloc(struct stm_fdma_chan *fchan);
 void stm_fdma_desc_free(struct stm_fdma_desc *fdesc);
+int stm_fdma_desc_ring_alloc(struct stm_fdma_chan *fchan);
+void stm_fdma_desc_ring_free(struct stm_fdma_chan *fchan);
 struct stm_fdma_desc *stm_fdma_desc_get(struct stm_fdma_chan *fchan);
 void stm_fdma_desc_put(struct stm_fdma_desc *fdesc);
 void stm_fdma_desc_chain(struct stm_fdma_desc **head,
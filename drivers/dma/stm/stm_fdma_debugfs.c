@@ -12,6 +12,7 @@
 
 #include <linux/device.h>
 #include <linux/debugfs.h>
+#include <linux/uaccess.h>
 #include <linux/platform_device.h>
 
 #include <linux/stm/platform.h>
@@ -211,6 +212,80 @@ static const struct file_operations stm_fdma_debugfs_chan_fops = {
 };
 
 
+#ifdef CONFIG_STM_FDMA_LATENCY
+
+/*
+ * Debugfs latency file functions
+ */
+
+static int stm_fdma_debugfs_latency_show(struct seq_file *m, void *v)
+{
+	struct stm_fdma_device *fdev = m->private;
+	int c, i;
+
+	seq_printf(m, "--- %s interrupt to callback latency ---\n",
+			dev_name(fdev->dev));
+
+	for (c = STM_FDMA_MIN_CHANNEL; c <= STM_FDMA_MAX_CHANNEL; c++) {
+		struct stm_fdma_chan *fchan = &fdev->ch_list[c];
+		struct stm_fdma_latency *latency = &fchan->latency;
+
+		if (!latency->count)
+			continue;
+
+		seq_printf(m, "channel %d (%s): %u callbacks, max %uus\n",
+			c, test_bit(STM_FDMA_IRQ_CALLBACK, &fchan->flags) ?
+			"irq" : "tasklet", latency->count, latency->max_us);
+
+		for (i = 0; i < STM_FDMA_LATENCY_BUCKETS; i++) {
+			if (!latency->hist[i])
+				continue;
+
+			if (i < STM_FDMA_LATENCY_BUCKETS - 1)
+				seq_printf(m, "  < %6uus: %u\n", 1 << i,
+						latency->hist[i]);
+			else
+				seq_printf(m, "  >=%6uus: %u\n", 1 << (i - 1),
+						latency->hist[i]);
+		}
+	}
+
+	return 0;
+}
+
+static int stm_fdma_debugfs_latency_open(struct inode *inode,
+		struct file *file)
+{
+	return single_open(file, stm_fdma_debugfs_latency_show,
+			inode->i_private);
+}
+
+/* Any write clears the histograms */
+static ssize_t stm_fdma_debugfs_latency_write(struct file *file,
+		const char __user *buf, size_t count, loff_t *ppos)
+{
+	struct seq_file *m = file->private_data;
+	struct stm_fdma_device *fdev = m->private;
+	int c;
+
+	for (c = STM_FDMA_MIN_CHANNEL; c <= STM_FDMA_MAX_CHANNEL; c++)
+		memset(&fdev->ch_list[c].latency, 0,
+				sizeof(struct stm_fdma_latency));
+
+	return count;
+}
+
+static const struct file_operations stm_fdma_debugfs_latency_fops = {
+	.open		= stm_fdma_debugfs_latency_open,
+	.read		= seq_read,
+	.write		= stm_fdma_debugfs_latency_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+#endif
+
+
 /*
  * Device register/unregister and initialise/shutdown
  */
@@ -240,6 +315,13 @@ void stm_fdma_debugfs_register(struct stm_fdma_device *fdev)
 	if (!fdev->debug_dmem)
 		goto error_dmem_file;
 
+#ifdef CONFIG_STM_FDMA_LATENCY
+	/* Create entry for the completion latency histograms */
+	fdev->debug_latency = debugfs_create_file("latency",
+					S_IRUGO | S_IWUSR, fdev->debug_dir,
+					fdev, &stm_fdma_debugfs_latency_fops);
+#endif
+
 	/* Create a debugfs entry for each channel */
 	for (c = STM_FDMA_MIN_CHANNEL; c <= STM_FDMA_MAX_CHANNEL; c++) {
 		snprintf(name, sizeof(name), "channel%d", c);
@@ -261,6 +343,8 @@ error_chan_file:
 			fdev->debug_chans[c] = NULL;
 		}
 	}
+	debugfs_remove(fdev->debug_latency);
+	fdev->debug_latency = NULL;
 	debugfs_remove(fdev->debug_dmem);
 	fdev->debug_dmem = NULL;
 error_dmem_file:
@@ -283,6 +367,7 @@ void stm_fdma_debugfs_unregister(struct stm_fdma_device *fdev)
 	for (c = STM_FDMA_MIN_CHANNEL; c <= STM_FDMA_MAX_CHANNEL; c++)
 		debugfs_remove(fdev->debug_chans[c]);
 
+	debugfs_remove(fdev->debug_latency);
 	debugfs_remove(fdev->debug_dmem);
 	debugfs_remove(fdev->debug_regs);
 	debugfs_remove(fdev->debug_dir);
@@ -11,7 +11,9 @@
  */
 
 #include <linux/slab.h>
+#include <linux/bitops.h>
 #include <linux/device.h>
+#include <linux/module.h>
 #include <linux/dmapool.h>
 #include <linux/dma-mapping.h>
 
@@ -20,23 +22,48 @@
 #include "stm_fdma.h"
 
 
+/*
+ * Number of descriptors preallocated in each channel's ring. Transfers
+ * needing more nodes than are free in the ring fall back to descriptors
+ * allocated on demand.
+ */
+static unsigned int desc_ring = STM_FDMA_DESCRIPTORS;
+module_param(desc_ring, uint, S_IRUGO);
+MODULE_PARM_DESC(desc_ring, "Descriptors preallocated per channel");
+
+
 /*
  * Descriptor functions
  */
 
-struct stm_fdma_desc *stm_fdma_desc_alloc(struct stm_fdma_chan *fchan)
+static void stm_fdma_desc_init(struct stm_fdma_chan *fchan,
+		struct stm_fdma_desc *fdesc)
+{
+	fdesc->fchan = fchan;
+	INIT_LIST_HEAD(&fdesc->node);
+	INIT_LIST_HEAD(&fdesc->llu_list);
+
+	dma_async_tx_descriptor_init(&fdesc->dma_desc, &fchan->dma_chan);
+
+	/* Set ack bit to ensure descriptor is ready for use */
+	fdesc->dma_desc.flags = DMA_CTRL_ACK;
+	fdesc->dma_desc.tx_submit = stm_fdma_tx_submit;
+}
+
+static struct stm_fdma_desc *__stm_fdma_desc_alloc(
+		struct stm_fdma_chan *fchan, gfp_t gfp)
 {
 	struct stm_fdma_desc *fdesc;
 
 	/* Allocate the descriptor */
-	fdesc = kzalloc(sizeof(struct stm_fdma_desc), GFP_KERNEL);
+	fdesc = kzalloc(sizeof(struct stm_fdma_desc), gfp);
 	if (!fdesc) {
 		dev_err(fchan->fdev->dev, "Failed to alloc desc\n");
 		goto error_kzalloc;
 	}
 
 	/* Allocate the llu from the dma pool */
-	fdesc->llu = dma_pool_alloc(fchan->fdev->dma_pool, GFP_KERNEL,
+	fdesc->llu = dma_pool_alloc(fchan->fdev->dma_pool, gfp,
 			&fdesc->dma_desc.phys);
 	if (!fdesc->llu) {
 		dev_err(fchan->fdev->dev, "Failed to alloc from dma pool\n");
@@ -44,15 +71,7 @@ struct stm_fdma_desc *stm_fdma_desc_alloc(struct stm_fdma_chan *fchan)
 	}
 
 	/* Initialise the descriptor */
-	fdesc->fchan = fchan;
-	INIT_LIST_HEAD(&fdesc->node);
-	INIT_LIST_HEAD(&fdesc->llu_list);
-
-	dma_async_tx_descriptor_init(&fdesc->dma_desc, &fchan->dma_chan);
-
-	/* Set ack bit to ensure descriptor is ready for use */
-	fdesc->dma_desc.flags = DMA_CTRL_ACK;
-	fdesc->dma_desc.tx_submit = stm_fdma_tx_submit;
+	stm_fdma_desc_init(fchan, fdesc);
 
 	return fdesc;
 
@@ -62,10 +81,25 @@ error_kzalloc:
 	return NULL;
 }
 
+struct stm_fdma_desc *stm_fdma_desc_alloc(struct stm_fdma_chan *fchan)
+{
+	return __stm_fdma_desc_alloc(fchan, GFP_KERNEL);
+}
+
+static inline int stm_fdma_desc_in_ring(struct stm_fdma_chan *fchan,
+		struct stm_fdma_desc *fdesc)
+{
+	return fdesc >= fchan->ring && fdesc < fchan->ring + fchan->ring_size;
+}
+
 static void stm_fdma_desc_dealloc(struct stm_fdma_desc *fdesc)
 {
 	struct stm_fdma_device *fdev = fdesc->fchan->fdev;
 
+	/* Ring descriptors are only freed with the ring */
+	if (stm_fdma_desc_in_ring(fdesc->fchan, fdesc))
+		return;
+
 	/* Free the llu back to the dma pool and free the descriptor */
 	dma_pool_free(fdev->dma_pool, fdesc->llu, fdesc->dma_desc.phys);
 	kfree(fdesc);
@@ -85,10 +119,129 @@ void stm_fdma_desc_free(struct stm_fdma_desc *fdesc)
 	stm_fdma_desc_dealloc(fdesc);
 }
 
+/*
+ * Descriptor ring functions
+ *
+ * Each channel preallocates a fixed ring of descriptors when it is
+ * allocated. A bitmap tracks which are in use, so descriptors can be
+ * taken and returned with atomic bit operations instead of the channel
+ * lock. This matters when several busy channels prepare and complete
+ * transfers at interrupt rate.
+ */
+
+int stm_fdma_desc_ring_alloc(struct stm_fdma_chan *fchan)
+{
+	struct stm_fdma_device *fdev = fchan->fdev;
+	u32 size = min_t(u32, desc_ring, STM_FDMA_RING_MAX);
+	u32 i;
+
+	BUG_ON(fchan->ring);
+
+	if (!size)
+		return 0;
+
+	fchan->ring = kcalloc(size, sizeof(struct stm_fdma_desc), GFP_KERNEL);
+	fchan->ring_map = kcalloc(BITS_TO_LONGS(size), sizeof(unsigned long),
+			GFP_KERNEL);
+	if (!fchan->ring || !fchan->ring_map)
+		goto error_alloc;
+
+	for (i = 0; i < size; ++i) {
+		struct stm_fdma_desc *fdesc = &fchan->ring[i];
+
+		fdesc->llu = dma_pool_alloc(fdev->dma_pool, GFP_KERNEL,
+				&fdesc->dma_desc.phys);
+		if (!fdesc->llu)
+			goto error_alloc;
+
+		stm_fdma_desc_init(fchan, fdesc);
+		fchan->ring_size++;
+	}
+
+	fchan->ring_next = 0;
+
+	return fchan->ring_size;
+
+error_alloc:
+	dev_err(fdev->dev, "Failed to alloc descriptor ring\n");
+	stm_fdma_desc_ring_free(fchan);
+	return -ENOMEM;
+}
+
+void stm_fdma_desc_ring_free(struct stm_fdma_chan *fchan)
+{
+	struct stm_fdma_device *fdev = fchan->fdev;
+	u32 i;
+
+	for (i = 0; i < fchan->ring_size; ++i)
+		dma_pool_free(fdev->dma_pool, fchan->ring[i].llu,
+				fchan->ring[i].dma_desc.phys);
+
+	kfree(fchan->ring_map);
+	kfree(fchan->ring);
+
+	fchan->ring = NULL;
+	fchan->ring_map = NULL;
+	fchan->ring_size = 0;
+}
+
+static struct stm_fdma_desc *stm_fdma_desc_ring_get(
+		struct stm_fdma_chan *fchan)
+{
+	u32 size = fchan->ring_size;
+	u32 i;
+
+	if (!size)
+		return NULL;
+
+	/*
+	 * Search from the slot after the last one taken, so the nodes of a
+	 * transfer are usually adjacent. The hint is updated without any
+	 * locking, a stale value only costs a longer search.
+	 */
+	i = find_next_zero_bit(fchan->ring_map, size, fchan->ring_next);
+	if (i >= size)
+		i = find_first_zero_bit(fchan->ring_map, size);
+
+	while (i < size) {
+		if (!test_and_set_bit(i, fchan->ring_map)) {
+			fchan->ring_next = (i + 1 < size) ? i + 1 : 0;
+			return &fchan->ring[i];
+		}
+
+		/* Lost a race for this slot, try the next one */
+		i = find_next_zero_bit(fchan->ring_map, size, i + 1);
+	}
+
+	return NULL;
+}
+
+/*
+ * Return a single descriptor to the ring, or add it to a list if it was
+ * allocated on demand. Must not be called for a descriptor still in use.
+ */
+static void stm_fdma_desc_release(struct stm_fdma_chan *fchan,
+		struct stm_fdma_desc *fdesc, struct list_head *list)
+{
+	if (stm_fdma_desc_in_ring(fchan, fdesc)) {
+		list_del_init(&fdesc->node);
+		smp_mb__before_clear_bit();
+		clear_bit(fdesc - fchan->ring, fchan->ring_map);
+	} else {
+		list_move_tail(&fdesc->node, list);
+	}
+}
+
 struct stm_fdma_desc *stm_fdma_desc_get(struct stm_fdma_chan *fchan)
 {
 	struct stm_fdma_desc *fdesc = NULL, *tdesc, *_tdesc;
 	unsigned long irqflags = 0;
+	LIST_HEAD(list);
+
+	/* Take a descriptor from the ring (no locking required) */
+	fdesc = stm_fdma_desc_ring_get(fchan);
+	if (fdesc)
+		goto init;
 
 	/*
 	 * Search the free list for the next available descriptor. Only those
@@ -101,9 +254,8 @@ struct stm_fdma_desc *stm_fdma_desc_get(struct stm_fdma_chan *fchan)
 	 * re-submitted, it is moved to the free list as a single complete
 	 * transfer entity.
 	 *
-	 * When the transfer is finally ACKed, the only time we can move the
-	 * llu_list to the free list is when getting the next available
-	 * descriptor.
+	 * When the transfer is finally ACKed, the only time we can release
+	 * the llu_list is when getting the next available descriptor.
 	 */
 
 	spin_lock_irqsave(&fchan->lock, irqflags);
@@ -112,8 +264,8 @@ struct stm_fdma_desc *stm_fdma_desc_get(struct stm_fdma_chan *fchan)
 	list_for_each_entry_safe(tdesc, _tdesc, &fchan->desc_free, node) {
 		/* If descriptor has been ACKed then remove from free list */
 		if (async_tx_test_ack(&tdesc->dma_desc)) {
-			/* Add llu_list to free list in case not empty */
-			list_splice_init(&tdesc->llu_list, &fchan->desc_free);
+			/* Release the llu_list in case not empty */
+			list_splice_init(&tdesc->llu_list, &list);
 			list_del_init(&tdesc->node);
 			fdesc = tdesc;
 			break;
@@ -121,12 +273,19 @@ struct stm_fdma_desc *stm_fdma_desc_get(struct stm_fdma_chan *fchan)
 		dev_dbg(fchan->fdev->dev, "Descriptor %p not ACKed\n", tdesc);
 	}
 
-	if (!fdesc) {
-		spin_unlock_irqrestore(&fchan->lock, irqflags);
+	spin_unlock_irqrestore(&fchan->lock, irqflags);
 
-		/* No descriptors available, attempt to allocate a new one */
+	list_for_each_entry_safe(tdesc, _tdesc, &list, node)
+		stm_fdma_desc_put(tdesc);
+
+	if (!fdesc) {
+		/*
+		 * No descriptors available, attempt to allocate a new one.
+		 * Transfers may be prepared from a completion callback, so
+		 * this must not sleep.
+		 */
 		dev_dbg(fchan->fdev->dev, "Allocating a new descriptor\n");
-		fdesc = stm_fdma_desc_alloc(fchan);
+		fdesc = __stm_fdma_desc_alloc(fchan, GFP_NOWAIT);
 		if (!fdesc) {
 			dev_err(fchan->fdev->dev, "Not enough descriptors\n");
 			return NULL;
@@ -135,13 +294,14 @@ struct stm_fdma_desc *stm_fdma_desc_get(struct stm_fdma_chan *fchan)
 		/* Increment number of descriptors allocated */
 		spin_lock_irqsave(&fchan->lock, irqflags);
 		fchan->desc_count++;
+		spin_unlock_irqrestore(&fchan->lock, irqflags);
 	}
 
-	spin_unlock_irqrestore(&fchan->lock, irqflags);
-
+init:
 	/* Re-initialise the descriptor */
 	memset(fdesc->llu, 0, sizeof(struct stm_fdma_llu));
 	INIT_LIST_HEAD(&fdesc->llu_list);
+	fdesc->dma_desc.flags = DMA_CTRL_ACK;
 	fdesc->dma_desc.cookie = 0;
 	fdesc->dma_desc.callback = NULL;
 	fdesc->dma_desc.callback_param = NULL;
@@ -152,16 +312,36 @@ struct stm_fdma_desc *stm_fdma_desc_get(struct stm_fdma_chan *fchan)
 
 void stm_fdma_desc_put(struct stm_fdma_desc *fdesc)
 {
-	if (fdesc) {
-		struct stm_fdma_chan *fchan = fdesc->fchan;
-		unsigned long irqflags = 0;
+	struct stm_fdma_desc *child, *_child;
+	struct stm_fdma_chan *fchan;
+	unsigned long irqflags = 0;
+	LIST_HEAD(list);
+
+	if (!fdesc)
+		return;
+
+	fchan = fdesc->fchan;
 
+	/*
+	 * A transfer which has not been ACKed may still be re-submitted by
+	 * the client, so it is kept intact on the free list until it is.
+	 */
+	if (!async_tx_test_ack(&fdesc->dma_desc)) {
 		spin_lock_irqsave(&fchan->lock, irqflags);
+		list_move(&fdesc->node, &fchan->desc_free);
+		spin_unlock_irqrestore(&fchan->lock, irqflags);
+		return;
+	}
 
-		/* Move all linked descriptors to the free list */
-		list_splice_init(&fdesc->llu_list, &fchan->desc_free);
-		list_add(&fdesc->node, &fchan->desc_free);
+	/* Return ring descriptors straight to the ring */
+	list_for_each_entry_safe(child, _child, &fdesc->llu_list, node)
+		stm_fdma_desc_release(fchan, child, &list);
+	stm_fdma_desc_release(fchan, fdesc, &list);
 
+	/* Move all other descriptors to the free list */
+	if (!list_empty(&list)) {
+		spin_lock_irqsave(&fchan->lock, irqflags);
+		list_splice(&list, &fchan->desc_free);
 		spin_unlock_irqrestore(&fchan->lock, irqflags);
 	}
 }
@@ -240,11 +420,35 @@ void stm_fdma_desc_unmap_buffers(struct stm_fdma_desc *fdesc)
 	}
 }
 
+#ifdef CONFIG_STM_FDMA_LATENCY
+static void stm_fdma_latency_record(struct stm_fdma_chan *fchan)
+{
+	struct stm_fdma_latency *latency = &fchan->latency;
+	s64 delta = ktime_us_delta(ktime_get(), latency->irq_time);
+	u32 us = clamp_t(s64, delta, 0, UINT_MAX);
+	int bucket = min(fls(us), STM_FDMA_LATENCY_BUCKETS - 1);
+
+	latency->hist[bucket]++;
+	latency->count++;
+	if (us > latency->max_us)
+		latency->max_us = us;
+}
+#else
+#define stm_fdma_latency_record(f)	do { } while (0)
+#endif
+
+/*
+ * Called from the completion tasklet, or directly from the interrupt
+ * handler for channels with interrupt callbacks enabled.
+ */
 void stm_fdma_desc_complete(unsigned long data)
 {
 	struct stm_fdma_chan *fchan = (struct stm_fdma_chan *) data;
 	struct stm_fdma_desc *fdesc = NULL;
+	dma_async_tx_callback callback;
+	void *callback_param;
 	unsigned long irqflags = 0;
+	int release = 0;
 
 	dev_dbg(fchan->fdev->dev, "%s(data=%08lx)\n", __func__, data);
 
@@ -267,6 +471,10 @@ void stm_fdma_desc_complete(unsigned long data)
 	fdesc = list_first_entry(&fchan->desc_active, struct stm_fdma_desc,
 			node);
 
+	/* The descriptor may be re-used as soon as it is released */
+	callback = fdesc->dma_desc.callback;
+	callback_param = fdesc->dma_desc.callback_param;
+
 	/* Process a non-cyclic descriptor */
 	if (!test_bit(STM_FDMA_IS_CYCLIC, &fchan->flags)) {
 		/* Remove non-cyclic descriptor from head of active list */
@@ -290,28 +498,31 @@ void stm_fdma_desc_complete(unsigned long data)
 
 		/*
 		 * If the transfer has been ACKed, then all individual
-		 * descriptors that make up the transfer can be moved to the
-		 * free list. If the transfer has not been ACKed, then it is
-		 * possible that it will be re-used, in which case the transfer
-		 * should be moved to the free list as-is.
+		 * descriptors that make up the transfer can be released. If
+		 * the transfer has not been ACKed, then it is possible that it
+		 * will be re-used, in which case the transfer should be moved
+		 * to the free list as-is.
 		 *
 		 * Until the ACK bit is set, the descriptor will not be re-used.
 		 * When the ACK bit is eventually set, and the descriptor is
 		 * about to be re-used, if the llu_list is not empty, the
-		 * llu_list will be added to the free list.
+		 * llu_list will be released.
 		 */
-
-		/* Move the llu_list to the free list only if desriptor ACKed */
 		if (fdesc->dma_desc.flags & DMA_CTRL_ACK)
-			list_splice_init(&fdesc->llu_list, &fchan->desc_free);
-
-		/* Move the descriptor to the free list (regardless of ACK) */
-		list_move(&fdesc->node, &fchan->desc_free);
+			release = 1;
+		else
+			list_add(&fdesc->node, &fchan->desc_free);
 	}
 
 	spin_unlock_irqrestore(&fchan->lock, irqflags);
 
+	/* Release before the callback so it can prepare the next transfer */
+	if (release)
+		stm_fdma_desc_put(fdesc);
+
 	/* Issue callback */
-	if (fdesc->dma_desc.callback)
-		fdesc->dma_desc.callback(fdesc->dma_desc.callback_param);
+	if (callback) {
+		stm_fdma_latency_record(fchan);
+		callback(callback_param);
+	}
 }
@@ -22,6 +22,11 @@
 #include <linux/mtd/mtd.h>
 #include <linux/mtd/partitions.h>
 #include <linux/of.h>
+#include <linux/completion.h>
+#include <linux/scatterlist.h>
+#include <linux/dma-mapping.h>
+#include <linux/ktime.h>
+#include <linux/stm/dma.h>
 
 #include <asm/div64.h>
 
@@ -39,6 +44,14 @@
 #define FLASH_MAX_STA_WRITE_MS	4000		/* Write status reg time */
 #define FSM_MAX_WAIT_SEQ_MS	1000		/* FSM execution time */
 
+/* FDMA read path */
+#define FSM_DMA_MAX_CHUNK	(64 * 1024)	/* Max bytes per FSM sequence */
+
+static unsigned int dma_read_threshold = 4096;
+module_param(dma_read_threshold, uint, 0644);
+MODULE_PARM_DESC(dma_read_threshold,
+		 "Minimum read size (bytes) to use FDMA (0: PIO only)");
+
 /*
  * Flags to tweak operation of default read/write/erase/lock routines
  */
@@ -87,6 +100,20 @@ struct stm_spi_fsm {
 	struct clk		*clk;
 	struct mutex		lock;
 	unsigned		partitioned;
+
+	/* FDMA read path */
+	struct dma_chan		*dma_chan;
+	struct stm_dma_paced_config dma_config;
+	struct completion	dma_done;
+	resource_size_t		fifo_phys;
+
+	/* Read throughput counters */
+	uint64_t		pio_read_bytes;
+	uint64_t		pio_read_ns;
+	uint64_t		dma_read_bytes;
+	uint64_t		dma_read_ns;
+	unsigned long		dma_read_fallbacks;
+
 	uint8_t	page_buf[FLASH_PAGESIZE]__aligned(4);
 };
 
@@ -2517,6 +2544,121 @@ static int fsm_read(struct stm_spi_fsm *fsm, uint8_t *const buf,
 	return 0;
 }
 
+static void fsm_dma_complete(void *param)
+{
+	struct stm_spi_fsm *fsm = param;
+
+	complete(&fsm->dma_done);
+}
+
+/*
+ * Recover from an aborted DMA read: drain whatever the sequence still pushes
+ * into the FIFO, then clear any trailing bytes.
+ */
+static void fsm_dma_abort(struct stm_spi_fsm *fsm)
+{
+	unsigned long deadline = jiffies +
+		msecs_to_jiffies(FSM_MAX_WAIT_SEQ_MS);
+	uint32_t words;
+
+	dmaengine_terminate_all(fsm->dma_chan);
+
+	while (!fsm_is_idle(fsm) && time_before(jiffies, deadline)) {
+		words = fsm_fifo_available(fsm);
+		while (words--)
+			readl(fsm->base + SPI_FAST_SEQ_DATA_REG);
+	}
+
+	fsm_clear_fifo(fsm);
+}
+
+/*
+ * Read using the FDMA to drain the FIFO.  'buf' must be cache-line aligned
+ * lowmem, and 'size' a multiple of the cache-line size (which also satisfies
+ * the 32-cycle read granularity).  Returns 0 on success, in which case the
+ * data is in 'buf', or an error, in which case the caller should fall back to
+ * PIO.
+ */
+static int fsm_read_dma(struct stm_spi_fsm *fsm, uint8_t *const buf,
+			const uint32_t size, const uint32_t offset)
+{
+	struct fsm_seq *seq = &fsm_seq_read;
+	struct dma_async_tx_descriptor *desc;
+	struct scatterlist sg;
+	int ret = 0;
+
+	dev_dbg(fsm->dev, "DMA reading %d bytes from 0x%08x\n", size, offset);
+
+	BUG_ON(((uint32_t)buf & (L1_CACHE_BYTES - 1)) ||
+	       (size & (L1_CACHE_BYTES - 1)));
+
+	sg_init_one(&sg, buf, size);
+	if (!dma_map_sg(fsm->dev, &sg, 1, DMA_FROM_DEVICE))
+		return -ENOMEM;
+
+	desc = dmaengine_prep_slave_sg(fsm->dma_chan, &sg, 1, DMA_DEV_TO_MEM,
+				       DMA_PREP_INTERRUPT);
+	if (!desc) {
+		ret = -EBUSY;
+		goto out_unmap;
+	}
+
+	desc->callback = fsm_dma_complete;
+	desc->callback_param = fsm;
+
+	INIT_COMPLETION(fsm->dma_done);
+	dmaengine_submit(desc);
+	dma_async_issue_pending(fsm->dma_chan);
+
+	/* Enter 32-bit address mode, if required */
+	if (fsm->configuration & CFG_READ_TOGGLE32BITADDR)
+		fsm_enter_32bitaddr(fsm, 1);
+
+	seq->data_size = TRANSFER_SIZE(size);
+	seq->addr1 = (offset >> 16) & 0xffff;
+	seq->addr2 = offset & 0xffff;
+
+	fsm_load_seq(fsm, seq);
+
+	if (!wait_for_completion_timeout(&fsm->dma_done,
+				msecs_to_jiffies(FSM_MAX_WAIT_SEQ_MS))) {
+		dev_err(fsm->dev, "timeout on DMA read completion\n");
+		fsm_dma_abort(fsm);
+		ret = -ETIMEDOUT;
+	} else {
+		/* Wait for sequence to finish */
+		fsm_wait_seq(fsm);
+	}
+
+	/* Exit 32-bit address mode, if required */
+	if (fsm->configuration & CFG_READ_TOGGLE32BITADDR)
+		fsm_enter_32bitaddr(fsm, 0);
+
+ out_unmap:
+	dma_unmap_sg(fsm->dev, &sg, 1, DMA_FROM_DEVICE);
+
+	return ret;
+}
+
+/* Number of bytes, from the start of 'buf', suitable for a DMA read */
+static uint32_t fsm_read_dma_len(struct stm_spi_fsm *fsm,
+				 const uint8_t *buf, size_t len)
+{
+	uint32_t bytes;
+
+	if (!fsm->dma_chan || !dma_read_threshold || len < dma_read_threshold)
+		return 0;
+
+	if (((uint32_t)buf & (L1_CACHE_BYTES - 1)) || !virt_addr_valid(buf))
+		return 0;
+
+	bytes = min_t(size_t, len, FSM_DMA_MAX_CHUNK) & ~(L1_CACHE_BYTES - 1);
+	if (!bytes || !virt_addr_valid(buf + bytes - 1))
+		return 0;
+
+	return bytes;
+}
+
 static int fsm_write(struct stm_spi_fsm *fsm, const uint8_t *const buf,
 		     const uint32_t size, const uint32_t offset)
 {
@@ -2918,6 +3060,7 @@ static int fsm_mtd_read(struct mtd_info *mtd, loff_t from, size_t len,
 {
 	struct stm_spi_fsm *fsm = mtd->priv;
 	uint32_t bytes;
+	ktime_t start;
 
 	dev_dbg(fsm->dev, "%s %s 0x%08x, len %zd\n",  __func__,
 		"from", (u32)from, len);
@@ -2935,10 +3078,26 @@ static int fsm_mtd_read(struct mtd_info *mtd, loff_t from, size_t len,
 	mutex_lock(&fsm->lock);
 
 	while (len > 0) {
+		start = ktime_get();
+
+		bytes = fsm_read_dma_len(fsm, buf, len);
+		if (bytes) {
+			if (fsm_read_dma(fsm, buf, bytes, from) == 0) {
+				fsm->dma_read_bytes += bytes;
+				fsm->dma_read_ns += ktime_to_ns(
+					ktime_sub(ktime_get(), start));
+				goto next;
+			}
+			fsm->dma_read_fallbacks++;
+		}
+
 		bytes = min(len, (size_t)FLASH_PAGESIZE);
 
 		fsm_read(fsm, buf, bytes, from);
 
+		fsm->pio_read_bytes += bytes;
+		fsm->pio_read_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+ next:
 		buf += bytes;
 		from += bytes;
 		len -= bytes;
@@ -3250,6 +3409,12 @@ static void *stm_fsm_dt_get_pdata(struct platform_device *pdev)
 	if (sc)
 		sysconf_release(sc);
 
+	of_property_read_string(np, "fdma-name", &data->fdma_name);
+	of_property_read_u32(np, "fdma-initiator", &data->fdma_initiator);
+	of_property_read_u32(np, "fdma-direct-conn", &data->fdma_direct_conn);
+	of_property_read_u32(np, "fdma-request-line",
+			     &data->fdma_request_line);
+
 	return data;
 }
 #else
@@ -3259,6 +3424,139 @@ static void *stm_fsm_dt_get_pdata(struct platform_device *pdev)
 }
 #endif
 
+/*
+ * FDMA read path setup
+ */
+static bool fsm_dma_filter_fn(struct dma_chan *chan, void *fn_param)
+{
+	struct stm_spi_fsm *fsm = fn_param;
+	struct stm_plat_spifsm_data *data = fsm->dev->platform_data;
+	struct stm_dma_paced_config *config = &fsm->dma_config;
+
+	/* If FDMA name has been specified, attempt to match channel to it */
+	if (data->fdma_name && !stm_dma_is_fdma_name(chan, data->fdma_name))
+		return false;
+
+	/* Paced by the FSM data FIFO */
+	config->type = STM_DMA_TYPE_PACED;
+	config->dma_addr = fsm->fifo_phys;
+	config->dreq_config.request_line = data->fdma_request_line;
+	config->dreq_config.direct_conn = data->fdma_direct_conn;
+	config->dreq_config.initiator = data->fdma_initiator;
+	config->dreq_config.increment = 0;
+	config->dreq_config.hold_off = 0;
+	config->dreq_config.maxburst = 1;
+	config->dreq_config.buswidth = DMA_SLAVE_BUSWIDTH_4_BYTES;
+	config->dreq_config.direction = DMA_DEV_TO_MEM;
+
+	chan->private = config;
+
+	return true;
+}
+
+static void __devinit fsm_dma_init(struct stm_spi_fsm *fsm,
+				   struct stm_plat_spifsm_data *data)
+{
+	struct dma_slave_config slave_config;
+	dma_cap_mask_t mask;
+
+	if (!data->fdma_request_line)
+		return;
+
+	init_completion(&fsm->dma_done);
+
+	dma_cap_zero(mask);
+	dma_cap_set(DMA_SLAVE, mask);
+
+	fsm->dma_chan = dma_request_channel(mask, fsm_dma_filter_fn, fsm);
+	if (!fsm->dma_chan) {
+		dev_warn(fsm->dev, "failed to request FDMA channel, using PIO\n");
+		return;
+	}
+
+	memset(&slave_config, 0, sizeof(slave_config));
+	slave_config.direction = DMA_DEV_TO_MEM;
+	slave_config.src_addr = fsm->fifo_phys;
+	slave_config.src_addr_width = DMA_SLAVE_BUSWIDTH_4_BYTES;
+	slave_config.src_maxburst = 1;
+
+	if (dmaengine_slave_config(fsm->dma_chan, &slave_config)) {
+		dev_warn(fsm->dev, "failed to configure FDMA channel, using PIO\n");
+		dma_release_channel(fsm->dma_chan);
+		fsm->dma_chan = NULL;
+		return;
+	}
+
+	dev_info(fsm->dev, "using FDMA '%s' channel %d for reads\n",
+		 dev_name(fsm->dma_chan->device->dev), fsm->dma_chan->chan_id);
+}
+
+static void fsm_dma_exit(struct stm_spi_fsm *fsm)
+{
+	if (!fsm->dma_chan)
+		return;
+
+	dmaengine_terminate_all(fsm->dma_chan);
+	dma_release_channel(fsm->dma_chan);
+	fsm->dma_chan = NULL;
+}
+
+/*
+ * Read throughput counters (write anything to reset)
+ */
+static uint64_t fsm_kibps(uint64_t bytes, uint64_t ns)
+{
+	uint64_t us = div64_u64(ns, 1000);
+
+	return us ? div64_u64((bytes >> 10) * 1000000, us) : 0;
+}
+
+static ssize_t fsm_read_stats_show(struct device *dev,
+				   struct device_attribute *attr, char *buf)
+{
+	struct stm_spi_fsm *fsm = dev_get_drvdata(dev);
+	uint64_t pio_bytes, pio_ns, dma_bytes, dma_ns;
+	unsigned long fallbacks;
+
+	mutex_lock(&fsm->lock);
+	pio_bytes = fsm->pio_read_bytes;
+	pio_ns = fsm->pio_read_ns;
+	dma_bytes = fsm->dma_read_bytes;
+	dma_ns = fsm->dma_read_ns;
+	fallbacks = fsm->dma_read_fallbacks;
+	mutex_unlock(&fsm->lock);
+
+	return sprintf(buf,
+		       "pio: %llu bytes, %llu us, %llu KiB/s\n"
+		       "dma: %llu bytes, %llu us, %llu KiB/s\n"
+		       "dma fallbacks: %lu\n",
+		       pio_bytes, div64_u64(pio_ns, 1000),
+		       fsm_kibps(pio_bytes, pio_ns),
+		       dma_bytes, div64_u64(dma_ns, 1000),
+		       fsm_kibps(dma_bytes, dma_ns),
+		       fallbacks);
+}
+
+static ssize_t fsm_read_stats_store(struct device *dev,
+				    struct device_attribute *attr,
+				    const char *buf, size_t count)
+{
+	struct stm_spi_fsm *fsm = dev_get_drvdata(dev);
+
+	mutex_lock(&fsm->lock);
+	fsm->pio_read_bytes = 0;
+	fsm->pio_read_ns = 0;
+	fsm->dma_read_bytes = 0;
+	fsm->dma_read_ns = 0;
+	fsm->dma_read_fallbacks = 0;
+	mutex_unlock(&fsm->lock);
+
+	return count;
+}
+
+static DEVICE_ATTR(read_stats, S_IRUGO | S_IWUSR,
+		   fsm_read_stats_show, fsm_read_stats_store);
+
 /*
  * STM SPI FSM driver setup
  */
@@ -3306,6 +3604,7 @@ static int __devinit stm_spi_fsm_probe(struct platform_device *pdev)
 	}
 
 	fsm->base = ioremap_nocache(resource->start, resource_size(resource));
+	fsm->fifo_phys = resource->start + SPI_FAST_SEQ_DATA_REG;
 
 	if (!fsm->base) {
 		dev_err(&pdev->dev, "failed to ioremap [0x%08x]\n",
@@ -3396,6 +3695,12 @@ static int __devinit stm_spi_fsm_probe(struct platform_device *pdev)
 
 	platform_set_drvdata(pdev, fsm);
 
+	/* Optional FDMA bulk read path */
+	fsm_dma_init(fsm, data);
+
+	if (device_create_file(&pdev->dev, &dev_attr_read_stats))
+		dev_warn(&pdev->dev, "failed to create read_stats attribute\n");
+
 	/* Set operating frequency, from table or overridden by platform data */
 	if (data->max_freq)
 		fsm_set_freq(fsm, data->max_freq);
@@ -3455,6 +3760,8 @@ static int __devinit stm_spi_fsm_probe(struct platform_device *pdev)
 	if (!ret)
 		return 0;
 
+	device_remove_file(&pdev->dev, &dev_attr_read_stats);
+	fsm_dma_exit(fsm);
  out5:
 	fsm_exit(fsm);
 	platform_set_drvdata(pdev, NULL);
@@ -3480,6 +3787,8 @@ static int __devexit stm_spi_fsm_remove(struct platform_device *pdev)
 	if (err)
 		return err;
 
+	device_remove_file(&pdev->dev, &dev_attr_read_stats);
+	fsm_dma_exit(fsm);
 	fsm_exit(fsm);
 	if (fsm->pad_state)
 		stm_pad_release(fsm->pad_state);
@@ -47,6 +47,17 @@
 #define NANDI_BCH_MAX_BUF_LIST			8
 #define NANDI_BCH_BUF_LIST_SIZE			(4 * NANDI_BCH_MAX_BUF_LIST)
 
+/* Queued erase/program operations, each with its own DMA-aligned buffer
+ * list */
+#define NANDI_BCH_MAX_QUEUE			8
+#define NANDI_BCH_BUF_LIST_STRIDE		ALIGN(NANDI_BCH_BUF_LIST_SIZE, \
+						      NANDI_BCH_DMA_ALIGNMENT)
+
+static int bch_queue_depth = NANDI_BCH_MAX_QUEUE;
+module_param(bch_queue_depth, int, 0644);
+MODULE_PARM_DESC(bch_queue_depth, "Erase/program operations chained per "
+		 "BCH sequence (1 to 8, default: 8)");
+
 /* BCH ECC sizes */
 static int bch_ecc_sizes[] = {
 	[BCH_18BIT_ECC] = 32,
@@ -119,6 +130,32 @@ struct nandi_info {
 	struct	mtd_partition	*parts;		/* MTD partitions */
 };
 
+/* BCH 'program' structure */
+struct bch_prog {
+	u32	multi_cs_addr[3];
+	u32	multi_cs_config;
+	u8	seq[16];
+	u32	addr;
+	u32	extra;
+	u8	cmd[4];
+	u32	reserved1;
+	u32	gen_cfg;
+	u32	delay;
+	u32	reserved2;
+	u32	seq_cfg;
+};
+
+/* Queue of BCH programs chained back-to-back from the SEQ Over interrupt */
+struct bch_queue {
+	struct bch_prog		prog[NANDI_BCH_MAX_QUEUE];
+	unsigned long		buf_phys[NANDI_BCH_MAX_QUEUE];
+	uint8_t			status[NANDI_BCH_MAX_QUEUE];
+	unsigned long		list_phys;	/* Buffer lists, one per op */
+	int			nr_ops;
+	int			done;		/* Operations completed */
+	int			active;		/* Chaining from IRQ */
+};
+
 /* NANDi Controller (Hamming/BCH) */
 struct nandi_controller {
 	void __iomem		*base;		/* Controller base*/
@@ -153,6 +190,10 @@ struct nandi_controller {
 	uint8_t			*page_buf;
 	uint8_t			*oob_buf;
 	uint32_t		*buf_list;
+	uint8_t			*queue_buf;	/* Bounce buffer for queued
+						 *  writes (optional) */
+
+	struct bch_queue	queue;
 
 	int			cached_page;	/* page number of page in
 						 *  'page_buf' */
@@ -160,21 +201,6 @@ struct nandi_controller {
 	struct nandi_info	info;		/* NAND device info */
 };
 
-/* BCH 'program' structure */
-struct bch_prog {
-	u32	multi_cs_addr[3];
-	u32	multi_cs_config;
-	u8	seq[16];
-	u32	addr;
-	u32	extra;
-	u8	cmd[4];
-	u32	reserved1;
-	u32	gen_cfg;
-	u32	delay;
-	u32	reserved2;
-	u32	seq_cfg;
-};
-
 /* BCH template programs (modified on-the-fly) */
 static struct bch_prog bch_prog_read_page = {
 	.cmd = {
@@ -194,6 +220,31 @@ static struct bch_prog bch_prog_read_page = {
 	.seq_cfg = SEQ_CFG_GO_STOP,
 };
 
+/* Multi-page read: the sequencer repeats the page read, stepping the page
+ * address and moving on to the next buffer list entry on each pass, while
+ * ECC_SCORE latches one score byte per pass into ECC_SCORE_REG_A/B.  The
+ * repeat count is set on-the-fly, and bounded by the buffer list size.
+ */
+static struct bch_prog bch_prog_read_pages = {
+	.cmd = {
+		NAND_CMD_READ0,
+		NAND_CMD_READSTART,
+	},
+	.seq = {
+		BCH_ECC_SCORE(0),
+		BCH_CMD_ADDR,
+		BCH_CL_CMD_1,
+		BCH_DATA_2_SECTOR,
+		BCH_INC(0),
+		BCH_DEC_JUMP(0),
+		BCH_STOP,
+	},
+	.gen_cfg = (GEN_CFG_DATA_8_NOT_16 |
+		    GEN_CFG_EXTRA_ADD_CYCLE |
+		    GEN_CFG_LAST_SEQ_NODE),
+	.seq_cfg = SEQ_CFG_GO_STOP,
+};
+
 static struct bch_prog bch_prog_write_page = {
 	.cmd = {
 		NAND_CMD_SEQIN,
@@ -249,10 +300,12 @@ static void bch_configure_progs(struct nandi_controller *nandi)
 
 	/* Set 'DATA' instruction */
 	bch_prog_read_page.seq[3] = data_instr;
+	bch_prog_read_pages.seq[3] = data_instr;
 	bch_prog_write_page.seq[1] = data_instr;
 
 	/* Set ECC mode */
 	bch_prog_read_page.gen_cfg |= gen_cfg_ecc;
+	bch_prog_read_pages.gen_cfg |= gen_cfg_ecc;
 	bch_prog_write_page.gen_cfg |= gen_cfg_ecc;
 	bch_prog_erase_block.gen_cfg |= gen_cfg_ecc;
 
@@ -263,6 +316,7 @@ static void bch_configure_progs(struct nandi_controller *nandi)
 	if (!nandi->extra_addr) {
 		/* Clear 'GEN_CFG_EXTRA_ADD_CYCLE' flag */
 		bch_prog_read_page.gen_cfg &= ~GEN_CFG_EXTRA_ADD_CYCLE;
+		bch_prog_read_pages.gen_cfg &= ~GEN_CFG_EXTRA_ADD_CYCLE;
 		bch_prog_write_page.gen_cfg &= ~GEN_CFG_EXTRA_ADD_CYCLE;
 		bch_prog_erase_block.gen_cfg &= ~GEN_CFG_EXTRA_ADD_CYCLE;
 
@@ -282,6 +336,8 @@ static void bch_configure_progs(struct nandi_controller *nandi)
 /*
  * NANDi Interrupts (shared by Hamming and BCH controllers)
  */
+static int bch_queue_next(struct nandi_controller *nandi);
+
 static irqreturn_t nandi_irq_handler(int irq, void *dev)
 {
 	struct nandi_controller *nandi = dev;
@@ -293,7 +349,8 @@ static irqreturn_t nandi_irq_handler(int irq, void *dev)
 		/* BCH */
 		writel(NANDBCH_INT_CLR_SEQNODESOVER,
 		       nandi->base + NANDBCH_INT_CLR);
-		complete(&nandi->seq_completed);
+		if (!nandi->queue.active || !bch_queue_next(nandi))
+			complete(&nandi->seq_completed);
 	}
 	if (status & NAND_INT_RBN) {
 		/* Hamming */
@@ -406,6 +463,29 @@ static int check_erased_page(uint8_t *data, uint32_t page_size, int max_zeros)
 	return zeros;
 }
 
+/* Convert a page ECC score into the number of ECC errors, or '-1' for
+ * uncorrectable error */
+static int bch_page_ecc_errs(struct nandi_controller *nandi,
+			     uint32_t ecc_err, uint8_t *buf)
+{
+	int ret;
+
+	if (ecc_err == 0xff) {
+		/* Downgrade uncorrectable ECC error for an erased page,
+		 * tolerating 'sectors_per_page' bits at zero.
+		 */
+		ret = check_erased_page(buf, nandi->info.mtd.writesize,
+					nandi->sectors_per_page);
+		if (ret >= 0)
+			dev_dbg(nandi->dev, "%s: erased page detected: downgrading uncorrectable ECC error.\n",
+				__func__);
+	} else {
+		ret = (int)ecc_err;
+	}
+
+	return ret;
+}
+
 /* Returns the number of ECC errors, or '-1' for uncorrectable error */
 static int bch_read_page(struct nandi_controller *nandi,
 			 loff_t offs,
@@ -416,7 +496,6 @@ static int bch_read_page(struct nandi_controller *nandi,
 	unsigned long list_phys;
 	unsigned long buf_phys;
 	uint32_t ecc_err;
-	int ret = 0;
 
 	dev_dbg(nandi->dev, "%s: offs = 0x%012llx\n", __func__, offs);
 
@@ -457,20 +536,81 @@ static int bch_read_page(struct nandi_controller *nandi,
 
 	/* Use the maximum per-sector ECC count! */
 	ecc_err = readl(nandi->base + NANDBCH_ECC_SCORE_REG_A) & 0xff;
-	if (ecc_err == 0xff) {
-		/* Downgrade uncorrectable ECC error for an erased page,
-		 * tolerating 'sectors_per_page' bits at zero.
-		 */
-		ret = check_erased_page(buf, page_size,
-					nandi->sectors_per_page);
-		if (ret >= 0)
-			dev_dbg(nandi->dev, "%s: erased page detected: downgrading uncorrectable ECC error.\n",
-				__func__);
-	} else {
-		ret = (int)ecc_err;
-	}
 
-	return ret;
+	return bch_page_ecc_errs(nandi, ecc_err, buf);
+}
+
+/*
+ * Read 'nr_pages' consecutive pages into a physically contiguous buffer, using
+ * one BCH sequence so that the controller streams the pages back-to-back.  The
+ * per-page ECC error counts (or '-1' for uncorrectable) are returned in
+ * 'ecc_errs'.
+ */
+static void bch_read_pages(struct nandi_controller *nandi,
+			   loff_t offs, uint8_t *buf,
+			   int nr_pages, int *ecc_errs)
+{
+	struct bch_prog *prog = &bch_prog_read_pages;
+	uint32_t page_size = nandi->info.mtd.writesize;
+	uint32_t scores[2];
+	unsigned long list_phys;
+	unsigned long buf_phys;
+	int i;
+
+	dev_dbg(nandi->dev, "%s: %d pages @ 0x%012llx\n", __func__,
+		nr_pages, offs);
+
+	BUG_ON((unsigned long)buf & (NANDI_BCH_DMA_ALIGNMENT - 1));
+	BUG_ON(offs & (page_size - 1));
+	BUG_ON(nr_pages < 1 || nr_pages > NANDI_BCH_MAX_BUF_LIST);
+
+	nandi_select(STM_NANDI_BCH);
+
+	nandi_enable_interrupts(nandi, NANDBCH_INT_SEQNODESOVER);
+	INIT_COMPLETION(nandi->seq_completed);
+
+	/* Reset ECC stats */
+	writel(CFG_RESET_ECC_ALL | CFG_ENABLE_AFM,
+	       nandi->base + NANDBCH_CONTROLLER_CFG);
+	writel(CFG_ENABLE_AFM, nandi->base + NANDBCH_CONTROLLER_CFG);
+
+	prog->addr = (uint32_t)((offs >> (nandi->page_shift - 8)) & 0xffffff00);
+	prog->seq_cfg = SEQ_CFG_GO_STOP | SEQ_CFG_REPEAT_COUNTER(nr_pages - 1);
+
+	buf_phys = dma_map_single(NULL, buf, nr_pages * page_size,
+				  DMA_FROM_DEVICE);
+
+	memset(nandi->buf_list, 0x00, NANDI_BCH_BUF_LIST_SIZE);
+	for (i = 0; i < nr_pages; i++)
+		nandi->buf_list[i] = (buf_phys + i * page_size) |
+			(nandi->sectors_per_page - 1);
+
+	list_phys = dma_map_single(NULL, nandi->buf_list,
+				   NANDI_BCH_BUF_LIST_SIZE, DMA_TO_DEVICE);
+
+	writel(list_phys, nandi->base + NANDBCH_BUFFER_LIST_PTR);
+
+	bch_load_prog_cpu(nandi, prog);
+
+	bch_wait_seq(nandi);
+
+	nandi_disable_interrupts(nandi, NANDBCH_INT_SEQNODESOVER);
+
+	dma_unmap_single(NULL, list_phys, NANDI_BCH_BUF_LIST_SIZE,
+			 DMA_TO_DEVICE);
+	dma_unmap_single(NULL, buf_phys, nr_pages * page_size,
+			 DMA_FROM_DEVICE);
+
+	/* One (maximum per-sector) ECC score byte per page */
+	scores[0] = readl(nandi->base + NANDBCH_ECC_SCORE_REG_A);
+	scores[1] = readl(nandi->base + NANDBCH_ECC_SCORE_REG_B);
+
+	for (i = 0; i < nr_pages; i++) {
+		uint32_t ecc_err = (scores[i / 4] >> ((i % 4) * 8)) & 0xff;
+
+		ecc_errs[i] = bch_page_ecc_errs(nandi, ecc_err,
+						buf + i * page_size);
+	}
 }
 
 /* Returns the status of the NAND device following the write operation */
@@ -521,6 +661,175 @@ static uint8_t bch_write_page(struct nandi_controller *nandi,
 	return status;
 }
 
+/*
+ * Queued erase/program operations: a sequence of BCH programs is prepared up
+ * front, then each one is loaded by the interrupt handler as soon as the
+ * previous one completes.  The chain stops at the first failed operation, and
+ * the device status of each completed operation is collected in 'status[]'.
+ */
+static int bch_queue_max(struct nandi_controller *nandi)
+{
+	return clamp(bch_queue_depth, 1, NANDI_BCH_MAX_QUEUE);
+}
+
+static void bch_queue_reset(struct nandi_controller *nandi)
+{
+	nandi->queue.nr_ops = 0;
+	nandi->queue.done = 0;
+}
+
+static void bch_queue_erase(struct nandi_controller *nandi, loff_t offs)
+{
+	struct bch_queue *q = &nandi->queue;
+	struct bch_prog *prog = &q->prog[q->nr_ops];
+
+	BUG_ON(q->nr_ops >= NANDI_BCH_MAX_QUEUE);
+
+	*prog = bch_prog_erase_block;
+	prog->extra = (uint32_t)(offs >> nandi->page_shift);
+	q->buf_phys[q->nr_ops++] = 0;
+}
+
+static void bch_queue_write(struct nandi_controller *nandi, loff_t offs,
+			    const uint8_t *buf)
+{
+	struct bch_queue *q = &nandi->queue;
+	struct bch_prog *prog = &q->prog[q->nr_ops];
+	uint32_t page_size = nandi->info.mtd.writesize;
+	uint32_t *list;
+
+	BUG_ON(q->nr_ops >= NANDI_BCH_MAX_QUEUE);
+	BUG_ON((unsigned long)buf & (NANDI_BCH_DMA_ALIGNMENT - 1));
+	BUG_ON(offs & (page_size - 1));
+
+	*prog = bch_prog_write_page;
+	prog->addr = (uint32_t)((offs >> (nandi->page_shift - 8)) & 0xffffff00);
+
+	list = nandi->buf_list + q->nr_ops * (NANDI_BCH_BUF_LIST_STRIDE / 4);
+	q->buf_phys[q->nr_ops] = dma_map_single(NULL, (void *)buf, page_size,
+						DMA_TO_DEVICE);
+	memset(list, 0x00, NANDI_BCH_BUF_LIST_SIZE);
+	list[0] = q->buf_phys[q->nr_ops] | (nandi->sectors_per_page - 1);
+	q->nr_ops++;
+}
+
+static void bch_queue_start(struct nandi_controller *nandi, int op)
+{
+	struct bch_queue *q = &nandi->queue;
+
+	if (q->buf_phys[op])
+		writel(q->list_phys + op * NANDI_BCH_BUF_LIST_STRIDE,
+		       nandi->base + NANDBCH_BUFFER_LIST_PTR);
+
+	bch_load_prog_cpu(nandi, &q->prog[op]);
+}
+
+/* Called from the SEQ Over interrupt; returns 1 if another operation has been
+ * started */
+static int bch_queue_next(struct nandi_controller *nandi)
+{
+	struct bch_queue *q = &nandi->queue;
+	uint8_t status;
+
+	status = (uint8_t)(readl(nandi->base +
+				 NANDBCH_CHECK_STATUS_REG_A) & 0xff);
+	q->status[q->done++] = status;
+
+	if ((status & NAND_STATUS_FAIL) || q->done == q->nr_ops)
+		return 0;
+
+	bch_queue_start(nandi, q->done);
+
+	return 1;
+}
+
+/* Run the queued operations; returns the number of operations completed */
+static int bch_queue_run(struct nandi_controller *nandi)
+{
+	struct bch_queue *q = &nandi->queue;
+	uint32_t page_size = nandi->info.mtd.writesize;
+	int ret;
+	int i;
+
+	dev_dbg(nandi->dev, "%s: %d operations\n", __func__, q->nr_ops);
+
+	if (!q->nr_ops)
+		return 0;
+
+	nandi_select(STM_NANDI_BCH);
+
+	q->list_phys = dma_map_single(NULL, nandi->buf_list,
+				      q->nr_ops * NANDI_BCH_BUF_LIST_STRIDE,
+				      DMA_TO_DEVICE);
+
+	nandi_enable_interrupts(nandi, NANDBCH_INT_SEQNODESOVER);
+	INIT_COMPLETION(nandi->seq_completed);
+
+	q->done = 0;
+	q->active = 1;
+	bch_queue_start(nandi, 0);
+
+	ret = wait_for_completion_timeout(&nandi->seq_completed,
+					  q->nr_ops * (HZ/2));
+
+	nandi_disable_interrupts(nandi, NANDBCH_INT_SEQNODESOVER);
+	q->active = 0;
+
+	if (!ret)
+		dev_err(nandi->dev, "BCH Seq timeout (%d/%d operations)\n",
+			q->done, q->nr_ops);
+
+	dma_unmap_single(NULL, q->list_phys,
+			 q->nr_ops * NANDI_BCH_BUF_LIST_STRIDE, DMA_TO_DEVICE);
+	for (i = 0; i < q->nr_ops; i++)
+		if (q->buf_phys[i])
+			dma_unmap_single(NULL, q->buf_phys[i], page_size,
+					 DMA_TO_DEVICE);
+
+	return q->done;
+}
+
+/* Update ECC stats following a page read; returns the number of corrected
+ * errors, or '-1' for uncorrectable error */
+static int bch_read_ecc_stats(struct nandi_controller *nandi,
+			      loff_t page_offs, int ecc_errs)
+{
+	if (ecc_errs < 0) {
+		dev_err(nandi->dev, "%s: uncorrectable error at 0x%012llx\n",
+			__func__, page_offs);
+		nandi->info.mtd.ecc_stats.failed++;
+	} else if (ecc_errs) {
+		dev_info(nandi->dev, "%s: corrected %u error(s) at 0x%012llx\n",
+			 __func__, ecc_errs, page_offs);
+		nandi->info.mtd.ecc_stats.corrected += ecc_errs;
+	}
+
+	return ecc_errs;
+}
+
+/* Number of whole pages, from 'page_num', that can be read directly into
+ * 'buf' in a single multi-page BCH sequence */
+static int bch_read_run_pages(struct nandi_controller *nandi,
+			      int page_num, size_t len, uint8_t *buf)
+{
+	uint32_t page_size = nandi->info.mtd.writesize;
+	int nr_pages;
+	int i;
+
+	nr_pages = min_t(size_t, len >> nandi->page_shift,
+			 NANDI_BCH_MAX_BUF_LIST);
+
+	/* The buffer must be physically contiguous over the whole run, and
+	 * the cached page is better served from 'page_buf' */
+	for (i = 1; i < nr_pages; i++) {
+		if (!virt_addr_valid(buf + (i + 1) * page_size - 1) ||
+		    page_num + i == nandi->cached_page)
+			break;
+	}
+
+	return i;
+}
+
 /* Helper function for bch_mtd_read, to handle multi-page or non-aligned reads */
 static int bch_read(struct nandi_controller *nandi,
 		    loff_t from, size_t len,
@@ -533,8 +842,11 @@ static int bch_read(struct nandi_controller *nandi,
 	int page_num;
 	uint32_t col_offs;
 	int ecc_errs, max_ecc_errs = 0;
+	int run_ecc_errs[NANDI_BCH_MAX_BUF_LIST];
+	int nr_pages;
 	size_t bytes;
 	uint8_t *p;
+	int i;
 
 	int bounce;
 
@@ -552,6 +864,7 @@ static int bch_read(struct nandi_controller *nandi,
 
 	while (len > 0) {
 		bytes = min((page_size - col_offs), len);
+		nr_pages = 1;
 
 		if ((bytes != page_size) ||
 		    ((unsigned int)buf & (NANDI_BCH_DMA_ALIGNMENT - 1)) ||
@@ -562,6 +875,22 @@ static int bch_read(struct nandi_controller *nandi,
 
 		if (page_num == nandi->cached_page) {
 			memcpy(buf, nandi->page_buf + col_offs, bytes);
+		} else if (!bounce &&
+			   (nr_pages = bch_read_run_pages(nandi, page_num,
+							  len, buf)) > 1) {
+			/* Stream a run of whole pages straight to 'buf' */
+			bch_read_pages(nandi, page_offs, buf, nr_pages,
+				       run_ecc_errs);
+
+			for (i = 0; i < nr_pages; i++) {
+				ecc_errs = bch_read_ecc_stats(nandi,
+						page_offs + i * page_size,
+						run_ecc_errs[i]);
+				if (ecc_errs > max_ecc_errs)
+					max_ecc_errs = ecc_errs;
+			}
+
+			bytes = nr_pages * page_size;
 		} else {
 			p = bounce ? nandi->page_buf : buf;
 
@@ -569,24 +898,15 @@ static int bch_read(struct nandi_controller *nandi,
 			if (bounce)
 				memcpy(buf, p + col_offs, bytes);
 
-			if (ecc_errs < 0) {
-				dev_err(nandi->dev, "%s: uncorrectable error at 0x%012llx\n",
-					__func__, page_offs);
-				nandi->info.mtd.ecc_stats.failed++;
+			bch_read_ecc_stats(nandi, page_offs, ecc_errs);
 
+			if (ecc_errs < 0) {
 				/* Do not cache uncorrectable pages */
 				if (bounce)
 					nandi->cached_page = -1;
 			} else {
-				if (ecc_errs) {
-					dev_info(nandi->dev, "%s: corrected %u error(s) at 0x%012llx\n",
-						 __func__, ecc_errs, page_offs);
-					nandi->info.mtd.ecc_stats.corrected +=
-						ecc_errs;
-
-					if (ecc_errs > max_ecc_errs)
-						max_ecc_errs = ecc_errs;
-				}
+				if (ecc_errs > max_ecc_errs)
+					max_ecc_errs = ecc_errs;
 
 				if (bounce)
 					nandi->cached_page = page_num;
@@ -600,8 +920,8 @@ static int bch_read(struct nandi_controller *nandi,
 			*retlen += bytes;
 
 		/* We are now page-aligned */
-		page_offs += page_size;
-		page_num++;
+		page_offs += nr_pages * page_size;
+		page_num += nr_pages;
 		col_offs = 0;
 	}
 
@@ -623,9 +943,13 @@ static int bch_write(struct nandi_controller *nandi,
 		     size_t *retlen, const uint8_t *buf)
 {
 	uint32_t page_size = nandi->info.mtd.writesize;
+	struct bch_queue *q = &nandi->queue;
 	int page_num;
 	int bounce;
+	int nr_pages;
+	int done;
 	const uint8_t *p = NULL;
+	int i;
 
 	dev_dbg(nandi->dev, "%s: %llu @ 0x%012llx\n", __func__,
 		(unsigned long long)len, to);
@@ -646,28 +970,49 @@ static int bch_write(struct nandi_controller *nandi,
 	page_num = (int)(to >> nandi->page_shift);
 
 	while (len > 0) {
+		nr_pages = min_t(size_t, len >> nandi->page_shift,
+				 bch_queue_max(nandi));
+
+		/* Without the queue bounce buffer, bounce one page at a time */
+		if (bounce && !nandi->queue_buf)
+			nr_pages = 1;
+
+		bch_queue_reset(nandi);
+		for (i = 0; i < nr_pages; i++) {
+			if (bounce && nandi->queue_buf) {
+				p = nandi->queue_buf + i * page_size;
+				memcpy((uint8_t *)p, buf + i * page_size,
+				       page_size);
+			} else if (bounce) {
+				memcpy(nandi->page_buf, buf, page_size);
+				p = nandi->page_buf;
+				nandi->cached_page = -1;
+			} else {
+				p = buf + i * page_size;
+			}
 
-		if (bounce) {
-			memcpy(nandi->page_buf, buf, page_size);
-			p = nandi->page_buf;
-			nandi->cached_page = -1;
-		} else {
-			p = buf;
+			if (nandi->cached_page == page_num + i)
+				nandi->cached_page = -1;
+
+			bch_queue_write(nandi, to + i * page_size, p);
 		}
 
-		if (nandi->cached_page == page_num)
-			nandi->cached_page = -1;
+		done = bch_queue_run(nandi);
 
-		if (bch_write_page(nandi, to, p) & NAND_STATUS_FAIL)
-			return -EIO;
+		for (i = 0; i < done; i++) {
+			if (q->status[i] & NAND_STATUS_FAIL)
+				return -EIO;
 
-		to += page_size;
-		page_num++;
-		buf += page_size;
-		len -= page_size;
+			if (retlen)
+				*retlen += page_size;
+		}
+		if (done < nr_pages)
+			return -EIO;
 
-		if (retlen)
-			*retlen += page_size;
+		to += nr_pages * page_size;
+		page_num += nr_pages;
+		buf += nr_pages * page_size;
+		len -= nr_pages * page_size;
 	}
 
 	return 0;
@@ -1869,8 +2214,12 @@ static int bch_mtd_erase(struct mtd_info *mtd, struct erase_info *instr)
 	loff_t offs = instr->addr;
 	size_t len = instr->len;
 	uint64_t offs_cached;
-	uint8_t status;
+	struct bch_queue *q = &nandi->queue;
+	loff_t offs_queued;
+	int bad_block;
+	int done;
 	int ret;
+	int i;
 
 	dev_dbg(nandi->dev, "%s: 0x%012llx @ 0x%012llx\n", __func__,
 		(unsigned long long)len, offs);
@@ -1907,20 +2256,32 @@ static int bch_mtd_erase(struct mtd_info *mtd, struct erase_info *instr)
 
 	instr->state = MTD_ERASING;
 	while (len) {
-		if (!nand_erasebb && mtd_block_isbad(mtd, offs)) {
-			dev_err(nandi->dev, "attempt to erase a bad block "
-				"at 0x%012llx\n", offs);
-			instr->state = MTD_ERASE_FAILED;
-			instr->fail_addr = offs;
-			goto erase_exit;
+		/* Queue a run of good blocks, stopping short of a bad one */
+		bch_queue_reset(nandi);
+		offs_queued = offs;
+		bad_block = 0;
+		while (len && q->nr_ops < bch_queue_max(nandi)) {
+			if (!nand_erasebb && mtd_block_isbad(mtd, offs)) {
+				bad_block = 1;
+				break;
+			}
+
+			if (offs == offs_cached)
+				nandi->cached_page = -1;
+
+			bch_queue_erase(nandi, offs);
+
+			len -= mtd->erasesize;
+			offs += mtd->erasesize;
 		}
 
-		if (offs == offs_cached)
-			nandi->cached_page = -1;
+		done = bch_queue_run(nandi);
 
-		status = bch_erase_block(nandi, offs);
+		for (i = 0; i < q->nr_ops; i++) {
+			if (i < done && !(q->status[i] & NAND_STATUS_FAIL))
+				continue;
 
-		if (status & NAND_STATUS_FAIL) {
+			offs = offs_queued + i * mtd->erasesize;
 			dev_err(nandi->dev, "failed to erase block at "
 				"0x%012llx\n", offs);
 			instr->state = MTD_ERASE_FAILED;
@@ -1928,8 +2289,13 @@ static int bch_mtd_erase(struct mtd_info *mtd, struct erase_info *instr)
 			goto erase_exit;
 		}
 
-		len -= mtd->erasesize;
-		offs += mtd->erasesize;
+		if (bad_block) {
+			dev_err(nandi->dev, "attempt to erase a bad block "
+				"at 0x%012llx\n", offs);
+			instr->state = MTD_ERASE_FAILED;
+			instr->fail_addr = offs;
+			goto erase_exit;
+		}
 	}
 	instr->state = MTD_ERASE_DONE;
 
@@ -3023,8 +3389,9 @@ static int __devinit stm_nand_bch_probe(struct platform_device *pdev)
 	bbt_buf_size = ALIGN(bbt_info->bbt_size, mtd->writesize);
 	buf_size += bbt_buf_size + NANDI_BCH_DMA_ALIGNMENT;
 
-	/*	- BCH BUF list */
-	buf_size += NANDI_BCH_BUF_LIST_SIZE + NANDI_BCH_DMA_ALIGNMENT;
+	/*	- BCH BUF lists (one per queued operation) */
+	buf_size += NANDI_BCH_MAX_QUEUE * NANDI_BCH_BUF_LIST_STRIDE +
+		NANDI_BCH_DMA_ALIGNMENT;
 
 	/* Allocate bufffer */
 	nandi->buf = devm_kzalloc(&pdev->dev, buf_size, GFP_KERNEL);
@@ -3041,6 +3408,17 @@ static int __devinit stm_nand_bch_probe(struct platform_device *pdev)
 	nandi->buf_list = (uint32_t *) PTR_ALIGN(bbt_info->bbt + bbt_buf_size,
 						 NANDI_BCH_DMA_ALIGNMENT);
 	nandi->cached_page = -1;
+
+	/*	- Bounce buffer for queued writes from unaligned or vmalloc'd
+	 *	  data (UBI), falls back to 'page_buf' if not available */
+	nandi->queue_buf = devm_kzalloc(&pdev->dev,
+					NANDI_BCH_MAX_QUEUE * mtd->writesize +
+					NANDI_BCH_DMA_ALIGNMENT, GFP_KERNEL);
+	if (nandi->queue_buf)
+		nandi->queue_buf = PTR_ALIGN(nandi->queue_buf,
+					     NANDI_BCH_DMA_ALIGNMENT);
+	else
+		dev_warn(nandi->dev, "no bounce buffer for queued writes\n");
 	if (nandi_examine_bbts(nandi, mtd) != 0) {
 		dev_err(nandi->dev, "incompatible BBTs detected\n");
 		dev_err(nandi->dev, "initiating NAND Recovery Mode\n");
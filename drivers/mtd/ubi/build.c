@@ -28,9 +28,10 @@
  * specified, UBI does not attach any MTD device, but it is possible to do
  * later using the "UBI control device".
  *
- * At the moment we only attach UBI devices by scanning, which will become a
- * bottleneck when flashes reach certain large size. Then one may improve UBI
- * and add other methods, although it does not seem to be easy to do.
+ * UBI devices are attached by scanning, which becomes a bottleneck when
+ * flashes reach certain large size. With fastmap, most of the scanning is
+ * avoided by reading the state of the device from a few PEBs (see fastmap.c),
+ * and full scanning is only the fall-back method.
  */
 
 #include <linux/err.h>
@@ -44,6 +45,7 @@
 #include <linux/kthread.h>
 #include <linux/kernel.h>
 #include <linux/slab.h>
+#include <linux/ktime.h>
 #include "ubi.h"
 
 /* Maximum length of the 'mtd=' parameter */
@@ -72,6 +74,14 @@ static int __initdata mtd_devs;
 /* MTD devices specification parameters */
 static struct mtd_dev_param __initdata mtd_dev_param[UBI_MAX_DEVICES];
 
+#ifdef CONFIG_MTD_UBI_FASTMAP
+/* Whether devices attached from now on use fastmap */
+static bool fastmap = 1;
+module_param(fastmap, bool, 0644);
+MODULE_PARM_DESC(fastmap, "Use fastmap to attach UBI devices (default: 1). "
+			  "When 0, an existing fastmap is erased on attach.");
+#endif
+
 /* Root UBI "class" object (corresponds to '/<sysfs>/class/ubi/') */
 struct class *ubi_class;
 
@@ -575,19 +585,25 @@ static void free_internal_volumes(struct ubi_device *ubi)
  * This function returns zero in case of success and a negative error code in
  * case of failure.
  *
- * Note, currently this is the only method to attach UBI devices. Hopefully in
- * the future we'll have more scalable attaching methods and avoid full media
- * scanning. But even in this case scanning will be needed as a fall-back
- * attaching method if there are some on-flash table corruptions.
+ * Note, if there is a fastmap, 'ubi_scan()' only scans the PEBs it does not
+ * describe. Full scanning is the fall-back attaching method if there is no
+ * fastmap or if it is corrupted.
  */
 static int attach_by_scanning(struct ubi_device *ubi)
 {
 	int err;
 	struct ubi_scan_info *si;
+	ktime_t start = ktime_get();
+
+	err = ubi_fastmap_init(ubi);
+	if (err)
+		return err;
 
 	si = ubi_scan(ubi);
-	if (IS_ERR(si))
+	if (IS_ERR(si)) {
+		ubi_fastmap_close(ubi);
 		return PTR_ERR(si);
+	}
 
 	ubi->bad_peb_count = si->bad_peb_count;
 	ubi->good_peb_count = ubi->peb_count - ubi->bad_peb_count;
@@ -608,6 +624,17 @@ static int attach_by_scanning(struct ubi_device *ubi)
 	if (err)
 		goto out_wl;
 
+	ubi_msg("attached by %s in %lld ms",
+		si->fastmap ? "fastmap" : "scanning",
+		ktime_to_ms(ktime_sub(ktime_get(), start)));
+
+	/* Make the next attach fast */
+	if (!si->fastmap) {
+		err = ubi_update_fastmap(ubi);
+		if (err)
+			goto out_wl;
+	}
+
 	ubi_scan_destroy_si(si);
 	return 0;
 
@@ -618,6 +645,7 @@ out_vtbl:
 	vfree(ubi->vtbl);
 out_si:
 	ubi_scan_destroy_si(si);
+	ubi_fastmap_close(ubi);
 	return err;
 }
 
@@ -935,6 +963,9 @@ int ubi_attach_mtd_dev(struct mtd_info *mtd, int ubi_num, int vid_hdr_offset)
 	ubi->ubi_num = ubi_num;
 	ubi->vid_hdr_offset = vid_hdr_offset;
 	ubi->autoresize_vol_id = -1;
+#ifdef CONFIG_MTD_UBI_FASTMAP
+	ubi->fm_disabled = !fastmap;
+#endif
 
 	mutex_init(&ubi->buf_mutex);
 	mutex_init(&ubi->ckvol_mutex);
@@ -1088,6 +1119,9 @@ int ubi_detach_mtd_dev(int ubi_num, int anyway)
 	if (ubi->bgt_thread)
 		kthread_stop(ubi->bgt_thread);
 
+	/* Write the state of the device out so that it attaches fast */
+	ubi_update_fastmap(ubi);
+
 	/*
 	 * Get a reference to the device in order to prevent 'dev_release()'
 	 * from freeing the @ubi object.
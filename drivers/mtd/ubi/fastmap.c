@@ -0,0 +1,893 @@
+/*
+ * Copyright (c) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See
+ * the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * UBI fastmap sub-system.
+ *
+ * Attaching by scanning reads the headers of every PEB, so it takes time
+ * proportional to the flash size. The fastmap is a snapshot of the erase
+ * counters, the WL state of all PEBs and the EBA tables of all volumes, which
+ * is stored in a few PEBs of the internal %UBI_FM_SB_VOLUME_ID and
+ * %UBI_FM_DATA_VOLUME_ID volumes. When attaching, only the first
+ * %UBI_FM_MAX_START PEBs are looked at to find the fastmap anchor, and then
+ * only the PEBs the fastmap can not vouch for are scanned.
+ *
+ * For the snapshot to stay valid, the following rules are kept while a
+ * fastmap is on flash:
+ *  o new data is only written to PEBs from the pool (@ubi->fm_pool), which
+ *    the fastmap lists and which are always scanned when attaching;
+ *  o PEBs which are put are not erased until the next fastmap is written (see
+ *    'schedule_put_erase()'), so the LEBs the fastmap maps to them survive;
+ *  o before a new fastmap is written the old anchor is erased, so a power cut
+ *    in between makes the next attach fall back to scanning.
+ *
+ * A new fastmap is written when the pool is exhausted, when pending works are
+ * flushed and when the device is detached. If no fastmap can be written, it is
+ * not used until the next attach.
+ */
+
+#include <linux/crc32.h>
+#include "ubi.h"
+
+/* Smallest number of PEBs in the pool */
+#define UBI_FM_MIN_POOL_SIZE 8
+
+/* Marks PEBs in the used list which are not mapped to a LEB yet */
+#define FM_USED_CLAIMED (-2)
+
+/**
+ * find_fm_anchor - find the fastmap anchor.
+ * @ubi: UBI device description object
+ * @vh: buffer for VID headers
+ * @sqnum: the sequence number of the anchor is returned here
+ *
+ * If there are several anchors, e.g. because a power cut prevented a stale one
+ * from being erased, the newest one is taken. This function returns the anchor
+ * PEB number, %-ENOENT if there is no anchor and other negative error codes in
+ * case of failure.
+ */
+static int find_fm_anchor(struct ubi_device *ubi, struct ubi_vid_hdr *vh,
+			  unsigned long long *sqnum)
+{
+	int pnum, err, anchor = -ENOENT;
+
+	for (pnum = 0; pnum < UBI_FM_MAX_START && pnum < ubi->peb_count;
+	     pnum++) {
+		err = ubi_io_is_bad(ubi, pnum);
+		if (err < 0)
+			return err;
+		else if (err)
+			continue;
+
+		err = ubi_io_read_vid_hdr(ubi, pnum, vh, 0);
+		if (err < 0)
+			return err;
+		else if (err && err != UBI_IO_BITFLIPS)
+			continue;
+
+		if (be32_to_cpu(vh->vol_id) != UBI_FM_SB_VOLUME_ID)
+			continue;
+
+		dbg_bld("fastmap anchor at PEB %d, sqnum %llu", pnum,
+			(unsigned long long)be64_to_cpu(vh->sqnum));
+		if (anchor < 0 || be64_to_cpu(vh->sqnum) > *sqnum) {
+			anchor = pnum;
+			*sqnum = be64_to_cpu(vh->sqnum);
+		}
+	}
+
+	return anchor;
+}
+
+/**
+ * add_ec - account an erase counter in the scanning information.
+ * @si: scanning information
+ * @ec: the erase counter
+ */
+static void add_ec(struct ubi_scan_info *si, int ec)
+{
+	si->ec_sum += ec;
+	si->ec_count += 1;
+	if (ec > si->max_ec)
+		si->max_ec = ec;
+	if (ec < si->min_ec)
+		si->min_ec = ec;
+}
+
+/**
+ * get_fm_ec - get and check a fastmap erase counter record.
+ * @ubi: UBI device description object
+ * @fec: the record
+ * @known: bitmap of PEBs described so far
+ * @pnum: the PEB number is returned here
+ * @ec: the erase counter is returned here
+ *
+ * Returns zero if the record is sane and describes a PEB which was not
+ * described before, and %-EINVAL if not.
+ */
+static int get_fm_ec(const struct ubi_device *ubi, const struct ubi_fm_ec *fec,
+		     unsigned long *known, int *pnum, int *ec)
+{
+	*pnum = be32_to_cpu(fec->pnum);
+	*ec = be32_to_cpu(fec->ec);
+
+	if (*pnum < 0 || *pnum >= ubi->peb_count ||
+	    *ec < 0 || *ec > UBI_MAX_ERASECOUNTER) {
+		ubi_err("bad fastmap record: PEB %d, EC %d", *pnum, *ec);
+		return -EINVAL;
+	}
+
+	if (test_and_set_bit(*pnum, known)) {
+		ubi_err("PEB %d is described twice by the fastmap", *pnum);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/**
+ * parse_fm - add the contents of a fastmap to the scanning information.
+ * @ubi: UBI device description object
+ * @si: scanning information
+ * @known: bitmap of PEBs described by the fastmap, filled in here
+ * @buf: the fastmap data
+ * @size: size of the fastmap data
+ *
+ * Used PEBs which are not mapped to any LEB are left out of @known, so that
+ * they are scanned. This function returns zero in case of success,
+ * %-EINVAL if the fastmap is inconsistent and other negative error codes in
+ * case of failure.
+ */
+static int parse_fm(struct ubi_device *ubi, struct ubi_scan_info *si,
+		    unsigned long *known, void *buf, int size)
+{
+	struct ubi_fm_hdr *fmhdr = buf;
+	struct ubi_fm_volhdr *fmvh;
+	struct ubi_fm_ec *fec;
+	struct ubi_vid_hdr vh;
+	struct ubi_ec_hdr *ech;
+	__be32 *pebs;
+	int *used_ec;
+	int i, j, err, pos, vols_pos, len, pnum, ec;
+	int free_count, used_count, erase_count, pool_size, vol_count;
+
+	if (size < sizeof(struct ubi_fm_hdr) ||
+	    be32_to_cpu(fmhdr->magic) != UBI_FM_HDR_MAGIC) {
+		ubi_err("bad fastmap header");
+		return -EINVAL;
+	}
+
+	free_count = be32_to_cpu(fmhdr->free_peb_count);
+	used_count = be32_to_cpu(fmhdr->used_peb_count);
+	erase_count = be32_to_cpu(fmhdr->erase_peb_count);
+	pool_size = be32_to_cpu(fmhdr->pool_size);
+	vol_count = be32_to_cpu(fmhdr->vol_count);
+
+	if (free_count < 0 || used_count < 0 || erase_count < 0 ||
+	    pool_size < 0 || pool_size > UBI_FM_MAX_POOL_SIZE ||
+	    vol_count < 0 || vol_count > UBI_MAX_VOLUMES + UBI_INT_VOL_COUNT ||
+	    free_count + used_count + erase_count > ubi->peb_count) {
+		ubi_err("bad fastmap header");
+		return -EINVAL;
+	}
+
+	/* Skip the volume records, the PEB lists follow them */
+	pos = vols_pos = sizeof(struct ubi_fm_hdr);
+	for (i = 0; i < vol_count; i++) {
+		fmvh = buf + pos;
+		if (pos + sizeof(struct ubi_fm_volhdr) > size ||
+		    be32_to_cpu(fmvh->magic) != UBI_FM_VHDR_MAGIC ||
+		    be32_to_cpu(fmvh->reserved_pebs) > ubi->peb_count) {
+			ubi_err("bad fastmap volume record %d", i);
+			return -EINVAL;
+		}
+		pos += sizeof(struct ubi_fm_volhdr) +
+		       be32_to_cpu(fmvh->reserved_pebs) * sizeof(__be32);
+	}
+
+	len = (free_count + used_count + erase_count) *
+	      sizeof(struct ubi_fm_ec) + pool_size * sizeof(__be32);
+	if (pos + len != size) {
+		ubi_err("bad fastmap size %d", size);
+		return -EINVAL;
+	}
+
+	used_ec = vmalloc(ubi->peb_count * sizeof(int));
+	if (!used_ec)
+		return -ENOMEM;
+	for (i = 0; i < ubi->peb_count; i++)
+		used_ec[i] = UBI_SCAN_UNKNOWN_EC;
+
+	ech = kzalloc(ubi->ec_hdr_alsize, GFP_KERNEL);
+	if (!ech) {
+		err = -ENOMEM;
+		goto out_free;
+	}
+
+	fec = buf + pos;
+	for (i = 0; i < free_count; i++, fec++) {
+		err = get_fm_ec(ubi, fec, known, &pnum, &ec);
+		if (err)
+			goto out_free;
+
+		err = ubi_scan_add_to_list(si, pnum, ec, 0, &si->free);
+		if (err)
+			goto out_free;
+		add_ec(si, ec);
+	}
+
+	for (i = 0; i < used_count; i++, fec++) {
+		err = get_fm_ec(ubi, fec, known, &pnum, &ec);
+		if (err)
+			goto out_free;
+		used_ec[pnum] = ec;
+	}
+
+	for (i = 0; i < erase_count; i++, fec++) {
+		err = get_fm_ec(ubi, fec, known, &pnum, &ec);
+		if (err)
+			goto out_free;
+
+		/*
+		 * These PEBs may have been erased, or have gone bad, since
+		 * the fastmap was written. Leave bad ones to scanning and
+		 * pick up the current erase counter if there is one.
+		 */
+		err = ubi_io_is_bad(ubi, pnum);
+		if (err < 0)
+			goto out_free;
+		else if (err) {
+			clear_bit(pnum, known);
+			continue;
+		}
+
+		err = ubi_io_read_ec_hdr(ubi, pnum, ech, 0);
+		if (err < 0)
+			goto out_free;
+		if ((!err || err == UBI_IO_BITFLIPS) &&
+		    be64_to_cpu(ech->ec) <= UBI_MAX_ERASECOUNTER)
+			ec = be64_to_cpu(ech->ec);
+
+		err = ubi_scan_add_to_list(si, pnum, ec, 0, &si->erase);
+		if (err)
+			goto out_free;
+		add_ec(si, ec);
+	}
+
+	/* Pool PEBs are scanned, they just must not be described otherwise */
+	pebs = buf + pos + (free_count + used_count + erase_count) *
+		     sizeof(struct ubi_fm_ec);
+	for (i = 0; i < pool_size; i++) {
+		pnum = be32_to_cpu(pebs[i]);
+		if (pnum < 0 || pnum >= ubi->peb_count ||
+		    test_bit(pnum, known)) {
+			ubi_err("bad fastmap pool PEB %d", pnum);
+			err = -EINVAL;
+			goto out_free;
+		}
+	}
+
+	/*
+	 * Now map the LEBs. The fastmap does not store sequence numbers, the
+	 * LEBs get sequence number zero, so that any copy found by scanning
+	 * the pool is newer.
+	 */
+	memset(&vh, 0, sizeof(struct ubi_vid_hdr));
+	pos = vols_pos;
+	for (i = 0; i < vol_count; i++) {
+		int vol_id, reserved_pebs, used_ebs, data_pad, usable_leb_size;
+
+		fmvh = buf + pos;
+		pebs = buf + pos + sizeof(struct ubi_fm_volhdr);
+		vol_id = be32_to_cpu(fmvh->vol_id);
+		reserved_pebs = be32_to_cpu(fmvh->reserved_pebs);
+		used_ebs = be32_to_cpu(fmvh->used_ebs);
+		data_pad = be32_to_cpu(fmvh->data_pad);
+		usable_leb_size = ubi->leb_size - data_pad;
+		pos += sizeof(struct ubi_fm_volhdr) +
+		       reserved_pebs * sizeof(__be32);
+
+		if ((vol_id < 0 || vol_id >= UBI_MAX_VOLUMES) &&
+		    vol_id != UBI_LAYOUT_VOLUME_ID) {
+			ubi_err("bad volume ID %d in fastmap", vol_id);
+			err = -EINVAL;
+			goto out_free;
+		}
+
+		vh.vol_type = fmvh->vol_type;
+		vh.compat = fmvh->compat;
+		vh.vol_id = fmvh->vol_id;
+		vh.used_ebs = fmvh->used_ebs;
+		vh.data_pad = fmvh->data_pad;
+
+		for (j = 0; j < reserved_pebs; j++) {
+			pnum = be32_to_cpu(pebs[j]);
+			if (pnum == UBI_LEB_UNMAPPED)
+				continue;
+
+			if (pnum < 0 || pnum >= ubi->peb_count ||
+			    used_ec[pnum] == FM_USED_CLAIMED) {
+				ubi_err("bad PEB %d for LEB %d:%d in fastmap",
+					pnum, vol_id, j);
+				err = -EINVAL;
+				goto out_free;
+			}
+
+			/*
+			 * A PEB which is not in the used list was taken from
+			 * the pool, it is scanned.
+			 */
+			if (used_ec[pnum] == UBI_SCAN_UNKNOWN_EC)
+				continue;
+
+			vh.lnum = cpu_to_be32(j);
+			if (vh.vol_type != UBI_VID_STATIC)
+				vh.data_size = 0;
+			else if (j == used_ebs - 1)
+				vh.data_size = fmvh->last_eb_bytes;
+			else
+				vh.data_size = cpu_to_be32(usable_leb_size);
+
+			ec = used_ec[pnum];
+			err = ubi_scan_add_used(ubi, si, pnum, ec, &vh, 0);
+			if (err)
+				goto out_free;
+			add_ec(si, ec);
+			used_ec[pnum] = FM_USED_CLAIMED;
+		}
+	}
+
+	/*
+	 * Used PEBs which are not mapped were being written or put while the
+	 * fastmap was written, let scanning find out what they contain.
+	 */
+	for (pnum = 0; pnum < ubi->peb_count; pnum++)
+		if (used_ec[pnum] >= 0) {
+			dbg_bld("PEB %d is used but not mapped", pnum);
+			clear_bit(pnum, known);
+		}
+
+	err = 0;
+
+out_free:
+	kfree(ech);
+	vfree(used_ec);
+	return err;
+}
+
+/**
+ * ubi_scan_fastmap - attach using the fastmap.
+ * @ubi: UBI device description object
+ * @si: scanning information to fill
+ * @known: bitmap of the PEBs which do not have to be scanned
+ *
+ * This function looks for the fastmap and adds the PEBs it describes to @si.
+ * The caller has to scan the PEBs which are not set in @known. This function
+ * returns zero in case of success, %UBI_NO_FASTMAP if there is no fastmap,
+ * %UBI_BAD_FASTMAP if the fastmap can not be used and a negative error code
+ * in case of failure. In the last two cases @si has to be discarded.
+ */
+int ubi_scan_fastmap(struct ubi_device *ubi, struct ubi_scan_info *si,
+		     unsigned long *known)
+{
+	struct ubi_vid_hdr *vh;
+	struct ubi_fm_sb *fmsb;
+	struct ubi_fastmap *fm = NULL;
+	unsigned long long sqnum = 0;
+	void *buf = NULL;
+	uint32_t crc;
+	int i, err, anchor, used_blocks, data_size, size, len;
+
+	vh = ubi_zalloc_vid_hdr(ubi, GFP_KERNEL);
+	if (!vh)
+		return -ENOMEM;
+
+	anchor = find_fm_anchor(ubi, vh, &sqnum);
+	if (anchor < 0) {
+		err = anchor == -ENOENT ? UBI_NO_FASTMAP : anchor;
+		goto out_free;
+	}
+
+	fmsb = kmalloc(sizeof(struct ubi_fm_sb), GFP_KERNEL);
+	if (!fmsb) {
+		err = -ENOMEM;
+		goto out_free;
+	}
+
+	err = ubi_io_read_data(ubi, fmsb, anchor, 0, sizeof(struct ubi_fm_sb));
+	if (err && err != UBI_IO_BITFLIPS)
+		goto out_bad;
+
+	used_blocks = be32_to_cpu(fmsb->used_blocks);
+	data_size = be32_to_cpu(fmsb->data_size);
+	size = sizeof(struct ubi_fm_sb) + data_size;
+
+	if (be32_to_cpu(fmsb->magic) != UBI_FM_SB_MAGIC ||
+	    fmsb->version != UBI_FM_FMT_VERSION ||
+	    used_blocks < 1 || used_blocks > UBI_FM_MAX_BLOCKS ||
+	    data_size < 0 || size > used_blocks * ubi->leb_size ||
+	    be32_to_cpu(fmsb->block_loc[0]) != anchor ||
+	    be64_to_cpu(fmsb->sqnum) != sqnum) {
+		ubi_err("bad fastmap super block at PEB %d", anchor);
+		goto out_bad;
+	}
+
+	buf = vmalloc(size);
+	if (!buf) {
+		err = -ENOMEM;
+		goto out_sb;
+	}
+
+	fm = kzalloc(sizeof(struct ubi_fastmap), GFP_KERNEL);
+	if (!fm) {
+		err = -ENOMEM;
+		goto out_sb;
+	}
+
+	for (i = 0; i < used_blocks; i++) {
+		int pnum = be32_to_cpu(fmsb->block_loc[i]);
+		int ec = be32_to_cpu(fmsb->block_ec[i]);
+
+		if (pnum < 0 || pnum >= ubi->peb_count ||
+		    ec < 0 || ec > UBI_MAX_ERASECOUNTER ||
+		    test_and_set_bit(pnum, known)) {
+			ubi_err("bad fastmap PEB %d", pnum);
+			goto out_bad;
+		}
+
+		if (i > 0) {
+			err = ubi_io_read_vid_hdr(ubi, pnum, vh, 0);
+			if (err && err != UBI_IO_BITFLIPS)
+				goto out_bad;
+
+			if (be32_to_cpu(vh->vol_id) != UBI_FM_DATA_VOLUME_ID ||
+			    be32_to_cpu(vh->lnum) != i) {
+				ubi_err("PEB %d is not fastmap block %d",
+					pnum, i);
+				goto out_bad;
+			}
+		}
+
+		len = min(size - i * ubi->leb_size, ubi->leb_size);
+		if (len > 0) {
+			err = ubi_io_read_data(ubi, buf + i * ubi->leb_size,
+					       pnum, 0, len);
+			if (err && err != UBI_IO_BITFLIPS)
+				goto out_bad;
+		}
+
+		fm->e[i] = kmem_cache_alloc(ubi_wl_entry_slab, GFP_KERNEL);
+		if (!fm->e[i]) {
+			err = -ENOMEM;
+			goto out_sb;
+		}
+		fm->e[i]->pnum = pnum;
+		fm->e[i]->ec = ec;
+		fm->used_blocks += 1;
+		add_ec(si, ec);
+	}
+
+	/* The CRC covers the super block with a zero @data_crc, and the data */
+	crc = be32_to_cpu(fmsb->data_crc);
+	((struct ubi_fm_sb *)buf)->data_crc = 0;
+	if (crc32(UBI_CRC32_INIT, buf, size) != crc) {
+		ubi_err("bad fastmap CRC");
+		goto out_bad;
+	}
+
+	err = parse_fm(ubi, si, known, buf + sizeof(struct ubi_fm_sb),
+		       data_size);
+	if (err == -EINVAL)
+		goto out_bad;
+	else if (err)
+		goto out_sb;
+
+	if (si->max_sqnum < sqnum)
+		si->max_sqnum = sqnum;
+	if (!ubi->image_seq)
+		ubi->image_seq = be32_to_cpu(fmsb->image_seq);
+
+	ubi->fm = fm;
+	fm = NULL;
+	dbg_bld("fastmap at PEB %d, %d blocks, %d bytes", anchor, used_blocks,
+		data_size);
+	goto out_sb;
+
+out_bad:
+	ubi_warn("cannot use the fastmap at PEB %d", anchor);
+	err = UBI_BAD_FASTMAP;
+out_sb:
+	if (fm) {
+		for (i = 0; i < fm->used_blocks; i++)
+			kmem_cache_free(ubi_wl_entry_slab, fm->e[i]);
+		kfree(fm);
+	}
+	vfree(buf);
+	kfree(fmsb);
+out_free:
+	ubi_free_vid_hdr(ubi, vh);
+	return err;
+}
+
+/**
+ * fill_fm_buf - take the snapshot of the UBI device state.
+ * @ubi: UBI device description object
+ * @deferred: the erase works which are written to the fastmap as pending are
+ *            moved from @ubi->fm_deferred to this list
+ *
+ * The EBA tables are copied first, and then the PEB lists with no work in
+ * flight. So a PEB which is put after its LEB was re-mapped shows up as used
+ * but not mapped, and is scanned when attaching. This function returns the
+ * size of the fastmap data in @ubi->fm_buf, after the super block, in case of
+ * success and a negative error code in case of failure.
+ */
+static int fill_fm_buf(struct ubi_device *ubi, struct list_head *deferred)
+{
+	void *buf = ubi->fm_buf;
+	struct ubi_fm_pool *pool = &ubi->fm_pool;
+	struct ubi_fm_hdr *fmhdr;
+	struct ubi_fm_volhdr *fmvh;
+	struct ubi_fm_ec *fec;
+	struct ubi_wl_entry *e;
+	struct ubi_work *wrk;
+	struct rb_node *rb;
+	__be32 *pebs;
+	int i, j, pos, vol_count = 0;
+	int free_count = 0, used_count = 0, erase_count = 0;
+
+	memset(buf, 0, ubi->fm_size);
+	pos = sizeof(struct ubi_fm_sb);
+	fmhdr = buf + pos;
+	pos += sizeof(struct ubi_fm_hdr);
+
+	spin_lock(&ubi->volumes_lock);
+	for (i = 0; i < ubi->vtbl_slots + UBI_INT_VOL_COUNT; i++) {
+		struct ubi_volume *vol = ubi->volumes[i];
+
+		if (!vol)
+			continue;
+
+		if (pos + sizeof(struct ubi_fm_volhdr) +
+		    vol->reserved_pebs * sizeof(__be32) > ubi->fm_size) {
+			spin_unlock(&ubi->volumes_lock);
+			ubi_err("fastmap is too small");
+			return -ENOSPC;
+		}
+
+		fmvh = buf + pos;
+		fmvh->magic = cpu_to_be32(UBI_FM_VHDR_MAGIC);
+		fmvh->vol_id = cpu_to_be32(vol->vol_id);
+		if (vol->vol_type == UBI_DYNAMIC_VOLUME)
+			fmvh->vol_type = UBI_VID_DYNAMIC;
+		else
+			fmvh->vol_type = UBI_VID_STATIC;
+		if (vol->vol_id == UBI_LAYOUT_VOLUME_ID)
+			fmvh->compat = UBI_LAYOUT_VOLUME_COMPAT;
+		fmvh->data_pad = cpu_to_be32(vol->data_pad);
+		fmvh->used_ebs = cpu_to_be32(vol->used_ebs);
+		fmvh->last_eb_bytes = cpu_to_be32(vol->last_eb_bytes);
+		fmvh->reserved_pebs = cpu_to_be32(vol->reserved_pebs);
+		pos += sizeof(struct ubi_fm_volhdr);
+
+		pebs = buf + pos;
+		for (j = 0; j < vol->reserved_pebs; j++)
+			pebs[j] = cpu_to_be32(vol->eba_tbl[j]);
+		pos += vol->reserved_pebs * sizeof(__be32);
+		vol_count += 1;
+	}
+	spin_unlock(&ubi->volumes_lock);
+
+	/*
+	 * Each PEB is in at most one of the lists, and @ubi->fm_size is big
+	 * enough for all of them.
+	 */
+	down_write(&ubi->work_sem);
+	spin_lock(&ubi->wl_lock);
+	ubi_wl_refill_pool(ubi);
+	list_splice_init(&ubi->fm_deferred, deferred);
+
+	fec = buf + pos;
+	ubi_rb_for_each_entry(rb, e, &ubi->free, u.rb) {
+		fec->pnum = cpu_to_be32(e->pnum);
+		fec++->ec = cpu_to_be32(e->ec);
+		free_count += 1;
+	}
+
+	ubi_rb_for_each_entry(rb, e, &ubi->used, u.rb) {
+		fec->pnum = cpu_to_be32(e->pnum);
+		fec++->ec = cpu_to_be32(e->ec);
+		used_count += 1;
+	}
+	ubi_rb_for_each_entry(rb, e, &ubi->scrub, u.rb) {
+		fec->pnum = cpu_to_be32(e->pnum);
+		fec++->ec = cpu_to_be32(e->ec);
+		used_count += 1;
+	}
+	ubi_rb_for_each_entry(rb, e, &ubi->erroneous, u.rb) {
+		fec->pnum = cpu_to_be32(e->pnum);
+		fec++->ec = cpu_to_be32(e->ec);
+		used_count += 1;
+	}
+	for (i = 0; i < UBI_PROT_QUEUE_LEN; i++)
+		list_for_each_entry(e, &ubi->pq[i], u.list) {
+			fec->pnum = cpu_to_be32(e->pnum);
+			fec++->ec = cpu_to_be32(e->ec);
+			used_count += 1;
+		}
+
+	list_for_each_entry(wrk, &ubi->works, list) {
+		if (!ubi_is_erase_work(wrk))
+			continue;
+		fec->pnum = cpu_to_be32(wrk->e->pnum);
+		fec++->ec = cpu_to_be32(wrk->e->ec);
+		erase_count += 1;
+	}
+	list_for_each_entry(wrk, deferred, list) {
+		fec->pnum = cpu_to_be32(wrk->e->pnum);
+		fec++->ec = cpu_to_be32(wrk->e->ec);
+		erase_count += 1;
+	}
+
+	pos += (free_count + used_count + erase_count) *
+	       sizeof(struct ubi_fm_ec);
+	pebs = buf + pos;
+	for (i = 0; i < pool->size; i++)
+		pebs[i] = cpu_to_be32(pool->pebs[i]);
+	pos += pool->size * sizeof(__be32);
+	spin_unlock(&ubi->wl_lock);
+	up_write(&ubi->work_sem);
+
+	ubi_assert(pos <= ubi->fm_size);
+	fmhdr->magic = cpu_to_be32(UBI_FM_HDR_MAGIC);
+	fmhdr->free_peb_count = cpu_to_be32(free_count);
+	fmhdr->used_peb_count = cpu_to_be32(used_count);
+	fmhdr->erase_peb_count = cpu_to_be32(erase_count);
+	fmhdr->pool_size = cpu_to_be32(pool->size);
+	fmhdr->vol_count = cpu_to_be32(vol_count);
+
+	dbg_gen("fastmap: %d free, %d used, %d to erase, %d in pool",
+		free_count, used_count, erase_count, pool->size);
+	return pos - sizeof(struct ubi_fm_sb);
+}
+
+/**
+ * write_fm_block - write one fastmap block.
+ * @ubi: UBI device description object
+ * @vh: VID header buffer
+ * @e: the PEB to write to
+ * @lnum: number of the block within the fastmap
+ * @size: size of the whole fastmap, super block included
+ *
+ * This function returns zero in case of success and a negative error code in
+ * case of failure.
+ */
+static int write_fm_block(struct ubi_device *ubi, struct ubi_vid_hdr *vh,
+			  struct ubi_wl_entry *e, int lnum, int size)
+{
+	int err, len;
+
+	vh->vol_type = UBI_VID_DYNAMIC;
+	vh->vol_id = cpu_to_be32(lnum ? UBI_FM_DATA_VOLUME_ID :
+				 UBI_FM_SB_VOLUME_ID);
+	vh->compat = UBI_FM_VOLUME_COMPAT;
+	vh->lnum = cpu_to_be32(lnum);
+
+	err = ubi_io_write_vid_hdr(ubi, e->pnum, vh);
+	if (err)
+		return err;
+
+	len = min(size - lnum * ubi->leb_size, ubi->leb_size);
+	if (len <= 0)
+		return 0;
+
+	return ubi_io_write_data(ubi, ubi->fm_buf + lnum * ubi->leb_size,
+				 e->pnum, 0, ALIGN(len, ubi->min_io_size));
+}
+
+/**
+ * ubi_update_fastmap - write a new fastmap.
+ * @ubi: UBI device description object
+ *
+ * The old fastmap is invalidated first, then the pool is refilled and the new
+ * fastmap is written, the anchor last. The erase works deferred meanwhile are
+ * queued afterwards. If the new fastmap can not be written, fastmap is not
+ * used any more until the next attach. This function returns zero in case of
+ * success and a negative error code in case of failure.
+ */
+int ubi_update_fastmap(struct ubi_device *ubi)
+{
+	struct ubi_fastmap *old, *new;
+	struct ubi_vid_hdr *vh;
+	struct ubi_fm_sb *fmsb = ubi->fm_buf;
+	unsigned long long sqnum;
+	LIST_HEAD(deferred);
+	int i, err, size, bad = -1;
+
+	mutex_lock(&ubi->fm_mutex);
+	if (ubi->fm_disabled || ubi->ro_mode) {
+		mutex_unlock(&ubi->fm_mutex);
+		return 0;
+	}
+
+	new = kzalloc(sizeof(struct ubi_fastmap), GFP_NOFS);
+	if (!new) {
+		mutex_unlock(&ubi->fm_mutex);
+		return -ENOMEM;
+	}
+
+	vh = ubi_zalloc_vid_hdr(ubi, GFP_NOFS);
+	if (!vh) {
+		kfree(new);
+		mutex_unlock(&ubi->fm_mutex);
+		return -ENOMEM;
+	}
+
+	old = ubi->fm;
+	if (old) {
+		err = ubi_wl_erase_fm_peb(ubi, old->e[0]);
+		if (err) {
+			ubi_err("cannot invalidate fastmap anchor PEB %d, "
+				"error %d", old->e[0]->pnum, err);
+			ubi_ro_mode(ubi);
+			goto out_free;
+		}
+
+		/*
+		 * From now on there is no fastmap on flash. Recycle the old
+		 * blocks right away, so the new ones do not eat into the
+		 * free PEBs the pool is refilled with.
+		 */
+		ubi->fm = NULL;
+		for (i = 1; i < old->used_blocks; i++)
+			if (ubi_wl_erase_fm_peb(ubi, old->e[i]))
+				ubi_wl_put_fm_peb(ubi, old->e[i], 1);
+		kfree(old);
+	}
+
+	new->used_blocks = ubi->fm_size / ubi->leb_size;
+	for (i = 0; i < new->used_blocks; i++) {
+		new->e[i] = ubi_wl_get_fm_peb(ubi, i == 0);
+		if (!new->e[i]) {
+			ubi_err("no free PEB for fastmap block %d", i);
+			err = -ENOSPC;
+			goto out_put;
+		}
+	}
+
+	size = fill_fm_buf(ubi, &deferred);
+	if (size < 0) {
+		err = size;
+		goto out_put;
+	}
+
+	for (i = 1; i < new->used_blocks; i++) {
+		vh->sqnum = cpu_to_be64(ubi_next_sqnum(ubi));
+		err = write_fm_block(ubi, vh, new->e[i], i,
+				     size + sizeof(struct ubi_fm_sb));
+		if (err) {
+			bad = i;
+			goto out_put;
+		}
+	}
+
+	/* The anchor gets the highest sequence number of the fastmap */
+	sqnum = ubi_next_sqnum(ubi);
+	fmsb->magic = cpu_to_be32(UBI_FM_SB_MAGIC);
+	fmsb->version = UBI_FM_FMT_VERSION;
+	fmsb->data_size = cpu_to_be32(size);
+	fmsb->used_blocks = cpu_to_be32(new->used_blocks);
+	fmsb->image_seq = cpu_to_be32(ubi->image_seq);
+	fmsb->sqnum = cpu_to_be64(sqnum);
+	for (i = 0; i < new->used_blocks; i++) {
+		fmsb->block_loc[i] = cpu_to_be32(new->e[i]->pnum);
+		fmsb->block_ec[i] = cpu_to_be32(new->e[i]->ec);
+	}
+	fmsb->data_crc = cpu_to_be32(crc32(UBI_CRC32_INIT, ubi->fm_buf,
+				     size + sizeof(struct ubi_fm_sb)));
+
+	vh->sqnum = cpu_to_be64(sqnum);
+	err = write_fm_block(ubi, vh, new->e[0], 0,
+			     size + sizeof(struct ubi_fm_sb));
+	if (err) {
+		bad = 0;
+		goto out_put;
+	}
+
+	ubi->fm = new;
+	ubi_free_vid_hdr(ubi, vh);
+	mutex_unlock(&ubi->fm_mutex);
+
+	dbg_gen("fastmap written, anchor PEB %d", new->e[0]->pnum);
+	ubi_wl_release_works(ubi, &deferred);
+	return 0;
+
+out_put:
+	for (i = 0; i < new->used_blocks && new->e[i]; i++)
+		ubi_wl_put_fm_peb(ubi, new->e[i], i == bad);
+	ubi_wl_release_works(ubi, &deferred);
+	ubi_wl_stop_fm(ubi);
+	ubi_warn("cannot write fastmap, error %d, it is disabled", err);
+	err = 0;
+out_free:
+	kfree(new);
+	ubi_free_vid_hdr(ubi, vh);
+	mutex_unlock(&ubi->fm_mutex);
+	return err;
+}
+
+/**
+ * ubi_fastmap_init - initialize the fastmap sub-system.
+ * @ubi: UBI device description object
+ *
+ * The fastmap always occupies the same number of PEBs, enough for the largest
+ * possible snapshot of this device. Fastmap is disabled if that is more than
+ * %UBI_FM_MAX_BLOCKS. This function returns zero in case of success and a
+ * negative error code in case of failure.
+ */
+int ubi_fastmap_init(struct ubi_device *ubi)
+{
+	size_t size;
+
+	mutex_init(&ubi->fm_mutex);
+	INIT_LIST_HEAD(&ubi->fm_deferred);
+	if (ubi->fm_disabled)
+		return 0;
+
+	size = sizeof(struct ubi_fm_sb) + sizeof(struct ubi_fm_hdr) +
+	       (UBI_MAX_VOLUMES + UBI_INT_VOL_COUNT) *
+	       sizeof(struct ubi_fm_volhdr) +
+	       ubi->peb_count * (sizeof(struct ubi_fm_ec) + sizeof(__be32)) +
+	       UBI_FM_MAX_POOL_SIZE * sizeof(__be32);
+	ubi->fm_size = roundup(size, ubi->leb_size);
+	if (ubi->fm_size / ubi->leb_size > UBI_FM_MAX_BLOCKS) {
+		ubi_warn("device is too large for fastmap, it is disabled");
+		ubi->fm_disabled = 1;
+		return 0;
+	}
+
+	ubi->fm_pool.max_size = clamp_t(int, ubi->peb_count / 20,
+					UBI_FM_MIN_POOL_SIZE,
+					UBI_FM_MAX_POOL_SIZE);
+
+	ubi->fm_buf = vmalloc(ubi->fm_size);
+	if (!ubi->fm_buf)
+		return -ENOMEM;
+
+	dbg_gen("fastmap: %d PEBs, pool of %d PEBs",
+		ubi->fm_size / ubi->leb_size, ubi->fm_pool.max_size);
+	return 0;
+}
+
+/**
+ * ubi_fastmap_close - close the fastmap sub-system.
+ * @ubi: UBI device description object
+ */
+void ubi_fastmap_close(struct ubi_device *ubi)
+{
+	int i;
+
+	if (ubi->fm) {
+		for (i = 0; i < ubi->fm->used_blocks; i++)
+			kmem_cache_free(ubi_wl_entry_slab, ubi->fm->e[i]);
+		kfree(ubi->fm);
+		ubi->fm = NULL;
+	}
+
+	vfree(ubi->fm_buf);
+	ubi->fm_buf = NULL;
+}
@@ -99,7 +99,7 @@ static struct ubi_ec_hdr *ech;
 static struct ubi_vid_hdr *vidh;
 
 /**
- * add_to_list - add physical eraseblock to a list.
+ * ubi_scan_add_to_list - add physical eraseblock to a list.
  * @si: scanning information
  * @pnum: physical eraseblock number to add
  * @ec: erase counter of the physical eraseblock
@@ -114,8 +114,8 @@ static struct ubi_vid_hdr *vidh;
  * returns zero in case of success and a negative error code in case of
  * failure.
  */
-static int add_to_list(struct ubi_scan_info *si, int pnum, int ec, int to_head,
-		       struct list_head *list)
+int ubi_scan_add_to_list(struct ubi_scan_info *si, int pnum, int ec,
+			 int to_head, struct list_head *list)
 {
 	struct ubi_scan_leb *seb;
 
@@ -532,8 +532,8 @@ int ubi_scan_add_used(struct ubi_device *ubi, struct ubi_scan_info *si,
 			if (err)
 				return err;
 
-			err = add_to_list(si, seb->pnum, seb->ec, cmp_res & 4,
-					  &si->erase);
+			err = ubi_scan_add_to_list(si, seb->pnum, seb->ec,
+						   cmp_res & 4, &si->erase);
 			if (err)
 				return err;
 
@@ -553,8 +553,8 @@ int ubi_scan_add_used(struct ubi_device *ubi, struct ubi_scan_info *si,
 			 * This logical eraseblock is older than the one found
 			 * previously.
 			 */
-			return add_to_list(si, pnum, ec, cmp_res & 4,
-					   &si->erase);
+			return ubi_scan_add_to_list(si, pnum, ec, cmp_res & 4,
+						    &si->erase);
 		}
 	}
 
@@ -868,12 +868,12 @@ static int process_eb(struct ubi_device *ubi, struct ubi_scan_info *si,
 		break;
 	case UBI_IO_FF:
 		si->empty_peb_count += 1;
-		return add_to_list(si, pnum, UBI_SCAN_UNKNOWN_EC, 0,
-				   &si->erase);
+		return ubi_scan_add_to_list(si, pnum, UBI_SCAN_UNKNOWN_EC, 0,
+					    &si->erase);
 	case UBI_IO_FF_BITFLIPS:
 		si->empty_peb_count += 1;
-		return add_to_list(si, pnum, UBI_SCAN_UNKNOWN_EC, 1,
-				   &si->erase);
+		return ubi_scan_add_to_list(si, pnum, UBI_SCAN_UNKNOWN_EC, 1,
+					    &si->erase);
 	case UBI_IO_BAD_HDR_EBADMSG:
 	case UBI_IO_BAD_HDR:
 		/*
@@ -984,7 +984,7 @@ static int process_eb(struct ubi_device *ubi, struct ubi_scan_info *si,
 			return err;
 		else if (!err)
 			/* This corruption is caused by a power cut */
-			err = add_to_list(si, pnum, ec, 1, &si->erase);
+			err = ubi_scan_add_to_list(si, pnum, ec, 1, &si->erase);
 		else
 			/* This is an unexpected corruption */
 			err = add_corrupted(si, pnum, ec);
@@ -992,15 +992,15 @@ static int process_eb(struct ubi_device *ubi, struct ubi_scan_info *si,
 			return err;
 		goto adjust_mean_ec;
 	case UBI_IO_FF_BITFLIPS:
-		err = add_to_list(si, pnum, ec, 1, &si->erase);
+		err = ubi_scan_add_to_list(si, pnum, ec, 1, &si->erase);
 		if (err)
 			return err;
 		goto adjust_mean_ec;
 	case UBI_IO_FF:
 		if (ec_err || bitflips)
-			err = add_to_list(si, pnum, ec, 1, &si->erase);
+			err = ubi_scan_add_to_list(si, pnum, ec, 1, &si->erase);
 		else
-			err = add_to_list(si, pnum, ec, 0, &si->free);
+			err = ubi_scan_add_to_list(si, pnum, ec, 0, &si->free);
 		if (err)
 			return err;
 		goto adjust_mean_ec;
@@ -1017,9 +1017,30 @@ static int process_eb(struct ubi_device *ubi, struct ubi_scan_info *si,
 		/* Unsupported internal volume */
 		switch (vidh->compat) {
 		case UBI_COMPAT_DELETE:
+			if (vol_id == UBI_FM_SB_VOLUME_ID && !ec_err) {
+				/*
+				 * A fastmap which is not used gets stale once
+				 * we write to the device, so it has to be gone
+				 * before that rather than just scheduled for
+				 * erasure.
+				 */
+				dbg_bld("erase fastmap anchor at PEB %d", pnum);
+				err = ubi_scan_erase_peb(ubi, si, pnum, ec + 1);
+				if (!err)
+					return ubi_scan_add_to_list(si, pnum,
+								    ec + 1, 0,
+								    &si->free);
+				if (err == -ENOMEM)
+					return err;
+				ubi_warn("cannot erase fastmap anchor at PEB %d",
+					 pnum);
+				return ubi_scan_add_to_list(si, pnum, ec, 1,
+							    &si->erase);
+			}
+
 			ubi_msg("\"delete\" compatible internal volume %d:%d"
 				" found, will remove it", vol_id, lnum);
-			err = add_to_list(si, pnum, ec, 1, &si->erase);
+			err = ubi_scan_add_to_list(si, pnum, ec, 1, &si->erase);
 			if (err)
 				return err;
 			return 0;
@@ -1034,7 +1055,7 @@ static int process_eb(struct ubi_device *ubi, struct ubi_scan_info *si,
 		case UBI_COMPAT_PRESERVE:
 			ubi_msg("\"preserve\" compatible internal volume %d:%d"
 				" found", vol_id, lnum);
-			err = add_to_list(si, pnum, ec, 0, &si->alien);
+			err = ubi_scan_add_to_list(si, pnum, ec, 0, &si->alien);
 			if (err)
 				return err;
 			return 0;
@@ -1141,23 +1162,17 @@ static int check_what_we_have(struct ubi_device *ubi, struct ubi_scan_info *si)
 }
 
 /**
- * ubi_scan - scan an MTD device.
- * @ubi: UBI device description object
+ * alloc_si - allocate scanning information.
  *
- * This function does full scanning of an MTD device and returns complete
- * information about it. In case of failure, an error code is returned.
+ * Returns the new scanning information or %NULL if there is no memory.
  */
-struct ubi_scan_info *ubi_scan(struct ubi_device *ubi)
+static struct ubi_scan_info *alloc_si(void)
 {
-	int err, pnum;
-	struct rb_node *rb1, *rb2;
-	struct ubi_scan_volume *sv;
-	struct ubi_scan_leb *seb;
 	struct ubi_scan_info *si;
 
 	si = kzalloc(sizeof(struct ubi_scan_info), GFP_KERNEL);
 	if (!si)
-		return ERR_PTR(-ENOMEM);
+		return NULL;
 
 	INIT_LIST_HEAD(&si->corr);
 	INIT_LIST_HEAD(&si->free);
@@ -1165,13 +1180,102 @@ struct ubi_scan_info *ubi_scan(struct ubi_device *ubi)
 	INIT_LIST_HEAD(&si->alien);
 	si->volumes = RB_ROOT;
 
-	err = -ENOMEM;
 	si->scan_leb_slab = kmem_cache_create("ubi_scan_leb_slab",
 					      sizeof(struct ubi_scan_leb),
 					      0, 0, NULL);
-	if (!si->scan_leb_slab)
-		goto out_si;
+	if (!si->scan_leb_slab) {
+		kfree(si);
+		return NULL;
+	}
+
+	return si;
+}
+
+#ifdef CONFIG_MTD_UBI_FASTMAP
+/**
+ * scan_fastmap - attach using the fastmap, if there is one.
+ * @ubi: UBI device description object
+ * @si: scanning information, may be replaced
+ * @known: the bitmap of PEBs which do not have to be scanned is returned here
+ *
+ * If there is no usable fastmap, @known is set to %NULL and all PEBs are
+ * scanned. This function returns zero in case of success and a negative error
+ * code in case of failure.
+ */
+static int scan_fastmap(struct ubi_device *ubi, struct ubi_scan_info **si,
+			unsigned long **known)
+{
+	int err;
+
+	*known = NULL;
+	if (ubi->fm_disabled)
+		return 0;
+
+	*known = kcalloc(BITS_TO_LONGS(ubi->peb_count), sizeof(unsigned long),
+			 GFP_KERNEL);
+	if (!*known)
+		return -ENOMEM;
+
+	err = ubi_scan_fastmap(ubi, *si, *known);
+	if (err == 0) {
+		(*si)->fastmap = 1;
+		return 0;
+	}
+
+	kfree(*known);
+	*known = NULL;
+	if (err < 0)
+		return err;
+
+	if (err == UBI_BAD_FASTMAP) {
+		ubi_warn("bad fastmap, attach by scanning");
+		ubi_scan_destroy_si(*si);
+		*si = alloc_si();
+		if (!*si)
+			return -ENOMEM;
+	}
+
+	return 0;
+}
+#else
+static inline int scan_fastmap(struct ubi_device *ubi,
+			       struct ubi_scan_info **si,
+			       unsigned long **known)
+{
+	*known = NULL;
+	return 0;
+}
+#endif
+
+/**
+ * ubi_scan - scan an MTD device.
+ * @ubi: UBI device description object
+ *
+ * This function does full scanning of an MTD device and returns complete
+ * information about it. If there is a fastmap, only the PEBs it does not
+ * describe are scanned. In case of failure, an error code is returned.
+ */
+struct ubi_scan_info *ubi_scan(struct ubi_device *ubi)
+{
+	int err, pnum;
+	struct rb_node *rb1, *rb2;
+	struct ubi_scan_volume *sv;
+	struct ubi_scan_leb *seb;
+	struct ubi_scan_info *si;
+	unsigned long *known;
+
+	si = alloc_si();
+	if (!si)
+		return ERR_PTR(-ENOMEM);
+
+	err = scan_fastmap(ubi, &si, &known);
+	if (err) {
+		if (si)
+			ubi_scan_destroy_si(si);
+		return ERR_PTR(err);
+	}
 
+	err = -ENOMEM;
 	ech = kzalloc(ubi->ec_hdr_alsize, GFP_KERNEL);
 	if (!ech)
 		goto out_si;
@@ -1181,6 +1285,9 @@ struct ubi_scan_info *ubi_scan(struct ubi_device *ubi)
 		goto out_ech;
 
 	for (pnum = 0; pnum < ubi->peb_count; pnum++) {
+		if (known && test_bit(pnum, known))
+			continue;
+
 		cond_resched();
 
 		dbg_gen("process PEB %d", pnum);
@@ -1222,12 +1329,16 @@ struct ubi_scan_info *ubi_scan(struct ubi_device *ubi)
 		if (seb->ec == UBI_SCAN_UNKNOWN_EC)
 			seb->ec = si->mean_ec;
 
-	err = paranoid_check_si(ubi, si);
-	if (err)
-		goto out_vidh;
+	/* The fastmap does not keep everything the checks look at */
+	if (!si->fastmap) {
+		err = paranoid_check_si(ubi, si);
+		if (err)
+			goto out_vidh;
+	}
 
 	ubi_free_vid_hdr(ubi, vidh);
 	kfree(ech);
+	kfree(known);
 
 	return si;
 
@@ -1236,6 +1347,7 @@ out_vidh:
 out_ech:
 	kfree(ech);
 out_si:
+	kfree(known);
 	ubi_scan_destroy_si(si);
 	return ERR_PTR(err);
 }
@@ -103,6 +103,7 @@ struct ubi_scan_volume {
  * @vols_found: number of volumes found during scanning
  * @highest_vol_id: highest volume ID
  * @is_empty: flag indicating whether the MTD device is empty or not
+ * @fastmap: non-zero if the device was attached using the fastmap
  * @min_ec: lowest erase counter value
  * @max_ec: highest erase counter value
  * @max_sqnum: highest sequence number value
@@ -129,6 +130,7 @@ struct ubi_scan_info {
 	int vols_found;
 	int highest_vol_id;
 	int is_empty;
+	int fastmap;
 	int min_ec;
 	int max_ec;
 	unsigned long long max_sqnum;
@@ -156,6 +158,8 @@ static inline void ubi_scan_move_to_list(struct ubi_scan_volume *sv,
 		list_add_tail(&seb->u.list, list);
 }
 
+int ubi_scan_add_to_list(struct ubi_scan_info *si, int pnum, int ec,
+			 int to_head, struct list_head *list);
 int ubi_scan_add_used(struct ubi_device *ubi, struct ubi_scan_info *si,
 		      int pnum, int ec, const struct ubi_vid_hdr *vid_hdr,
 		      int bitflips);
@@ -312,6 +312,16 @@ struct ubi_vid_hdr {
 #define UBI_LAYOUT_VOLUME_NAME   "layout volume"
 #define UBI_LAYOUT_VOLUME_COMPAT UBI_COMPAT_REJECT
 
+/*
+ * The fastmap volumes contain the fastmap super block and the fastmap data.
+ * They are "delete" compatible, so UBI implementations which do not support
+ * fastmap just erase them.
+ */
+
+#define UBI_FM_SB_VOLUME_ID      (UBI_INTERNAL_VOL_START + 16)
+#define UBI_FM_DATA_VOLUME_ID    (UBI_INTERNAL_VOL_START + 17)
+#define UBI_FM_VOLUME_COMPAT     UBI_COMPAT_DELETE
+
 /* The maximum number of volumes per one UBI device */
 #define UBI_MAX_VOLUMES 128
 
@@ -375,4 +385,130 @@ struct ubi_vtbl_record {
 	__be32  crc;
 } __packed;
 
+/* The version of the fastmap on-flash format */
+#define UBI_FM_FMT_VERSION 1
+
+/* Fastmap super block magic number (ASCII "UBFS") */
+#define UBI_FM_SB_MAGIC   0x55424653
+/* Fastmap data header magic number (ASCII "UBFH") */
+#define UBI_FM_HDR_MAGIC  0x55424648
+/* Fastmap volume record magic number (ASCII "UBFV") */
+#define UBI_FM_VHDR_MAGIC 0x55424656
+
+/* The fastmap anchor PEB is always one of the first %UBI_FM_MAX_START PEBs */
+#define UBI_FM_MAX_START 64
+
+/* The maximum number of PEBs the fastmap may occupy */
+#define UBI_FM_MAX_BLOCKS 32
+
+/* The maximum number of PEBs in the fastmap pool */
+#define UBI_FM_MAX_POOL_SIZE 256
+
+/**
+ * struct ubi_fm_sb - fastmap super block.
+ * @magic: fastmap super block magic number (%UBI_FM_SB_MAGIC)
+ * @version: format version of this fastmap (%UBI_FM_FMT_VERSION)
+ * @padding1: reserved for future, zeroes
+ * @data_crc: CRC32 checksum of the super block, with this field set to zero,
+ *            and of the fastmap data
+ * @data_size: size of the fastmap data in bytes
+ * @used_blocks: number of PEBs this fastmap occupies
+ * @image_seq: image sequence number of the UBI device
+ * @sqnum: sequence number of the anchor PEB's VID header
+ * @block_loc: PEBs this fastmap occupies, @block_loc[0] is the anchor
+ * @block_ec: erase counters of the @block_loc PEBs
+ * @padding2: reserved for future, zeroes
+ *
+ * The super block is stored at the beginning of the anchor PEB, which belongs
+ * to the %UBI_FM_SB_VOLUME_ID volume. The fastmap data follows it there and
+ * continues in the other @block_loc PEBs, which belong to the
+ * %UBI_FM_DATA_VOLUME_ID volume, each at the beginning of LEB number @i for
+ * @block_loc[@i].
+ *
+ * The fastmap data starts with a &struct ubi_fm_hdr.
+ */
+struct ubi_fm_sb {
+	__be32  magic;
+	__u8    version;
+	__u8    padding1[3];
+	__be32  data_crc;
+	__be32  data_size;
+	__be32  used_blocks;
+	__be32  image_seq;
+	__be64  sqnum;
+	__be32  block_loc[UBI_FM_MAX_BLOCKS];
+	__be32  block_ec[UBI_FM_MAX_BLOCKS];
+	__u8    padding2[32];
+} __packed;
+
+/**
+ * struct ubi_fm_hdr - fastmap data header.
+ * @magic: fastmap data header magic number (%UBI_FM_HDR_MAGIC)
+ * @free_peb_count: number of free PEBs
+ * @used_peb_count: number of used PEBs
+ * @erase_peb_count: number of PEBs which have to be erased
+ * @pool_size: number of PEBs in the pool
+ * @vol_count: number of volume records
+ * @padding: reserved for future, zeroes
+ *
+ * The header is followed by @vol_count volume records, then by
+ * @free_peb_count, @used_peb_count and @erase_peb_count &struct ubi_fm_ec
+ * records, in that order, and finally by @pool_size big-endian PEB numbers.
+ *
+ * PEBs which were handed out from the pool after the fastmap had been written
+ * may contain newer data than the fastmap describes, so their VID headers
+ * have to be read when attaching. The same goes for PEBs which the fastmap
+ * does not mention at all, and for used PEBs no volume record maps.
+ */
+struct ubi_fm_hdr {
+	__be32  magic;
+	__be32  free_peb_count;
+	__be32  used_peb_count;
+	__be32  erase_peb_count;
+	__be32  pool_size;
+	__be32  vol_count;
+	__u8    padding[8];
+} __packed;
+
+/**
+ * struct ubi_fm_ec - fastmap erase counter record.
+ * @pnum: physical eraseblock number
+ * @ec: erase counter
+ */
+struct ubi_fm_ec {
+	__be32  pnum;
+	__be32  ec;
+} __packed;
+
+/**
+ * struct ubi_fm_volhdr - fastmap volume record.
+ * @magic: fastmap volume record magic number (%UBI_FM_VHDR_MAGIC)
+ * @vol_id: volume ID
+ * @vol_type: volume type (%UBI_VID_DYNAMIC or %UBI_VID_STATIC)
+ * @compat: compatibility flags of the volume
+ * @padding1: reserved for future, zeroes
+ * @data_pad: how many bytes at the end of logical eraseblocks of this volume
+ *            are not used
+ * @used_ebs: number of used logical eraseblocks (static volumes only)
+ * @last_eb_bytes: number of bytes in the last used logical eraseblock (static
+ *                 volumes only)
+ * @reserved_pebs: number of logical eraseblocks of the volume
+ * @padding2: reserved for future, zeroes
+ *
+ * The record is followed by the EBA table of the volume: @reserved_pebs
+ * big-endian PEB numbers, %-1 for unmapped logical eraseblocks.
+ */
+struct ubi_fm_volhdr {
+	__be32  magic;
+	__be32  vol_id;
+	__u8    vol_type;
+	__u8    compat;
+	__u8    padding1[2];
+	__be32  data_pad;
+	__be32  used_ebs;
+	__be32  last_eb_bytes;
+	__be32  reserved_pebs;
+	__u8    padding2[4];
+} __packed;
+
 #endif /* !__UBI_MEDIA_H__ */
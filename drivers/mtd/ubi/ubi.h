@@ -131,6 +131,18 @@ enum {
 	MOVE_RETRY,
 };
 
+/*
+ * Return codes of the 'ubi_scan_fastmap()' function.
+ *
+ * UBI_NO_FASTMAP: there is no fastmap on the device
+ * UBI_BAD_FASTMAP: the fastmap is corrupted or inconsistent and the device has
+ *                  to be scanned
+ */
+enum {
+	UBI_NO_FASTMAP = 1,
+	UBI_BAD_FASTMAP,
+};
+
 /**
  * struct ubi_wl_entry - wear-leveling entry.
  * @u.rb: link in the corresponding (free/used) RB-tree
@@ -151,6 +163,62 @@ struct ubi_wl_entry {
 	int pnum;
 };
 
+/**
+ * struct ubi_work - UBI work description data structure.
+ * @list: a link in the list of pending works
+ * @func: worker function
+ * @e: physical eraseblock to erase
+ * @torture: if the physical eraseblock has to be tortured
+ *
+ * The @func pointer points to the worker function. If the @cancel argument is
+ * not zero, the worker has to free the resources and exit immediately. The
+ * worker has to return zero in case of success and a negative error code in
+ * case of failure.
+ */
+struct ubi_work {
+	struct list_head list;
+	int (*func)(struct ubi_device *ubi, struct ubi_work *wrk, int cancel);
+	/* The below fields are only relevant to erasure works */
+	struct ubi_wl_entry *e;
+	int torture;
+	/* Only relevant to WL works, see 'ubi_wl_get_fm_peb()' */
+	int anchor;
+};
+
+#ifdef CONFIG_MTD_UBI_FASTMAP
+
+/**
+ * struct ubi_fastmap - in-memory description of the on-flash fastmap.
+ * @used_blocks: number of PEBs the fastmap occupies
+ * @e: WL entries of these PEBs, @e[0] is the anchor
+ *
+ * The WL entries are owned by this object and are not in any WL tree.
+ */
+struct ubi_fastmap {
+	int used_blocks;
+	struct ubi_wl_entry *e[UBI_FM_MAX_BLOCKS];
+};
+
+/**
+ * struct ubi_fm_pool - the pool of PEBs handed out between fastmap writes.
+ * @pebs: PEB numbers in the pool
+ * @used: number of PEBs already handed out, they are at the head of @pebs
+ * @size: number of PEBs in the pool
+ * @max_size: how many PEBs the pool is refilled with
+ *
+ * Only PEBs from the pool are written to while a fastmap is on flash, so only
+ * they have to be scanned when attaching. The pool is refilled from the
+ * @ubi->free tree whenever a new fastmap is written.
+ */
+struct ubi_fm_pool {
+	int pebs[UBI_FM_MAX_POOL_SIZE];
+	int used;
+	int size;
+	int max_size;
+};
+
+#endif /* CONFIG_MTD_UBI_FASTMAP */
+
 /**
  * struct ubi_ltree_entry - an entry in the lock tree.
  * @rb: links RB-tree nodes
@@ -343,7 +411,8 @@ struct ubi_wl_entry;
  * @pq_head: protection queue head
  * @wl_lock: protects the @used, @free, @pq, @pq_head, @lookuptbl, @move_from,
  *	     @move_to, @move_to_put @erase_pending, @wl_scheduled, @works,
- *	     @erroneous, and @erroneous_peb_count fields
+ *	     @erroneous, @erroneous_peb_count, @fm_pool, @fm_deferred and
+ *	     @fm_disabled fields
  * @move_mutex: serializes eraseblock moves
  * @work_sem: synchronizes the WL worker with use tasks
  * @wl_scheduled: non-zero if the wear-leveling was scheduled
@@ -358,6 +427,15 @@ struct ubi_wl_entry;
  * @thread_enabled: if the background thread is enabled
  * @bgt_name: background thread name
  *
+ * @fm: the fastmap currently on flash, %NULL if there is none
+ * @fm_pool: PEBs which may be handed out before the next fastmap is written
+ * @fm_deferred: erase works of PEBs put since the last fastmap was written,
+ *               they are queued only once a new fastmap is on flash
+ * @fm_mutex: serializes fastmap writes and protects @fm
+ * @fm_buf: buffer the fastmap is built in
+ * @fm_size: size of @fm_buf, a multiple of @leb_size
+ * @fm_disabled: if fastmap is not used for this device
+ *
  * @flash_size: underlying MTD device size (in bytes)
  * @peb_count: count of physical eraseblocks on the MTD device
  * @peb_size: physical eraseblock size
@@ -446,6 +524,17 @@ struct ubi_device {
 	int thread_enabled;
 	char bgt_name[sizeof(UBI_BGT_NAME_PATTERN)+2];
 
+#ifdef CONFIG_MTD_UBI_FASTMAP
+	/* Fastmap stuff */
+	struct ubi_fastmap *fm;
+	struct ubi_fm_pool fm_pool;
+	struct list_head fm_deferred;
+	struct mutex fm_mutex;
+	void *fm_buf;
+	int fm_size;
+	int fm_disabled;
+#endif
+
 	/* I/O sub-system's stuff */
 	long long flash_size;
 	int peb_count;
@@ -534,6 +623,7 @@ int ubi_eba_atomic_leb_change(struct ubi_device *ubi, struct ubi_volume *vol,
 int ubi_eba_copy_leb(struct ubi_device *ubi, int from, int to,
 		     struct ubi_vid_hdr *vid_hdr);
 int ubi_eba_init_scan(struct ubi_device *ubi, struct ubi_scan_info *si);
+unsigned long long ubi_next_sqnum(struct ubi_device *ubi);
 
 /* wl.c */
 int ubi_wl_get_peb(struct ubi_device *ubi, int dtype);
@@ -543,6 +633,27 @@ int ubi_wl_scrub_peb(struct ubi_device *ubi, int pnum);
 int ubi_wl_init_scan(struct ubi_device *ubi, struct ubi_scan_info *si);
 void ubi_wl_close(struct ubi_device *ubi);
 int ubi_thread(void *u);
+#ifdef CONFIG_MTD_UBI_FASTMAP
+int ubi_is_erase_work(struct ubi_work *wrk);
+struct ubi_wl_entry *ubi_wl_get_fm_peb(struct ubi_device *ubi, int anchor);
+int ubi_wl_put_fm_peb(struct ubi_device *ubi, struct ubi_wl_entry *e,
+		      int torture);
+int ubi_wl_erase_fm_peb(struct ubi_device *ubi, struct ubi_wl_entry *e);
+void ubi_wl_refill_pool(struct ubi_device *ubi);
+void ubi_wl_release_works(struct ubi_device *ubi, struct list_head *list);
+void ubi_wl_stop_fm(struct ubi_device *ubi);
+
+/* fastmap.c */
+int ubi_scan_fastmap(struct ubi_device *ubi, struct ubi_scan_info *si,
+		     unsigned long *known);
+int ubi_update_fastmap(struct ubi_device *ubi);
+int ubi_fastmap_init(struct ubi_device *ubi);
+void ubi_fastmap_close(struct ubi_device *ubi);
+#else
+static inline int ubi_update_fastmap(struct ubi_device *ubi) { return 0; }
+static inline int ubi_fastmap_init(struct ubi_device *ubi) { return 0; }
+static inline void ubi_fastmap_close(struct ubi_device *ubi) { }
+#endif
 
 /* io.c */
 int ubi_io_read(const struct ubi_device *ubi, void *buf, int pnum, int offset,
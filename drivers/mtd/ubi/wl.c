@@ -142,26 +142,6 @@
  */
 #define WL_MAX_FAILURES 32
 
-/**
- * struct ubi_work - UBI work description data structure.
- * @list: a link in the list of pending works
- * @func: worker function
- * @e: physical eraseblock to erase
- * @torture: if the physical eraseblock has to be tortured
- *
- * The @func pointer points to the worker function. If the @cancel argument is
- * not zero, the worker has to free the resources and exit immediately. The
- * worker has to return zero in case of success and a negative error code in
- * case of failure.
- */
-struct ubi_work {
-	struct list_head list;
-	int (*func)(struct ubi_device *ubi, struct ubi_work *wrk, int cancel);
-	/* The below fields are only relevant to erasure works */
-	struct ubi_wl_entry *e;
-	int torture;
-};
-
 #ifdef CONFIG_MTD_UBI_DEBUG
 static int paranoid_check_ec(struct ubi_device *ubi, int pnum, int ec);
 static int paranoid_check_in_wl_tree(const struct ubi_device *ubi,
@@ -380,39 +360,105 @@ static struct ubi_wl_entry *find_wl_entry(struct rb_root *root, int diff)
 	return e;
 }
 
+#ifdef CONFIG_MTD_UBI_FASTMAP
+
 /**
- * ubi_wl_get_peb - get a physical eraseblock.
+ * find_anchor_wl_entry - find a used PEB which may hold the fastmap anchor.
+ * @root: the RB-tree where to look for
+ *
+ * This function returns the wear leveling entry with the lowest erase counter
+ * among the first %UBI_FM_MAX_START PEBs, or %NULL if there is none.
+ */
+static struct ubi_wl_entry *find_anchor_wl_entry(struct rb_root *root)
+{
+	struct rb_node *p;
+	struct ubi_wl_entry *e;
+
+	for (p = rb_first(root); p; p = rb_next(p)) {
+		e = rb_entry(p, struct ubi_wl_entry, u.rb);
+		if (e->pnum < UBI_FM_MAX_START)
+			return e;
+	}
+
+	return NULL;
+}
+
+/**
+ * find_pool_peb - find a physical eraseblock in the fastmap pool.
  * @ubi: UBI device description object
  * @dtype: type of data which will be stored in this physical eraseblock
  *
- * This function returns a physical eraseblock in case of success and a
- * negative error code in case of failure. Might sleep.
+ * The pool is refilled from both ends of the @ubi->free tree, so long term
+ * data gets the most worn out PEB left in the pool and short term data the
+ * least worn out one. Returns %NULL if the pool is exhausted.
  */
-int ubi_wl_get_peb(struct ubi_device *ubi, int dtype)
+static struct ubi_wl_entry *find_pool_peb(struct ubi_device *ubi, int dtype)
 {
-	int err;
-	struct ubi_wl_entry *e, *first, *last;
+	struct ubi_fm_pool *pool = &ubi->fm_pool;
+	struct ubi_wl_entry *e, *best = NULL;
+	int i;
 
-	ubi_assert(dtype == UBI_LONGTERM || dtype == UBI_SHORTTERM ||
-		   dtype == UBI_UNKNOWN);
+	if (pool->used == pool->size)
+		return NULL;
 
-retry:
-	spin_lock(&ubi->wl_lock);
-	if (!ubi->free.rb_node) {
-		if (ubi->works_count == 0) {
-			ubi_assert(list_empty(&ubi->works));
-			ubi_err("no free eraseblocks");
-			spin_unlock(&ubi->wl_lock);
-			return -ENOSPC;
-		}
-		spin_unlock(&ubi->wl_lock);
+	if (dtype == UBI_UNKNOWN)
+		return ubi->lookuptbl[pool->pebs[pool->used]];
 
-		err = produce_free_peb(ubi);
-		if (err < 0)
-			return err;
-		goto retry;
+	for (i = pool->used; i < pool->size; i++) {
+		e = ubi->lookuptbl[pool->pebs[i]];
+		if (!best)
+			best = e;
+		else if (dtype == UBI_LONGTERM && e->ec > best->ec)
+			best = e;
+		else if (dtype == UBI_SHORTTERM && e->ec < best->ec)
+			best = e;
 	}
 
+	return best;
+}
+
+/**
+ * take_pool_peb - remove a physical eraseblock from the fastmap pool.
+ * @ubi: UBI device description object
+ * @e: the physical eraseblock to remove
+ */
+static void take_pool_peb(struct ubi_device *ubi, struct ubi_wl_entry *e)
+{
+	struct ubi_fm_pool *pool = &ubi->fm_pool;
+	int i;
+
+	for (i = pool->used; i < pool->size; i++)
+		if (pool->pebs[i] == e->pnum)
+			break;
+
+	ubi_assert(i < pool->size);
+	pool->pebs[i] = pool->pebs[pool->used];
+	pool->pebs[pool->used++] = e->pnum;
+}
+
+#endif /* CONFIG_MTD_UBI_FASTMAP */
+
+/**
+ * find_free_peb - find a free physical eraseblock.
+ * @ubi: UBI device description object
+ * @dtype: type of data which will be stored in this physical eraseblock
+ *
+ * This function returns the free physical eraseblock which suits @dtype best,
+ * or %NULL if there is none. While fastmap is used, only PEBs from the
+ * fastmap pool are handed out. Note, @ubi->wl_lock has to be locked.
+ */
+static struct ubi_wl_entry *find_free_peb(struct ubi_device *ubi, int dtype)
+{
+	struct ubi_wl_entry *e, *first, *last;
+
+#ifdef CONFIG_MTD_UBI_FASTMAP
+	if (!ubi->fm_disabled)
+		return find_pool_peb(ubi, dtype);
+#endif
+
+	if (!ubi->free.rb_node)
+		return NULL;
+
 	switch (dtype) {
 	case UBI_LONGTERM:
 		/*
@@ -451,13 +497,85 @@ retry:
 		BUG();
 	}
 
+	return e;
+}
+
+/**
+ * take_free_peb - take a physical eraseblock found by 'find_free_peb()'.
+ * @ubi: UBI device description object
+ * @e: the physical eraseblock to take
+ *
+ * Note, @ubi->wl_lock has to be locked.
+ */
+static void take_free_peb(struct ubi_device *ubi, struct ubi_wl_entry *e)
+{
+#ifdef CONFIG_MTD_UBI_FASTMAP
+	if (!ubi->fm_disabled) {
+		take_pool_peb(ubi, e);
+		return;
+	}
+#endif
+
 	paranoid_check_in_wl_tree(ubi, e, &ubi->free);
+	rb_erase(&e->u.rb, &ubi->free);
+}
+
+/**
+ * ubi_wl_get_peb - get a physical eraseblock.
+ * @ubi: UBI device description object
+ * @dtype: type of data which will be stored in this physical eraseblock
+ *
+ * This function returns a physical eraseblock in case of success and a
+ * negative error code in case of failure. Might sleep.
+ */
+int ubi_wl_get_peb(struct ubi_device *ubi, int dtype)
+{
+	int err;
+	struct ubi_wl_entry *e;
+
+	ubi_assert(dtype == UBI_LONGTERM || dtype == UBI_SHORTTERM ||
+		   dtype == UBI_UNKNOWN);
+
+retry:
+	spin_lock(&ubi->wl_lock);
+	e = find_free_peb(ubi, dtype);
+	if (!e) {
+#ifdef CONFIG_MTD_UBI_FASTMAP
+		if (!ubi->fm_disabled && (ubi->free.rb_node ||
+					  !list_empty(&ubi->fm_deferred))) {
+			/*
+			 * The pool is exhausted. Writing a new fastmap refills
+			 * it and lets the PEBs put meanwhile be erased.
+			 */
+			spin_unlock(&ubi->wl_lock);
+
+			err = ubi_update_fastmap(ubi);
+			if (err)
+				return err;
+			if (ubi->ro_mode)
+				return -EROFS;
+			goto retry;
+		}
+#endif
+		if (ubi->works_count == 0) {
+			ubi_assert(list_empty(&ubi->works));
+			ubi_err("no free eraseblocks");
+			spin_unlock(&ubi->wl_lock);
+			return -ENOSPC;
+		}
+		spin_unlock(&ubi->wl_lock);
+
+		err = produce_free_peb(ubi);
+		if (err < 0)
+			return err;
+		goto retry;
+	}
 
 	/*
 	 * Move the physical eraseblock to the protection queue where it will
 	 * be protected from being moved for some time.
 	 */
-	rb_erase(&e->u.rb, &ubi->free);
+	take_free_peb(ubi, e);
 	dbg_wl("PEB %d EC %d", e->pnum, e->ec);
 	prot_queue_add(ubi, e);
 	spin_unlock(&ubi->wl_lock);
@@ -652,6 +770,53 @@ static int schedule_erase(struct ubi_device *ubi, struct ubi_wl_entry *e,
 	return 0;
 }
 
+#ifdef CONFIG_MTD_UBI_FASTMAP
+/**
+ * schedule_put_erase - schedule erasure of a physical eraseblock which was put.
+ * @ubi: UBI device description object
+ * @e: the WL entry of the physical eraseblock to erase
+ * @torture: if the physical eraseblock has to be tortured
+ *
+ * The fastmap on flash may still map a LEB to the put PEB. Were the PEB erased
+ * before the next fastmap is written, attaching would map the LEB to an empty
+ * PEB. So while fastmap is used the erase work is parked on
+ * @ubi->fm_deferred, and it is queued once a new fastmap is on flash.
+ *
+ * This function returns zero in case of success and a %-ENOMEM in case of
+ * failure.
+ */
+static int schedule_put_erase(struct ubi_device *ubi, struct ubi_wl_entry *e,
+			      int torture)
+{
+	struct ubi_work *wl_wrk;
+
+	wl_wrk = kmalloc(sizeof(struct ubi_work), GFP_NOFS);
+	if (!wl_wrk)
+		return -ENOMEM;
+
+	wl_wrk->func = &erase_worker;
+	wl_wrk->e = e;
+	wl_wrk->torture = torture;
+
+	spin_lock(&ubi->wl_lock);
+	if (!ubi->fm_disabled) {
+		dbg_wl("defer erasure of PEB %d, EC %d, torture %d",
+		       e->pnum, e->ec, torture);
+		list_add_tail(&wl_wrk->list, &ubi->fm_deferred);
+		spin_unlock(&ubi->wl_lock);
+		return 0;
+	}
+	spin_unlock(&ubi->wl_lock);
+
+	dbg_wl("schedule erasure of PEB %d, EC %d, torture %d",
+	       e->pnum, e->ec, torture);
+	schedule_ubi_work(ubi, wl_wrk);
+	return 0;
+}
+#else
+#define schedule_put_erase schedule_erase
+#endif
+
 /**
  * wear_leveling_worker - wear-leveling worker function.
  * @ubi: UBI device description object
@@ -659,14 +824,16 @@ static int schedule_erase(struct ubi_device *ubi, struct ubi_wl_entry *e,
  * @cancel: non-zero if the worker has to free memory and exit
  *
  * This function copies a more worn out physical eraseblock to a less worn out
- * one. Returns zero in case of success and a negative error code in case of
+ * one. If @wrk->anchor is set, the data of one of the first %UBI_FM_MAX_START
+ * PEBs is moved out instead, so that the fastmap anchor may be put there.
+ * Returns zero in case of success and a negative error code in case of
  * failure.
  */
 static int wear_leveling_worker(struct ubi_device *ubi, struct ubi_work *wrk,
 				int cancel)
 {
 	int err, scrubbing = 0, torture = 0, protect = 0, erroneous = 0;
-	int vol_id = -1, uninitialized_var(lnum);
+	int vol_id = -1, uninitialized_var(lnum), anchor = wrk->anchor;
 	struct ubi_wl_entry *e1, *e2;
 	struct ubi_vid_hdr *vid_hdr;
 
@@ -683,8 +850,31 @@ static int wear_leveling_worker(struct ubi_device *ubi, struct ubi_work *wrk,
 	ubi_assert(!ubi->move_from && !ubi->move_to);
 	ubi_assert(!ubi->move_to_put);
 
-	if (!ubi->free.rb_node ||
-	    (!ubi->used.rb_node && !ubi->scrub.rb_node)) {
+#ifdef CONFIG_MTD_UBI_FASTMAP
+	if (anchor) {
+		/*
+		 * This is done while no fastmap is being used, so the PEB is
+		 * taken from the @ubi->free tree rather than from the pool.
+		 */
+		e1 = find_anchor_wl_entry(&ubi->used);
+		if (!e1 || !ubi->free.rb_node) {
+			dbg_wl("cancel anchor move: used %d, free %d",
+			       !!e1, !!ubi->free.rb_node);
+			goto out_cancel;
+		}
+		e2 = find_wl_entry(&ubi->free, WL_FREE_MAX_DIFF);
+		paranoid_check_in_wl_tree(ubi, e1, &ubi->used);
+		rb_erase(&e1->u.rb, &ubi->used);
+		paranoid_check_in_wl_tree(ubi, e2, &ubi->free);
+		rb_erase(&e2->u.rb, &ubi->free);
+		dbg_wl("move anchor candidate PEB %d EC %d to PEB %d EC %d",
+		       e1->pnum, e1->ec, e2->pnum, e2->ec);
+		goto move;
+	}
+#endif
+
+	e2 = find_free_peb(ubi, UBI_LONGTERM);
+	if (!e2 || (!ubi->used.rb_node && !ubi->scrub.rb_node)) {
 		/*
 		 * No free physical eraseblocks? Well, they must be waiting in
 		 * the queue to be erased. Cancel movement - it will be
@@ -696,7 +886,7 @@ static int wear_leveling_worker(struct ubi_device *ubi, struct ubi_work *wrk,
 		 * triggered again.
 		 */
 		dbg_wl("cancel WL, a list is empty: free %d, used %d",
-		       !ubi->free.rb_node, !ubi->used.rb_node);
+		       !e2, !ubi->used.rb_node);
 		goto out_cancel;
 	}
 
@@ -707,7 +897,6 @@ static int wear_leveling_worker(struct ubi_device *ubi, struct ubi_work *wrk,
 		 * counters differ much enough, start wear-leveling.
 		 */
 		e1 = rb_entry(rb_first(&ubi->used), struct ubi_wl_entry, u.rb);
-		e2 = find_wl_entry(&ubi->free, WL_FREE_MAX_DIFF);
 
 		if (!(e2->ec - e1->ec >= UBI_WL_THRESHOLD)) {
 			dbg_wl("no WL needed: min used EC %d, max free EC %d",
@@ -722,14 +911,15 @@ static int wear_leveling_worker(struct ubi_device *ubi, struct ubi_work *wrk,
 		/* Perform scrubbing */
 		scrubbing = 1;
 		e1 = rb_entry(rb_first(&ubi->scrub), struct ubi_wl_entry, u.rb);
-		e2 = find_wl_entry(&ubi->free, WL_FREE_MAX_DIFF);
 		paranoid_check_in_wl_tree(ubi, e1, &ubi->scrub);
 		rb_erase(&e1->u.rb, &ubi->scrub);
 		dbg_wl("scrub PEB %d to PEB %d", e1->pnum, e2->pnum);
 	}
 
-	paranoid_check_in_wl_tree(ubi, e2, &ubi->free);
-	rb_erase(&e2->u.rb, &ubi->free);
+	take_free_peb(ubi, e2);
+#ifdef CONFIG_MTD_UBI_FASTMAP
+move:
+#endif
 	ubi->move_from = e1;
 	ubi->move_to = e2;
 	spin_unlock(&ubi->wl_lock);
@@ -846,7 +1036,14 @@ static int wear_leveling_worker(struct ubi_device *ubi, struct ubi_work *wrk,
 	ubi->move_to_put = ubi->wl_scheduled = 0;
 	spin_unlock(&ubi->wl_lock);
 
-	err = schedule_erase(ubi, e1, 0);
+	/*
+	 * The anchor is only moved while no fastmap is on flash, nothing
+	 * refers to the old copy of the LEB then and it may be erased at once.
+	 */
+	if (anchor)
+		err = schedule_erase(ubi, e1, 0);
+	else
+		err = schedule_put_erase(ubi, e1, 0);
 	if (err) {
 		kmem_cache_free(ubi_wl_entry_slab, e1);
 		if (e2)
@@ -963,7 +1160,8 @@ static int ensure_wear_leveling(struct ubi_device *ubi)
 	 * the WL worker has to be scheduled anyway.
 	 */
 	if (!ubi->scrub.rb_node) {
-		if (!ubi->used.rb_node || !ubi->free.rb_node)
+		e2 = find_free_peb(ubi, UBI_LONGTERM);
+		if (!ubi->used.rb_node || !e2)
 			/* No physical eraseblocks - no deal */
 			goto out_unlock;
 
@@ -974,7 +1172,6 @@ static int ensure_wear_leveling(struct ubi_device *ubi)
 		 * %UBI_WL_THRESHOLD.
 		 */
 		e1 = rb_entry(rb_first(&ubi->used), struct ubi_wl_entry, u.rb);
-		e2 = find_wl_entry(&ubi->free, WL_FREE_MAX_DIFF);
 
 		if (!(e2->ec - e1->ec >= UBI_WL_THRESHOLD))
 			goto out_unlock;
@@ -991,6 +1188,7 @@ static int ensure_wear_leveling(struct ubi_device *ubi)
 		goto out_cancel;
 	}
 
+	wrk->anchor = 0;
 	wrk->func = &wear_leveling_worker;
 	schedule_ubi_work(ubi, wrk);
 	return err;
@@ -1199,7 +1397,7 @@ retry:
 	}
 	spin_unlock(&ubi->wl_lock);
 
-	err = schedule_erase(ubi, e, torture);
+	err = schedule_put_erase(ubi, e, torture);
 	if (err) {
 		spin_lock(&ubi->wl_lock);
 		wl_tree_add(e, &ubi->used);
@@ -1283,6 +1481,21 @@ int ubi_wl_flush(struct ubi_device *ubi)
 {
 	int err;
 
+#ifdef CONFIG_MTD_UBI_FASTMAP
+	/*
+	 * The erasure of PEBs put since the last fastmap was written waits for
+	 * the next fastmap, write it so that they are flushed as well.
+	 */
+	spin_lock(&ubi->wl_lock);
+	err = !list_empty(&ubi->fm_deferred);
+	spin_unlock(&ubi->wl_lock);
+	if (err) {
+		err = ubi_update_fastmap(ubi);
+		if (err)
+			return err;
+	}
+#endif
+
 	/*
 	 * Erase while the pending works queue is not empty, but not more than
 	 * the number of currently pending works.
@@ -1315,6 +1528,294 @@ int ubi_wl_flush(struct ubi_device *ubi)
 	return 0;
 }
 
+#ifdef CONFIG_MTD_UBI_FASTMAP
+
+/**
+ * ubi_is_erase_work - check if a work is an erase work.
+ * @wrk: the work to check
+ */
+int ubi_is_erase_work(struct ubi_work *wrk)
+{
+	return wrk->func == erase_worker;
+}
+
+/**
+ * schedule_anchor_move - schedule moving data out of an anchor candidate PEB.
+ * @ubi: UBI device description object
+ *
+ * This function returns zero in case of success, %-EBUSY if wear-leveling is
+ * in progress and %-ENOMEM in case of failure.
+ */
+static int schedule_anchor_move(struct ubi_device *ubi)
+{
+	struct ubi_work *wrk;
+
+	spin_lock(&ubi->wl_lock);
+	if (ubi->wl_scheduled) {
+		spin_unlock(&ubi->wl_lock);
+		return -EBUSY;
+	}
+	ubi->wl_scheduled = 1;
+	spin_unlock(&ubi->wl_lock);
+
+	wrk = kmalloc(sizeof(struct ubi_work), GFP_NOFS);
+	if (!wrk) {
+		spin_lock(&ubi->wl_lock);
+		ubi->wl_scheduled = 0;
+		spin_unlock(&ubi->wl_lock);
+		return -ENOMEM;
+	}
+
+	wrk->anchor = 1;
+	wrk->func = &wear_leveling_worker;
+	schedule_ubi_work(ubi, wrk);
+	return 0;
+}
+
+/**
+ * ubi_wl_get_fm_peb - get a physical eraseblock for the fastmap.
+ * @ubi: UBI device description object
+ * @anchor: if the PEB will hold the fastmap super block
+ *
+ * The fastmap is rewritten often, so the free PEB with the lowest erase counter
+ * is taken. The anchor PEB has to be one of the first %UBI_FM_MAX_START PEBs,
+ * where it is looked for when attaching. Pending works are done synchronously
+ * if no suitable PEB is free. If the first PEBs all hold data, e.g. after an
+ * image was flashed, the data of one of them is moved elsewhere. Returns %NULL
+ * if there is no suitable PEB.
+ */
+struct ubi_wl_entry *ubi_wl_get_fm_peb(struct ubi_device *ubi, int anchor)
+{
+	struct ubi_wl_entry *e = NULL;
+	struct rb_node *p;
+	int moved = 0;
+
+retry:
+	spin_lock(&ubi->wl_lock);
+	for (p = rb_first(&ubi->free); p; p = rb_next(p)) {
+		e = rb_entry(p, struct ubi_wl_entry, u.rb);
+		if (!anchor || e->pnum < UBI_FM_MAX_START)
+			break;
+	}
+
+	if (!p) {
+		if (ubi->works_count == 0) {
+			spin_unlock(&ubi->wl_lock);
+			if (!anchor || moved)
+				return NULL;
+
+			dbg_wl("no free anchor candidate, move one");
+			moved = 1;
+			if (schedule_anchor_move(ubi))
+				return NULL;
+			goto retry;
+		}
+		spin_unlock(&ubi->wl_lock);
+
+		dbg_wl("do one work synchronously");
+		if (do_work(ubi))
+			return NULL;
+		goto retry;
+	}
+
+	paranoid_check_in_wl_tree(ubi, e, &ubi->free);
+	rb_erase(&e->u.rb, &ubi->free);
+	spin_unlock(&ubi->wl_lock);
+
+	dbg_wl("PEB %d EC %d for the fastmap", e->pnum, e->ec);
+	return e;
+}
+
+/**
+ * ubi_wl_put_fm_peb - return a fastmap physical eraseblock.
+ * @ubi: UBI device description object
+ * @e: the WL entry of the physical eraseblock
+ * @torture: if this physical eraseblock has to be tortured
+ *
+ * The PEB is scheduled for erasure right away, it is not described by any
+ * fastmap on flash. This function returns zero in case of success and a
+ * negative error code in case of failure.
+ */
+int ubi_wl_put_fm_peb(struct ubi_device *ubi, struct ubi_wl_entry *e,
+		      int torture)
+{
+	int err;
+
+	err = schedule_erase(ubi, e, torture);
+	if (err) {
+		kmem_cache_free(ubi_wl_entry_slab, e);
+		ubi_ro_mode(ubi);
+	}
+
+	return err;
+}
+
+/**
+ * ubi_wl_erase_fm_peb - synchronously erase a fastmap physical eraseblock.
+ * @ubi: UBI device description object
+ * @e: the WL entry of the physical eraseblock
+ *
+ * This function is used to invalidate the fastmap anchor. The erased PEB is
+ * added to the @ubi->free tree. Returns zero in case of success and a negative
+ * error code in case of failure, @e is left to the caller then.
+ */
+int ubi_wl_erase_fm_peb(struct ubi_device *ubi, struct ubi_wl_entry *e)
+{
+	int err;
+
+	err = sync_erase(ubi, e, 0);
+	if (err)
+		return err;
+
+	spin_lock(&ubi->wl_lock);
+	wl_tree_add(e, &ubi->free);
+	spin_unlock(&ubi->wl_lock);
+	return 0;
+}
+
+/**
+ * ubi_wl_refill_pool - refill the fastmap pool.
+ * @ubi: UBI device description object
+ *
+ * PEBs which are left in the pool are kept, the pool is topped up with PEBs of
+ * low and of high erase counter alternately. Note, @ubi->wl_lock has to be
+ * locked.
+ */
+void ubi_wl_refill_pool(struct ubi_device *ubi)
+{
+	struct ubi_fm_pool *pool = &ubi->fm_pool;
+	struct ubi_wl_entry *e;
+	int i;
+
+	for (i = 0; i < pool->size - pool->used; i++)
+		pool->pebs[i] = pool->pebs[pool->used + i];
+	pool->size -= pool->used;
+	pool->used = 0;
+
+	while (pool->size < pool->max_size && ubi->free.rb_node) {
+		if (pool->size & 1)
+			e = find_wl_entry(&ubi->free, WL_FREE_MAX_DIFF);
+		else
+			e = rb_entry(rb_first(&ubi->free), struct ubi_wl_entry,
+				     u.rb);
+		rb_erase(&e->u.rb, &ubi->free);
+		pool->pebs[pool->size++] = e->pnum;
+	}
+}
+
+/**
+ * ubi_wl_release_works - queue works.
+ * @ubi: UBI device description object
+ * @list: the works to queue
+ *
+ * This function is used to queue the erase works which were parked until a
+ * fastmap is written.
+ */
+void ubi_wl_release_works(struct ubi_device *ubi, struct list_head *list)
+{
+	struct ubi_work *wrk, *tmp;
+
+	list_for_each_entry_safe(wrk, tmp, list, list) {
+		list_del(&wrk->list);
+		schedule_ubi_work(ubi, wrk);
+	}
+}
+
+/**
+ * ubi_wl_stop_fm - stop using fastmap.
+ * @ubi: UBI device description object
+ *
+ * This function is called when no valid fastmap is on flash any more and none
+ * can be written. The pool is returned to the @ubi->free tree and the erasure
+ * of the put PEBs is not deferred any longer.
+ */
+void ubi_wl_stop_fm(struct ubi_device *ubi)
+{
+	struct ubi_fm_pool *pool = &ubi->fm_pool;
+	LIST_HEAD(deferred);
+	int i;
+
+	spin_lock(&ubi->wl_lock);
+	ubi->fm_disabled = 1;
+	for (i = pool->used; i < pool->size; i++)
+		wl_tree_add(ubi->lookuptbl[pool->pebs[i]], &ubi->free);
+	pool->used = pool->size = 0;
+	list_splice_init(&ubi->fm_deferred, &deferred);
+	spin_unlock(&ubi->wl_lock);
+
+	ubi_wl_release_works(ubi, &deferred);
+}
+
+/**
+ * reserve_fm_pebs - reserve physical eraseblocks for the fastmap.
+ * @ubi: UBI device description object
+ *
+ * If there are not enough PEBs, fastmap is disabled, and a fastmap found when
+ * attaching is invalidated as it would become stale. This function returns
+ * zero in case of success and a negative error code in case of failure.
+ */
+static int reserve_fm_pebs(struct ubi_device *ubi)
+{
+	struct ubi_fastmap *fm = ubi->fm;
+	int i, err, need;
+
+	if (ubi->fm_disabled)
+		return 0;
+
+	need = ubi->fm_size / ubi->leb_size;
+	if (ubi->avail_pebs >= need) {
+		ubi->avail_pebs -= need;
+		ubi->rsvd_pebs += need;
+		return 0;
+	}
+
+	ubi_warn("not enough PEBs for fastmap (%d, need %d), disable it",
+		 ubi->avail_pebs, need);
+	ubi->fm_disabled = 1;
+	if (!fm)
+		return 0;
+
+	err = ubi_wl_erase_fm_peb(ubi, fm->e[0]);
+	if (err)
+		return err;
+
+	ubi->fm = NULL;
+	for (i = 1; i < fm->used_blocks; i++) {
+		if (!err)
+			err = schedule_erase(ubi, fm->e[i], 0);
+		else
+			kmem_cache_free(ubi_wl_entry_slab, fm->e[i]);
+	}
+	kfree(fm);
+	return err;
+}
+
+/**
+ * fm_pool_destroy - free the fastmap pool and the deferred erase works.
+ * @ubi: UBI device description object
+ */
+static void fm_pool_destroy(struct ubi_device *ubi)
+{
+	struct ubi_fm_pool *pool = &ubi->fm_pool;
+	struct ubi_work *wrk, *tmp;
+	int i;
+
+	for (i = pool->used; i < pool->size; i++)
+		kmem_cache_free(ubi_wl_entry_slab,
+				ubi->lookuptbl[pool->pebs[i]]);
+	pool->used = pool->size = 0;
+
+	list_for_each_entry_safe(wrk, tmp, &ubi->fm_deferred, list) {
+		list_del(&wrk->list);
+		wrk->func(ubi, wrk, 1);
+	}
+}
+
+#else
+#define reserve_fm_pebs(ubi) 0
+#define fm_pool_destroy(ubi)
+#endif /* CONFIG_MTD_UBI_FASTMAP */
+
 /**
  * tree_destroy - destroy an RB-tree.
  * @root: the root of the tree to destroy
@@ -1507,6 +2008,12 @@ int ubi_wl_init_scan(struct ubi_device *ubi, struct ubi_scan_info *si)
 		}
 	}
 
+#ifdef CONFIG_MTD_UBI_FASTMAP
+	if (ubi->fm)
+		for (i = 0; i < ubi->fm->used_blocks; i++)
+			ubi->lookuptbl[ubi->fm->e[i]->pnum] = ubi->fm->e[i];
+#endif
+
 	if (ubi->avail_pebs < WL_RESERVED_PEBS) {
 		ubi_err("no enough physical eraseblocks (%d, need %d)",
 			ubi->avail_pebs, WL_RESERVED_PEBS);
@@ -1518,6 +2025,10 @@ int ubi_wl_init_scan(struct ubi_device *ubi, struct ubi_scan_info *si)
 	ubi->avail_pebs -= WL_RESERVED_PEBS;
 	ubi->rsvd_pebs += WL_RESERVED_PEBS;
 
+	err = reserve_fm_pebs(ubi);
+	if (err)
+		goto out_free;
+
 	/* Schedule wear-leveling if needed */
 	err = ensure_wear_leveling(ubi);
 	if (err)
@@ -1559,12 +2070,14 @@ void ubi_wl_close(struct ubi_device *ubi)
 {
 	dbg_wl("close the WL sub-system");
 	cancel_pending(ubi);
+	fm_pool_destroy(ubi);
 	protection_queue_destroy(ubi);
 	tree_destroy(&ubi->used);
 	tree_destroy(&ubi->erroneous);
 	tree_destroy(&ubi->free);
 	tree_destroy(&ubi->scrub);
 	kfree(ubi->lookuptbl);
+	ubi_fastmap_close(ubi);
 }
 
 #ifdef CONFIG_MTD_UBI_DEBUG
@@ -109,6 +109,51 @@ static void fpif_ethtool_setmsglevel(struct net_device *dev, u32 level)
 	priv->msg_enable = level;
 }
 
+static const struct {
+	char name[ETH_GSTRING_LEN];
+	int offset;
+} fpif_gstrings_stats[] = {
+	{ "rx_refill_fail",
+	  offsetof(struct fpif_rx_stats, rx_refill_fail) },
+	{ "rx_recycled", offsetof(struct fpif_rx_stats, rx_recycled) },
+	{ "rx_starved", offsetof(struct fpif_rx_stats, rx_starved) },
+};
+#define FPIF_STATS_LEN ARRAY_SIZE(fpif_gstrings_stats)
+
+static int fpif_ethtool_get_sset_count(struct net_device *dev, int sset)
+{
+	switch (sset) {
+	case ETH_SS_STATS:
+		return FPIF_STATS_LEN;
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
+static void fpif_ethtool_get_strings(struct net_device *dev, u32 stringset,
+				     u8 *data)
+{
+	int i;
+
+	if (stringset != ETH_SS_STATS)
+		return;
+
+	for (i = 0; i < FPIF_STATS_LEN; i++)
+		memcpy(data + i * ETH_GSTRING_LEN,
+		       fpif_gstrings_stats[i].name, ETH_GSTRING_LEN);
+}
+
+static void fpif_ethtool_get_stats(struct net_device *dev,
+				   struct ethtool_stats *stats, u64 *data)
+{
+	struct fpif_priv *priv = netdev_priv(dev);
+	int i;
+
+	for (i = 0; i < FPIF_STATS_LEN; i++)
+		data[i] = *(unsigned long *)((char *)&priv->xstats +
+					     fpif_gstrings_stats[i].offset);
+}
+
 static int fpif_check_if_running(struct net_device *dev)
 {
 	if (!netif_running(dev))
@@ -127,6 +172,13 @@ static const struct ethtool_ops fpif_ethtool_ops = {
 	.get_msglevel = fpif_ethtool_getmsglevel,
 	.set_msglevel = fpif_ethtool_setmsglevel,
 	.get_link = ethtool_op_get_link,
+	.get_sset_count = fpif_ethtool_get_sset_count,
+	.get_strings = fpif_ethtool_get_strings,
+	.get_ethtool_stats = fpif_ethtool_get_stats,
+#ifdef CONFIG_STMFP_FLOW_OFFLOAD
+	.get_rxnfc = fp_flow_get_rxnfc,
+	.set_rxnfc = fp_flow_set_rxnfc,
+#endif
 };
 
 void fpif_set_ethtool_ops(struct net_device *netdev)
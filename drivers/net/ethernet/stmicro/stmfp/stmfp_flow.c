@@ -0,0 +1,543 @@
+/***************************************************************************
+  FPIF hardware flow offload
+
+  Copyright (C) 2026  agent
+
+  This program is free software; you can redistribute it and/or modify it
+  under the terms and conditions of the GNU General Public License,
+  version 2, as published by the Free Software Foundation.
+
+  This program is distributed in the hope it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+  more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+
+  The full GNU General Public License is included in this distribution in
+  the file called "COPYING".
+
+  Frames bridged between two fastpath ports all go through the CPU. Once
+  the bridge keeps forwarding frames for a destination MAC from one port
+  to another, a TCAM entry matching the source port and destination MAC
+  is installed to redirect them to the egress port in hardware. Switched
+  frames no longer refresh the bridge FDB, so entries are removed after
+  a timeout, or as soon as the FDB disagrees, and learnt again from the
+  frames that reach the CPU.
+***************************************************************************/
+
+#include <linux/etherdevice.h>
+#include <linux/ethtool.h>
+#include <linux/netdevice.h>
+#include <linux/if_bridge.h>
+#include <linux/phy.h>
+#include <linux/rtnetlink.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/io.h>
+
+#include "stmfp_main.h"
+/* For the port state and the bridge netfilter settings */
+#include <../net/bridge/br_private.h>
+
+static const char * const fp_flow_state_name[] = {
+	[FP_FLOW_FREE] = "free",
+	[FP_FLOW_LEARNING] = "learning",
+	[FP_FLOW_HW] = "hw",
+	[FP_FLOW_STATIC] = "static",
+};
+
+static inline int fp_flow_tcam_idx(int slot)
+{
+	return TCAM_BRIDGE_IDX + slot;
+}
+
+static void fp_flow_install(struct fpif_grp *fpgrp, struct fp_flow *flow,
+			    int slot)
+{
+	struct fpif_priv *in = netdev_priv(fpgrp->netdev[flow->in]);
+	struct fpif_priv *out = netdev_priv(fpgrp->netdev[flow->out]);
+	struct fp_tcam_info tcam_info;
+
+	memset(&tcam_info, 0, sizeof(tcam_info));
+	tcam_info.sp = in->sp;
+	tcam_info.match_sp = 1;
+	tcam_info.dev_addr_d = flow->addr;
+	tcam_info.redir = 1;
+	tcam_info.dest = out->dmap;
+	fp_add_tcam(fpgrp, &tcam_info, fp_flow_tcam_idx(slot));
+}
+
+static void fp_flow_remove(struct fpif_grp *fpgrp, struct fp_flow *flow,
+			   int slot)
+{
+	if (flow->state == FP_FLOW_HW || flow->state == FP_FLOW_STATIC)
+		fp_remove_tcam(fpgrp, fp_flow_tcam_idx(slot));
+	flow->state = FP_FLOW_FREE;
+}
+
+static int fp_flow_port_forwarding(struct net_device *dev)
+{
+	struct net_bridge_port *p;
+
+	if (!(dev->flags & IFF_UP) || !(dev->priv_flags & IFF_BRIDGE_PORT))
+		return 0;
+
+	p = br_port_get_rcu(dev);
+
+	return p && p->state == BR_STATE_FORWARDING;
+}
+
+/**
+ * fp_flow_valid() -- Check that the bridge still forwards the flow
+ * the way the TCAM entry would. Called with rcu_read_lock held.
+ */
+static int fp_flow_valid(struct fpif_grp *fpgrp, struct fp_flow *flow)
+{
+	struct net_device *in = fpgrp->netdev[flow->in];
+	struct net_device *out = fpgrp->netdev[flow->out];
+	struct net_device *br_dev = in->master;
+
+	if (!br_dev || br_dev != out->master ||
+	    !(br_dev->priv_flags & IFF_EBRIDGE))
+		return 0;
+
+	if (!fp_flow_port_forwarding(in) || !fp_flow_port_forwarding(out))
+		return 0;
+
+#ifdef CONFIG_BRIDGE_NETFILTER
+	{
+		struct net_bridge *br = netdev_priv(br_dev);
+
+		/* Switched frames would bypass the bridge netfilter hooks */
+		if (br->nf_call_iptables || br->nf_call_ip6tables ||
+		    br->nf_call_arptables)
+			return 0;
+	}
+#endif
+
+	return br_fdb_find_port(br_dev, flow->addr) == out;
+}
+
+/**
+ * fp_flow_learn() -- Account a frame bridged from another fastpath port
+ * @priv: egress port
+ * @skb: frame, data pointing to the ethernet header
+ * Called from the xmit path, the flow is offloaded later by the worker,
+ * which only runs while learnt flows exist.
+ */
+void fp_flow_learn(struct fpif_priv *priv, struct sk_buff *skb)
+{
+	struct fpif_grp *fpgrp = priv->fpgrp;
+	struct fp_flow_table *ft = &fpgrp->flow;
+	struct net_device *netdev = priv->netdev;
+	struct net_device *in = NULL;
+	struct fp_flow *flow, *free = NULL;
+	const struct ethhdr *eth;
+	int i, j;
+
+	if (!ft->enabled || !skb->skb_iif || !netdev->master ||
+	    skb->skb_iif == netdev->ifindex)
+		return;
+
+	eth = (const struct ethhdr *)skb->data;
+	if (!is_unicast_ether_addr(eth->h_dest))
+		return;
+
+	for (j = 0; j < NUM_INTFS; j++) {
+		if (fpgrp->netdev[j] &&
+		    fpgrp->netdev[j]->ifindex == skb->skb_iif) {
+			in = fpgrp->netdev[j];
+			break;
+		}
+	}
+	if (!in || in->master != netdev->master)
+		return;
+
+	spin_lock(&ft->lock);
+	for (i = 0; i < FP_FLOW_ENTRIES; i++) {
+		flow = &ft->flows[i];
+		if (flow->state == FP_FLOW_FREE) {
+			if (!free)
+				free = flow;
+			continue;
+		}
+		if (flow->in != j || compare_ether_addr(flow->addr,
+							eth->h_dest))
+			continue;
+
+		if (flow->state == FP_FLOW_LEARNING) {
+			/* The station moved, start again */
+			if (flow->out != priv->id) {
+				flow->out = priv->id;
+				flow->hits = 0;
+				flow->stamp = jiffies;
+			}
+			flow->hits++;
+		}
+		goto out;
+	}
+
+	if (free) {
+		memcpy(free->addr, eth->h_dest, ETH_ALEN);
+		free->in = j;
+		free->out = priv->id;
+		free->hits = 1;
+		free->stamp = jiffies;
+		free->state = FP_FLOW_LEARNING;
+		schedule_delayed_work(&ft->work, HZ);
+	} else {
+		ft->table_full++;
+	}
+out:
+	spin_unlock(&ft->lock);
+}
+
+/**
+ * fp_flow_flush() -- Drop the learnt flows entering or leaving a port
+ * Called with the rtnl lock held, static rules are kept.
+ */
+void fp_flow_flush(struct fpif_priv *priv)
+{
+	struct fpif_grp *fpgrp = priv->fpgrp;
+	struct fp_flow_table *ft = &fpgrp->flow;
+	struct fp_flow *flow;
+	int i;
+
+	spin_lock_bh(&ft->lock);
+	for (i = 0; i < FP_FLOW_ENTRIES; i++) {
+		flow = &ft->flows[i];
+		if (flow->state != FP_FLOW_LEARNING &&
+		    flow->state != FP_FLOW_HW)
+			continue;
+		if (flow->in == priv->id || flow->out == priv->id)
+			fp_flow_remove(fpgrp, flow, i);
+	}
+	spin_unlock_bh(&ft->lock);
+}
+
+static void fp_flow_work(struct work_struct *work)
+{
+	struct fp_flow_table *ft = container_of(to_delayed_work(work),
+						struct fp_flow_table, work);
+	struct fpif_grp *fpgrp = container_of(ft, struct fpif_grp, flow);
+	unsigned long timeout = ft->timeout * HZ;
+	unsigned long learn = FP_FLOW_LEARN_TIME;
+	struct fp_flow *flow;
+	int i, pending = 0;
+
+	/* TCAM updates are serialised by the rtnl lock */
+	if (!rtnl_trylock())
+		goto resched;
+
+	spin_lock_bh(&ft->lock);
+	rcu_read_lock();
+	for (i = 0; i < FP_FLOW_ENTRIES; i++) {
+		flow = &ft->flows[i];
+		switch (flow->state) {
+		case FP_FLOW_LEARNING:
+			if (!ft->enabled ||
+			    time_after(jiffies, flow->stamp + learn)) {
+				flow->state = FP_FLOW_FREE;
+				break;
+			}
+			if (flow->hits < ft->threshold ||
+			    !fp_flow_valid(fpgrp, flow))
+				break;
+			fp_flow_install(fpgrp, flow, i);
+			flow->state = FP_FLOW_HW;
+			flow->stamp = jiffies;
+			ft->installed++;
+			fpdbg("flow %d offloaded\n", i);
+			break;
+		case FP_FLOW_HW:
+			if (!ft->enabled) {
+				fp_flow_remove(fpgrp, flow, i);
+			} else if (time_after(jiffies, flow->stamp + timeout)) {
+				fp_flow_remove(fpgrp, flow, i);
+				ft->aged++;
+			} else if (!fp_flow_valid(fpgrp, flow)) {
+				fp_flow_remove(fpgrp, flow, i);
+				ft->stale++;
+			}
+			break;
+		default:
+			break;
+		}
+		if (flow->state == FP_FLOW_LEARNING ||
+		    flow->state == FP_FLOW_HW)
+			pending++;
+	}
+	rcu_read_unlock();
+	spin_unlock_bh(&ft->lock);
+	rtnl_unlock();
+
+	/* Static rules never age, fp_flow_learn() rearms the worker */
+	if (!pending)
+		return;
+resched:
+	schedule_delayed_work(&ft->work, HZ);
+}
+
+static int fp_flow_find_static(struct fp_flow_table *ft, u8 in, int loc)
+{
+	if (loc < 0 || loc >= FP_FLOW_ENTRIES)
+		return -EINVAL;
+
+	if (ft->flows[loc].state != FP_FLOW_STATIC || ft->flows[loc].in != in)
+		return -ENOENT;
+
+	return 0;
+}
+
+/**
+ * fp_flow_get_rxnfc() -- List the ethtool rules of a port
+ * Rules match the destination MAC of frames entering this port. There
+ * are no rx rings to steer to: the action (ring_cookie) is the id of
+ * the fastpath port frames are switched to, so ETHTOOL_GRXRINGS reports
+ * the number of ports. Dropping (RX_CLS_FLOW_DISC) is not supported.
+ */
+int fp_flow_get_rxnfc(struct net_device *dev, struct ethtool_rxnfc *cmd,
+		      u32 *rule_locs)
+{
+	struct fpif_priv *priv = netdev_priv(dev);
+	struct fp_flow_table *ft = &priv->fpgrp->flow;
+	struct ethtool_rx_flow_spec *fs = &cmd->fs;
+	struct fp_flow *flow;
+	int i, cnt = 0, err = 0;
+
+	spin_lock_bh(&ft->lock);
+	switch (cmd->cmd) {
+	case ETHTOOL_GRXRINGS:
+		cmd->data = NUM_INTFS;
+		break;
+	case ETHTOOL_GRXCLSRLCNT:
+		for (i = 0; i < FP_FLOW_ENTRIES; i++)
+			if (!fp_flow_find_static(ft, priv->id, i))
+				cnt++;
+		cmd->rule_cnt = cnt;
+		cmd->data = FP_FLOW_ENTRIES | RX_CLS_LOC_SPECIAL;
+		break;
+	case ETHTOOL_GRXCLSRULE:
+		err = fp_flow_find_static(ft, priv->id, fs->location);
+		if (err)
+			break;
+		flow = &ft->flows[fs->location];
+		memset(&fs->h_u, 0, sizeof(fs->h_u));
+		memset(&fs->m_u, 0, sizeof(fs->m_u));
+		memset(&fs->h_ext, 0, sizeof(fs->h_ext));
+		memset(&fs->m_ext, 0, sizeof(fs->m_ext));
+		fs->flow_type = ETHER_FLOW;
+		memcpy(fs->h_u.ether_spec.h_dest, flow->addr, ETH_ALEN);
+		memset(fs->m_u.ether_spec.h_dest, 0xff, ETH_ALEN);
+		fs->ring_cookie = flow->out;
+		break;
+	case ETHTOOL_GRXCLSRLALL:
+		for (i = 0; i < FP_FLOW_ENTRIES; i++) {
+			if (fp_flow_find_static(ft, priv->id, i))
+				continue;
+			if (cnt == cmd->rule_cnt) {
+				err = -EMSGSIZE;
+				break;
+			}
+			rule_locs[cnt++] = i;
+		}
+		cmd->rule_cnt = cnt;
+		cmd->data = FP_FLOW_ENTRIES;
+		break;
+	default:
+		err = -EOPNOTSUPP;
+		break;
+	}
+	spin_unlock_bh(&ft->lock);
+
+	return err;
+}
+
+static int fp_flow_add_static(struct fpif_priv *priv,
+			      struct ethtool_rx_flow_spec *fs)
+{
+	struct fpif_grp *fpgrp = priv->fpgrp;
+	struct fp_flow_table *ft = &fpgrp->flow;
+	struct ethhdr *h = &fs->h_u.ether_spec;
+	struct ethhdr *m = &fs->m_u.ether_spec;
+	struct fp_flow *flow;
+	int i, loc = -1;
+
+	/* The TCAM only matches the source port and destination MAC */
+	if (fs->flow_type != ETHER_FLOW ||
+	    !is_broadcast_ether_addr(m->h_dest) ||
+	    !is_zero_ether_addr(m->h_source) || m->h_proto ||
+	    !is_unicast_ether_addr(h->h_dest))
+		return -EINVAL;
+
+	if (fs->ring_cookie >= NUM_INTFS || fs->ring_cookie == priv->id ||
+	    !fpgrp->netdev[fs->ring_cookie])
+		return -EINVAL;
+
+	if (fs->location != RX_CLS_LOC_ANY) {
+		if (fs->location >= FP_FLOW_ENTRIES)
+			return -EINVAL;
+		loc = fs->location;
+	}
+
+	for (i = 0; i < FP_FLOW_ENTRIES; i++) {
+		flow = &ft->flows[i];
+		if (flow->state == FP_FLOW_FREE || flow->in != priv->id ||
+		    compare_ether_addr(flow->addr, h->h_dest))
+			continue;
+		/* A static rule for the same flow is replaced in place */
+		if (flow->state == FP_FLOW_STATIC) {
+			if (loc >= 0 && loc != i)
+				return -EEXIST;
+			loc = i;
+		}
+		fp_flow_remove(fpgrp, flow, i);
+	}
+
+	if (loc < 0) {
+		for (i = 0; i < FP_FLOW_ENTRIES; i++)
+			if (ft->flows[i].state == FP_FLOW_FREE)
+				break;
+		/* Make room by evicting a learnt flow */
+		if (i == FP_FLOW_ENTRIES)
+			for (i = 0; i < FP_FLOW_ENTRIES; i++)
+				if (ft->flows[i].state != FP_FLOW_STATIC)
+					break;
+		if (i == FP_FLOW_ENTRIES)
+			return -ENOSPC;
+		loc = i;
+	}
+
+	flow = &ft->flows[loc];
+	if (flow->state == FP_FLOW_STATIC && flow->in != priv->id)
+		return -EBUSY;
+	fp_flow_remove(fpgrp, flow, loc);
+
+	memcpy(flow->addr, h->h_dest, ETH_ALEN);
+	flow->in = priv->id;
+	flow->out = fs->ring_cookie;
+	flow->hits = 0;
+	flow->stamp = jiffies;
+	fp_flow_install(fpgrp, flow, loc);
+	flow->state = FP_FLOW_STATIC;
+	fs->location = loc;
+
+	return 0;
+}
+
+/**
+ * fp_flow_set_rxnfc() -- Add or delete an ethtool rule on a port
+ * Called with the rtnl lock held.
+ */
+int fp_flow_set_rxnfc(struct net_device *dev, struct ethtool_rxnfc *cmd)
+{
+	struct fpif_priv *priv = netdev_priv(dev);
+	struct fpif_grp *fpgrp = priv->fpgrp;
+	struct fp_flow_table *ft = &fpgrp->flow;
+	int err;
+
+	spin_lock_bh(&ft->lock);
+	switch (cmd->cmd) {
+	case ETHTOOL_SRXCLSRLINS:
+		err = fp_flow_add_static(priv, &cmd->fs);
+		break;
+	case ETHTOOL_SRXCLSRLDEL:
+		err = fp_flow_find_static(ft, priv->id, cmd->fs.location);
+		if (!err)
+			fp_flow_remove(fpgrp, &ft->flows[cmd->fs.location],
+				       cmd->fs.location);
+		break;
+	default:
+		err = -EOPNOTSUPP;
+		break;
+	}
+	spin_unlock_bh(&ft->lock);
+
+	return err;
+}
+
+static int fp_flow_show(struct seq_file *seq, void *v)
+{
+	struct fpif_grp *fpgrp = seq->private;
+	struct fp_flow_table *ft = &fpgrp->flow;
+	struct fp_flow *flow;
+	int i;
+
+	seq_printf(seq, "slot tcam state    in        dest              "
+		   "out       hits       age\n");
+	spin_lock_bh(&ft->lock);
+	for (i = 0; i < FP_FLOW_ENTRIES; i++) {
+		flow = &ft->flows[i];
+		if (flow->state == FP_FLOW_FREE)
+			continue;
+		seq_printf(seq, "%4d %4d %-8s %-9s %pM %-9s %-10u %lus\n",
+			   i, fp_flow_tcam_idx(i),
+			   fp_flow_state_name[flow->state],
+			   fpgrp->netdev[flow->in]->name, flow->addr,
+			   fpgrp->netdev[flow->out]->name, flow->hits,
+			   (jiffies - flow->stamp) / HZ);
+	}
+	spin_unlock_bh(&ft->lock);
+
+	return 0;
+}
+
+static int fp_flow_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, fp_flow_show, inode->i_private);
+}
+
+static const struct file_operations fp_flow_fops = {
+	.owner = THIS_MODULE,
+	.open = fp_flow_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static void fp_flow_init_fs(struct fpif_grp *fpgrp)
+{
+	struct fp_flow_table *ft = &fpgrp->flow;
+	struct dentry *dir;
+
+	dir = debugfs_create_dir(DRV_NAME, NULL);
+	if (IS_ERR_OR_NULL(dir))
+		return;
+
+	debugfs_create_file("flows", S_IRUGO, dir, fpgrp, &fp_flow_fops);
+	debugfs_create_u32("flow_offload", S_IRUGO | S_IWUSR, dir,
+			   &ft->enabled);
+	debugfs_create_u32("flow_threshold", S_IRUGO | S_IWUSR, dir,
+			   &ft->threshold);
+	debugfs_create_u32("flow_timeout", S_IRUGO | S_IWUSR, dir,
+			   &ft->timeout);
+	debugfs_create_u32("flow_installed", S_IRUGO, dir, &ft->installed);
+	debugfs_create_u32("flow_aged", S_IRUGO, dir, &ft->aged);
+	debugfs_create_u32("flow_stale", S_IRUGO, dir, &ft->stale);
+	debugfs_create_u32("flow_table_full", S_IRUGO, dir,
+			   &ft->table_full);
+	ft->dir = dir;
+}
+
+void fp_flow_init(struct fpif_grp *fpgrp)
+{
+	struct fp_flow_table *ft = &fpgrp->flow;
+
+	spin_lock_init(&ft->lock);
+	ft->enabled = 1;
+	ft->threshold = FP_FLOW_THRESHOLD;
+	ft->timeout = FP_FLOW_TIMEOUT;
+	INIT_DELAYED_WORK(&ft->work, fp_flow_work);
+	fp_flow_init_fs(fpgrp);
+}
+
+void fp_flow_exit(struct fpif_grp *fpgrp)
+{
+	struct fp_flow_table *ft = &fpgrp->flow;
+
+	cancel_delayed_work_sync(&ft->work);
+	debugfs_remove_recursive(ft->dir);
+}
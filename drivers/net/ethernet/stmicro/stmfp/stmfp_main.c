@@ -244,8 +244,13 @@ static inline struct sk_buff *fpif_poll_start_skb(struct fpif_priv *priv,
 	struct sk_buff *skb = NULL;
 	struct net_device *netdev = priv->netdev;
 
-	skb = __netdev_alloc_skb(netdev, priv->rx_buffer_size +
-			RXBUF_ALIGNMENT, mask);
+	/* Reuse a buffer given back by tx completion when there is one */
+	skb = __skb_dequeue(&priv->rx_recycle);
+	if (skb)
+		priv->xstats.rx_recycled++;
+	else
+		skb = __netdev_alloc_skb(netdev, priv->rx_buffer_size +
+				RXBUF_ALIGNMENT, mask);
 	if (skb)
 		skb_reserve(skb, RXBUF_ALIGNMENT -
 			(((unsigned long)skb->data) &
@@ -309,38 +314,75 @@ static inline void fpif_q_rx_buffer(struct fpif_rxdma *rxdma_ptr,
 	rxdma_ptr->fp_rx_skbuff[head_rx].skb = skb;
 	rxdma_ptr->fp_rx_skbuff[head_rx].dma_ptr = buf_ptr;
 	rxdma_ptr->head_rx = (head_rx + 1) & RX_RING_MOD_MASK;
-	fpif_write_reg(&rxdma_ptr->rx_ch_reg->rx_cpu,
-		       rxdma_ptr->head_rx);
 }
 
 
-static int fpif_rxb_setup(struct fpif_priv *priv)
+/**
+ * fpif_rx_refill() -- Replenish the empty slots of the rx ring
+ * Nothing is done until at least FPIF_RX_REFILL_BATCH slots are empty;
+ * buffers are then handed to the DMA one chunk at a time. A failed
+ * allocation is only counted, the slots left empty are retried on the
+ * next call. Returns the number of buffers queued.
+ */
+static int fpif_rx_refill(struct fpif_priv *priv, gfp_t mask)
 {
-	unsigned int i;
-	int ret = 0;
+	struct fpif_rxdma *rxdma_ptr = priv->rxdma_ptr;
+	struct device *devptr = priv->devptr;
 	struct sk_buff *skb;
 	dma_addr_t dma_addr;
-	struct device *devptr = priv->devptr;
+	int empty, queued = 0;
 
-	/* Setup the skbuff rings */
-	for (i = 0; i < FPIF_RX_BUFS - 1; i++) {
-		skb = fpif_poll_start_skb(priv, GFP_KERNEL);
-		if (NULL == skb) {
-			netdev_err(priv->netdev, "allocating RX buffer\n");
-			if (i == 0) {
-				fpif_rxb_release(priv);
-				return -ENOMEM;
-			} else {
-				break;
-			}
-		} else {
-			dma_addr = dma_map_single(devptr, skb->data,
-						  priv->rx_buffer_size,
-						  DMA_FROM_DEVICE);
-			fpif_q_rx_buffer(priv->rxdma_ptr, skb, dma_addr);
+	/* Fill up to the level the ring has always been set up with */
+	empty = FPIF_RX_BUFS - 1 -
+		((rxdma_ptr->head_rx - rxdma_ptr->last_rx) & RX_RING_MOD_MASK);
+	if (empty < FPIF_RX_REFILL_BATCH)
+		return 0;
+
+	while (empty--) {
+		skb = fpif_poll_start_skb(priv, mask);
+		if (unlikely(!skb)) {
+			priv->xstats.rx_refill_fail++;
+			break;
 		}
+		dma_addr = dma_map_single(devptr, skb->data,
+					  priv->rx_buffer_size,
+					  DMA_FROM_DEVICE);
+		if (unlikely(dma_mapping_error(devptr, dma_addr))) {
+			dev_kfree_skb_any(skb);
+			priv->xstats.rx_refill_fail++;
+			break;
+		}
+		fpif_q_rx_buffer(rxdma_ptr, skb, dma_addr);
+		if (!(++queued % FPIF_RX_REFILL_BATCH))
+			fpif_write_reg(&rxdma_ptr->rx_ch_reg->rx_cpu,
+				       rxdma_ptr->head_rx);
 	}
-	return ret;
+	if (queued % FPIF_RX_REFILL_BATCH)
+		fpif_write_reg(&rxdma_ptr->rx_ch_reg->rx_cpu,
+			       rxdma_ptr->head_rx);
+
+	return queued;
+}
+
+
+static inline int fpif_rx_starved(struct fpif_rxdma *rxdma_ptr)
+{
+	return rxdma_ptr->head_rx == rxdma_ptr->last_rx;
+}
+
+
+static int fpif_rxb_setup(struct fpif_priv *priv)
+{
+	int queued;
+
+	/* Setup the skbuff rings */
+	queued = fpif_rx_refill(priv, GFP_KERNEL);
+	if (queued < FPIF_RX_BUFS - 1)
+		netdev_err(priv->netdev, "allocating RX buffer\n");
+	if (!queued)
+		return -ENOMEM;
+
+	return 0;
 }
 
 
@@ -858,7 +900,7 @@ static int is_valid_tcam(struct fpif_grp *fpgrp, int idx)
 }
 
 
-static void remove_tcam(struct fpif_grp *fpgrp, int idx)
+void fp_remove_tcam(struct fpif_grp *fpgrp, int idx)
 {
 	int valid;
 
@@ -887,7 +929,7 @@ static void mod_tcam(struct fpif_grp *fpgrp, struct fp_tcam_info *tcam_info,
 		      dev_addr[5]);
 
 	fpif_write_reg(fpgrp->base + FP_FC_RST, 0);
-	if (sp) {
+	if (sp || tcam_info->match_sp) {
 		val = FC_SOURCE_SRCP_MASK | sp << FC_SOURCE_SRCP_SHIFT;
 		fpif_write_reg(fpgrp->base + FP_FC_SOURCE, val);
 	}
@@ -917,8 +959,8 @@ static void mod_tcam(struct fpif_grp *fpgrp, struct fp_tcam_info *tcam_info,
 }
 
 
-static void add_tcam(struct fpif_grp *fpgrp, struct fp_tcam_info *tcam_info,
-		     int idx)
+void fp_add_tcam(struct fpif_grp *fpgrp, struct fp_tcam_info *tcam_info,
+		 int idx)
 {
 	int valid;
 
@@ -942,7 +984,7 @@ static void remove_tcam_br(struct fpif_priv *priv)
 		return;
 
 	idx = TCAM_PROMS_FPBR_IDX + priv->id;
-	remove_tcam(fpgrp, idx);
+	fp_remove_tcam(fpgrp, idx);
 	priv->br_tcam_idx = IDX_INV;
 }
 
@@ -957,7 +999,7 @@ static void add_tcam_br(struct fpif_priv *priv, struct net_device *netdev)
 	tcam_info.dev_addr_d = netdev->dev_addr;
 	tcam_info.sp = priv->sp;
 	idx = TCAM_PROMS_FPBR_IDX + priv->id;
-	add_tcam(fpgrp, &tcam_info, idx);
+	fp_add_tcam(fpgrp, &tcam_info, idx);
 	priv->br_tcam_idx = idx;
 	return;
 }
@@ -968,8 +1010,8 @@ static void remove_tcam_promisc(struct fpif_priv *priv)
 	struct fpif_grp *fpgrp = priv->fpgrp;
 
 	if (priv->promisc_idx != TCAM_IDX_INV) {
-		remove_tcam(fpgrp, TCAM_PROMS_SP_IDX + priv->id);
-		remove_tcam(fpgrp, TCAM_PROMS_FP_IDX + priv->id);
+		fp_remove_tcam(fpgrp, TCAM_PROMS_SP_IDX + priv->id);
+		fp_remove_tcam(fpgrp, TCAM_PROMS_FP_IDX + priv->id);
 		priv->promisc_idx = TCAM_IDX_INV;
 	}
 }
@@ -980,7 +1022,7 @@ static void remove_tcam_allmulti(struct fpif_priv *priv)
 	struct fpif_grp *fpgrp = priv->fpgrp;
 
 	if (priv->allmulti_idx != TCAM_IDX_INV) {
-		remove_tcam(fpgrp, TCAM_ALLMULTI_IDX + priv->id);
+		fp_remove_tcam(fpgrp, TCAM_ALLMULTI_IDX + priv->id);
 		priv->allmulti_idx = TCAM_IDX_INV;
 	}
 }
@@ -1000,7 +1042,7 @@ static void add_tcam_allmulti(struct fpif_priv *priv)
 		tcam_info.dest = priv->dma_port;
 		tcam_info.all_multi = 1;
 		idx = TCAM_ALLMULTI_IDX + priv->id;
-		add_tcam(priv->fpgrp, &tcam_info, idx);
+		fp_add_tcam(priv->fpgrp, &tcam_info, idx);
 		priv->allmulti_idx = idx;
 	}
 }
@@ -1017,7 +1059,7 @@ static void add_tcam_promisc(struct fpif_priv *priv)
 		tcam_info.sp = priv->sp;
 		tcam_info.dev_addr_d = netdev->dev_addr;
 		idx = TCAM_PROMS_FP_IDX + priv->id;
-		add_tcam(priv->fpgrp, &tcam_info, idx);
+		fp_add_tcam(priv->fpgrp, &tcam_info, idx);
 
 		memset(&tcam_info, 0, sizeof(tcam_info));
 		tcam_info.sp = priv->sp;
@@ -1026,7 +1068,7 @@ static void add_tcam_promisc(struct fpif_priv *priv)
 		tcam_info.redir = 1;
 		tcam_info.dest = priv->dma_port;
 		idx = TCAM_PROMS_SP_IDX + priv->id;
-		add_tcam(priv->fpgrp, &tcam_info, idx);
+		fp_add_tcam(priv->fpgrp, &tcam_info, idx);
 		priv->promisc_idx = idx;
 	}
 }
@@ -1076,6 +1118,7 @@ static int dp_device_event(struct notifier_block *unused, unsigned long event,
 
 		priv->br_l2cam_idx = IDX_INV;
 		remove_tcam_br(priv);
+		fp_flow_flush(priv);
 
 		if ((bridge_up) && (p->dev->flags & IFF_UP)) {
 			err = put_l2cam(priv, netdev->dev_addr, &idx);
@@ -1174,7 +1217,8 @@ static inline void fpif_process_frame(struct fpif_priv *priv,
 /**
  * fpif_clean_rx_ring() -- Processes each frame in the rx ring
  * until the budget/quota has been reached. Returns the number
- * of frames handled
+ * of frames handled. The emptied slots are refilled afterwards
+ * by fpif_rx_refill().
  */
 static inline int fpif_clean_rx_ring(struct fpif_priv *priv, int limit)
 {
@@ -1184,11 +1228,15 @@ static inline int fpif_clean_rx_ring(struct fpif_priv *priv, int limit)
 	dma_addr_t dma_addr;
 	struct fpif_rxdma *rxdma_ptr = priv->rxdma_ptr;
 
-	tail_ptr = readl(&rxdma_ptr->rx_ch_reg->rx_done);
-	last_rx = rxdma_ptr->last_rx;
+	/*
+	 * Clear the rx interrupt before sampling rx_done: frames completed
+	 * after the read raise it again and are picked up by the next poll.
+	 */
 	fpif_write_reg(&rxdma_ptr->rxbase->rx_irq_flags,
 		       1 << priv->rx_dma_ch);
-	while (last_rx != tail_ptr && limit--) {
+	tail_ptr = readl(&rxdma_ptr->rx_ch_reg->rx_done);
+	last_rx = rxdma_ptr->last_rx;
+	while (last_rx != tail_ptr && cntr < limit) {
 		dma_addr = rxdma_ptr->fp_rx_skbuff[last_rx].dma_ptr;
 		skb = rxdma_ptr->fp_rx_skbuff[last_rx].skb;
 		rxdma_ptr->fp_rx_skbuff[last_rx].skb = 0;
@@ -1198,21 +1246,7 @@ static inline int fpif_clean_rx_ring(struct fpif_priv *priv, int limit)
 				 priv->rx_buffer_size, DMA_FROM_DEVICE);
 
 		fpif_process_frame(priv, skb);
-		skb = fpif_poll_start_skb(priv, GFP_ATOMIC);
-		if (NULL == skb) {
-			netdev_err(priv->netdev, "skb is not free\n");
-			break;
-		}
-		dma_addr =
-		    dma_map_single(priv->devptr, skb->data,
-				   priv->rx_buffer_size, DMA_FROM_DEVICE);
-		fpif_q_rx_buffer(rxdma_ptr, skb, dma_addr);
 		last_rx = (last_rx + 1) & RX_RING_MOD_MASK;
-		/* clear the rx interrupt */
-		if (last_rx == tail_ptr)
-			fpif_write_reg(&rxdma_ptr->rxbase->rx_irq_flags,
-				       1 << priv->rx_dma_ch);
-		tail_ptr = readl(&rxdma_ptr->rx_ch_reg->rx_done);
 	}
 	rxdma_ptr->last_rx = last_rx;
 
@@ -1234,6 +1268,8 @@ static int fpif_clean_tx_ring(struct fpif_priv *priv, int tx_work_limit)
 	dma_addr_t dma_addr;
 	struct sk_buff *skb;
 	struct fpif_txdma *txdma_ptr = priv->txdma_ptr;
+	struct sk_buff_head *recycle = &priv->rx_recycle;
+	int recycle_size = priv->rx_buffer_size + RXBUF_ALIGNMENT;
 
 	tail_ptr = readl(&txdma_ptr->tx_ch_reg->tx_done);
 	last_tx = txdma_ptr->last_tx;
@@ -1251,8 +1287,14 @@ static int fpif_clean_tx_ring(struct fpif_priv *priv, int tx_work_limit)
 		else
 			dma_unmap_single(priv->devptr,
 				(dma_addr_t) dma_addr, len, DMA_TO_DEVICE);
-		if (eop)
-			dev_kfree_skb_any(skb);
+		if (eop && skb) {
+			/* Hand the buffer to the rx refill when it fits */
+			if (skb_queue_len(recycle) < FPIF_RX_RING_SIZE &&
+			    skb_recycle_check(skb, recycle_size))
+				__skb_queue_head(recycle, skb);
+			else
+				dev_kfree_skb_any(skb);
+		}
 		txdma_ptr->fp_tx_skbuff[last_tx].skb = 0;
 		txdma_ptr->fp_tx_skbuff[last_tx].skb_data = 0;
 		last_tx = (last_tx + 1) & TX_RING_MOD_MASK;
@@ -1330,8 +1372,18 @@ static int fpif_poll(struct napi_struct *napi, int budget)
 	fpdbg2("%s\n", __func__);
 	howmany_rx = fpif_clean_rx_ring(priv, budget);
 	fpif_clean_tx_ring(priv, FP_TX_FREE_BUDGET);
+	fpif_rx_refill(priv, GFP_ATOMIC);
 	check_napi_sched(fpgrp);
 
+	/*
+	 * With no buffer left the DMA can not raise another rx interrupt,
+	 * so stay in polling mode until the refill succeeds.
+	 */
+	if (unlikely(fpif_rx_starved(priv->rxdma_ptr))) {
+		priv->xstats.rx_starved++;
+		howmany_rx = budget;
+	}
+
 	if (howmany_rx < budget) {
 		fpdbg2("napi_complete for id=%d\n", priv->id);
 		napi_complete(&priv->napi);
@@ -1466,6 +1518,7 @@ static int fpif_xmit_frame(struct sk_buff *skb, struct net_device *netdev)
 	fpdbg("TX:len=%d data_len=%d prot=%x id=%d ch=%d\n",
 	      skb->len, skb->data_len, htons(skb->protocol), priv->id,
 	      priv->tx_dma_ch);
+	fp_flow_learn(priv, skb);
 
 	spin_lock(&txdma_ptr->fpif_txlock);
 	nr_frags = skb_shinfo(skb)->nr_frags;
@@ -1751,8 +1804,9 @@ static int fpif_close(struct net_device *netdev)
 		fpif_write_reg(priv->rgmii_base + RGMII_MACINFO0, macinfo);
 	}
 	netif_stop_queue(netdev);
-	skb_queue_purge(&priv->rx_recycle);
+	fp_flow_flush(priv);
 	napi_disable(&priv->napi);
+	skb_queue_purge(&priv->rx_recycle);
 	if (priv->phydev) {
 		phy_stop(priv->phydev);
 		phy_disconnect(priv->phydev);
@@ -2148,6 +2202,7 @@ static int __devinit fpif_probe(struct pci_dev *pdev,
 		 readl(fpgrp->base + FPGA_BRIDGE_VER_REG2));
 
 	fp_hwinit(fpgrp);
+	fp_flow_init(fpgrp);
 	fpdbg("%s:ends\n", __func__);
 	return 0;
 
@@ -2169,6 +2224,7 @@ static void fpif_remove(struct pci_dev *pdev)
 	struct fpif_grp *fpgrp = pci_get_drvdata(pdev);
 	void __iomem *base = fpgrp->base;
 
+	fp_flow_exit(fpgrp);
 	fpif_deinit(fpgrp);
 	free_irq(pdev->irq, fpgrp);
 	kfree(fpgrp);
@@ -2340,6 +2396,7 @@ static int __devinit fpif_probe(struct platform_device *pdev)
 	}
 	platform_set_drvdata(pdev, fpgrp);
 	fp_hwinit(fpgrp);
+	fp_flow_init(fpgrp);
 	pr_debug("%s ends\n", __func__);
 
 	return 0;
@@ -2349,6 +2406,7 @@ static int fpif_remove(struct platform_device *pdev)
 {
 	struct fpif_grp *fpgrp = platform_get_drvdata(pdev);
 
+	fp_flow_exit(fpgrp);
 	fpif_deinit(fpgrp);
 	return 0;
 }
@@ -22,6 +22,9 @@
 
 #include <linux/stmfp.h>
 #include <linux/mutex.h>
+#include <linux/workqueue.h>
+#include <linux/if_ether.h>
+#include <linux/ethtool.h>
 #define DRV_MODULE_VERSION "1.0"
 #define DRV_NAME "fpif"
 
@@ -55,6 +58,8 @@
 #define FPIF_RX_RING_SIZE 256
 #define RX_RING_MOD_MASK (FPIF_RX_RING_SIZE - 1)
 #define FPIF_RX_BUFS (FPIF_RX_RING_SIZE - 1)
+/* Empty RX slots are refilled, and handed to the DMA, in chunks of this */
+#define FPIF_RX_REFILL_BATCH (16)
 
 #define FPIF_TX_RING_SIZE 256
 #define TX_RING_MOD_MASK (FPIF_TX_RING_SIZE - 1)
@@ -406,6 +411,12 @@
 #define TCAM_RD (0x80000000)
 #define TCAM_WR (0)
 
+/* TCAM_BRIDGE_IDX up to the promiscuous entries holds offloaded flows */
+#define FP_FLOW_ENTRIES (TCAM_PROMS_SP_IDX - TCAM_BRIDGE_IDX)
+#define FP_FLOW_THRESHOLD (32)
+#define FP_FLOW_TIMEOUT (120)
+#define FP_FLOW_LEARN_TIME (5 * HZ)
+
 struct rx_ch_reg {
 	u32 rx_cpu;
 	u32 rx_ip;
@@ -487,6 +498,12 @@ struct fp_tx_ring {
 	void *priv;
 };
 
+struct fpif_rx_stats {
+	unsigned long rx_refill_fail;
+	unsigned long rx_recycled;
+	unsigned long rx_starved;
+};
+
 struct fpif_rxdma {
 	struct fp_rxdma_regs *rxbase;
 	struct rx_ch_reg *rx_ch_reg;
@@ -511,6 +528,37 @@ struct fpif_txdma {
 	int ch;
 };
 
+enum fp_flow_state {
+	FP_FLOW_FREE,
+	FP_FLOW_LEARNING,	/* seen by the CPU, not yet offloaded */
+	FP_FLOW_HW,		/* switched by the TCAM, ages out */
+	FP_FLOW_STATIC		/* added by ethtool, never ages */
+};
+
+struct fp_flow {
+	u8 addr[ETH_ALEN];
+	u8 in;
+	u8 out;
+	u8 state;
+	u32 hits;
+	unsigned long stamp;
+};
+
+struct fp_flow_table {
+	/* This lock protect the flows against the xmit path */
+	spinlock_t lock;
+	struct fp_flow flows[FP_FLOW_ENTRIES];
+	struct delayed_work work;
+	u32 enabled;
+	u32 threshold;
+	u32 timeout;
+	u32 installed;
+	u32 aged;
+	u32 stale;
+	u32 table_full;
+	struct dentry *dir;
+};
+
 struct fpif_grp {
 	void __iomem *base;
 	unsigned long active_if;
@@ -533,6 +581,9 @@ struct fpif_grp {
 	struct fpif_txdma txdma_info[MAX_TXDMA];
 	u8 l2_idx[FP_L2CAM_SIZE];
 	struct plat_stmfp_data *plat;
+#ifdef CONFIG_STMFP_FLOW_OFFLOAD
+	struct fp_flow_table flow;
+#endif
 };
 
 struct fpif_priv {
@@ -554,6 +605,7 @@ struct fpif_priv {
 	u32 dmap; /* Fastpath Destination Map */
 	u32 rx_buffer_size;
 	struct sk_buff_head rx_recycle;
+	struct fpif_rx_stats xstats;
 	struct device *devptr;
 	struct phy_device *phydev;
 	int oldlink;
@@ -578,6 +630,7 @@ struct fp_tcam_info {
 	u8 bridge;
 	u8 cont;
 	u8 all_multi;
+	u8 match_sp;	/* match the source port even when it is 0 */
 	unsigned char *dev_addr_d;
 };
 
@@ -594,3 +647,23 @@ extern int fpif_mdio_unregister(struct net_device *ndev);
 extern void fpif_set_ethtool_ops(struct net_device *netdev);
 extern int init_fastnet_hardware(void);
 extern int fpif_wait_till_done(struct fpif_priv *priv);
+extern void fp_add_tcam(struct fpif_grp *fpgrp, struct fp_tcam_info *tcam_info,
+			int idx);
+extern void fp_remove_tcam(struct fpif_grp *fpgrp, int idx);
+
+#ifdef CONFIG_STMFP_FLOW_OFFLOAD
+extern void fp_flow_init(struct fpif_grp *fpgrp);
+extern void fp_flow_exit(struct fpif_grp *fpgrp);
+extern void fp_flow_learn(struct fpif_priv *priv, struct sk_buff *skb);
+extern void fp_flow_flush(struct fpif_priv *priv);
+extern int fp_flow_get_rxnfc(struct net_device *dev,
+			     struct ethtool_rxnfc *cmd, u32 *rule_locs);
+extern int fp_flow_set_rxnfc(struct net_device *dev,
+			     struct ethtool_rxnfc *cmd);
+#else
+static inline void fp_flow_init(struct fpif_grp *fpgrp) { }
+static inline void fp_flow_exit(struct fpif_grp *fpgrp) { }
+static inline void fp_flow_learn(struct fpif_priv *priv,
+				 struct sk_buff *skb) { }
+static inline void fp_flow_flush(struct fpif_priv *priv) { }
+#endif
@@ -45,6 +45,9 @@
 #undef FRAME_FILTER_DEBUG
 /* #define FRAME_FILTER_DEBUG */
 
+#define STMMAC_TX_OCC_BUCKETS	4
+#define STMMAC_TX_BATCH_BUCKETS	8
+
 struct stmmac_extra_stats {
 	/* Transmit errors */
 	unsigned long tx_underflow ____cacheline_aligned;
@@ -97,6 +100,15 @@ struct stmmac_extra_stats {
 	unsigned long tx_clean;
 	unsigned long tx_reset_ic_bit;
 	unsigned long irq_receive_pmt_irq_n;
+	/* TX ring occupancy (quarters of the ring) sampled on each xmit */
+	unsigned long tx_ring_occ[STMMAC_TX_OCC_BUCKETS];
+	/* Frames reclaimed per stmmac_tx_clean call (0, 1, 2-3, ..., 64+) */
+	unsigned long tx_clean_batch[STMMAC_TX_BATCH_BUCKETS];
+	/* RX page pool */
+	unsigned long rx_page_recycle_hit;
+	unsigned long rx_page_recycle_miss;
+	unsigned long rx_page_alloc_fail;
+	unsigned long rx_copybreak_n;
 	/* MMC info */
 	unsigned long mmc_tx_irq_n;
 	unsigned long mmc_rx_irq_n;
@@ -205,6 +217,13 @@ struct stmmac_extra_stats {
 #define STMMAC_MAX_COAL_TX_TICK	100000
 #define STMMAC_TX_MAX_FRAMES	256
 #define STMMAC_TX_FRAMES	64
+/* Rx frame coalesce (RX IC bit set every N descriptors) */
+#define STMMAC_RX_MAX_FRAMES	256
+/* Adaptive coalesce defaults (packets per second) */
+#define STMMAC_PKT_RATE_LOW	4000
+#define STMMAC_PKT_RATE_HIGH	40000
+#define STMMAC_COAL_TX_TIMER_LOW	1000
+#define STMMAC_RX_FRAMES_HIGH	64
 
 /* Rx IPC status */
 enum rx_frame_status {
@@ -323,6 +342,9 @@ struct stmmac_desc_ops {
 	/* Handle extra events on specific interrupts hw dependent */
 	int (*get_rx_owner) (struct dma_desc *p);
 	void (*set_rx_owner) (struct dma_desc *p);
+	/* Enable/disable the interrupt on rx frame completion; used with
+	 * the RX Watchdog to coalesce the rx interrupts by frame count */
+	void (*set_rx_ic) (struct dma_desc *p, int enable);
 	/* Get the receive frame size */
 	int (*get_rx_frame_len) (struct dma_desc *p, int rx_coe_type);
 	/* Return the reception status looking at the RDES1 */
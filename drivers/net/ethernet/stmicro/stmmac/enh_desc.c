@@ -281,6 +281,11 @@ static void enh_desc_set_rx_owner(struct dma_desc *p)
 	p->des01.erx.own = 1;
 }
 
+static void enh_desc_set_rx_ic(struct dma_desc *p, int enable)
+{
+	p->des01.erx.disable_ic = !enable;
+}
+
 static int enh_desc_get_tx_ls(struct dma_desc *p)
 {
 	return p->des01.etx.last_segment;
@@ -393,6 +398,7 @@ const struct stmmac_desc_ops enh_desc_ops = {
 	.get_tx_ls = enh_desc_get_tx_ls,
 	.set_tx_owner = enh_desc_set_tx_owner,
 	.set_rx_owner = enh_desc_set_rx_owner,
+	.set_rx_ic = enh_desc_set_rx_ic,
 	.get_rx_frame_len = enh_desc_get_rx_frame_len,
 	.rx_extended_status = enh_desc_get_ext_status,
 	.enable_tx_timestamp = enh_desc_enable_tx_timestamp,
@@ -164,6 +164,11 @@ static void ndesc_set_rx_owner(struct dma_desc *p)
 	p->des01.rx.own = 1;
 }
 
+static void ndesc_set_rx_ic(struct dma_desc *p, int enable)
+{
+	p->des01.rx.disable_ic = !enable;
+}
+
 static int ndesc_get_tx_ls(struct dma_desc *p)
 {
 	return p->des01.tx.last_segment;
@@ -265,6 +270,7 @@ const struct stmmac_desc_ops ndesc_ops = {
 	.get_tx_ls = ndesc_get_tx_ls,
 	.set_tx_owner = ndesc_set_tx_owner,
 	.set_rx_owner = ndesc_set_rx_owner,
+	.set_rx_ic = ndesc_set_rx_ic,
 	.get_rx_frame_len = ndesc_get_rx_frame_len,
 	.enable_tx_timestamp = ndesc_enable_tx_timestamp,
 	.get_tx_timestamp_status = ndesc_get_tx_timestamp_status,
@@ -38,6 +38,36 @@ struct stmmac_tx_info {
 	bool map_as_page;
 };
 
+struct stmmac_rx_page {
+	struct page *page;
+	dma_addr_t dma;
+	unsigned int offset;
+	unsigned int sync_len;
+};
+
+/* Adaptive interrupt coalescing: the rx watchdog, the rx frame threshold
+ * and the tx mitigation are scaled between the _low and _high values
+ * according to the packet rate measured in the NAPI poll.
+ */
+struct stmmac_coal_adapt {
+	u32 use_rx;
+	u32 use_tx;
+	u32 pkt_rate_low;
+	u32 pkt_rate_high;
+	u32 rx_riwt_low;
+	u32 rx_riwt_high;
+	u32 rx_frames_low;
+	u32 rx_frames_high;
+	u32 tx_usecs_low;
+	u32 tx_usecs_high;
+	u32 tx_frames_low;
+	u32 tx_frames_high;
+	u32 sample_interval;
+	unsigned long last_jiffies;
+	unsigned long last_rx_packets;
+	unsigned long last_tx_packets;
+};
+
 struct stmmac_priv {
 	/* Frequently used values are kept adjacent for cache effect */
 	struct dma_extended_desc *dma_etx ____cacheline_aligned_in_smp;
@@ -65,10 +95,13 @@ struct stmmac_priv {
 	unsigned int dma_rx_size;
 	unsigned int dma_buf_sz;
 	u32 rx_riwt;
+	u32 rx_coal_frames;
 	int hwts_rx_en;
 	dma_addr_t *rx_skbuff_dma;
 	dma_addr_t dma_rx_phy;
 	unsigned int rx_csum;
+	struct stmmac_rx_page *rx_page;
+	int rx_page_mode;
 
 	struct napi_struct napi ____cacheline_aligned_in_smp;
 
@@ -112,6 +145,7 @@ struct stmmac_priv {
 	unsigned int default_addend;
 	u32 adv_ts;
 	int use_riwt;
+	struct stmmac_coal_adapt coal_adapt;
 	spinlock_t ptp_lock;
 	u32 lpi_ctl_status;
 };
@@ -46,6 +46,9 @@ struct stmmac_stats {
 #define STMMAC_STAT(m)	\
 	{ #m, FIELD_SIZEOF(struct stmmac_extra_stats, m),	\
 	offsetof(struct stmmac_priv, xstats.m)}
+#define STMMAC_STAT_BUCKET(m, i, s)	\
+	{ s, FIELD_SIZEOF(struct stmmac_extra_stats, m[0]),	\
+	offsetof(struct stmmac_priv, xstats.m[i])}
 
 static const struct stmmac_stats stmmac_gstrings_stats[] = {
 	/* Transmit errors */
@@ -99,6 +102,24 @@ static const struct stmmac_stats stmmac_gstrings_stats[] = {
 	STMMAC_STAT(tx_clean),
 	STMMAC_STAT(tx_reset_ic_bit),
 	STMMAC_STAT(irq_receive_pmt_irq_n),
+	/* TX ring occupancy and completion batch histograms */
+	STMMAC_STAT_BUCKET(tx_ring_occ, 0, "tx_ring_occ_0_25pc"),
+	STMMAC_STAT_BUCKET(tx_ring_occ, 1, "tx_ring_occ_25_50pc"),
+	STMMAC_STAT_BUCKET(tx_ring_occ, 2, "tx_ring_occ_50_75pc"),
+	STMMAC_STAT_BUCKET(tx_ring_occ, 3, "tx_ring_occ_75_100pc"),
+	STMMAC_STAT_BUCKET(tx_clean_batch, 0, "tx_clean_batch_0"),
+	STMMAC_STAT_BUCKET(tx_clean_batch, 1, "tx_clean_batch_1"),
+	STMMAC_STAT_BUCKET(tx_clean_batch, 2, "tx_clean_batch_2_3"),
+	STMMAC_STAT_BUCKET(tx_clean_batch, 3, "tx_clean_batch_4_7"),
+	STMMAC_STAT_BUCKET(tx_clean_batch, 4, "tx_clean_batch_8_15"),
+	STMMAC_STAT_BUCKET(tx_clean_batch, 5, "tx_clean_batch_16_31"),
+	STMMAC_STAT_BUCKET(tx_clean_batch, 6, "tx_clean_batch_32_63"),
+	STMMAC_STAT_BUCKET(tx_clean_batch, 7, "tx_clean_batch_64_plus"),
+	/* RX page pool */
+	STMMAC_STAT(rx_page_recycle_hit),
+	STMMAC_STAT(rx_page_recycle_miss),
+	STMMAC_STAT(rx_page_alloc_fail),
+	STMMAC_STAT(rx_copybreak_n),
 	/* MMC info */
 	STMMAC_STAT(mmc_tx_irq_n),
 	STMMAC_STAT(mmc_rx_irq_n),
@@ -674,12 +695,51 @@ static int stmmac_get_coalesce(struct net_device *dev,
 			       struct ethtool_coalesce *ec)
 {
 	struct stmmac_priv *priv = netdev_priv(dev);
+	struct stmmac_coal_adapt *ca = &priv->coal_adapt;
 
 	ec->tx_coalesce_usecs = priv->tx_coal_timer;
 	ec->tx_max_coalesced_frames = priv->tx_coal_frames;
 
-	if (priv->use_riwt)
+	if (priv->use_riwt) {
 		ec->rx_coalesce_usecs = stmmac_riwt2usec(priv->rx_riwt, priv);
+		ec->rx_max_coalesced_frames = priv->rx_coal_frames;
+		ec->rx_coalesce_usecs_low = stmmac_riwt2usec(ca->rx_riwt_low,
+							     priv);
+		ec->rx_coalesce_usecs_high = stmmac_riwt2usec(ca->rx_riwt_high,
+							      priv);
+		ec->rx_max_coalesced_frames_low = ca->rx_frames_low;
+		ec->rx_max_coalesced_frames_high = ca->rx_frames_high;
+		ec->use_adaptive_rx_coalesce = ca->use_rx;
+	}
+
+	ec->use_adaptive_tx_coalesce = ca->use_tx;
+	ec->tx_coalesce_usecs_low = ca->tx_usecs_low;
+	ec->tx_coalesce_usecs_high = ca->tx_usecs_high;
+	ec->tx_max_coalesced_frames_low = ca->tx_frames_low;
+	ec->tx_max_coalesced_frames_high = ca->tx_frames_high;
+	ec->pkt_rate_low = ca->pkt_rate_low;
+	ec->pkt_rate_high = ca->pkt_rate_high;
+	ec->rate_sample_interval = ca->sample_interval;
+
+	return 0;
+}
+
+static int stmmac_check_tx_coalesce(u32 usecs, u32 frames)
+{
+	if ((usecs == 0) && (frames == 0))
+		return -EINVAL;
+
+	if ((usecs > STMMAC_MAX_COAL_TX_TICK) ||
+	    (frames > STMMAC_TX_MAX_FRAMES))
+		return -EINVAL;
+
+	return 0;
+}
+
+static int stmmac_check_riwt(u32 riwt)
+{
+	if ((riwt > MAX_DMA_RIWT) || (riwt < MIN_DMA_RIWT))
+		return -EINVAL;
 
 	return 0;
 }
@@ -688,46 +748,79 @@ static int stmmac_set_coalesce(struct net_device *dev,
 			       struct ethtool_coalesce *ec)
 {
 	struct stmmac_priv *priv = netdev_priv(dev);
-	unsigned int rx_riwt;
+	struct stmmac_coal_adapt *ca = &priv->coal_adapt;
+	unsigned int rx_riwt, riwt_low, riwt_high;
 
 	/* Check not supported parameters  */
-	if ((ec->rx_max_coalesced_frames) || (ec->rx_coalesce_usecs_irq) ||
+	if ((ec->rx_coalesce_usecs_irq) ||
 	    (ec->rx_max_coalesced_frames_irq) || (ec->tx_coalesce_usecs_irq) ||
-	    (ec->use_adaptive_rx_coalesce) || (ec->use_adaptive_tx_coalesce) ||
-	    (ec->pkt_rate_low) || (ec->rx_coalesce_usecs_low) ||
-	    (ec->rx_max_coalesced_frames_low) || (ec->tx_coalesce_usecs_high) ||
-	    (ec->tx_max_coalesced_frames_low) || (ec->pkt_rate_high) ||
-	    (ec->tx_coalesce_usecs_low) || (ec->rx_coalesce_usecs_high) ||
-	    (ec->rx_max_coalesced_frames_high) ||
 	    (ec->tx_max_coalesced_frames_irq) ||
-	    (ec->stats_block_coalesce_usecs) ||
-	    (ec->tx_max_coalesced_frames_high) || (ec->rate_sample_interval))
+	    (ec->stats_block_coalesce_usecs))
 		return -EOPNOTSUPP;
 
 	if (ec->rx_coalesce_usecs == 0)
 		return -EINVAL;
 
-	if ((ec->tx_coalesce_usecs == 0) &&
-	    (ec->tx_max_coalesced_frames == 0))
+	if (stmmac_check_tx_coalesce(ec->tx_coalesce_usecs,
+				     ec->tx_max_coalesced_frames))
 		return -EINVAL;
 
-	if ((ec->tx_coalesce_usecs > STMMAC_MAX_COAL_TX_TICK) ||
-	    (ec->tx_max_coalesced_frames > STMMAC_TX_MAX_FRAMES))
+	if ((ec->rx_max_coalesced_frames > STMMAC_RX_MAX_FRAMES) ||
+	    (ec->rx_max_coalesced_frames_low > STMMAC_RX_MAX_FRAMES) ||
+	    (ec->rx_max_coalesced_frames_high > STMMAC_RX_MAX_FRAMES))
 		return -EINVAL;
 
 	rx_riwt = stmmac_usec2riwt(ec->rx_coalesce_usecs, priv);
 
-	if ((rx_riwt > MAX_DMA_RIWT) || (rx_riwt < MIN_DMA_RIWT))
+	if (stmmac_check_riwt(rx_riwt))
 		return -EINVAL;
 	else if (!priv->use_riwt)
 		return -EOPNOTSUPP;
 
+	riwt_low = stmmac_usec2riwt(ec->rx_coalesce_usecs_low, priv);
+	riwt_high = stmmac_usec2riwt(ec->rx_coalesce_usecs_high, priv);
+
+	if (ec->use_adaptive_rx_coalesce || ec->use_adaptive_tx_coalesce) {
+		if (ec->pkt_rate_low >= ec->pkt_rate_high)
+			return -EINVAL;
+		if (ec->use_adaptive_rx_coalesce &&
+		    (stmmac_check_riwt(riwt_low) ||
+		     stmmac_check_riwt(riwt_high)))
+			return -EINVAL;
+		if (ec->use_adaptive_tx_coalesce &&
+		    (stmmac_check_tx_coalesce(ec->tx_coalesce_usecs_low,
+					      ec->tx_max_coalesced_frames_low) ||
+		     stmmac_check_tx_coalesce(ec->tx_coalesce_usecs_high,
+					      ec->tx_max_coalesced_frames_high)))
+			return -EINVAL;
+	}
+
 	/* Only copy relevant parameters, ignore all others. */
 	priv->tx_coal_frames = ec->tx_max_coalesced_frames;
 	priv->tx_coal_timer = ec->tx_coalesce_usecs;
+	priv->rx_coal_frames = ec->rx_max_coalesced_frames;
 	priv->rx_riwt = rx_riwt;
 	priv->hw->dma->rx_watchdog(priv->ioaddr, priv->rx_riwt);
 
+	ca->pkt_rate_low = ec->pkt_rate_low;
+	ca->pkt_rate_high = ec->pkt_rate_high;
+	ca->sample_interval = ec->rate_sample_interval;
+	if (!stmmac_check_riwt(riwt_low))
+		ca->rx_riwt_low = riwt_low;
+	if (!stmmac_check_riwt(riwt_high))
+		ca->rx_riwt_high = riwt_high;
+	ca->rx_frames_low = ec->rx_max_coalesced_frames_low;
+	ca->rx_frames_high = ec->rx_max_coalesced_frames_high;
+	ca->tx_usecs_low = ec->tx_coalesce_usecs_low;
+	ca->tx_usecs_high = ec->tx_coalesce_usecs_high;
+	ca->tx_frames_low = ec->tx_max_coalesced_frames_low;
+	ca->tx_frames_high = ec->tx_max_coalesced_frames_high;
+	ca->last_jiffies = jiffies;
+	ca->last_rx_packets = dev->stats.rx_packets;
+	ca->last_tx_packets = dev->stats.tx_packets;
+	ca->use_rx = ec->use_adaptive_rx_coalesce;
+	ca->use_tx = ec->use_adaptive_tx_coalesce;
+
 	return 0;
 }
 
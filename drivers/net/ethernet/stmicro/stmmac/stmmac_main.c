@@ -123,6 +123,26 @@ MODULE_PARM_DESC(chain_mode, "To use chain instead of ring mode");
 static int wol_plus_en;
 module_param(wol_plus_en, int, S_IRUGO | S_IWUSR);
 MODULE_PARM_DESC(wol_plus_en, "Driver can use the WoL+ feature");
+
+/* When the RX page pool is enabled the DMA receives into pre-mapped pages
+ * that are recycled by the driver: small frames are copied into a new skb
+ * (copybreak) and larger ones are attached as page fragments. This avoids
+ * one skb allocation and one dma_map_single per received frame.
+ */
+static int rx_page_pool;
+module_param(rx_page_pool, int, S_IRUGO);
+MODULE_PARM_DESC(rx_page_pool, "Receive into recycled pages [on/off]");
+
+#define STMMAC_RX_COPYBREAK	256
+static int rx_copybreak = STMMAC_RX_COPYBREAK;
+module_param(rx_copybreak, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(rx_copybreak, "Copy only frames shorter than this (page pool)");
+
+/* Each page holds two RX buffers; the headers of the frames not copied are
+ * pulled into the skb linear area, the payload stays in the page.
+ */
+#define STMMAC_RX_PAGE_BUF	(PAGE_SIZE / 2)
+#define STMMAC_RX_HDR_SIZE	128
 static irqreturn_t stmmac_interrupt(int irq, void *dev_id);
 
 #ifdef CONFIG_STMMAC_DEBUG_FS
@@ -131,6 +151,9 @@ static void stmmac_exit_fs(void);
 #endif
 
 #define STMMAC_COAL_TIMER(x) (jiffies + usecs_to_jiffies(x))
+/* Packet rate sampling period used by the adaptive coalescing when no
+ * rate_sample_interval is given by ethtool. */
+#define STMMAC_COAL_SAMPLE_PERIOD	(HZ / 10)
 
 /**
  * stmmac_verify_args - verify the driver parameters.
@@ -155,6 +178,8 @@ static void stmmac_verify_args(void)
 		pause = PAUSE_TIME;
 	if (eee_timer < 0)
 		eee_timer = STMMAC_DEFAULT_LPI_TIMER;
+	if (rx_copybreak < 0)
+		rx_copybreak = STMMAC_RX_COPYBREAK;
 }
 
 /**
@@ -985,11 +1010,75 @@ static void stmmac_clear_descriptors(struct stmmac_priv *priv)
 						     (i == txsize - 1));
 }
 
+/**
+ * stmmac_rx_page_alloc: allocate and map a page for the RX page pool
+ * @priv: driver private structure
+ * @entry: RX descriptor index
+ * @gfp: allocation flags
+ * Description: the whole page is mapped once and stays mapped while it is
+ * recycled; only the received bytes are synced afterwards.
+ */
+static int stmmac_rx_page_alloc(struct stmmac_priv *priv, unsigned int entry,
+				gfp_t gfp)
+{
+	struct stmmac_rx_page *rxp = &priv->rx_page[entry];
+	struct page *page;
+
+	page = alloc_page(gfp | __GFP_COLD);
+	if (unlikely(!page))
+		return -ENOMEM;
+
+	rxp->dma = dma_map_page(priv->device, page, 0, PAGE_SIZE,
+				DMA_FROM_DEVICE);
+	if (dma_mapping_error(priv->device, rxp->dma)) {
+		__free_page(page);
+		return -EINVAL;
+	}
+	rxp->page = page;
+	rxp->offset = 0;
+	rxp->sync_len = 0;
+
+	return 0;
+}
+
+static void stmmac_rx_page_free(struct stmmac_priv *priv, unsigned int entry)
+{
+	struct stmmac_rx_page *rxp = &priv->rx_page[entry];
+
+	if (rxp->page) {
+		dma_unmap_page(priv->device, rxp->dma, PAGE_SIZE,
+			       DMA_FROM_DEVICE);
+		put_page(rxp->page);
+	}
+	rxp->page = NULL;
+}
+
+static inline void stmmac_rx_page_set_desc(struct stmmac_priv *priv,
+					   struct dma_desc *p,
+					   unsigned int entry)
+{
+	struct stmmac_rx_page *rxp = &priv->rx_page[entry];
+
+	p->des2 = rxp->dma + rxp->offset + NET_IP_ALIGN;
+}
+
 static int stmmac_init_rx_buffers(struct stmmac_priv *priv, struct dma_desc *p,
 				  int i)
 {
 	struct sk_buff *skb;
 
+	if (priv->rx_page_mode) {
+		int ret = stmmac_rx_page_alloc(priv, i, GFP_KERNEL);
+
+		if (ret) {
+			pr_err("%s: Rx init fails; page allocation\n",
+			       __func__);
+			return ret;
+		}
+		stmmac_rx_page_set_desc(priv, p, i);
+		return 0;
+	}
+
 	skb = __netdev_alloc_skb(priv->dev, priv->dma_buf_sz + NET_IP_ALIGN,
 				 GFP_KERNEL);
 	if (!skb) {
@@ -1018,6 +1107,10 @@ static int stmmac_init_rx_buffers(struct stmmac_priv *priv, struct dma_desc *p,
 
 static void stmmac_free_rx_buffers(struct stmmac_priv *priv, int i)
 {
+	if (priv->rx_page_mode) {
+		stmmac_rx_page_free(priv, i);
+		return;
+	}
 	if (priv->rx_skbuff[i]) {
 		dma_unmap_single(priv->device, priv->rx_skbuff_dma[i],
 				 priv->dma_buf_sz, DMA_FROM_DEVICE);
@@ -1054,6 +1147,10 @@ static int init_dma_desc_rings(struct net_device *dev)
 	priv->dma_buf_sz = bfsize;
 	buf_sz = bfsize;
 
+	/* The page pool only covers buffers that fit in half a page */
+	priv->rx_page_mode = rx_page_pool &&
+			     (bfsize + NET_IP_ALIGN <= STMMAC_RX_PAGE_BUF);
+
 	if (netif_msg_probe(priv))
 		pr_debug("%s: txsize %d, rxsize %d, bfsize %d\n", __func__,
 			 txsize, rxsize, bfsize);
@@ -1108,6 +1205,13 @@ static int init_dma_desc_rings(struct net_device *dev)
 	if (!priv->rx_skbuff)
 		goto err_rx_skbuff;
 
+	if (priv->rx_page_mode) {
+		priv->rx_page = kcalloc(rxsize, sizeof(struct stmmac_rx_page),
+					GFP_KERNEL);
+		if (!priv->rx_page)
+			goto err_rx_page;
+	}
+
 	priv->tx_skbuff_dma = kmalloc_array(txsize,
 					    sizeof(*priv->tx_skbuff_dma),
 					    GFP_KERNEL);
@@ -1137,7 +1241,7 @@ static int init_dma_desc_rings(struct net_device *dev)
 		if (ret)
 			goto err_init_rx_buffers;
 
-		if (netif_msg_probe(priv))
+		if (netif_msg_probe(priv) && !priv->rx_page_mode)
 			pr_debug("[%p]\t[%p]\t[%x]\n", priv->rx_skbuff[i],
 				 priv->rx_skbuff[i]->data,
 				 (unsigned int)priv->rx_skbuff_dma[i]);
@@ -1175,6 +1279,7 @@ static int init_dma_desc_rings(struct net_device *dev)
 
 	priv->dirty_tx = 0;
 	priv->cur_tx = 0;
+	netdev_reset_queue(dev);
 
 	stmmac_clear_descriptors(priv);
 
@@ -1189,6 +1294,9 @@ err_init_rx_buffers:
 err_tx_skbuff:
 	kfree(priv->tx_skbuff_dma);
 err_tx_skbuff_dma:
+	kfree(priv->rx_page);
+	priv->rx_page = NULL;
+err_rx_page:
 	kfree(priv->rx_skbuff);
 err_rx_skbuff:
 	kfree(priv->rx_skbuff_dma);
@@ -1276,6 +1384,8 @@ static void free_dma_desc_resources(struct stmmac_priv *priv)
 	}
 	kfree(priv->rx_skbuff_dma);
 	kfree(priv->rx_skbuff);
+	kfree(priv->rx_page);
+	priv->rx_page = NULL;
 	kfree(priv->tx_skbuff_dma);
 	kfree(priv->tx_skbuff);
 }
@@ -1312,6 +1422,7 @@ static void stmmac_dma_operation_mode(struct stmmac_priv *priv)
 static void stmmac_tx_clean(struct stmmac_priv *priv)
 {
 	unsigned int txsize = priv->dma_tx_size;
+	unsigned int bytes_compl = 0, pkts_compl = 0;
 
 	spin_lock(&priv->tx_lock);
 
@@ -1368,6 +1479,8 @@ static void stmmac_tx_clean(struct stmmac_priv *priv)
 		priv->hw->ring->clean_desc3(priv, p);
 
 		if (likely(skb != NULL)) {
+			bytes_compl += skb->len;
+			pkts_compl++;
 			dev_kfree_skb(skb);
 			priv->tx_skbuff[entry] = NULL;
 		}
@@ -1376,6 +1489,11 @@ static void stmmac_tx_clean(struct stmmac_priv *priv)
 
 		priv->dirty_tx++;
 	}
+
+	priv->xstats.tx_clean_batch[min_t(int, fls(pkts_compl),
+					  STMMAC_TX_BATCH_BUCKETS - 1)]++;
+	netdev_completed_queue(priv->dev, pkts_compl, bytes_compl);
+
 	if (unlikely(netif_queue_stopped(priv->dev) &&
 		     stmmac_tx_avail(priv) > STMMAC_TX_THRESH(priv))) {
 		netif_tx_lock(priv->dev);
@@ -1430,6 +1548,7 @@ static void stmmac_tx_err(struct stmmac_priv *priv)
 						     (i == txsize - 1));
 	priv->dirty_tx = 0;
 	priv->cur_tx = 0;
+	netdev_reset_queue(priv->dev);
 	priv->hw->dma->start_tx(priv->ioaddr);
 
 	priv->dev->stats.tx_errors++;
@@ -1639,13 +1758,18 @@ static int stmmac_init_dma_engine(struct stmmac_priv *priv)
  * stmmac_tx_timer: mitigation sw timer for tx.
  * @data: data pointer
  * Description:
- * This is the timer handler to directly invoke the stmmac_tx_clean.
+ * This is the timer handler for frames queued without the interrupt on
+ * completion bit. It schedules the NAPI poll, so the ring is reclaimed
+ * there in one batch together with any other pending work.
  */
 static void stmmac_tx_timer(unsigned long data)
 {
 	struct stmmac_priv *priv = (struct stmmac_priv *)data;
 
-	stmmac_tx_clean(priv);
+	if (likely(napi_schedule_prep(&priv->napi))) {
+		stmmac_disable_dma_irq(priv);
+		__napi_schedule(&priv->napi);
+	}
 }
 
 /**
@@ -2013,7 +2137,11 @@ static netdev_tx_t stmmac_xmit(struct sk_buff *skb, struct net_device *dev)
 		netif_stop_queue(dev);
 	}
 
+	priv->xstats.tx_ring_occ[((priv->cur_tx - priv->dirty_tx) *
+				  STMMAC_TX_OCC_BUCKETS - 1) / txsize]++;
+
 	dev->stats.tx_bytes += skb->len;
+	netdev_sent_queue(dev, skb->len);
 
 	if (unlikely((skb_shinfo(skb)->tx_flags & SKBTX_HW_TSTAMP) &&
 		     priv->hwts_tx_en)) {
@@ -2057,7 +2185,32 @@ static inline void stmmac_rx_refill(struct stmmac_priv *priv)
 		else
 			p = priv->dma_rx + entry;
 
-		if (likely(priv->rx_skbuff[entry] == NULL)) {
+		if (priv->rx_page_mode) {
+			struct stmmac_rx_page *rxp = &priv->rx_page[entry];
+
+			if (likely(rxp->page)) {
+				/* Recycled buffer: only the bytes the CPU may
+				 * have touched need to go back to the device.
+				 */
+				if (rxp->sync_len)
+					dma_sync_single_range_for_device(
+						priv->device, rxp->dma,
+						rxp->offset, rxp->sync_len,
+						DMA_FROM_DEVICE);
+				priv->xstats.rx_page_recycle_hit++;
+			} else {
+				if (unlikely(stmmac_rx_page_alloc(priv, entry,
+								  GFP_ATOMIC))) {
+					priv->xstats.rx_page_alloc_fail++;
+					break;
+				}
+				priv->xstats.rx_page_recycle_miss++;
+			}
+			rxp->sync_len = 0;
+			stmmac_rx_page_set_desc(priv, p, entry);
+
+			priv->hw->ring->refill_desc3(priv, p);
+		} else if (likely(priv->rx_skbuff[entry] == NULL)) {
 			struct sk_buff *skb;
 
 			skb = netdev_alloc_skb_ip_align(priv->dev, bfsize);
@@ -2077,12 +2230,77 @@ static inline void stmmac_rx_refill(struct stmmac_priv *priv)
 			if (netif_msg_rx_status(priv))
 				pr_debug("\trefill entry #%d\n", entry);
 		}
+		/* With the RX Watchdog, interrupt on completion is only
+		 * requested every rx_coal_frames descriptors.
+		 */
+		if (priv->use_riwt)
+			priv->hw->desc->set_rx_ic(p, priv->rx_coal_frames &&
+				!(priv->dirty_rx % priv->rx_coal_frames));
 		wmb();
 		priv->hw->desc->set_rx_owner(p);
 		wmb();
 	}
 }
 
+/**
+ * stmmac_rx_page_skb: build the skb for a frame received in the page pool
+ * @priv: driver private structure
+ * @entry: RX descriptor index
+ * @frame_len: length of the received frame
+ * Description: short frames are copied and the buffer stays with the
+ * descriptor. Otherwise the headers are copied and the payload is attached
+ * as a page fragment; if nobody else holds the page the descriptor moves to
+ * its other half, else the page is released to the stack.
+ */
+static struct sk_buff *stmmac_rx_page_skb(struct stmmac_priv *priv,
+					  unsigned int entry, int frame_len)
+{
+	struct stmmac_rx_page *rxp = &priv->rx_page[entry];
+	unsigned int off = rxp->offset + NET_IP_ALIGN;
+	void *va = page_address(rxp->page) + off;
+	struct sk_buff *skb;
+	unsigned int hlen;
+	bool reuse;
+
+	dma_sync_single_range_for_cpu(priv->device, rxp->dma, off, frame_len,
+				      DMA_FROM_DEVICE);
+	/* From now on the CPU may have cache lines of the received bytes */
+	rxp->sync_len = NET_IP_ALIGN + frame_len;
+	prefetch(va);
+
+	if (frame_len <= rx_copybreak)
+		hlen = frame_len;
+	else
+		hlen = min_t(unsigned int, frame_len, STMMAC_RX_HDR_SIZE);
+
+	skb = netdev_alloc_skb_ip_align(priv->dev, hlen);
+	if (unlikely(!skb))
+		return NULL;
+
+	memcpy(__skb_put(skb, hlen), va, hlen);
+	if (hlen == frame_len) {
+		priv->xstats.rx_copybreak_n++;
+		return skb;
+	}
+
+	reuse = (page_count(rxp->page) == 1) &&
+		(page_to_nid(rxp->page) == numa_node_id());
+
+	skb_add_rx_frag(skb, 0, rxp->page, off + hlen, frame_len - hlen,
+			STMMAC_RX_PAGE_BUF);
+	if (likely(reuse)) {
+		get_page(rxp->page);
+		rxp->offset ^= STMMAC_RX_PAGE_BUF;
+		rxp->sync_len = NET_IP_ALIGN + priv->dma_buf_sz;
+	} else {
+		dma_unmap_page(priv->device, rxp->dma, PAGE_SIZE,
+			       DMA_FROM_DEVICE);
+		rxp->page = NULL;
+	}
+
+	return skb;
+}
+
 /**
  * stmmac_rx_refill: refill used skb preallocated buffers
  * @priv: driver private structure
@@ -2135,7 +2353,8 @@ static int stmmac_rx(struct stmmac_priv *priv, int limit)
 							   entry);
 		if (unlikely(status == discard_frame)) {
 			priv->dev->stats.rx_errors++;
-			if (priv->hwts_rx_en && !priv->extend_desc) {
+			if (priv->hwts_rx_en && !priv->extend_desc &&
+			    !priv->rx_page_mode) {
 				/* DESC2 & DESC3 will be overwitten by device
 				 * with timestamp value, hence reinitialize
 				 * them in stmmac_rx_refill() function so that
@@ -2166,22 +2385,40 @@ static int stmmac_rx(struct stmmac_priv *priv, int limit)
 					pr_debug("\tframe size %d, COE: %d\n",
 						 frame_len, status);
 			}
-			skb = priv->rx_skbuff[entry];
-			if (unlikely(!skb)) {
-				pr_err("%s: Inconsistent Rx descriptor chain\n",
-				       priv->dev->name);
-				priv->dev->stats.rx_dropped++;
-				break;
-			}
-			prefetch(skb->data - NET_IP_ALIGN);
-			priv->rx_skbuff[entry] = NULL;
+			if (priv->rx_page_mode) {
+				if (unlikely(!priv->rx_page[entry].page)) {
+					pr_err("%s: Inconsistent Rx page pool\n",
+					       priv->dev->name);
+					priv->dev->stats.rx_dropped++;
+					break;
+				}
+				skb = stmmac_rx_page_skb(priv, entry,
+							 frame_len);
+				if (unlikely(!skb)) {
+					priv->dev->stats.rx_dropped++;
+					entry = next_entry;
+					continue;
+				}
+				stmmac_get_rx_hwtstamp(priv, entry, skb);
+			} else {
+				skb = priv->rx_skbuff[entry];
+				if (unlikely(!skb)) {
+					pr_err("%s: Inconsistent Rx descriptor chain\n",
+					       priv->dev->name);
+					priv->dev->stats.rx_dropped++;
+					break;
+				}
+				prefetch(skb->data - NET_IP_ALIGN);
+				priv->rx_skbuff[entry] = NULL;
 
-			stmmac_get_rx_hwtstamp(priv, entry, skb);
+				stmmac_get_rx_hwtstamp(priv, entry, skb);
 
-			skb_put(skb, frame_len);
-			dma_unmap_single(priv->device,
-					 priv->rx_skbuff_dma[entry],
-					 priv->dma_buf_sz, DMA_FROM_DEVICE);
+				skb_put(skb, frame_len);
+				dma_unmap_single(priv->device,
+						 priv->rx_skbuff_dma[entry],
+						 priv->dma_buf_sz,
+						 DMA_FROM_DEVICE);
+			}
 
 			if (netif_msg_pktdata(priv)) {
 				pr_debug("frame received (%dbytes)", frame_len);
@@ -2210,6 +2447,109 @@ static int stmmac_rx(struct stmmac_priv *priv, int limit)
 	return count;
 }
 
+/**
+ * stmmac_coal_scale: scale a coalesce parameter with the packet rate
+ * @ca: adaptive coalesce settings
+ * @rate: measured packets per second
+ * @low: value used at or below pkt_rate_low
+ * @high: value used at or above pkt_rate_high
+ */
+static u32 stmmac_coal_scale(struct stmmac_coal_adapt *ca, u32 rate,
+			     u32 low, u32 high)
+{
+	s64 delta;
+
+	if (rate <= ca->pkt_rate_low)
+		return low;
+	if (rate >= ca->pkt_rate_high)
+		return high;
+
+	delta = (s64)((s32)high - (s32)low) * (rate - ca->pkt_rate_low);
+
+	return low + (s32)div_s64(delta, ca->pkt_rate_high - ca->pkt_rate_low);
+}
+
+/**
+ * stmmac_coal_adapt: adaptive interrupt coalescing
+ * @priv: driver private structure
+ * Description: called from the NAPI poll; once per sample interval it
+ * computes the rx and tx packet rates and re-tunes the RX Watchdog, the rx
+ * frame threshold and the tx mitigation timer/frames between their _low
+ * (low latency) and _high (few interrupts) settings.
+ */
+static void stmmac_coal_adapt(struct stmmac_priv *priv)
+{
+	struct stmmac_coal_adapt *ca = &priv->coal_adapt;
+	struct net_device_stats *stats = &priv->dev->stats;
+	unsigned long now = jiffies;
+	unsigned long period = now - ca->last_jiffies;
+	unsigned long interval;
+	u32 rx_rate, tx_rate;
+
+	if (likely(!ca->use_rx && !ca->use_tx))
+		return;
+
+	if (ca->sample_interval)
+		interval = ca->sample_interval * HZ;
+	else
+		interval = STMMAC_COAL_SAMPLE_PERIOD;
+	if (period < interval)
+		return;
+
+	rx_rate = div_u64((u64)(stats->rx_packets - ca->last_rx_packets) * HZ,
+			  period);
+	tx_rate = div_u64((u64)(stats->tx_packets - ca->last_tx_packets) * HZ,
+			  period);
+	ca->last_rx_packets = stats->rx_packets;
+	ca->last_tx_packets = stats->tx_packets;
+	ca->last_jiffies = now;
+
+	if (ca->use_rx && priv->use_riwt) {
+		u32 riwt = stmmac_coal_scale(ca, rx_rate, ca->rx_riwt_low,
+					     ca->rx_riwt_high);
+
+		priv->rx_coal_frames = stmmac_coal_scale(ca, rx_rate,
+							 ca->rx_frames_low,
+							 ca->rx_frames_high);
+		if (riwt != priv->rx_riwt) {
+			priv->rx_riwt = riwt;
+			priv->hw->dma->rx_watchdog(priv->ioaddr, riwt);
+		}
+	}
+
+	if (ca->use_tx) {
+		priv->tx_coal_timer = stmmac_coal_scale(ca, tx_rate,
+							ca->tx_usecs_low,
+							ca->tx_usecs_high);
+		priv->tx_coal_frames = stmmac_coal_scale(ca, tx_rate,
+							 ca->tx_frames_low,
+							 ca->tx_frames_high);
+	}
+}
+
+/**
+ * stmmac_init_coal_adapt: default adaptive coalesce settings
+ * @priv: driver private structure
+ * Description: adaptive coalescing is off by default; the _high values
+ * are the static defaults and the _low ones favour latency.
+ */
+static void stmmac_init_coal_adapt(struct stmmac_priv *priv)
+{
+	struct stmmac_coal_adapt *ca = &priv->coal_adapt;
+
+	ca->pkt_rate_low = STMMAC_PKT_RATE_LOW;
+	ca->pkt_rate_high = STMMAC_PKT_RATE_HIGH;
+	ca->rx_riwt_low = MIN_DMA_RIWT;
+	ca->rx_riwt_high = MAX_DMA_RIWT;
+	ca->rx_frames_low = 1;
+	ca->rx_frames_high = STMMAC_RX_FRAMES_HIGH;
+	ca->tx_usecs_low = STMMAC_COAL_TX_TIMER_LOW;
+	ca->tx_usecs_high = STMMAC_COAL_TX_TIMER;
+	ca->tx_frames_low = 1;
+	ca->tx_frames_high = STMMAC_TX_FRAMES;
+	ca->last_jiffies = jiffies;
+}
+
 /**
  *  stmmac_poll - stmmac poll method (NAPI)
  *  @napi : pointer to the napi structure.
@@ -2227,6 +2567,7 @@ static int stmmac_poll(struct napi_struct *napi, int budget)
 	stmmac_tx_clean(priv);
 
 	work_done = stmmac_rx(priv, budget);
+	stmmac_coal_adapt(priv);
 	if (work_done < budget) {
 		napi_complete(napi);
 		stmmac_enable_dma_irq(priv);
@@ -2788,6 +3129,7 @@ struct stmmac_priv *stmmac_dvr_probe(struct device *device,
 		priv->use_riwt = 1;
 		pr_info(" Enable RX Mitigation via HW Watchdog Timer\n");
 	}
+	stmmac_init_coal_adapt(priv);
 
 	netif_napi_add(ndev, &priv->napi, stmmac_poll, 64);
 
@@ -3058,6 +3400,12 @@ static int __init stmmac_cmdline_opt(char *str)
 		} else if (!strncmp(opt, "wol_plus_en:", 12)) {
 			if (kstrtoint(opt + 12, 0, &wol_plus_en))
 				goto err;
+		} else if (!strncmp(opt, "rx_page_pool:", 13)) {
+			if (kstrtoint(opt + 13, 0, &rx_page_pool))
+				goto err;
+		} else if (!strncmp(opt, "rx_copybreak:", 13)) {
+			if (kstrtoint(opt + 13, 0, &rx_copybreak))
+				goto err;
 		}
 	}
 	return 0;
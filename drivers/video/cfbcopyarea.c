@@ -73,6 +73,7 @@ bitcpy(struct fb_info *p, unsigned long __iomem *dst, unsigned dst_idx,
 			FB_WRITEL( comp( FB_READL(src), FB_READL(dst), first), dst);
 		} else {
 			// Multiple destination words
+			unsigned m;
 
 			// Leading bits
 			if (first != ~0UL) {
@@ -84,6 +85,10 @@ bitcpy(struct fb_info *p, unsigned long __iomem *dst, unsigned dst_idx,
 
 			// Main chunk
 			n /= bits;
+			m = fb_copy_words(dst, src, n);
+			dst += m;
+			src += m;
+			n -= m;
 			while (n >= 8) {
 				FB_WRITEL(FB_READL(src++), dst++);
 				FB_WRITEL(FB_READL(src++), dst++);
@@ -50,6 +50,7 @@ bitfill_aligned(struct fb_info *p, unsigned long __iomem *dst, int dst_idx,
 		FB_WRITEL(comp(pat, FB_READL(dst), first), dst);
 	} else {
 		// Multiple destination words
+		unsigned m;
 
 		// Leading bits
 		if (first!= ~0UL) {
@@ -60,6 +61,9 @@ bitfill_aligned(struct fb_info *p, unsigned long __iomem *dst, int dst_idx,
 
 		// Main chunk
 		n /= bits;
+		m = fb_fill_words(dst, pat, n);
+		dst += m;
+		n -= m;
 		while (n >= 8) {
 			FB_WRITEL(pat, dst++);
 			FB_WRITEL(pat, dst++);
@@ -3,6 +3,7 @@
 
 #include <asm/types.h>
 #include <linux/fb.h>
+#include <asm/fb.h>
 
     /*
      *  Compose two values, using a bitmask as decision value
@@ -15,6 +16,29 @@ comp(unsigned long a, unsigned long b, unsigned long mask)
     return ((a ^ b) & mask) ^ b;
 }
 
+    /*
+     *  Fill or copy a run of whole words in one go, where the architecture
+     *  writes uncached framebuffer memory faster than a word at a time
+     *  (see asm/fb.h).  Returns the number of words written, the caller
+     *  writes the rest.
+     */
+
+#ifndef fb_fill_words
+static inline unsigned
+fb_fill_words(void __iomem *dst, unsigned long pat, unsigned n)
+{
+    return 0;
+}
+#endif
+
+#ifndef fb_copy_words
+static inline unsigned
+fb_copy_words(void __iomem *dst, const void __iomem *src, unsigned n)
+{
+    return 0;
+}
+#endif
+
     /*
      *  Create a pattern with the given pixel's color
      */
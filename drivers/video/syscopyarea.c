@@ -44,6 +44,7 @@ bitcpy(struct fb_info *p, unsigned long *dst, int dst_idx,
 			*dst = comp(*src, *dst, first);
 		} else {
 			/* Multiple destination words */
+			unsigned m;
 			/* Leading bits */
  			if (first != ~0UL) {
 				*dst = comp(*src, *dst, first);
@@ -54,6 +55,11 @@ bitcpy(struct fb_info *p, unsigned long *dst, int dst_idx,
 
 			/* Main chunk */
 			n /= bits;
+			m = fb_copy_words((void __iomem __force *)dst,
+					  (const void __iomem __force *)src, n);
+			dst += m;
+			src += m;
+			n -= m;
 			while (n >= 8) {
 				*dst++ = *src++;
 				*dst++ = *src++;
@@ -40,6 +40,7 @@ bitfill_aligned(struct fb_info *p, unsigned long *dst, int dst_idx,
 		*dst = comp(pat, *dst, first);
 	} else {
 		/* Multiple destination words */
+		unsigned m;
 
 		/* Leading bits */
  		if (first!= ~0UL) {
@@ -50,6 +51,9 @@ bitfill_aligned(struct fb_info *p, unsigned long *dst, int dst_idx,
 
 		/* Main chunk */
 		n /= bits;
+		m = fb_fill_words((void __iomem __force *)dst, pat, n);
+		dst += m;
+		n -= m;
 		while (n >= 8) {
 			*dst++ = pat;
 			*dst++ = pat;
@@ -28,6 +28,7 @@
  */
 
 #define BPA2_NORMAL    0x00000001
+#define BPA2_MOVABLE   0x00000002 /* lend free memory when unused */
 
 struct bpa2_partition_desc {
 	const char *name;
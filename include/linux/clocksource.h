@@ -207,6 +207,19 @@ struct clocksource {
 #define CLOCK_SOURCE_VALID_FOR_HRES		0x20
 #define CLOCK_SOURCE_UNSTABLE			0x40
 
+/*
+ * Architectures whose vDSO can read a clock source counter register
+ * directly provide arch_clocksource_user_counter() in asm/clocksource.h;
+ * drivers use it to publish the bus address of the counter and a value
+ * to XOR it with.
+ */
+#ifndef arch_clocksource_user_counter
+static inline void arch_clocksource_user_counter(struct clocksource *cs,
+						 unsigned long addr, u32 xor)
+{
+}
+#endif
+
 /* simplify initialization of mask field */
 #define CLOCKSOURCE_MASK(bits) (cycle_t)((bits) < 64 ? ((1ULL<<(bits))-1) : -1)
 
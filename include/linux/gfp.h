@@ -391,4 +391,12 @@ static inline bool pm_suspended_storage(void)
 }
 #endif /* CONFIG_PM_SLEEP */
 
+#ifdef CONFIG_BPA2_MOVABLE
+/* Lending of reserved memory to movable allocations, see mm/bpa2.c */
+extern void init_bpa2_reserved_pageblock(struct page *page);
+extern int alloc_contig_range(unsigned long start, unsigned long end,
+			      int migratetype);
+extern void free_contig_range(unsigned long pfn, unsigned long nr_pages);
+#endif
+
 #endif /* __LINUX_GFP_H */
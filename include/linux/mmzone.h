@@ -40,8 +40,21 @@
 #define MIGRATE_MOVABLE       2
 #define MIGRATE_PCPTYPES      3 /* the number of types on the pcp lists */
 #define MIGRATE_RESERVE       3
+#ifdef CONFIG_BPA2_MOVABLE
+/*
+ * Pageblocks lent to the page allocator by a BPA2 partition. Only
+ * movable allocations are served from them and they never change
+ * type, so the partition can always migrate the pages out again.
+ */
+#define MIGRATE_BPA2          4
+#define MIGRATE_ISOLATE       5 /* can't allocate from here */
+#define MIGRATE_TYPES         6
+#define is_migrate_bpa2(migratetype) unlikely((migratetype) == MIGRATE_BPA2)
+#else
 #define MIGRATE_ISOLATE       4 /* can't allocate from here */
 #define MIGRATE_TYPES         5
+#define is_migrate_bpa2(migratetype) false
+#endif
 
 #define for_each_migratetype_order(order, type) \
 	for (order = 0; order < MAX_ORDER; order++) \
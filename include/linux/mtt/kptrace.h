@@ -45,6 +45,19 @@ void mtt_kptrace_stop(void);
 int mtt_kptrace_comp_alloc(void);
 
 /* KPTrace defs */
+#ifdef CONFIG_KPTRACE_BENCHMARK
+struct kp_overhead {
+	u64 hits;
+	u64 total_ns;
+	u64 max_ns;
+};
+
+struct kp_tracepoint_stats {
+	struct kp_overhead entry;
+	struct kp_overhead ret;
+};
+#endif
+
 struct kp_tracepoint {
 	struct kprobe kp;
 	struct kretprobe rp;
@@ -58,6 +71,11 @@ struct kp_tracepoint {
 	int late_tracepoint;
 	const struct file_operations *ops;
 	struct list_head list;
+#ifdef CONFIG_KPTRACE_BENCHMARK
+	int (*entry_handler)(struct kprobe *, struct pt_regs *);
+	int (*return_handler)(struct kretprobe_instance *, struct pt_regs *);
+	struct kp_tracepoint_stats __percpu *stats;
+#endif
 };
 
 struct kp_tracepoint_set {
@@ -139,6 +139,10 @@ void mtt_drv_tty_write(mtt_packet_t *p, int lock);
 /* RelayFS output driver write routine */
 void mtt_drv_relay_write(mtt_packet_t *p, int lock);
 
+/* RelayFS output driver in-place packet routines */
+mtt_packet_t *mtt_drv_relay_reserve(uint32_t target);
+void mtt_drv_relay_commit(mtt_packet_t *p);
+
 mtt_return_t debug_sanity_check(void);
 void debug_dump_sys_config(void);
 
@@ -171,6 +175,10 @@ extern mtt_packet_t *mtt_pkts_cmd;
 
 struct mtt_output_driver {
 	void (*write_func) (mtt_packet_t *p, int lock);
+	/* Optional: build packets in place in the output medium,
+	 * local interrupts stay disabled from reserve to commit. */
+	mtt_packet_t *(*reserve_func) (uint32_t target);
+	void (*commit_func) (mtt_packet_t *p);
 	int (*mmap_func) (struct file *filp, struct vm_area_struct *vma,
 			 void *data);
 	void *(*comp_alloc_func) (uint32_t comp_id, void *data);
@@ -119,6 +119,11 @@ static inline int stm_dma_is_fdma_channel(struct dma_chan *chan, int id)
 }
 
 
+/*
+ * Channel extensions API
+ */
+int stm_dma_irq_callbacks(struct dma_chan *chan, int enable);
+
 /*
  * Audio channel extensions API
  */
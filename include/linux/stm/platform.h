@@ -488,6 +488,12 @@ struct stm_plat_spifsm_data {
 	unsigned int		max_freq;
 	struct stm_pad_config	*pads;
 	struct stm_spifsm_caps	capabilities;
+
+	/* Optional FDMA channel for bulk reads (request_line 0: PIO only) */
+	const char		*fdma_name;
+	unsigned int		fdma_initiator;
+	unsigned int		fdma_direct_conn;
+	unsigned int		fdma_request_line;
 };
 
 
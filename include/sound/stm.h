@@ -374,6 +374,7 @@ struct snd_stm_uniperif_player_info {
 	int parking_enabled;
 	int standby_enabled;
 	int underflow_enabled;			/* Underflow recovery mode */
+	int low_latency;			/* Small periods, per-node irq */
 
 	const char *fdma_name;
 	unsigned int fdma_initiator;
@@ -29,6 +29,9 @@
 #include <net/sock.h>
 #include <asm/sections.h>
 #include <linux/relay.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/math64.h>
 
 #include <linux/mtt/kptrace.h>
 #include <asm/mtt-kptrace.h>
@@ -107,6 +110,12 @@ static struct attribute *tracepoint_attribs[] = {
 			    .name = "callstack",
 			    .mode = S_IRUGO | S_IWUSR,
 			    },
+#ifdef CONFIG_KPTRACE_BENCHMARK
+	&(struct attribute){
+			    .name = "overhead",
+			    .mode = S_IRUGO | S_IWUSR,
+			    },
+#endif
 	NULL
 };
 
@@ -180,6 +189,91 @@ tracepoint_set_store_attrs(struct kobject *kobj,
 	return size;
 }
 
+#ifdef CONFIG_KPTRACE_BENCHMARK
+/*
+ * Tracepoint overhead measurement: the kprobe handlers are wrapped so
+ * that the time spent building and emitting each record is accounted
+ * per tracepoint, and reported by its "overhead" attribute. This does
+ * not include the cost of the kprobe exception itself.
+ */
+static inline void kptrace_account(struct kp_overhead *o, u64 delta)
+{
+	o->hits++;
+	o->total_ns += delta;
+	if (delta > o->max_ns)
+		o->max_ns = delta;
+}
+
+static int kptrace_timed_pre_handler(struct kprobe *p, struct pt_regs *regs)
+{
+	struct kp_tracepoint *tp = container_of(p, struct kp_tracepoint, kp);
+	u64 start = sched_clock();
+	int ret;
+
+	ret = tp->entry_handler(p, regs);
+
+	kptrace_account(&this_cpu_ptr(tp->stats)->entry,
+			sched_clock() - start);
+	return ret;
+}
+
+static int kptrace_timed_rp_handler(struct kretprobe_instance *ri,
+				    struct pt_regs *regs)
+{
+	struct kp_tracepoint *tp = container_of(ri->rp, struct kp_tracepoint,
+						rp);
+	u64 start = sched_clock();
+	int ret;
+
+	ret = tp->return_handler(ri, regs);
+
+	kptrace_account(&this_cpu_ptr(tp->stats)->ret,
+			sched_clock() - start);
+	return ret;
+}
+
+static void kptrace_overhead_sum(struct kp_overhead *sum,
+				 struct kp_overhead *o)
+{
+	sum->hits += o->hits;
+	sum->total_ns += o->total_ns;
+	if (o->max_ns > sum->max_ns)
+		sum->max_ns = o->max_ns;
+}
+
+static int kptrace_overhead_show(struct kp_tracepoint *tp, char *buffer)
+{
+	struct kp_overhead entry = { 0 }, ret = { 0 };
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct kp_tracepoint_stats *stats = per_cpu_ptr(tp->stats, cpu);
+
+		kptrace_overhead_sum(&entry, &stats->entry);
+		kptrace_overhead_sum(&ret, &stats->ret);
+	}
+
+	return snprintf(buffer, PAGE_SIZE,
+			"entry: %llu hits, avg %llu ns, max %llu ns\n"
+			"return: %llu hits, avg %llu ns, max %llu ns\n",
+			entry.hits,
+			entry.hits ? div64_u64(entry.total_ns, entry.hits) : 0,
+			entry.max_ns,
+			ret.hits,
+			ret.hits ? div64_u64(ret.total_ns, ret.hits) : 0,
+			ret.max_ns);
+}
+
+static void kptrace_overhead_reset(struct kp_tracepoint *tp)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(tp->stats, cpu), 0,
+		       sizeof(struct kp_tracepoint_stats));
+}
+#endif
+
 static ssize_t
 tracepoint_show_attrs(struct kobject *kobj,
 		      struct attribute *attr, char *buffer)
@@ -208,6 +302,11 @@ tracepoint_show_attrs(struct kobject *kobj,
 		}
 	}
 
+#ifdef CONFIG_KPTRACE_BENCHMARK
+	if (strcmp(attr->name, "overhead") == 0)
+		return kptrace_overhead_show(tp, buffer);
+#endif
+
 	return strlen(buffer);
 }
 
@@ -232,6 +331,12 @@ tracepoint_store_attrs(struct kobject *kobj,
 			tp->callstack = 0;
 	}
 
+#ifdef CONFIG_KPTRACE_BENCHMARK
+	/* Any write clears the overhead figures */
+	if (strcmp(attr->name, "overhead") == 0)
+		kptrace_overhead_reset(tp);
+#endif
+
 	return size;
 }
 
@@ -413,6 +518,21 @@ static struct kp_tracepoint *__create_tracepoint(
 	tp->late_tracepoint = late_tracepoint;
 	tp->inserted = TP_UNUSED;
 
+#ifdef CONFIG_KPTRACE_BENCHMARK
+	tp->stats = alloc_percpu(struct kp_tracepoint_stats);
+	if (!tp->stats) {
+		kfree(tp);
+		return NULL;
+	}
+
+	tp->entry_handler = entry_handler;
+	tp->return_handler = return_handler;
+	if (entry_handler)
+		entry_handler = kptrace_timed_pre_handler;
+	if (return_handler)
+		return_handler = kptrace_timed_rp_handler;
+#endif
+
 	/* The 'alias' is the tracepoint name exposed via sysfs. By default, it
 	 * is the symbol name */
 	if (!alias)
@@ -427,6 +547,9 @@ static struct kp_tracepoint *__create_tracepoint(
 		if (!tp->kp.addr) {
 			printk(KERN_WARNING "kptrace: Symbol %s not found\n",
 			       name);
+#ifdef CONFIG_KPTRACE_BENCHMARK
+			free_percpu(tp->stats);
+#endif
 			kfree(tp);
 			return NULL;
 		}
@@ -2341,6 +2464,9 @@ void mtt_kptrace_cleanup(void)
 		tp = list_entry(p, struct kp_tracepoint, list);
 		if (tp != NULL) {
 			kobject_put(&tp->kobj);
+#ifdef CONFIG_KPTRACE_BENCHMARK
+			free_percpu(tp->stats);
+#endif
 			kfree(tp);
 		}
 	}
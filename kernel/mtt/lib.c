@@ -22,6 +22,7 @@
 #include <linux/module.h>
 #include <linux/spinlock.h>
 #include <linux/hardirq.h>
+#include <linux/percpu.h>
 
 #define __MTT_IMPL__
 
@@ -334,6 +335,10 @@ EXPORT_SYMBOL(mtt_get_component_filter);
 
 /*======================== KPTRACE INTERNAL HANDLERS ==================*/
 
+/* Output driver that reserved the packet being built on this core,
+ * NULL when it was taken from the preallocated ones. */
+static DEFINE_PER_CPU(struct mtt_output_driver *, kptrace_inplace_drv);
+
 /*
  * Allocate and prepare a packet.
  *
@@ -345,6 +350,7 @@ uint32_t *mtt_kptrace_pkt_get(uint32_t type_info, mtt_packet_t **p,
 {
 	long core = 0;
 	uint32_t target = MTT_TARGET_LIN0;
+	struct mtt_output_driver *drv = mtt_cur_out_drv;
 
 	BUG_ON(!p);
 
@@ -355,8 +361,19 @@ uint32_t *mtt_kptrace_pkt_get(uint32_t type_info, mtt_packet_t **p,
 
 	target = MTT_TARGET_LIN0 + core;
 
-	/* allocate or retrieve a preallocated TRACE frame */
-	*p = mtt_pkt_alloc(target);
+	if (drv->reserve_func) {
+		/* Build the packet directly in the output medium,
+		 * the driver keeps this core to ourselves until
+		 * mtt_kptrace_pkt_put(). */
+		*p = drv->reserve_func(target);
+		__get_cpu_var(kptrace_inplace_drv) = drv;
+
+		MTT_PTCL_SET_HEADER((*p)->u.buf, target, MTT_CMD_TRACE,
+				    mtt_sys_config.params);
+	} else {
+		/* allocate or retrieve a preallocated TRACE frame */
+		*p = mtt_pkt_alloc(target);
+	}
 
 	return mtt_pkt_get(mtt_comp_cpu[core], *p, type_info, loc);
 }
@@ -365,6 +382,13 @@ uint32_t *mtt_kptrace_pkt_get(uint32_t type_info, mtt_packet_t **p,
 int mtt_kptrace_pkt_put(mtt_packet_t *p)
 {
 	unsigned long flags = 0;
+	struct mtt_output_driver *drv = __get_cpu_var(kptrace_inplace_drv);
+
+	if (drv) {
+		__get_cpu_var(kptrace_inplace_drv) = NULL;
+		drv->commit_func(p);
+		return 0;
+	}
 
 	spin_lock_irqsave(&mttlib_lock, flags);
 
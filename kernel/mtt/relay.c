@@ -36,7 +36,7 @@ static struct rchan *my_chan;
 static int logging;
 static int mappings;
 static int suspended;
-static size_t dropped;
+static DEFINE_PER_CPU(size_t, dropped);
 static size_t subbuf_size = 512*1024;
 static size_t n_subbufs = 4;
 #define RELAY_MAXSUBBUFSIZE 16777216
@@ -74,6 +74,8 @@ mtt_drv_relay_config(struct mtt_sys_kconfig *cfg);
 
 static struct mtt_output_driver relay_output_driver = {
 	.write_func = mtt_drv_relay_write,
+	.reserve_func = mtt_drv_relay_reserve,
+	.commit_func = mtt_drv_relay_commit,
 	.config_func = mtt_drv_relay_config,
 	.debugfs = NULL,
 	.guid = MTT_DRV_GUID_DFS,
@@ -243,6 +245,7 @@ static struct rchan_callbacks relay_callbacks = {
 static struct rchan *create_channel(unsigned subbuf_size, unsigned n_subbufs)
 {
 	struct rchan *tmpchan;
+	int cpu;
 
 	mtt_printk(KERN_DEBUG "create_channel(%d,%d)\n", subbuf_size,
 		   n_subbufs);
@@ -258,7 +261,8 @@ static struct rchan *create_channel(unsigned subbuf_size, unsigned n_subbufs)
 	logging = 0;
 	mappings = 0;
 	suspended = 0;
-	dropped = 0;
+	for_each_possible_cpu(cpu)
+		per_cpu(dropped, cpu) = 0;
 
 	return tmpchan;
 }
@@ -281,8 +285,11 @@ static void destroy_channel(void)
 	}
 	spin_unlock(&tmpbuf_lock);
 
-	if (tmpchan)
+	if (tmpchan) {
+		/* Writers run with local interrupts disabled. */
+		synchronize_sched();
 		relay_close(tmpchan);
+	}
 }
 
 /**
@@ -579,8 +586,13 @@ dropped_read(struct file *filp, char __user *buffer,
 	     size_t count, loff_t *ppos)
 {
 	char buf[16];
+	size_t total = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		total += per_cpu(dropped, cpu);
 
-	snprintf(buf, sizeof(buf), "%zu\n", dropped);
+	snprintf(buf, sizeof(buf), "%zu\n", total);
 
 	return simple_read_from_buffer(buffer, count, ppos, buf, strlen(buf));
 }
@@ -752,14 +764,19 @@ static inline void __relay_write_nolock(struct rchan *chan,
 	struct rchan_buf *buf;
 
 	buf = chan->buf[raw_smp_processor_id()];
-	if (unlikely((buf->offset + length) > buf->chan->subbuf_size))
+	if (unlikely((buf->offset + length) > buf->chan->subbuf_size)) {
 		length = relay_switch_subbuf(buf, length);
+		if (!length) {
+			__this_cpu_inc(dropped);
+			return;
+		}
+	}
 
 	memcpy(buf->data + buf->offset, data, length);
 	buf->offset += length;
 }
 
-void mtt_drv_relay_write(mtt_packet_t *p, int lock)
+static inline void mtt_drv_relay_crc(mtt_packet_t *p)
 {
 #ifdef _MTT_TESTCRC_
 	u32 crc = 0;
@@ -770,11 +787,107 @@ void mtt_drv_relay_write(mtt_packet_t *p, int lock)
 	*(uint32_t *)(p->u.buf + p->length) = crc;
 	p->length += 4;
 #endif
+}
+
+void mtt_drv_relay_write(mtt_packet_t *p, int lock)
+{
+	unsigned long flags;
+
+	mtt_drv_relay_crc(p);
+
 	MTT_BUG_ON(my_chan == NULL);
 
 	/* try the already locked version. */
 	if (likely(lock == APILOCK))
 		__relay_write_nolock(my_chan, p->u.buf, p->length);
-	else
-		relay_write(my_chan, p->u.buf, p->length);
+	else {
+		local_irq_save(flags);
+		__relay_write_nolock(my_chan, p->u.buf, p->length);
+		local_irq_restore(flags);
+	}
+}
+
+/*
+ * In-place packet path.
+ *
+ * Relay buffers are per-CPU, so a writer only races with interrupts
+ * on its own CPU. The reserve routine disables them and hands out room
+ * for a full sized packet at the current offset of this CPU's
+ * sub-buffer; the packet is then built there directly and the commit
+ * routine only has to advance the offset, without any copy nor global
+ * lock. Sub-buffer switches, and so the padding and produced counts,
+ * are left to relay_switch_subbuf() as for regular writes.
+ *
+ * When the sub-buffers are too small to hold a full sized packet the
+ * packet is built in a per-CPU scratch area and copied at commit time.
+ */
+enum relay_inplace_state {
+	RELAY_INPLACE,
+	RELAY_COPY,
+	RELAY_DROP
+};
+
+struct relay_inplace {
+	mtt_packet_t pkt;
+	struct rchan *chan;
+	struct rchan_buf *buf;
+	enum relay_inplace_state state;
+	unsigned long flags;
+	uint32_t scratch[MAX_PKT_SIZE / 4];
+};
+
+static DEFINE_PER_CPU(struct relay_inplace, relay_inplace);
+
+mtt_packet_t *mtt_drv_relay_reserve(uint32_t target)
+{
+	struct relay_inplace *ip;
+	struct rchan_buf *buf;
+	unsigned long flags;
+
+	local_irq_save(flags);
+
+	ip = &__get_cpu_var(relay_inplace);
+	ip->flags = flags;
+	ip->chan = ACCESS_ONCE(my_chan);
+	ip->state = RELAY_COPY;
+	ip->pkt.u.buf = (char *)ip->scratch;
+
+	if (unlikely(!ip->chan) ||
+	    ip->chan->subbuf_size < MAX_PKT_SIZE + sizeof(unsigned int))
+		return &ip->pkt;
+
+	buf = ip->chan->buf[smp_processor_id()];
+	if (unlikely(buf->offset + MAX_PKT_SIZE > buf->chan->subbuf_size) &&
+	    !relay_switch_subbuf(buf, MAX_PKT_SIZE)) {
+		__this_cpu_inc(dropped);
+		ip->state = RELAY_DROP;
+		return &ip->pkt;
+	}
+
+	ip->buf = buf;
+	ip->state = RELAY_INPLACE;
+	ip->pkt.u.buf = buf->data + buf->offset;
+
+	return &ip->pkt;
+}
+
+void mtt_drv_relay_commit(mtt_packet_t *p)
+{
+	struct relay_inplace *ip = container_of(p, struct relay_inplace, pkt);
+
+	mtt_drv_relay_crc(p);
+
+	switch (ip->state) {
+	case RELAY_INPLACE:
+		ip->buf->offset += p->length;
+		break;
+	case RELAY_COPY:
+		if (ip->chan)
+			__relay_write_nolock(ip->chan, p->u.buf, p->length);
+		break;
+	case RELAY_DROP:
+		break;
+	}
+
+	local_irq_restore(ip->flags);
 }
@@ -33,7 +33,8 @@
  * 	<size> := standard linux memory size (e.g. 4M or 0x400000)
  * 	<base physical address> := physical address the partition should
  * 	                            start from (e.g. 32M or 0x02000000)
- *      <flags> := currently unused
+ *      <flags> := "movable" to lend the free memory to movable
+ *                 allocations (requires CONFIG_BPA2_MOVABLE)
  *
  * Examples:
  *
@@ -43,6 +44,8 @@
  * 			LMI_SYS|audio:0x05000000:\
  * 			bigphyarea:5M
  *
+ * 	bpa2parts=video:32M::movable
+ *
  *   This program is free software; you can redistribute it and/or modify
  *   it under the terms of the GNU General Public License as published by
  *   the Free Software Foundation; either version 2 of the License, or
@@ -73,6 +76,11 @@
 #include <linux/errno.h>
 #include <linux/slab.h>
 #include <linux/pfn.h>
+#include <linux/rbtree.h>
+#include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 #include <linux/bpa2.h>
 
 
@@ -103,8 +111,23 @@
 
 
 
+/* An allocation needs at most two range nodes (used block and
+ * alignment/remainder split), up to BPA2_RANGES_SPARE unused ones are kept
+ * and the others are freed */
+#define BPA2_RANGES_SPARE 16
+#define BPA2_RANGES_PER_ALLOC 2
+
+/*
+ * Free ranges are indexed both by address, to merge neighbours on free,
+ * and by size, for best-fit allocation. Used ranges are indexed by
+ * address only. Spare nodes are kept on a singly linked list.
+ */
 struct bpa2_range {
-	struct bpa2_range *next;
+	struct rb_node node; /* in free_addr or used, by base */
+	union {
+		struct rb_node size_node; /* in free_size, by size then base */
+		struct bpa2_range *next_spare;
+	};
 	unsigned long base; /* base of allocated block */
 	unsigned long size; /* size in bytes */
 #if defined(CONFIG_BPA2_ALLOC_TRACE)
@@ -115,9 +138,29 @@ struct bpa2_range {
 
 struct bpa2_part {
 	struct resource res;
-	struct bpa2_range initial_free_list;
-	struct bpa2_range *free_list;
-	struct bpa2_range *used_list;
+	spinlock_t lock;
+	struct bpa2_range initial_range;
+	struct rb_root free_addr;
+	struct rb_root free_size;
+	struct rb_root used;
+	struct bpa2_range *spare;
+	int spare_cnt;
+	/* Statistics */
+	int free_cnt;
+	int used_cnt;
+	unsigned long free_total;
+	unsigned long alloc_fails;
+#if defined(CONFIG_BPA2_MOVABLE)
+	/* Page frames lent to the page allocator, none if lend_end is 0 */
+	unsigned long lend_start;
+	unsigned long lend_end;
+	/* Reclaim statistics */
+	unsigned long reclaim_cnt;
+	unsigned long reclaim_fails;
+	unsigned long reclaim_last_us;
+	unsigned long reclaim_max_us;
+	u64 reclaim_total_us;
+#endif
 	int flags;
 	int low_mem;
 	struct list_head list;
@@ -129,9 +172,14 @@ struct bpa2_part {
 
 
 
+/* Partitions are only ever added during boot, so the list needs no lock */
 static LIST_HEAD(bpa2_parts);
 static struct bpa2_part *bpa2_bigphysarea_part;
-static DEFINE_SPINLOCK(bpa2_lock);
+
+#if defined(CONFIG_BPA2_MOVABLE)
+/* Serialises page isolation, neighbouring ranges may share pageblocks */
+static DEFINE_MUTEX(bpa2_reclaim_mutex);
+#endif
 
 
 
@@ -167,6 +215,328 @@ static int bpa2_check_name(struct bpa2_part *part, const char *name)
 	return -1;
 }
 
+/*
+ * Range index helpers, all called with the partition lock held
+ * (or during boot, for the initial range).
+ */
+static void bpa2_insert_addr(struct rb_root *root, struct bpa2_range *range)
+{
+	struct rb_node **p = &root->rb_node;
+	struct rb_node *parent = NULL;
+
+	while (*p) {
+		struct bpa2_range *tmp = rb_entry(*p, struct bpa2_range, node);
+
+		parent = *p;
+		if (range->base < tmp->base)
+			p = &(*p)->rb_left;
+		else
+			p = &(*p)->rb_right;
+	}
+
+	rb_link_node(&range->node, parent, p);
+	rb_insert_color(&range->node, root);
+}
+
+static void bpa2_insert_size(struct bpa2_part *part, struct bpa2_range *range)
+{
+	struct rb_node **p = &part->free_size.rb_node;
+	struct rb_node *parent = NULL;
+
+	while (*p) {
+		struct bpa2_range *tmp = rb_entry(*p, struct bpa2_range,
+				size_node);
+
+		parent = *p;
+		if (range->size < tmp->size ||
+		    (range->size == tmp->size && range->base < tmp->base))
+			p = &(*p)->rb_left;
+		else
+			p = &(*p)->rb_right;
+	}
+
+	rb_link_node(&range->size_node, parent, p);
+	rb_insert_color(&range->size_node, &part->free_size);
+}
+
+static void bpa2_insert_free(struct bpa2_part *part, struct bpa2_range *range)
+{
+	bpa2_insert_addr(&part->free_addr, range);
+	bpa2_insert_size(part, range);
+	part->free_cnt++;
+	part->free_total += range->size;
+}
+
+static void bpa2_erase_free(struct bpa2_part *part, struct bpa2_range *range)
+{
+	rb_erase(&range->node, &part->free_addr);
+	rb_erase(&range->size_node, &part->free_size);
+	part->free_cnt--;
+	part->free_total -= range->size;
+}
+
+/* Resize a free range in place, its address order does not change */
+static void bpa2_resize_free(struct bpa2_part *part, struct bpa2_range *range,
+		unsigned long base, unsigned long size)
+{
+	rb_erase(&range->size_node, &part->free_size);
+	part->free_total += size - range->size;
+	range->base = base;
+	range->size = size;
+	bpa2_insert_size(part, range);
+}
+
+/* Return the range with the highest base not above `base' */
+static struct bpa2_range *bpa2_lookup_addr(struct rb_root *root,
+		unsigned long base)
+{
+	struct rb_node *n = root->rb_node;
+	struct bpa2_range *found = NULL;
+
+	while (n) {
+		struct bpa2_range *tmp = rb_entry(n, struct bpa2_range, node);
+
+		if (base < tmp->base) {
+			n = n->rb_left;
+		} else {
+			found = tmp;
+			n = n->rb_right;
+		}
+	}
+
+	return found;
+}
+
+static struct bpa2_range *bpa2_get_spare(struct bpa2_part *part)
+{
+	struct bpa2_range *range = part->spare;
+
+	BUG_ON(!range);
+	part->spare = range->next_spare;
+	part->spare_cnt--;
+
+	return range;
+}
+
+static void bpa2_put_spare(struct bpa2_part *part, struct bpa2_range *range)
+{
+	/* The initial range is part of the partition structure */
+	if (part->spare_cnt >= BPA2_RANGES_SPARE &&
+			range != &part->initial_range) {
+		kfree(range);
+		return;
+	}
+
+	range->next_spare = part->spare;
+	part->spare = range;
+	part->spare_cnt++;
+}
+
+/* Called without the lock, adds a range node to the pool */
+static int bpa2_refill_spare(struct bpa2_part *part, int priority)
+{
+	struct bpa2_range *range;
+
+	range = kmalloc(sizeof(*range), priority);
+	if (!range)
+		return -ENOMEM;
+
+	spin_lock(&part->lock);
+	bpa2_put_spare(part, range);
+	spin_unlock(&part->lock);
+
+	return 0;
+}
+
+/* Return a range removed from the used index to the free index,
+ * merging it with its neighbours. Called with the lock held. */
+static void bpa2_release(struct bpa2_part *part, struct bpa2_range *range)
+{
+	struct bpa2_range *prev, *next;
+	struct rb_node *n;
+
+	prev = bpa2_lookup_addr(&part->free_addr, range->base);
+	if (prev)
+		n = rb_next(&prev->node);
+	else
+		n = rb_first(&part->free_addr);
+	next = n ? rb_entry(n, struct bpa2_range, node) : NULL;
+
+	if (prev && prev->base + prev->size != range->base)
+		prev = NULL;
+	if (next && range->base + range->size != next->base)
+		next = NULL;
+
+	if (prev && next) {
+		bpa2_erase_free(part, next);
+		bpa2_resize_free(part, prev, prev->base,
+				prev->size + range->size + next->size);
+		bpa2_put_spare(part, next);
+		bpa2_put_spare(part, range);
+	} else if (prev) {
+		bpa2_resize_free(part, prev, prev->base,
+				prev->size + range->size);
+		bpa2_put_spare(part, range);
+	} else if (next) {
+		bpa2_resize_free(part, next, range->base,
+				range->size + next->size);
+		bpa2_put_spare(part, range);
+	} else {
+		bpa2_insert_free(part, range);
+	}
+}
+
+
+
+#if defined(CONFIG_BPA2_MOVABLE)
+
+/*
+ * Free memory of a "movable" partition is lent to the page allocator as
+ * MIGRATE_BPA2 pageblocks, so it can hold page cache and user pages
+ * while no driver needs it. Allocations migrate those pages away before
+ * returning the range. Only the part of the partition aligned to the
+ * largest buddy page is lent.
+ */
+
+static unsigned long bpa2_lend_align(void)
+{
+	return max_t(unsigned long, MAX_ORDER_NR_PAGES, pageblock_nr_pages);
+}
+
+/* Clip [base, base + size) to the lent page frames */
+static int bpa2_lent_pfns(struct bpa2_part *part, unsigned long base,
+		unsigned long size, unsigned long *start, unsigned long *end)
+{
+	*start = max(PFN_DOWN(base), part->lend_start);
+	*end = min(PFN_DOWN(base + size), part->lend_end);
+
+	return *start < *end;
+}
+
+static int bpa2_can_reclaim(struct bpa2_part *part, int priority)
+{
+	/* Migrating the borrowed pages may sleep */
+	return part->lend_end == 0 || (priority & __GFP_WAIT);
+}
+
+static void bpa2_lend(struct bpa2_part *part, unsigned long base,
+		unsigned long size)
+{
+	unsigned long start, end;
+
+	if (bpa2_lent_pfns(part, base, size, &start, &end))
+		free_contig_range(start, end - start);
+}
+
+static int bpa2_reclaim(struct bpa2_part *part, unsigned long base,
+		unsigned long size)
+{
+	unsigned long start, end, us;
+	ktime_t t;
+	int result;
+
+	if (!bpa2_lent_pfns(part, base, size, &start, &end))
+		return 0;
+
+	mutex_lock(&bpa2_reclaim_mutex);
+	t = ktime_get();
+	result = alloc_contig_range(start, end, MIGRATE_BPA2);
+	us = ktime_to_us(ktime_sub(ktime_get(), t));
+	mutex_unlock(&bpa2_reclaim_mutex);
+
+	spin_lock(&part->lock);
+	part->reclaim_cnt++;
+	if (result != 0)
+		part->reclaim_fails++;
+	part->reclaim_last_us = us;
+	part->reclaim_total_us += us;
+	if (us > part->reclaim_max_us)
+		part->reclaim_max_us = us;
+	spin_unlock(&part->lock);
+
+	if (result != 0)
+		printk(KERN_WARNING "bpa2: could not reclaim 0x%08lx-0x%08lx "
+				"(%d)\n", base, base + size - 1, result);
+
+	return result;
+}
+
+static void __init bpa2_lend_part(struct bpa2_part *part)
+{
+	unsigned long align = bpa2_lend_align();
+	unsigned long start, end, pfn;
+	struct rb_node *n;
+
+	if (!part->low_mem) {
+		printk(KERN_WARNING "bpa2: '%s' not in low memory, can't "
+				"be movable\n", bpa2_get_name(part, 0));
+		return;
+	}
+
+	start = ALIGN(PFN_UP(part->res.start), align);
+	end = PFN_DOWN(part->res.end + 1) & ~(align - 1);
+	if (start >= end || page_zone(pfn_to_page(start)) !=
+			page_zone(pfn_to_page(end - 1))) {
+		printk(KERN_WARNING "bpa2: '%s' can't be lent to the page "
+				"allocator\n", bpa2_get_name(part, 0));
+		return;
+	}
+
+	/* All pages come out allocated, the free ones are released below */
+	for (pfn = start; pfn < end; pfn += pageblock_nr_pages)
+		init_bpa2_reserved_pageblock(pfn_to_page(pfn));
+
+	mutex_lock(&bpa2_reclaim_mutex);
+	spin_lock(&part->lock);
+	part->lend_start = start;
+	part->lend_end = end;
+	for (n = rb_first(&part->free_addr); n != NULL; n = rb_next(n)) {
+		struct bpa2_range *range = rb_entry(n, struct bpa2_range, node);
+
+		bpa2_lend(part, range->base, range->size);
+	}
+	spin_unlock(&part->lock);
+	mutex_unlock(&bpa2_reclaim_mutex);
+
+	printk(KERN_INFO "bpa2: '%s' lending %lu kB to movable allocations\n",
+			bpa2_get_name(part, 0), (end - start) << (PAGE_SHIFT - 10));
+}
+
+static int __init bpa2_lend_init(void)
+{
+	struct bpa2_part *part;
+
+	list_for_each_entry(part, &bpa2_parts, list)
+		if (part->flags & BPA2_MOVABLE)
+			bpa2_lend_part(part);
+
+	return 0;
+}
+/* The page allocator must be up, BPA2 users not yet */
+core_initcall(bpa2_lend_init);
+
+#else
+
+static inline int bpa2_can_reclaim(struct bpa2_part *part, int priority)
+{
+	return 1;
+}
+
+static inline void bpa2_lend(struct bpa2_part *part, unsigned long base,
+		unsigned long size)
+{
+}
+
+static inline int bpa2_reclaim(struct bpa2_part *part, unsigned long base,
+		unsigned long size)
+{
+	return 0;
+}
+
+#endif /* CONFIG_BPA2_MOVABLE */
+
+
+
 static int __init bpa2_alloc_low(struct bpa2_part *part, unsigned long size,
 		unsigned long *start)
 {
@@ -280,11 +650,28 @@ static int __init bpa2_add_part(const char **names, int names_cnt,
 	}
 
 	/* Initialize ranges */
-	part->initial_free_list.next = NULL;
-	part->initial_free_list.base = start;
-	part->initial_free_list.size = size;
-	part->free_list = &part->initial_free_list;
-	part->used_list = NULL;
+	spin_lock_init(&part->lock);
+	part->free_addr = RB_ROOT;
+	part->free_size = RB_ROOT;
+	part->used = RB_ROOT;
+	part->spare = NULL;
+	part->spare_cnt = 0;
+	part->free_cnt = 0;
+	part->used_cnt = 0;
+	part->free_total = 0;
+	part->alloc_fails = 0;
+#if defined(CONFIG_BPA2_MOVABLE)
+	part->lend_start = 0;
+	part->lend_end = 0;
+	part->reclaim_cnt = 0;
+	part->reclaim_fails = 0;
+	part->reclaim_last_us = 0;
+	part->reclaim_max_us = 0;
+	part->reclaim_total_us = 0;
+#endif
+	part->initial_range.base = start;
+	part->initial_range.size = size;
+	bpa2_insert_free(part, &part->initial_range);
 
 	/* And finally... */
 	list_add_tail(&part->list, &bpa2_parts);
@@ -388,6 +775,7 @@ static int __init bpa2_parts_setup(char *str)
 	while ((desc = strsep(&str, ",")) != NULL) {
 		unsigned long start = 0;
 		unsigned long size = 0;
+		unsigned long flags;
 		int names_cnt = 1;
 		const char **names;
 		char *token;
@@ -439,11 +827,20 @@ static int __init bpa2_parts_setup(char *str)
 			}
 		}
 
-		/* Get partition flags (not implemented yet) */
+		/* Get partition flags */
+		flags = BPA2_NORMAL;
+		token = strsep(&desc, ":");
+		if (token && *token) {
+			if (strcmp(token, "movable") == 0)
+				flags |= BPA2_MOVABLE;
+			else
+				printk(KERN_WARNING "bpa2: unknown flags "
+						"'%s' ignored\n", token);
+		}
 
 		/* Finally add it to the list... */
 		if (bpa2_add_part(names, names_cnt, start, size,
-					BPA2_NORMAL) != 0)
+					flags) != 0)
 			printk(KERN_ERR "bpa2: '%s' partition skipped\n",
 					*names);
 
@@ -506,22 +903,21 @@ struct bpa2_part *bpa2_find_part_addr(unsigned long base, unsigned long size)
 {
 	struct bpa2_part *part;
 
-	spin_lock(&bpa2_lock);
-
 	list_for_each_entry(part, &bpa2_parts, list) {
-		struct bpa2_range *range = part->used_list;
-		while (range) {
-			if (base >= range->base
-			    && (base + size) <= (range->base + range->size)) {
-				spin_unlock(&bpa2_lock);
-				return part;
-			}
-			range = range->next;
+		struct bpa2_range *range;
+
+		if (base < part->res.start || base > part->res.end)
+			continue;
+
+		spin_lock(&part->lock);
+		range = bpa2_lookup_addr(&part->used, base);
+		if (range && (base + size) <= (range->base + range->size)) {
+			spin_unlock(&part->lock);
+			return part;
 		}
+		spin_unlock(&part->lock);
 	}
 
-	spin_unlock(&bpa2_lock);
-
 	return NULL;
 }
 EXPORT_SYMBOL(bpa2_find_part_addr);
@@ -543,89 +939,110 @@ EXPORT_SYMBOL(bpa2_find_part_addr);
 unsigned long __bpa2_alloc_pages(struct bpa2_part *part, int count, int align,
 		int priority, const char *trace_file, int trace_line)
 {
-	struct bpa2_range *range, **range_ptr;
-	struct bpa2_range *new_range, *align_range, *used_range;
+	struct bpa2_range *range, *used_range, *tail_range;
+	struct rb_node *n, *best;
 	unsigned long aligned_base = 0;
-	unsigned long result = 0;
+	unsigned long size, head, tail;
 
 	if (count == 0)
 		return 0;
 
-	/* Allocate the data structures we might need here so that we
-	 * don't have problems inside the spinlock.
-	 * Free at the end if not used. */
-	new_range = kmalloc(sizeof(*new_range), priority);
-	align_range = kmalloc(sizeof(*align_range), priority);
-	if ((new_range == NULL) || (align_range == NULL))
-		goto fail;
-
 	if (align == 0)
 		align = PAGE_SIZE;
 	else
 		align = align * PAGE_SIZE;
 
-	spin_lock(&bpa2_lock);
+	size = count * PAGE_SIZE;
+
+	spin_lock(&part->lock);
 
-	/* Search a free block which is large enough, even with alignment. */
-	range_ptr = &part->free_list;
-	while (*range_ptr != NULL) {
-		range = *range_ptr;
+	if (!bpa2_can_reclaim(part, priority)) {
+		part->alloc_fails++;
+		spin_unlock(&part->lock);
+		return 0;
+	}
+
+	/* Make sure we have the range nodes we might need, so that
+	 * nothing has to be allocated with the lock held. */
+	while (part->spare_cnt < BPA2_RANGES_PER_ALLOC) {
+		spin_unlock(&part->lock);
+		if (bpa2_refill_spare(part, priority) != 0)
+			return 0;
+		spin_lock(&part->lock);
+	}
+
+	/* Find the smallest free range which is large enough */
+	best = NULL;
+	n = part->free_size.rb_node;
+	while (n) {
+		range = rb_entry(n, struct bpa2_range, size_node);
+		if (range->size >= size) {
+			best = n;
+			n = n->rb_left;
+		} else {
+			n = n->rb_right;
+		}
+	}
+
+	/* Then the first one, in size order, which still fits once
+	 * aligned. Usually this is the first candidate. */
+	for (n = best; n != NULL; n = rb_next(n)) {
+		range = rb_entry(n, struct bpa2_range, size_node);
 		aligned_base = ((range->base + align - 1) / align) * align;
-		if (aligned_base + count * PAGE_SIZE <=
-				range->base + range->size)
+		if (aligned_base + size <= range->base + range->size)
 			break;
-		range_ptr = &range->next;
-	}
-	if (*range_ptr == NULL)
-		goto fail_unlock;
-	range = *range_ptr;
-
-	/* When we have to align, the pages needed for alignment can
-	 * be put back to the free pool. */
-	if (aligned_base != range->base) {
-		align_range->base = range->base;
-		align_range->size = aligned_base - range->base;
-		range->base = aligned_base;
-		range->size -= align_range->size;
-		align_range->next = range;
-		*range_ptr = align_range;
-		range_ptr = &align_range->next;
-		align_range = NULL;
-	}
-
-	if (count * PAGE_SIZE < range->size) {
-		/* Range is larger than needed, create a new list element for
-		 * the used list and shrink the element in the free list. */
-		new_range->base = range->base;
-		new_range->size = count * PAGE_SIZE;
-		range->base = new_range->base + new_range->size;
-		range->size = range->size - new_range->size;
-		used_range = new_range;
-		new_range = NULL;
+	}
+	if (n == NULL) {
+		part->alloc_fails++;
+		spin_unlock(&part->lock);
+		return 0;
+	}
+
+	head = aligned_base - range->base;
+	tail = range->base + range->size - (aligned_base + size);
+
+	/* The pages needed for alignment stay in the free range, any
+	 * pages above the allocation go back as a new free range. */
+	if (head) {
+		bpa2_resize_free(part, range, range->base, head);
+		used_range = bpa2_get_spare(part);
 	} else {
-		/* Range fits perfectly, remove it from free list. */
-		*range_ptr = range->next;
+		bpa2_erase_free(part, range);
 		used_range = range;
 	}
+
+	if (tail) {
+		tail_range = bpa2_get_spare(part);
+		tail_range->base = aligned_base + size;
+		tail_range->size = tail;
+		bpa2_insert_free(part, tail_range);
+	}
+
+	used_range->base = aligned_base;
+	used_range->size = size;
 #if defined(CONFIG_BPA2_ALLOC_TRACE)
 	/* Save the caller data */
 	used_range->trace_file = trace_file;
 	used_range->trace_line = trace_line;
 #endif
-	/* Insert block into used list */
-	used_range->next = part->used_list;
-	part->used_list = used_range;
-	result = used_range->base;
-
-fail_unlock:
-	spin_unlock(&bpa2_lock);
-fail:
-	if (new_range)
-		kfree(new_range);
-	if (align_range)
-		kfree(align_range);
+	/* Insert block into used index */
+	bpa2_insert_addr(&part->used, used_range);
+	part->used_cnt++;
+
+	spin_unlock(&part->lock);
+
+	/* Take back any pages lent to the page allocator */
+	if (bpa2_reclaim(part, aligned_base, size) != 0) {
+		spin_lock(&part->lock);
+		rb_erase(&used_range->node, &part->used);
+		part->used_cnt--;
+		bpa2_release(part, used_range);
+		part->alloc_fails++;
+		spin_unlock(&part->lock);
+		return 0;
+	}
 
-	return result;
+	return aligned_base;
 }
 EXPORT_SYMBOL(__bpa2_alloc_pages);
 
@@ -642,61 +1059,32 @@ EXPORT_SYMBOL(__bpa2_alloc_pages);
  */
 void bpa2_free_pages(struct bpa2_part *part, unsigned long base)
 {
-	struct bpa2_range *prev, *next, *range, **range_ptr;
+	struct bpa2_range *range;
 
-	spin_lock(&bpa2_lock);
+	spin_lock(&part->lock);
 
-	/* Search the block in the used list. */
-	for (range_ptr = &part->used_list;
-			*range_ptr != NULL;
-			range_ptr = &(*range_ptr)->next)
-		if ((*range_ptr)->base == base)
-			break;
-	if (*range_ptr == NULL) {
+	/* Search the block in the used index. */
+	range = bpa2_lookup_addr(&part->used, base);
+	if (range == NULL || range->base != base) {
 		printk(KERN_ERR "%s: 0x%08lx not allocated!\n",
 				__func__, base);
-		spin_unlock(&bpa2_lock);
+		spin_unlock(&part->lock);
 		return;
 	}
-	range = *range_ptr;
 
-	/* Remove range from the used list: */
-	*range_ptr = (*range_ptr)->next;
+	/* Remove range from the used index: */
+	rb_erase(&range->node, &part->used);
+	part->used_cnt--;
 
-	/* The free-list is sorted by address, search insertion point
-	 * and insert block in free list. */
-	for (range_ptr = &part->free_list, prev = NULL;
-			*range_ptr != NULL;
-			prev = *range_ptr, range_ptr = &(*range_ptr)->next)
-		if ((*range_ptr)->base >= base)
-			break;
-	range->next  = *range_ptr;
-	*range_ptr   = range;
-
-	/* Concatenate free range with neighbors, if possible.
-	 * Try for upper neighbor (next in list) first, then
-	 * for lower neighbor (predecessor in list). */
-	next = NULL;
-	if (range->next != NULL &&
-			range->base + range->size == range->next->base) {
-		next = range->next;
-		range->size += next->size;
-		range->next = next->next;
-	}
-	if (prev != NULL &&
-			prev->base + prev->size == range->base) {
-		prev->size += range->size;
-		prev->next = range->next;
-	} else {
-		range = NULL;
-	}
+	spin_unlock(&part->lock);
 
-	spin_unlock(&bpa2_lock);
+	/* The pages must be back in the page allocator before the range
+	 * can be found free, and reclaimed, by another allocation. */
+	bpa2_lend(part, range->base, range->size);
 
-	if (next && (next != &part->initial_free_list))
-		kfree(next);
-	if (range && (range != &part->initial_free_list))
-		kfree(range);
+	spin_lock(&part->lock);
+	bpa2_release(part, range);
+	spin_unlock(&part->lock);
 }
 EXPORT_SYMBOL(bpa2_free_pages);
 
@@ -734,8 +1122,6 @@ EXPORT_SYMBOL(bigphysarea_free_pages);
 
 static void *bpa2_seq_start(struct seq_file *s, loff_t *pos)
 {
-	spin_lock(&bpa2_lock);
-
 	return seq_list_start(&bpa2_parts, *pos);
 }
 
@@ -746,58 +1132,78 @@ static void *bpa2_seq_next(struct seq_file *s, void *v, loff_t *pos)
 
 static void bpa2_seq_stop(struct seq_file *s, void *v)
 {
-	spin_unlock(&bpa2_lock);
 }
 
 static int bpa2_seq_show(struct seq_file *s, void *v)
 {
 	struct bpa2_part *part = list_entry(v, struct bpa2_part, list);
 	struct bpa2_range *range;
-	int free_count, free_total, free_max;
-	int used_count, used_total, used_max;
+	struct rb_node *n;
+	unsigned long free_total, free_max, used_total, used_max;
+	int free_count, used_count;
+	int frag;
 	int i;
 
-	free_count = 0;
-	free_total = 0;
-	free_max = 0;
-	for (range = part->free_list; range != NULL; range = range->next) {
-		free_count++;
-		free_total += range->size;
-		if (range->size > free_max)
-			free_max = range->size;
-	}
+	spin_lock(&part->lock);
 
-	used_count = 0;
+	free_count = part->free_cnt;
+	free_total = part->free_total;
+	n = rb_last(&part->free_size);
+	free_max = n ? rb_entry(n, struct bpa2_range, size_node)->size : 0;
+
+	used_count = part->used_cnt;
 	used_total = 0;
 	used_max = 0;
-	for (range = part->used_list; range != NULL; range = range->next) {
-		used_count++;
+	for (n = rb_first(&part->used); n != NULL; n = rb_next(n)) {
+		range = rb_entry(n, struct bpa2_range, node);
 		used_total += range->size;
 		if (range->size > used_max)
 			used_max = range->size;
 	}
 
+	/* Share of the free memory not usable for the largest request */
+	frag = free_total ?
+		100 - (int)div64_u64((u64)free_max * 100, free_total) : 0;
+
 	seq_printf(s, "Partition: ");
 	for (i = 0; i < part->names_cnt; i++)
 		seq_printf(s, "%s'%s'", i > 0 ? " aka " : "",
 				bpa2_get_name(part, i));
 	seq_printf(s, "\n");
-	seq_printf(s, "Size: %d kB, base address: 0x%08x\n",
-			(part->res.end - part->res.start + 1) / 1024,
-			part->res.start);
+	seq_printf(s, "Size: %lu kB, base address: 0x%08lx\n",
+			(unsigned long)resource_size(&part->res) / 1024,
+			(unsigned long)part->res.start);
 	seq_printf(s, "Statistics:                  free       "
 			"    used\n");
 	seq_printf(s, "- number of blocks:      %8d       %8d\n",
 			free_count, used_count);
-	seq_printf(s, "- size of largest block: %8d kB    %8d kB\n",
+	seq_printf(s, "- size of largest block: %8lu kB    %8lu kB\n",
 			free_max / 1024, used_max / 1024);
-	seq_printf(s, "- total:                 %8d kB    %8d kB\n",
+	seq_printf(s, "- total:                 %8lu kB    %8lu kB\n",
 			free_total / 1024, used_total / 1024);
+	seq_printf(s, "Fragmentation: %d%% (%d free ranges, largest %lu kB)\n",
+			frag, free_count, free_max / 1024);
+	seq_printf(s, "Failed allocations: %lu\n", part->alloc_fails);
+#if defined(CONFIG_BPA2_MOVABLE)
+	if (part->lend_end) {
+		seq_printf(s, "Lent to page allocator: %lu kB at 0x%08lx\n",
+				(part->lend_end - part->lend_start) <<
+				(PAGE_SHIFT - 10),
+				(unsigned long)PFN_PHYS(part->lend_start));
+		seq_printf(s, "Reclaims: %lu (%lu failed), latency last %lu us,"
+				" average %lu us, max %lu us\n",
+				part->reclaim_cnt, part->reclaim_fails,
+				part->reclaim_last_us,
+				part->reclaim_cnt ? (unsigned long)div64_u64(
+				part->reclaim_total_us, part->reclaim_cnt) : 0,
+				part->reclaim_max_us);
+	}
+#endif
 
 	if (used_count) {
 		seq_printf(s, "Allocations:\n");
-		for (range = part->used_list; range != NULL;
-				range = range->next) {
+		for (n = rb_first(&part->used); n != NULL; n = rb_next(n)) {
+			range = rb_entry(n, struct bpa2_range, node);
 			seq_printf(s, "- %lu B at 0x%.8lx",
 					range->size, range->base);
 #if defined(CONFIG_BPA2_ALLOC_TRACE)
@@ -811,6 +1217,8 @@ static int bpa2_seq_show(struct seq_file *s, void *v)
 
 	seq_printf(s, "\n");
 
+	spin_unlock(&part->lock);
+
 	return 0;
 }
 
@@ -119,8 +119,8 @@ static bool suitable_migration_target(struct page *page)
 	if (PageBuddy(page) && page_order(page) >= pageblock_order)
 		return true;
 
-	/* If the block is MIGRATE_MOVABLE, allow migration */
-	if (migratetype == MIGRATE_MOVABLE)
+	/* If the block is MIGRATE_MOVABLE or lent by BPA2, allow migration */
+	if (migratetype == MIGRATE_MOVABLE || is_migrate_bpa2(migratetype))
 		return true;
 
 	/* Otherwise skip the block */
@@ -58,6 +58,8 @@
 #include <linux/memcontrol.h>
 #include <linux/prefetch.h>
 #include <linux/page-debug-flags.h>
+#include <linux/migrate.h>
+#include <linux/mm_inline.h>
 
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
@@ -872,13 +874,19 @@ struct page *__rmqueue_smallest(struct zone *zone, unsigned int order,
 
 /*
  * This array describes the order lists are fallen back to when
- * the free lists for the desirable migrate type are depleted
+ * the free lists for the desirable migrate type are depleted.
+ * Each list is terminated by MIGRATE_RESERVE.
  */
 static int fallbacks[MIGRATE_TYPES][MIGRATE_TYPES-1] = {
 	[MIGRATE_UNMOVABLE]   = { MIGRATE_RECLAIMABLE, MIGRATE_MOVABLE,   MIGRATE_RESERVE },
 	[MIGRATE_RECLAIMABLE] = { MIGRATE_UNMOVABLE,   MIGRATE_MOVABLE,   MIGRATE_RESERVE },
+#ifdef CONFIG_BPA2_MOVABLE
+	[MIGRATE_MOVABLE]     = { MIGRATE_BPA2,        MIGRATE_RECLAIMABLE, MIGRATE_UNMOVABLE, MIGRATE_RESERVE },
+	[MIGRATE_BPA2]        = { MIGRATE_RESERVE }, /* Never used */
+#else
 	[MIGRATE_MOVABLE]     = { MIGRATE_RECLAIMABLE, MIGRATE_UNMOVABLE, MIGRATE_RESERVE },
-	[MIGRATE_RESERVE]     = { MIGRATE_RESERVE,     MIGRATE_RESERVE,   MIGRATE_RESERVE }, /* Never used */
+#endif
+	[MIGRATE_RESERVE]     = { MIGRATE_RESERVE }, /* Never used */
 };
 
 /*
@@ -978,7 +986,7 @@ __rmqueue_fallback(struct zone *zone, int order, int start_migratetype)
 
 			/* MIGRATE_RESERVE handled later if necessary */
 			if (migratetype == MIGRATE_RESERVE)
-				continue;
+				break;
 
 			area = &(zone->free_area[current_order]);
 			if (list_empty(&area->free_list[migratetype]))
@@ -992,11 +1000,14 @@ __rmqueue_fallback(struct zone *zone, int order, int start_migratetype)
 			 * If breaking a large block of pages, move all free
 			 * pages to the preferred allocation list. If falling
 			 * back for a reclaimable kernel allocation, be more
-			 * aggressive about taking ownership of free pages
+			 * aggressive about taking ownership of free pages.
+			 * Blocks lent by BPA2 are never taken over, they
+			 * must only ever hold movable pages.
 			 */
-			if (unlikely(current_order >= (pageblock_order >> 1)) ||
+			if (!is_migrate_bpa2(migratetype) &&
+			    (unlikely(current_order >= (pageblock_order >> 1)) ||
 					start_migratetype == MIGRATE_RECLAIMABLE ||
-					page_group_by_mobility_disabled) {
+					page_group_by_mobility_disabled)) {
 				unsigned long pages;
 				pages = move_freepages_block(zone, page,
 								start_migratetype);
@@ -1015,7 +1026,8 @@ __rmqueue_fallback(struct zone *zone, int order, int start_migratetype)
 			rmv_page_order(page);
 
 			/* Take ownership for orders >= pageblock_order */
-			if (current_order >= pageblock_order)
+			if (current_order >= pageblock_order &&
+			    !is_migrate_bpa2(migratetype))
 				change_pageblock_range(page, current_order,
 							start_migratetype);
 
@@ -1075,6 +1087,8 @@ static int rmqueue_bulk(struct zone *zone, unsigned int order,
 	spin_lock(&zone->lock);
 	for (i = 0; i < count; ++i) {
 		struct page *page = __rmqueue(zone, order, migratetype);
+		int mt = migratetype;
+
 		if (unlikely(page == NULL))
 			break;
 
@@ -1091,7 +1105,15 @@ static int rmqueue_bulk(struct zone *zone, unsigned int order,
 			list_add(&page->lru, list);
 		else
 			list_add_tail(&page->lru, list);
-		set_page_private(page, migratetype);
+#ifdef CONFIG_BPA2_MOVABLE
+		/*
+		 * Pages from a BPA2 block must go back to its free list if
+		 * they are drained from the pcp list unused.
+		 */
+		if (is_migrate_bpa2(get_pageblock_migratetype(page)))
+			mt = MIGRATE_BPA2;
+#endif
+		set_page_private(page, mt);
 		list = &page->lru;
 	}
 	__mod_zone_page_state(zone, NR_FREE_PAGES, -(i << order));
@@ -1372,7 +1394,9 @@ int split_free_page(struct page *page)
 	if (order >= pageblock_order - 1) {
 		struct page *endpage = page + (1 << order) - 1;
 		for (; page < endpage; page += pageblock_nr_pages)
-			set_pageblock_migratetype(page, MIGRATE_MOVABLE);
+			if (!is_migrate_bpa2(get_pageblock_migratetype(page)))
+				set_pageblock_migratetype(page,
+							  MIGRATE_MOVABLE);
 	}
 
 	return 1 << order;
@@ -5433,7 +5457,8 @@ __count_immobile_pages(struct zone *zone, struct page *page, int count)
 	if (zone_idx(zone) == ZONE_MOVABLE)
 		return true;
 
-	if (get_pageblock_migratetype(page) == MIGRATE_MOVABLE)
+	if (get_pageblock_migratetype(page) == MIGRATE_MOVABLE ||
+	    is_migrate_bpa2(get_pageblock_migratetype(page)))
 		return true;
 
 	pfn = page_to_pfn(page);
@@ -5550,7 +5575,7 @@ out:
 	return ret;
 }
 
-void unset_migratetype_isolate(struct page *page)
+void unset_migratetype_isolate(struct page *page, int migratetype)
 {
 	struct zone *zone;
 	unsigned long flags;
@@ -5558,12 +5583,235 @@ void unset_migratetype_isolate(struct page *page)
 	spin_lock_irqsave(&zone->lock, flags);
 	if (get_pageblock_migratetype(page) != MIGRATE_ISOLATE)
 		goto out;
-	set_pageblock_migratetype(page, MIGRATE_MOVABLE);
-	move_freepages_block(zone, page, MIGRATE_MOVABLE);
+	set_pageblock_migratetype(page, migratetype);
+	move_freepages_block(zone, page, migratetype);
 out:
 	spin_unlock_irqrestore(&zone->lock, flags);
 }
 
+#ifdef CONFIG_BPA2_MOVABLE
+/**
+ * init_bpa2_reserved_pageblock - lend a reserved pageblock to the allocator
+ * @page: first page of the pageblock
+ *
+ * The pageblock, reserved at boot, becomes MIGRATE_BPA2 with all of its
+ * pages allocated. The owner then frees the pages it does not use with
+ * free_contig_range() and gets them back with alloc_contig_range().
+ */
+void __init init_bpa2_reserved_pageblock(struct page *page)
+{
+	unsigned i = pageblock_nr_pages;
+	struct page *p = page;
+
+	do {
+		__ClearPageReserved(p);
+		init_page_count(p);
+	} while (++p, --i);
+
+	set_pageblock_migratetype(page, MIGRATE_BPA2);
+	totalram_pages += pageblock_nr_pages;
+}
+
+static struct page *
+__alloc_contig_migrate_alloc(struct page *page, unsigned long private,
+			     int **resultp)
+{
+	return alloc_page(GFP_HIGHUSER_MOVABLE);
+}
+
+#define CONTIG_MIGRATE_RETRIES	5
+
+/* Migrate all pages in use in [start, end), which must be isolated */
+static int __alloc_contig_migrate_range(unsigned long start, unsigned long end)
+{
+	unsigned long pfn;
+	struct page *page;
+	int tries = 0;
+	int ret;
+	LIST_HEAD(source);
+
+	migrate_prep();
+
+	for (;;) {
+		int busy = 0;
+
+		for (pfn = start; pfn < end; pfn++) {
+			if (!pfn_valid_within(pfn))
+				continue;
+			page = pfn_to_page(pfn);
+			if (!get_page_unless_zero(page))
+				continue;
+
+			if (isolate_lru_page(page) == 0) {
+				list_add_tail(&page->lru, &source);
+				inc_zone_page_state(page, NR_ISOLATED_ANON +
+						    page_is_file_cache(page));
+			} else {
+				/* Not on the LRU (yet), try again later */
+				busy++;
+			}
+			put_page(page);
+		}
+
+		if (list_empty(&source) && !busy)
+			return 0;
+
+		if (++tries > CONTIG_MIGRATE_RETRIES)
+			break;
+
+		if (!list_empty(&source)) {
+			ret = migrate_pages(&source, __alloc_contig_migrate_alloc,
+					    0, false, MIGRATE_SYNC);
+			if (ret)
+				putback_lru_pages(&source);
+			INIT_LIST_HEAD(&source);
+		}
+
+		lru_add_drain_all();
+		if (busy)
+			yield();
+	}
+
+	putback_lru_pages(&source);
+
+	return -EBUSY;
+}
+
+/*
+ * Take the isolated free pages of [start, end) out of the buddy lists
+ * as order-0 pages. Returns the end of the last buddy page taken, which
+ * may lie beyond `end', or 0 if a page in the range was not free.
+ */
+static unsigned long __isolate_free_range(unsigned long start,
+					  unsigned long end)
+{
+	struct zone *zone = page_zone(pfn_to_page(start));
+	unsigned long pfn, flags;
+	struct page *page;
+	int order;
+
+	spin_lock_irqsave(&zone->lock, flags);
+	for (pfn = start; pfn < end; pfn += 1 << order) {
+		page = pfn_to_page(pfn);
+		if (!PageBuddy(page))
+			break;
+
+		order = page_order(page);
+		list_del(&page->lru);
+		zone->free_area[order].nr_free--;
+		rmv_page_order(page);
+		__mod_zone_page_state(zone, NR_FREE_PAGES, -(1UL << order));
+
+		set_page_refcounted(page);
+		split_page(page, order);
+	}
+	spin_unlock_irqrestore(&zone->lock, flags);
+
+	if (pfn < end) {
+		/* Give back what was taken so far */
+		free_contig_range(start, pfn - start);
+		return 0;
+	}
+
+	return pfn;
+}
+
+static unsigned long pfn_max_align_down(unsigned long pfn)
+{
+	return pfn & ~(max_t(unsigned long, MAX_ORDER_NR_PAGES,
+			     pageblock_nr_pages) - 1);
+}
+
+static unsigned long pfn_max_align_up(unsigned long pfn)
+{
+	return ALIGN(pfn, max_t(unsigned long, MAX_ORDER_NR_PAGES,
+				pageblock_nr_pages));
+}
+
+/**
+ * alloc_contig_range - take a range of lent pages back from the allocator
+ * @start: first PFN to allocate
+ * @end: one past the last PFN to allocate
+ * @migratetype: type of the pageblocks, MIGRATE_BPA2
+ *
+ * The MAX_ORDER aligned blocks around the range are isolated, the pages
+ * in use in the range are migrated elsewhere and the then free pages are
+ * removed from the buddy lists. The caller must serialise calls for
+ * overlapping blocks. Returns 0 with the range allocated as order-0
+ * pages, or -EBUSY if some page could not be moved. May sleep.
+ */
+int alloc_contig_range(unsigned long start, unsigned long end,
+		       int migratetype)
+{
+	unsigned long outer_start, outer_end;
+	struct page *page;
+	int order;
+	int ret;
+
+	ret = start_isolate_page_range(pfn_max_align_down(start),
+				       pfn_max_align_up(end), migratetype);
+	if (ret)
+		return ret;
+
+	ret = __alloc_contig_migrate_range(start, end);
+	if (ret)
+		goto done;
+
+	/* Flush out pages freed to the pcp lists during migration */
+	drain_all_pages();
+
+	/*
+	 * The first page may be in the middle of a larger free buddy
+	 * page; take that one whole and free the part below `start'.
+	 * The pages are isolated, so they can not leave the buddy lists.
+	 */
+	order = 0;
+	outer_start = start;
+	for (;;) {
+		page = pfn_to_page(outer_start);
+		if (PageBuddy(page) && page_order(page) >= order)
+			break;
+		if (++order >= MAX_ORDER) {
+			ret = -EBUSY;
+			goto done;
+		}
+		outer_start = start & (~0UL << order);
+	}
+
+	if (test_pages_isolated(outer_start, end)) {
+		ret = -EBUSY;
+		goto done;
+	}
+
+	outer_end = __isolate_free_range(outer_start, end);
+	if (!outer_end) {
+		ret = -EBUSY;
+		goto done;
+	}
+
+	if (start != outer_start)
+		free_contig_range(outer_start, start - outer_start);
+	if (end != outer_end)
+		free_contig_range(end, outer_end - end);
+
+done:
+	undo_isolate_page_range(pfn_max_align_down(start),
+				pfn_max_align_up(end), migratetype);
+	return ret;
+}
+
+/**
+ * free_contig_range - give order-0 pages back to the allocator
+ * @pfn: first PFN to free
+ * @nr_pages: number of pages
+ */
+void free_contig_range(unsigned long pfn, unsigned long nr_pages)
+{
+	for (; nr_pages--; pfn++)
+		__free_page(pfn_to_page(pfn));
+}
+#endif /* CONFIG_BPA2_MOVABLE */
+
 #ifdef CONFIG_MEMORY_HOTREMOVE
 /*
  * All pages in the range must be isolated before calling this.
@@ -613,6 +613,9 @@ static char * const migratetype_names[MIGRATE_TYPES] = {
 	"Reclaimable",
 	"Movable",
 	"Reserve",
+#ifdef CONFIG_BPA2_MOVABLE
+	"BPA2",
+#endif
 	"Isolate",
 };
 
@@ -247,6 +247,34 @@ struct net_bridge_fdb_entry *__br_fdb_get(struct net_bridge *br,
 	return NULL;
 }
 
+/**
+ * br_fdb_find_port - port the bridge forwards an address to
+ * @br_dev: bridge device
+ * @addr: destination MAC address
+ *
+ * Returns the port frames for @addr are forwarded to, or NULL if the
+ * address is unknown or local to the bridge. The device is not
+ * referenced, so the caller must hold the rtnl lock or rcu_read_lock.
+ */
+struct net_device *br_fdb_find_port(const struct net_device *br_dev,
+				    const unsigned char *addr)
+{
+	struct net_bridge_fdb_entry *f;
+	struct net_device *dev = NULL;
+
+	if (!(br_dev->priv_flags & IFF_EBRIDGE))
+		return NULL;
+
+	rcu_read_lock();
+	f = __br_fdb_get(netdev_priv(br_dev), addr);
+	if (f && !f->is_local && f->dst)
+		dev = f->dst->dev;
+	rcu_read_unlock();
+
+	return dev;
+}
+EXPORT_SYMBOL_GPL(br_fdb_find_port);
+
 #if IS_ENABLED(CONFIG_ATM_LANE)
 /* Interface used by ATM LANE hook to test
  * if an addr is on some other bridge port */
@@ -34,6 +34,7 @@
 #include <linux/stm/pad.h>
 #include <linux/stm/dma.h>
 #include <linux/pm_runtime.h>
+#include <linux/bitops.h>
 #include <sound/core.h>
 #include <sound/pcm.h>
 #include <sound/control.h>
@@ -64,6 +65,13 @@
 #define UNIPERIF_FIFO_FRAMES	4	/* FDMA trigger limit in frames */
 #define UNIPERIF_PLAYER_UNDERFLOW_US	1000
 
+/* Low latency mode: small periods, each one a single interrupting node */
+#define LOW_LATENCY_PERIOD_BYTES_MIN	256	/* 64 frames, 16 bits, 2 ch. */
+#define LOW_LATENCY_SUBBLOCKS	1
+
+/* Left/right swapping is done through a cached bounce buffer this size */
+#define SWAP_CHUNK_BYTES	256
+
 
 /*
  * Driver specific types.
@@ -224,6 +232,26 @@ static struct snd_pcm_hardware uniperif_player_raw_hw = {
 
 static int uniperif_player_stop(struct snd_pcm_substream *substream);
 
+static void uniperif_player_set_hardware(struct uniperif_player *player,
+		const struct snd_pcm_hardware *hardware)
+{
+	player->hardware = *hardware;
+
+	/* Low latency players allow periods down to a few interrupts per
+	 * 10 ms, that is what they are for... */
+	if (player->info->low_latency)
+		player->hardware.period_bytes_min =
+				LOW_LATENCY_PERIOD_BYTES_MIN;
+}
+
+static int uniperif_player_sub_periods(struct uniperif_player *player)
+{
+	/* Sub-periods only give parking a finer granularity, with small
+	 * periods every period is a single node raising an interrupt */
+	return player->info->low_latency ? LOW_LATENCY_SUBBLOCKS :
+			PARKING_SUBBLOCKS;
+}
+
 
 /*
  * Uniperipheral player implementation
@@ -352,7 +380,7 @@ static bool uniperif_player_dma_filter_fn(struct dma_chan *chan, void *fn_param)
 	config->dreq_config.direction = DMA_MEM_TO_DEV;
 
 	/* Set the default parking configuration */
-	config->park_config.sub_periods = PARKING_SUBBLOCKS;
+	config->park_config.sub_periods = uniperif_player_sub_periods(player);
 	config->park_config.buffer_size = PARKING_BUFFER_SIZE;
 
 	/* Save the channel config inside the channel structure */
@@ -673,7 +701,8 @@ static int uniperif_player_hw_params(struct snd_pcm_substream *substream,
 			params_channels(hw_params) / 8;
 
 	/* Set the parking configuration (actually set in 'standby' function) */
-	player->dma_park_config.sub_periods = PARKING_SUBBLOCKS;
+	player->dma_park_config.sub_periods =
+			uniperif_player_sub_periods(player);
 	player->dma_park_config.buffer_size = transfer_bytes + (frame_bytes-1);
 	player->dma_park_config.buffer_size /= frame_bytes;
 	player->dma_park_config.buffer_size *= frame_bytes;
@@ -1538,26 +1567,55 @@ static snd_pcm_uframes_t uniperif_player_pointer(
 				player->dma_channel,
 				player->dma_cookie, &state);
 
+		/* The residue is exact to the byte, round it to a frame */
 		residue = state.residue;
 		hwptr = (runtime->dma_bytes - residue) % runtime->dma_bytes;
-
-		/* Set hwptr to the start of current period */
-		hwptr /= player->period_bytes;
-		hwptr *= player->period_bytes;
+		hwptr -= hwptr % frames_to_bytes(runtime, 1);
 	}
 
 	return bytes_to_frames(runtime, hwptr);
 }
 
+/*
+ * The dma area is uncached, so rather than swapping it in place (reading
+ * it back a halfword at a time), the data goes through a small cached
+ * buffer where each stereo frame is swapped with a single rotate, then
+ * is written out once with whole word stores.
+ */
+static int uniperif_player_copy_swap(void *dst, void __user *src,
+		size_t bytes)
+{
+	u32 chunk[SWAP_CHUNK_BYTES / sizeof(u32)];
+
+	while (bytes) {
+		size_t len = min_t(size_t, bytes, sizeof(chunk));
+		int i;
+
+		if (copy_from_user(chunk, src, len))
+			return -EFAULT;
+
+		/* A 16-bit stereo frame is one word, L/R are its halves */
+		for (i = 0; i < len / sizeof(u32); i++)
+			chunk[i] = ror32(chunk[i], 16);
+
+		memcpy(dst, chunk, len);
+
+		dst += len;
+		src += len;
+		bytes -= len;
+	}
+
+	return 0;
+}
+
 static int uniperif_player_copy(struct snd_pcm_substream *substream,
 		int channel, snd_pcm_uframes_t pos,
 		void __user *src, snd_pcm_uframes_t count)
 {
 	struct uniperif_player *player = snd_pcm_substream_chip(substream);
 	struct snd_pcm_runtime *runtime = substream->runtime;
+	size_t bytes = frames_to_bytes(runtime, count);
 	void *dst;
-	int result;
-	int i;
 
 	BUG_ON(!player);
 	BUG_ON(!snd_stm_magic_valid(player));
@@ -1567,25 +1625,14 @@ static int uniperif_player_copy(struct snd_pcm_substream *substream,
 	/* Get a pointer to the dma area to copy the user space data to */
 	dst = runtime->dma_area + frames_to_bytes(runtime, pos);
 
+	/* Check if we should swap left and right channels of 16-bit data */
+	if (runtime->format == SNDRV_PCM_FORMAT_S16_LE &&
+			player->info->s16_swap_lr)
+		return uniperif_player_copy_swap(dst, src, bytes);
+
 	/* Perform a normal copy from user */
-	result = copy_from_user(dst, src, frames_to_bytes(runtime, count));
-	BUG_ON(result);
-
-	/* Check if we are a 16-bit format */
-	if (runtime->format == SNDRV_PCM_FORMAT_S16_LE) {
-		/* Check if we should swap left and right channels */
-		if (player->info->s16_swap_lr) {
-			short *dst16 = dst;
-			short tmp;
-
-			/* Swap channels */
-			for (i = 0; i < count; ++i) {
-				tmp = dst16[2 * i];
-				dst16[2 * i] = dst16[2 * i + 1];
-				dst16[2 * i + 1] = tmp;
-			}
-		}
-	}
+	if (copy_from_user(dst, src, bytes))
+		return -EFAULT;
 
 	return 0;
 }
@@ -1978,7 +2025,7 @@ static int uniperif_player_ctl_raw_put(struct snd_kcontrol *kcontrol,
 {
 	struct uniperif_player *player = snd_kcontrol_chip(kcontrol);
 	int changed = 0;
-	struct snd_pcm_hardware hardware;
+	const struct snd_pcm_hardware *hardware;
 	enum uniperif_iec958_input_mode input_mode;
 
 	dev_dbg(player->dev, "%s(kcontrol=%p, ucontrol=%p)", __func__,
@@ -1988,16 +2035,16 @@ static int uniperif_player_ctl_raw_put(struct snd_kcontrol *kcontrol,
 	BUG_ON(!snd_stm_magic_valid(player));
 
 	if (ucontrol->value.integer.value[0]) {
-		hardware = uniperif_player_raw_hw;
+		hardware = &uniperif_player_raw_hw;
 		input_mode = UNIPERIF_IEC958_INPUT_MODE_RAW;
 	} else {
-		hardware = uniperif_player_pcm_hw;
+		hardware = &uniperif_player_pcm_hw;
 		input_mode = UNIPERIF_IEC958_INPUT_MODE_PCM;
 	}
 
 	spin_lock(&player->default_settings_lock);
 	changed = (input_mode != player->default_settings.input_mode);
-	player->hardware = hardware;
+	uniperif_player_set_hardware(player, hardware);
 	player->default_settings.input_mode = input_mode;
 	spin_unlock(&player->default_settings_lock);
 
@@ -2405,6 +2452,7 @@ static void uniperif_player_parse_dt(struct platform_device *pdev,
 	of_property_read_u32(pnode, "standby", &info->standby_enabled);
 	of_property_read_u32(pnode, "underflow", &info->underflow_enabled);
 	of_property_read_u32(pnode, "s16-swap-lr", &info->s16_swap_lr);
+	of_property_read_u32(pnode, "low-latency", &info->low_latency);
 
 	/* Save the info structure */
 	player->info = info;
@@ -2450,16 +2498,16 @@ static int uniperif_player_probe(struct platform_device *pdev)
 
 	switch (player->info->player_type) {
 	case SND_STM_UNIPERIF_PLAYER_TYPE_HDMI:
-		player->hardware = uniperif_player_pcm_hw;
+		uniperif_player_set_hardware(player, &uniperif_player_pcm_hw);
 		player->stream_settings.input_mode =
 				UNIPERIF_IEC958_INPUT_MODE_PCM;
 		break;
 	case SND_STM_UNIPERIF_PLAYER_TYPE_PCM:
-		player->hardware = uniperif_player_pcm_hw;
+		uniperif_player_set_hardware(player, &uniperif_player_pcm_hw);
 		break;
 	case SND_STM_UNIPERIF_PLAYER_TYPE_SPDIF:
 		/* Default to PCM mode where hardware does everything */
-		player->hardware = uniperif_player_pcm_hw;
+		uniperif_player_set_hardware(player, &uniperif_player_pcm_hw);
 		player->stream_settings.input_mode =
 				UNIPERIF_IEC958_INPUT_MODE_PCM;
 		break;
@@ -0,0 +1,244 @@
+/*
+ *
+ * futex-contend.c
+ *
+ * contend: Benchmark for contended futex based locks
+ *
+ * A number of threads take and release one shared lock in a loop.  With
+ * --yield the lock is held across sched_yield(), so that even on a
+ * uniprocessor nearly every unlock has a waiter to wake.  Depending on
+ * the options the contended paths go through FUTEX_WAIT/FUTEX_WAKE,
+ * FUTEX_WAKE_OP (futex_atomic_op_inuser() in the kernel) or
+ * FUTEX_LOCK_PI/FUTEX_UNLOCK_PI (futex_atomic_cmpxchg_inatomic()).
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/time.h>
+#include <linux/futex.h>
+
+static unsigned int nthreads = 4;
+static unsigned int runtime = 5;
+static bool use_wake_op = false;
+static bool use_pi = false;
+static bool do_yield = false;
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads,
+		     "Specify number of threads"),
+	OPT_UINTEGER('r', "runtime", &runtime,
+		     "Specify runtime (in seconds)"),
+	OPT_BOOLEAN('o', "wake-op", &use_wake_op,
+		    "Release contended locks with FUTEX_WAKE_OP"),
+	OPT_BOOLEAN('p', "pi", &use_pi,
+		    "Use priority inheritance futexes"),
+	OPT_BOOLEAN('y', "yield", &do_yield,
+		    "Call sched_yield() while holding the lock"),
+	OPT_END()
+};
+
+static const char * const bench_futex_contend_usage[] = {
+	"perf bench futex contend <options>",
+	NULL
+};
+
+/* 0: unlocked, 1: locked, 2: locked with (possible) waiters */
+static int lock_word;
+static volatile int done;
+
+struct worker {
+	pthread_t thread;
+	unsigned long ops;
+	unsigned long wakes;	/* unlocks which entered the kernel */
+};
+
+static int sys_futex(int *uaddr, int op, int val, int *uaddr2, int val3)
+{
+	return syscall(__NR_futex, uaddr, op, val, NULL, uaddr2, val3);
+}
+
+static void lock_futex(int *lock)
+{
+	int c = __sync_val_compare_and_swap(lock, 0, 1);
+
+	if (!c)
+		return;
+
+	if (c != 2)
+		c = __sync_lock_test_and_set(lock, 2);
+
+	while (c) {
+		sys_futex(lock, FUTEX_WAIT_PRIVATE, 2, NULL, 0);
+		c = __sync_lock_test_and_set(lock, 2);
+	}
+}
+
+/* Returns 1 if the unlock had to enter the kernel */
+static int unlock_futex(int *lock)
+{
+	if (use_wake_op) {
+		/* Uncontended: no need to enter the kernel at all */
+		if (__sync_val_compare_and_swap(lock, 1, 0) == 1)
+			return 0;
+
+		/* Let the kernel release the lock and wake one waiter */
+		sys_futex(lock, FUTEX_WAKE_OP_PRIVATE, 1, lock,
+			  FUTEX_OP(FUTEX_OP_SET, 0, FUTEX_OP_CMP_EQ, 0));
+		return 1;
+	}
+
+	if (__sync_lock_test_and_set(lock, 0) != 2)
+		return 0;
+
+	sys_futex(lock, FUTEX_WAKE_PRIVATE, 1, NULL, 0);
+	return 1;
+}
+
+static void lock_pi(int *lock, int tid)
+{
+	if (__sync_val_compare_and_swap(lock, 0, tid) == 0)
+		return;
+
+	while (sys_futex(lock, FUTEX_LOCK_PI_PRIVATE, 0, NULL, 0) &&
+	       errno == EINTR)
+		;
+}
+
+static int unlock_pi(int *lock, int tid)
+{
+	if (__sync_val_compare_and_swap(lock, tid, 0) == tid)
+		return 0;
+
+	sys_futex(lock, FUTEX_UNLOCK_PI_PRIVATE, 0, NULL, 0);
+	return 1;
+}
+
+static void *worker_thread(void *arg)
+{
+	struct worker *w = arg;
+	int tid = syscall(__NR_gettid);
+
+	while (!done) {
+		if (use_pi)
+			lock_pi(&lock_word, tid);
+		else
+			lock_futex(&lock_word);
+
+		if (do_yield)
+			sched_yield();
+
+		if (use_pi)
+			w->wakes += unlock_pi(&lock_word, tid);
+		else
+			w->wakes += unlock_futex(&lock_word);
+		w->ops++;
+	}
+
+	return NULL;
+}
+
+int bench_futex_contend(int argc, const char **argv,
+			const char *prefix __used)
+{
+	struct worker *workers;
+	struct timeval start, stop, diff;
+	unsigned long long total = 0, wakes = 0, result_usec;
+	unsigned long min_ops = ULONG_MAX, max_ops = 0;
+	unsigned int i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_futex_contend_usage, 0);
+
+	if (!nthreads || !runtime) {
+		fprintf(stderr, "Threads and runtime must be non-zero\n");
+		return 1;
+	}
+
+	workers = calloc(nthreads, sizeof(*workers));
+	if (!workers) {
+		fprintf(stderr, "Failed to allocate %u workers\n", nthreads);
+		return 1;
+	}
+
+	lock_word = 0;
+	done = 0;
+
+	gettimeofday(&start, NULL);
+
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&workers[i].thread, NULL, worker_thread,
+				   &workers[i])) {
+			fprintf(stderr, "pthread_create() failed (error: %s)\n",
+				strerror(errno));
+			exit(1);
+		}
+	}
+
+	sleep(runtime);
+	done = 1;
+
+	for (i = 0; i < nthreads; i++)
+		pthread_join(workers[i].thread, NULL);
+
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	for (i = 0; i < nthreads; i++) {
+		total += workers[i].ops;
+		wakes += workers[i].wakes;
+		if (workers[i].ops < min_ops)
+			min_ops = workers[i].ops;
+		if (workers[i].ops > max_ops)
+			max_ops = workers[i].ops;
+	}
+
+	result_usec = diff.tv_sec * 1000000ULL + diff.tv_usec;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %u threads contending on one %s lock%s\n\n",
+		       nthreads, use_pi ? "PI futex" : "futex",
+		       use_wake_op && !use_pi ? " (FUTEX_WAKE_OP unlock)" : "");
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec/1000));
+
+		printf(" %14llu lock/unlock pairs\n", total);
+		printf(" %14llu contended unlocks\n", wakes);
+		printf(" %14lf usecs/op\n",
+		       total ? (double)result_usec / (double)total : 0.0);
+		printf(" %14llu ops/sec\n",
+		       total * 1000000ULL / result_usec);
+		printf(" %14lu min ops/thread\n", min_ops);
+		printf(" %14lu max ops/thread\n", max_ops);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%llu\n", total * 1000000ULL / result_usec);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	free(workers);
+
+	return 0;
+}
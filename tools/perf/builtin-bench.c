@@ -13,6 +13,7 @@
  * Available subsystem list:
  *  sched ... scheduler and IPC mechanism
  *  mem   ... memory access performance
+ *  futex ... futex based locking
  *
  */
 
@@ -61,6 +62,16 @@ static struct bench_suite mem_suites[] = {
 	  NULL             }
 };
 
+static struct bench_suite futex_suites[] = {
+	{ "contend",
+	  "Threads contending on one futex based lock",
+	  bench_futex_contend },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL                }
+};
+
 struct bench_subsys {
 	const char *name;
 	const char *summary;
@@ -74,6 +85,9 @@ static struct bench_subsys subsystems[] = {
 	{ "mem",
 	  "memory access performance",
 	  mem_suites },
+	{ "futex",
+	  "futex based locking",
+	  futex_suites },
 	{ "all",		/* sentinel: easy for help */
 	  "test all subsystem (pseudo subsystem)",
 	  NULL },
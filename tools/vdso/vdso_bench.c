@@ -0,0 +1,226 @@
+/*
+ * vdso_bench.c: compare the vDSO time functions with the system calls
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * The vDSO symbols are looked up directly in the image mapped by the
+ * kernel (AT_SYSINFO_EHDR), so this works whether or not the C library
+ * knows about them. Usage: vdso_bench [iterations]
+ */
+#define _GNU_SOURCE
+#include <elf.h>
+#include <fcntl.h>
+#include <link.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef CLOCK_REALTIME_COARSE
+#define CLOCK_REALTIME_COARSE	5
+#endif
+#ifndef CLOCK_MONOTONIC_COARSE
+#define CLOCK_MONOTONIC_COARSE	6
+#endif
+
+typedef int (*clock_gettime_t)(clockid_t clk, struct timespec *ts);
+typedef int (*gettimeofday_t)(struct timeval *tv, struct timezone *tz);
+typedef time_t (*time_fn_t)(time_t *t);
+
+static unsigned long vdso_base(void)
+{
+	ElfW(auxv_t) aux;
+	unsigned long base = 0;
+	int fd;
+
+	fd = open("/proc/self/auxv", O_RDONLY);
+	if (fd < 0)
+		return 0;
+	while (read(fd, &aux, sizeof(aux)) == sizeof(aux)) {
+		if (aux.a_type == AT_SYSINFO_EHDR) {
+			base = aux.a_un.a_val;
+			break;
+		}
+	}
+	close(fd);
+
+	return base;
+}
+
+/* Minimal lookup in the dynamic symbol table of the vDSO image */
+static void *vdso_sym(unsigned long base, const char *name)
+{
+	ElfW(Ehdr) *ehdr = (ElfW(Ehdr) *)base;
+	ElfW(Phdr) *phdr = (ElfW(Phdr) *)(base + ehdr->e_phoff);
+	ElfW(Dyn) *dyn = NULL;
+	ElfW(Sym) *symtab = NULL;
+	const char *strtab = NULL;
+	ElfW(Word) *hash = NULL;
+	unsigned long load_offset = 0;
+	unsigned int i;
+
+	for (i = 0; i < ehdr->e_phnum; i++) {
+		if (phdr[i].p_type == PT_LOAD)
+			load_offset = base + phdr[i].p_offset - phdr[i].p_vaddr;
+		else if (phdr[i].p_type == PT_DYNAMIC)
+			dyn = (ElfW(Dyn) *)(base + phdr[i].p_offset);
+	}
+	if (!dyn)
+		return NULL;
+
+	for (; dyn->d_tag != DT_NULL; dyn++) {
+		switch (dyn->d_tag) {
+		case DT_SYMTAB:
+			symtab = (ElfW(Sym) *)(dyn->d_un.d_ptr + load_offset);
+			break;
+		case DT_STRTAB:
+			strtab = (const char *)(dyn->d_un.d_ptr + load_offset);
+			break;
+		case DT_HASH:
+			hash = (ElfW(Word) *)(dyn->d_un.d_ptr + load_offset);
+			break;
+		}
+	}
+	if (!symtab || !strtab || !hash)
+		return NULL;
+
+	/* hash[1] is the number of symbols */
+	for (i = 0; i < hash[1]; i++) {
+		if (symtab[i].st_shndx == SHN_UNDEF)
+			continue;
+		if (!strcmp(strtab + symtab[i].st_name, name))
+			return (void *)(symtab[i].st_value + load_offset);
+	}
+
+	return NULL;
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	syscall(SYS_clock_gettime, CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int sys_clock_gettime(clockid_t clk, struct timespec *ts)
+{
+	return syscall(SYS_clock_gettime, clk, ts);
+}
+
+static int sys_gettimeofday(struct timeval *tv, struct timezone *tz)
+{
+	return syscall(SYS_gettimeofday, tv, tz);
+}
+
+static time_t sys_time(time_t *t)
+{
+	return syscall(SYS_time, t);
+}
+
+static double bench_clock(clock_gettime_t fn, clockid_t clk, long loops)
+{
+	struct timespec ts;
+	double start;
+	long i;
+
+	start = now_ns();
+	for (i = 0; i < loops; i++)
+		fn(clk, &ts);
+
+	return (now_ns() - start) / loops;
+}
+
+static double bench_gtod(gettimeofday_t fn, long loops)
+{
+	struct timeval tv;
+	double start;
+	long i;
+
+	start = now_ns();
+	for (i = 0; i < loops; i++)
+		fn(&tv, NULL);
+
+	return (now_ns() - start) / loops;
+}
+
+static double bench_time(time_fn_t fn, long loops)
+{
+	double start;
+	long i;
+
+	start = now_ns();
+	for (i = 0; i < loops; i++)
+		fn(NULL);
+
+	return (now_ns() - start) / loops;
+}
+
+static void report(const char *name, double vdso, double sys)
+{
+	printf("%-24s %10.1f %10.1f %8.1fx\n", name, vdso, sys,
+	       vdso > 0 ? sys / vdso : 0.0);
+}
+
+int main(int argc, char **argv)
+{
+	static const struct {
+		const char *name;
+		clockid_t id;
+	} clocks[] = {
+		{ "CLOCK_REALTIME", CLOCK_REALTIME },
+		{ "CLOCK_MONOTONIC", CLOCK_MONOTONIC },
+		{ "CLOCK_REALTIME_COARSE", CLOCK_REALTIME_COARSE },
+		{ "CLOCK_MONOTONIC_COARSE", CLOCK_MONOTONIC_COARSE },
+	};
+	long loops = argc > 1 ? atol(argv[1]) : 1000000;
+	unsigned long base = vdso_base();
+	clock_gettime_t vdso_clock_gettime;
+	gettimeofday_t vdso_gettimeofday;
+	time_fn_t vdso_time;
+	struct timespec a, b;
+	unsigned int i;
+
+	if (!base) {
+		fprintf(stderr, "no vDSO mapped\n");
+		return 1;
+	}
+	vdso_clock_gettime = vdso_sym(base, "__kernel_clock_gettime");
+	vdso_gettimeofday = vdso_sym(base, "__kernel_gettimeofday");
+	vdso_time = vdso_sym(base, "__kernel_time");
+	if (!vdso_clock_gettime || !vdso_gettimeofday || !vdso_time) {
+		fprintf(stderr, "vDSO time functions not found\n");
+		return 1;
+	}
+
+	/* Sanity check: both paths must agree */
+	sys_clock_gettime(CLOCK_MONOTONIC, &a);
+	vdso_clock_gettime(CLOCK_MONOTONIC, &b);
+	if ((b.tv_sec < a.tv_sec) ||
+	    ((b.tv_sec == a.tv_sec) && (b.tv_nsec < a.tv_nsec))) {
+		fprintf(stderr, "vDSO CLOCK_MONOTONIC went backwards\n");
+		return 1;
+	}
+
+	printf("%ld iterations, ns per call\n", loops);
+	printf("%-24s %10s %10s %9s\n", "", "vdso", "syscall", "speedup");
+	for (i = 0; i < sizeof(clocks) / sizeof(clocks[0]); i++)
+		report(clocks[i].name,
+		       bench_clock(vdso_clock_gettime, clocks[i].id, loops),
+		       bench_clock(sys_clock_gettime, clocks[i].id, loops));
+	report("gettimeofday", bench_gtod(vdso_gettimeofday, loops),
+	       bench_gtod(sys_gettimeofday, loops));
+	report("time", bench_time(vdso_time, loops),
+	       bench_time(sys_time, loops));
+
+	return 0;
+}